@@ -0,0 +1,179 @@
+/*
+    PC stand-in for a fancy-inverter board. Opens a pty, prints its path and answers supervisory requests
+    from a fake register map the same way the firmware does, so host software can be tested without hardware.
+
+    board_standin [-a addr] [-n count]
+    With -n, serves <count> boards with consecutive addresses on one pty (like a shared bus).
+*/
+
+#include "sup_proto.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+
+#include <poll.h>
+
+struct FakeBoard {
+    std::array<uint8_t, SUP_REG_COUNT> regs{};
+    sup::ConfigBlock eeprom;
+    unsigned energy_ws = 0;
+    unsigned pv_energy_ws = 0;
+    bool pv_in = true;
+    std::mt19937 rng;
+
+    explicit FakeBoard(uint8_t a) : rng(a) {
+        regs[SUP_REG_STATE] = SUP_STATE_SLEEP;
+        regs[SUP_REG_FLAGS] = SUP_FLAG_CFG_EEPROM;
+        eeprom = sup::default_config();
+        eeprom[SUP_CFG_ADDR] = a;
+        eeprom[SUP_CFG_CRC] = sup::config_crc(eeprom);
+        std::copy(eeprom.begin(), eeprom.end(), regs.begin() + SUP_REG_CFG);
+        regs[SUP_REG_CFG + SUP_CFG_PROFILE] = SUP_PROFILE_ECO;  // auto resolves at boot, pretend load was plugged
+    }
+
+    uint8_t addr() const { return regs[SUP_REG_CFG + SUP_CFG_ADDR]; }
+
+    void second_elapsed() {  // wander through states so monitors have something to show
+        std::uniform_int_distribution<int> dice(0, 99);
+        uint8_t& state = regs[SUP_REG_STATE];
+        int d = dice(rng);
+        if(state == SUP_STATE_SLEEP && d < 5) state = SUP_STATE_RUNNING;
+        else if(state == SUP_STATE_RUNNING && d < 3) state = SUP_STATE_NO_LOAD;
+        else if(state == SUP_STATE_NO_LOAD && d < 10) state = (d < 5) ? SUP_STATE_RUNNING : SUP_STATE_NO_LOAD_KEEP;
+        else if(state == SUP_STATE_NO_LOAD_KEEP && d < 5) state = SUP_STATE_NO_LOAD_LONG;
+        else if(state == SUP_STATE_NO_LOAD_LONG && d < 5) state = SUP_STATE_SLEEP;
+        else if(state == SUP_STATE_ERROR) state = SUP_STATE_RUNNING;
+        else if(state == SUP_STATE_RUNNING && d == 99) {
+            state = SUP_STATE_ERROR;
+            for(int i = SUP_ERR_LOG_LEN - 1; i > 0; i--) regs[SUP_REG_ERR_LOG + i] = regs[SUP_REG_ERR_LOG + i - 1];
+            regs[SUP_REG_ERR_LOG] = 1 + dice(rng) % 4;
+            if(regs[SUP_REG_ERR_COUNT] < 0xFF) regs[SUP_REG_ERR_COUNT]++;
+        }
+        if(++regs[SUP_REG_CLOCK_SEC] >= 60) {
+            regs[SUP_REG_CLOCK_SEC] = 0;
+            if(++regs[SUP_REG_CLOCK_MIN] >= 60) {
+                regs[SUP_REG_CLOCK_MIN] = 0;
+                if(++regs[SUP_REG_CLOCK_HOUR] >= 24) regs[SUP_REG_CLOCK_HOUR] = 0;
+            }
+        }
+        if(state == SUP_STATE_SLEEP) regs[SUP_REG_SESSION] = 0;
+        else if(state == SUP_STATE_RUNNING && regs[SUP_REG_CLOCK_SEC] == 0 && regs[SUP_REG_SESSION] < 0xFF)
+            regs[SUP_REG_SESSION]++;
+        uint8_t profile = regs[SUP_REG_CFG + SUP_CFG_PROFILE];
+        regs[SUP_REG_PROFILE] = (profile < SUP_PROFILE_COUNT) ? profile : SUP_PROFILE_ECO;
+        regs[SUP_REG_POWER] = (state == SUP_STATE_RUNNING) ? 4 + dice(rng) % 20 : 0;
+        regs[SUP_REG_FLAGS] = (regs[SUP_REG_FLAGS] & (SUP_FLAG_CFG_EEPROM | SUP_FLAG_CFG_SAVED)) | SUP_FLAG_PGOOD |
+                              SUP_FLAG_LOAD_DETECT | ((state != SUP_STATE_SLEEP) ? SUP_FLAG_PLUGGED | SUP_FLAG_POW_5V : 0);
+        if(dice(rng) < 2) pv_in = !pv_in;  // clouds
+        regs[SUP_REG_FLAGS] |= (pv_in) ? SUP_FLAG_PV_IN | SUP_FLAG_PV_SURPLUS : 0;
+        if(pv_in) {
+            pv_energy_ws += regs[SUP_REG_POWER] * 5;
+            for(; pv_energy_ws >= 3600; pv_energy_ws -= 3600) {
+                if(!++regs[SUP_REG_PV_ENERGY]) regs[SUP_REG_PV_ENERGY + 1]++;
+            }
+        }
+        int temp = regs[SUP_REG_TEMP] ? regs[SUP_REG_TEMP] : 65;  // heats up with load, cools down towards 25degC
+        temp += (regs[SUP_REG_POWER] * 5 > (temp - 65) * 4) ? 1 : (temp > 65) ? -1 : 0;
+        regs[SUP_REG_TEMP] = static_cast<uint8_t>(temp);
+        energy_ws += regs[SUP_REG_POWER] * 5;
+        for(; energy_ws >= 3600; energy_ws -= 3600) {
+            for(int i = 0; i < 4; i++) {
+                if(++regs[SUP_REG_ENERGY + i]) break;
+            }
+        }
+    }
+
+    std::optional<sup::Response> handle(const sup::Request& req) {  // mirrors T0_ISR in inverter.c
+        if(req.addr != addr() && req.addr != SUP_ADDR_BROADCAST) return std::nullopt;
+        sup::Response resp{req.addr, req.reg, {}};
+        if(req.cmd == SUP_CMD_READ && req.arg) {
+            if(req.reg < SUP_REG_COUNT && req.arg <= SUP_MAX_READ && req.arg <= SUP_REG_COUNT - req.reg)
+                resp.data.assign(regs.begin() + req.reg, regs.begin() + req.reg + req.arg);
+        }
+        else if(req.cmd == SUP_CMD_WRITE && req.reg >= SUP_REG_FIRST_RW && req.reg < SUP_REG_COUNT) {
+            static const uint8_t limits[SUP_CFG_LEN][2] = SUP_CFG_LIMITS;
+            const uint8_t* lim = limits[req.reg - SUP_REG_CFG];
+            if((req.arg >= lim[0] && req.arg <= lim[1]) ||
+               (req.reg == SUP_REG_CFG + SUP_CFG_PROFILE && req.arg == SUP_PROFILE_AUTO)) {
+                regs[req.reg] = req.arg;
+                resp.data.push_back(req.arg);
+            }
+        }
+        else if(req.cmd == SUP_CMD_WRITE && req.reg == SUP_REG_CLOCK_MIN && req.arg < 60) {
+            regs[SUP_REG_CLOCK_MIN] = req.arg;
+            regs[SUP_REG_CLOCK_SEC] = 0;
+            resp.data.push_back(req.arg);
+        }
+        else if(req.cmd == SUP_CMD_WRITE && req.reg == SUP_REG_CLOCK_HOUR && req.arg < 24) {
+            regs[SUP_REG_CLOCK_HOUR] = req.arg;
+            resp.data.push_back(req.arg);
+        }
+        else if(req.cmd == SUP_CMD_SAVE) {
+            std::copy(regs.begin() + SUP_REG_CFG, regs.end(), eeprom.begin());
+            eeprom[SUP_CFG_VERSION] = SUP_CFG_LAYOUT;
+            eeprom[SUP_CFG_CRC] = sup::config_crc(eeprom);
+            std::copy(eeprom.begin(), eeprom.end(), regs.begin() + SUP_REG_CFG);
+            regs[SUP_REG_FLAGS] |= SUP_FLAG_CFG_SAVED;
+            resp.reg = SUP_REG_FLAGS;
+            resp.data.push_back(regs[SUP_REG_FLAGS]);
+        }
+        if(req.addr == SUP_ADDR_BROADCAST) return std::nullopt;
+        return resp;
+    }
+};
+
+int main(int argc, char** argv) {
+    uint8_t first_addr = SUP_ADDR_DEFAULT;
+    int count = 1;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        if(strcmp(argv[i], "-a") == 0) first_addr = static_cast<uint8_t>(strtoul(argv[i + 1], nullptr, 0));
+        else if(strcmp(argv[i], "-n") == 0) count = atoi(argv[i + 1]);
+    }
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) || unlockpt(master)) {
+        perror("pty");
+        return 1;
+    }
+    termios tio{};
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+    printf("%s\n", ptsname(master));
+    fflush(stdout);
+
+    std::vector<FakeBoard> boards;
+    for(int i = 0; i < count; i++) boards.emplace_back(static_cast<uint8_t>(first_addr + i));
+    sup::RequestDecoder dec;
+    auto next_second = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    for(;;) {
+        pollfd pfd{master, POLLIN, 0};
+        int ready = poll(&pfd, 1, 100);
+        if(std::chrono::steady_clock::now() >= next_second) {
+            next_second += std::chrono::seconds(1);
+            for(auto& b : boards) b.second_elapsed();
+        }
+        if(ready <= 0) continue;
+        if(pfd.revents & POLLHUP) {  // nobody has the slave side open right now
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        uint8_t buf[64];
+        ssize_t n = read(master, buf, sizeof(buf));
+        for(ssize_t i = 0; i < n; i++) {
+            auto req = dec.feed(buf[i]);
+            if(!req) continue;
+            for(auto& b : boards) {
+                auto resp = b.handle(*req);
+                if(!resp) continue;
+                auto frame = resp->encode();
+                if(write(master, frame.data(), frame.size()) < 0) perror("write");
+            }
+        }
+    }
+}
+
+// g++ -std=c++17 -O2 -o board_standin board_standin.cpp
@@ -0,0 +1,397 @@
+/*
+    Checks of the instruction-level core in sim/emulator.hpp on small hand-assembled programs, the instructions
+    whose flags and corner cases are easy to get wrong and the interrupt logic the firmware relies on. There is no
+    sdcc here to build test images with, so the programs are written out as bytes next to their mnemonics.
+
+    emutest [-v]
+
+    ADD, ADDC and SUBB (immediate and register forms) over a grid of operands with the carry in both ways, against
+    CY, AC, OV and P worked out from the arithmetic. DA after ADDC over every pair of BCD bytes. MUL and DIV,
+    division by zero included. CJNE in all four forms, jump and CY. Interrupt priorities: five sources pending at
+    once under all 32 IP settings, a high level interrupt nesting into a low level one, a low one waiting for
+    RETI and one more instruction. Last, delay loops like sdcc's under a running Timer0 interrupt, fast-forwarded
+    and single-stepped, must stop at the same cycle with the same registers, IRAM and SFRs at every pause.
+    Lists the first few failures and exits with 1 if there are any, -v prints the counts per check.
+*/
+
+#include "sim/emulator.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using sim::u8;
+using sim::u16;
+
+static unsigned failures = 0;
+
+static void fail(const std::string& what) {
+    if(++failures > 10) return;
+    std::printf("FAIL %s\n", what.c_str());
+}
+
+static std::string hex(unsigned v) {
+    char s[8];
+    std::snprintf(s, sizeof s, "%02X", v);
+    return s;
+}
+
+// SFRs and bits used below
+enum : u8 {
+    ACC = 0xE0, B = 0xF0, PSW = 0xD0, TCON = 0x88, TMOD = 0x89, TH0 = 0x8C, SCON = 0x98, IE = 0xA8, IP = 0xB8,
+    IE0 = 0x89, IE1 = 0x8B, TF0 = 0x8D, TR0 = 0x8C, TI = 0x99, EA = 0xAF,
+};
+constexpr u8 CY = 0x80, AC = 0x40, OV = 0x04, P = 0x01;
+
+struct Program {
+    std::vector<u8> code;
+    Program& at(u16 addr) {  // code goes on from addr, the gap is filled with NOPs
+        if(code.size() > addr) throw std::logic_error("code overlaps at " + std::to_string(addr));
+        code.resize(addr, 0x00);
+        return *this;
+    }
+    Program& op(std::initializer_list<u8> bytes) {
+        code.insert(code.end(), bytes);
+        return *this;
+    }
+    Program& halt() { return op({0x80, 0xFE}); }  // SJMP $
+};
+
+static std::unique_ptr<sim::Emulator> start(const Program& p, bool fast_forward = true) {
+    auto img = std::make_shared<sim::Image>();
+    std::copy(p.code.begin(), p.code.end(), img->code.begin());
+    img->size = p.code.size();
+    auto scn = std::make_shared<sim::Scenario>();
+    scn->duration = 10 * sim::SEC;
+    return sim::Emulator::create(scn, img, fast_forward);
+}
+
+static std::unique_ptr<sim::Emulator> run(const Program& p) {  // long enough for any program here to reach its halt
+    auto emu = start(p);
+    emu->run_to(2 * sim::MS);
+    return emu;
+}
+
+static bool parity(unsigned a) { return __builtin_parity(a & 0xFF); }
+
+// ADD, ADDC, SUBB: the flags from the operands as numbers, not from the bit tricks of the core
+static unsigned arith(int kind, unsigned x, unsigned y, bool c, unsigned& flags) {
+    int sx = int8_t(x), sy = int8_t(y), r, sr;
+    bool cy, ac;
+    if(kind < 2) {
+        if(kind == 0) c = false;
+        r = int(x + y + c);
+        sr = sx + sy + c;
+        cy = r > 0xFF;
+        ac = (x & 0x0F) + (y & 0x0F) + c > 0x0F;
+    }
+    else {
+        r = int(x) - int(y) - c;
+        sr = sx - sy - c;
+        cy = r < 0;
+        ac = int(x & 0x0F) - int(y & 0x0F) - c < 0;
+    }
+    flags = (cy ? CY : 0) | (ac ? AC : 0) | ((sr < -128 || sr > 127) ? OV : 0) | (parity(unsigned(r)) ? P : 0);
+    return unsigned(r) & 0xFF;
+}
+
+static unsigned check_arith() {
+    static const char* names[3] = {"ADD", "ADDC", "SUBB"};
+    static const u8 imm[3] = {0x24, 0x34, 0x94}, reg[3] = {0x2A, 0x3A, 0x9A};  // A,#d and A,R2
+    static const u8 vals[] = {0x00, 0x01, 0x07, 0x08, 0x0F, 0x10, 0x3C, 0x7E, 0x7F, 0x80, 0x81, 0x99, 0xC3, 0xF0, 0xFE, 0xFF};
+    unsigned n = 0;
+    for(int kind = 0; kind < 3; kind++) {
+        for(u8 x : vals) {
+            for(u8 y : vals) {
+                for(int c = 0; c < 2; c++) {
+                    for(int form = 0; form < 2; form++) {
+                        // F0 and RS0 set and AC/OV left over from before, the instruction must keep the first two
+                        Program p;
+                        p.op({0x75, PSW, u8(0x28 | AC | OV | (c ? CY : 0))});  // MOV PSW,#...
+                        p.op({0x74, x});                                       // MOV A,#x
+                        if(form) p.op({0x7A, y, reg[kind]});                   // MOV R2,#y / op A,R2 (bank 1)
+                        else p.op({imm[kind], y});                             // op A,#y
+                        p.halt();
+                        auto emu = run(p);
+                        unsigned flags, want = arith(kind, x, y, c, flags);
+                        u8 psw = emu->sfr(PSW);
+                        if(emu->acc() != want || (psw & (CY | AC | OV | P)) != flags || (psw & 0x38) != 0x28)
+                            fail(std::string(names[kind]) + (form ? " A,R2 " : " A,# ") + hex(x) + " " + hex(y) +
+                                 " c" + std::to_string(c) + ": A " + hex(emu->acc()) + " PSW " + hex(psw) +
+                                 ", want A " + hex(want) + " flags " + hex(flags));
+                        n++;
+                    }
+                }
+            }
+        }
+    }
+    return n;
+}
+
+static unsigned check_da() {  // ADDC of two BCD bytes, then DA A gives their decimal sum and the decimal carry
+    unsigned n = 0;
+    for(unsigned x = 0; x < 100; x++) {
+        for(unsigned y = 0; y < 100; y++) {
+            bool c = (x + y) & 1;
+            u8 bx = u8(x / 10 << 4 | x % 10), by = u8(y / 10 << 4 | y % 10);
+            Program p;
+            p.op({0x75, PSW, u8(c ? CY : 0)}).op({0x74, bx}).op({0x34, by}).op({0xD4}).halt();  // ADDC A,#y; DA A
+            auto emu = run(p);
+            unsigned sum = x + y + c;
+            u8 want = u8((sum % 100) / 10 << 4 | sum % 10);
+            bool cy = emu->sfr(PSW) & CY;
+            if(emu->acc() != want || cy != (sum >= 100))
+                fail("DA " + hex(bx) + " + " + hex(by) + " + " + std::to_string(c) + ": A " + hex(emu->acc()) +
+                     " CY " + std::to_string(cy));
+            n++;
+        }
+    }
+    // from the datasheet: 56h + 67h + 1 = BEh, DA gives 24h and CY, the sum of 56 and 67 and 1 is 124
+    Program p;
+    p.op({0x75, PSW, CY}).op({0x74, 0x56}).op({0x34, 0x67}).op({0xD4}).halt();
+    auto emu = run(p);
+    if(emu->acc() != 0x24 || !(emu->sfr(PSW) & CY)) fail("DA datasheet example: A " + hex(emu->acc()));
+    return n + 1;
+}
+
+static unsigned check_muldiv() {
+    static const u8 vals[] = {0x00, 0x01, 0x02, 0x03, 0x07, 0x0F, 0x10, 0x11, 0x40, 0x7F, 0x80, 0xAA, 0xFE, 0xFF};
+    unsigned n = 0;
+    for(u8 x : vals) {
+        for(u8 y : vals) {
+            for(int div = 0; div < 2; div++) {
+                // CY and OV set before, both instructions clear CY, OV tells overflow or division by zero
+                Program p;
+                p.op({0x75, PSW, u8(CY | OV)}).op({0x74, x}).op({0x75, B, y}).op({u8(div ? 0x84 : 0xA4)}).halt();
+                auto emu = run(p);
+                u8 psw = emu->sfr(PSW), a = emu->acc(), b = emu->sfr(B);
+                std::string at = (div ? "DIV " : "MUL ") + hex(x) + " " + hex(y) + ": A " + hex(a) + " B " + hex(b) +
+                                 " PSW " + hex(psw);
+                if(psw & CY) fail(at + ", CY not cleared");
+                if(!div) {
+                    unsigned r = x * y;
+                    if(a != (r & 0xFF) || b != r >> 8 || bool(psw & OV) != (r > 0xFF)) fail(at);
+                }
+                else if(!y) {
+                    if(!(psw & OV)) fail(at + ", no OV on division by zero");
+                }
+                else if(a != x / y || b != x % y || (psw & OV)) fail(at);
+                if(bool(psw & P) != parity(a)) fail(at + ", parity");
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+static unsigned check_cjne() {
+    static const u8 vals[] = {0x00, 0x01, 0x7F, 0x80, 0xFE, 0xFF};
+    unsigned n = 0;
+    for(u8 x : vals) {
+        for(u8 y : vals) {
+            for(int form = 0; form < 4; form++) {
+                Program p;
+                p.op({0x75, PSW, u8((x < y) ? 0 : CY)});  // CY the other way round first
+                p.op({0x74, x}).op({0x7B, x}).op({0x78, 0x40}).op({0x75, 0x40, x}).op({0x75, 0x41, y});
+                switch(form) {
+                    case 0: p.op({0xB4, y, 0x03}); break;    // CJNE A,#y,+3
+                    case 1: p.op({0xB5, 0x41, 0x03}); break; // CJNE A,41h,+3
+                    case 2: p.op({0xBB, y, 0x03}); break;    // CJNE R3,#y,+3
+                    case 3: p.op({0xB6, y, 0x03}); break;    // CJNE @R0,#y,+3
+                }
+                p.op({0x75, 0x42, 0x01});  // MOV 42h,#1, skipped when the jump is taken
+                p.halt();
+                auto emu = run(p);
+                bool jumped = emu->iram()[0x42] == 0, cy = emu->sfr(PSW) & CY;
+                if(jumped != (x != y) || cy != (x < y))
+                    fail("CJNE form " + std::to_string(form) + " " + hex(x) + " " + hex(y) + ": jumped " +
+                         std::to_string(jumped) + " CY " + std::to_string(cy));
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+// vectors 03h IE0, 0Bh TF0, 13h IE1, 1Bh TF1, 23h serial. Each logs its vector at @R0 and returns.
+static void log_vectors(Program& p) {
+    for(u8 v = 0x03; v <= 0x1B; v += 8) p.at(v).op({0x76, v, 0x08, 0x32});  // MOV @R0,#v; INC R0; RETI
+    p.at(0x23).op({0x76, 0x23, 0x08, 0xC2, TI, 0x32});                     // serial also clears TI
+}
+
+static unsigned check_priorities() {
+    unsigned n = 0;
+    static const u8 vec[5] = {0x03, 0x0B, 0x13, 0x1B, 0x23};
+    for(u8 ip = 0; ip < 32; ip++) {
+        Program p;
+        p.op({0x02, 0x00, 0x30});  // LJMP 30h
+        log_vectors(p);
+        p.at(0x30).op({0x78, 0x50});     // MOV R0,#50h
+        p.op({0x75, IP, ip});
+        p.op({0x75, IE, 0x1F});          // all five sources, EA still off
+        p.op({0x75, TCON, 0xAF});        // TF1, TF0, IE1, IE0 pending, both INTs edge triggered
+        p.op({0x75, SCON, 0x02});        // TI pending
+        p.op({0xD2, EA});                // SETB EA
+        for(int i = 0; i < 8; i++) p.op({0x00});
+        p.halt();
+        auto emu = run(p);
+        std::vector<u8> want, got(emu->iram().begin() + 0x50, emu->iram().begin() + 0x55);
+        for(int level = 1; level >= 0; level--)
+            for(int s = 0; s < 5; s++)
+                if(bool(ip >> s & 1) == bool(level)) want.push_back(vec[s]);
+        if(got != want || emu->iram()[0] != 0x55) {
+            std::string s = "priorities IP " + hex(ip) + ":";
+            for(u8 v : got) s += " " + hex(v);
+            fail(s);
+        }
+        n++;
+    }
+
+    // TF0 at low level sets IE1 (high) and IE0 (low) in its ISR: IE1 nests right away, IE0 waits for the RETI
+    // and one instruction of the main program, which logs how many of its INC 60h ran
+    Program p;
+    p.op({0x02, 0x00, 0x30});
+    p.at(0x03).op({0xA6, 0x60, 0x08, 0x32});  // MOV @R0,60h; INC R0; RETI
+    p.at(0x0B).op({0x02, 0x01, 0x00});        // LJMP 100h
+    p.at(0x13).op({0x76, 0x13, 0x08, 0x32});
+    p.at(0x30).op({0x78, 0x50}).op({0x75, 0x60, 0x00});
+    p.op({0x75, TCON, 0x05});  // edge triggered
+    p.op({0x75, IP, 0x04});    // PX1
+    p.op({0x75, IE, 0x87});    // EA, EX1, ET0, EX0
+    p.op({0x00});              // the IE write holds interrupts for one instruction
+    p.op({0xD2, TF0});
+    for(int i = 0; i < 4; i++) p.op({0x05, 0x60});  // INC 60h
+    p.halt();
+    p.at(0x100).op({0x76, 0x0B, 0x08}).op({0xD2, IE1}).op({0x76, 0xB0, 0x08});
+    p.op({0xD2, IE0}).op({0x76, 0xB1, 0x08, 0x32});
+    auto emu = run(p);
+    std::vector<u8> want{0x0B, 0x13, 0xB0, 0xB1, 0x01}, got(emu->iram().begin() + 0x50, emu->iram().begin() + 0x55);
+    if(got != want || emu->iram()[0x60] != 4 || emu->sp() != 0x07) {
+        std::string s = "nesting:";
+        for(u8 v : got) s += " " + hex(v);
+        fail(s + ", SP " + hex(emu->sp()));
+    }
+
+    // RETI pops the return address the hardware LCALL pushed, whatever the ISR did to A and the registers
+    Program r;
+    r.op({0x02, 0x00, 0x30});
+    r.at(0x0B).op({0x74, 0x5A, 0x32});         // MOV A,#5Ah; RETI
+    r.at(0x30).op({0x75, IE, 0x82}).op({0x00});
+    r.op({0xD2, TF0});
+    r.op({0xF5, 0x45});                        // MOV 45h,A, right after the interrupt
+    r.halt();
+    emu = run(r);
+    if(emu->iram()[0x45] != 0x5A || emu->sp() != 0x07 || emu->stats().interrupts != 1 ||
+       emu->iram()[0x08] != 0x36 || emu->iram()[0x09] != 0x00)
+        fail("RETI: 45h " + hex(emu->iram()[0x45]) + " SP " + hex(emu->sp()) + " return address " +
+             hex(emu->iram()[0x09]) + hex(emu->iram()[0x08]));
+    return n + 2;
+}
+
+static unsigned check_fast_forward(unsigned& pauses) {
+    // delay loops like the firmware's, all while Timer0 interrupts in mode 2 count in 30h, 31h
+    Program p;
+    p.op({0x02, 0x00, 0x30});
+    p.at(0x0B).op({0xC0, ACC, 0x05, 0x30, 0xE5, 0x30});  // PUSH ACC; INC 30h; MOV A,30h
+    p.op({0x70, 0x02, 0x05, 0x31, 0xD0, ACC, 0x32});      // JNZ +2; INC 31h; POP ACC; RETI
+    p.at(0x30).op({0x75, TMOD, 0x02}).op({0x75, TH0, 0x40}).op({0xD2, TR0}).op({0x75, IE, 0x82});
+    u16 top = u16(p.code.size());
+    // DJNZ on registers, two levels
+    p.op({0x7E, 0x20});                    // MOV R6,#20h
+    p.op({0x7F, 0x00});                    // MOV R7,#0
+    p.op({0xDF, 0xFE});                    // DJNZ R7,$
+    p.op({0xDE, 0xFC});                    // DJNZ R6,-4
+    // DJNZ on a direct byte
+    p.op({0x75, 0x38, 0xC8});              // MOV 38h,#200
+    p.op({0xD5, 0x38, 0xFD});              // DJNZ 38h,$
+    // while(wait--) on a 16-bit variable the way sdcc writes it
+    p.op({0x75, 0x3A, 0x10, 0x75, 0x3B, 0x03});  // wait = 0310h in 3Ah (low), 3Bh
+    u16 loop = u16(p.code.size());
+    p.op({0xAC, 0x3A, 0xAD, 0x3B});        // MOV R4,3Ah; MOV R5,3Bh
+    p.op({0x15, 0x3A});                    // DEC 3Ah
+    p.op({0x74, 0xFF, 0xB5, 0x3A, 0x02});  // MOV A,#FFh; CJNE A,3Ah,+2
+    p.op({0x15, 0x3B});                    // DEC 3Bh
+    p.op({0xEC, 0x4D});                    // MOV A,R4; ORL A,R5
+    p.op({0x70, u8(loop - (p.code.size() + 2))});  // JNZ loop
+    // up-count with CJNE
+    p.op({0x79, 0x00});                    // MOV R1,#0
+    p.op({0x09, 0xB9, 0xF0, 0xFC});        // INC R1; CJNE R1,#F0h,-4
+    // waiting for the interrupt to move its count on, five times
+    p.op({0x7A, 0x05});                    // MOV R2,#5
+    p.op({0xAB, 0x30});                    // MOV R3,30h
+    p.op({0xEB, 0xB5, 0x30, 0x02});        // MOV A,R3; CJNE A,30h,+2
+    p.op({0x80, 0xFA});                    // SJMP -6
+    p.op({0xDA, 0xF6});                    // DJNZ R2,-10
+    p.op({0x05, 0x39});                    // INC 39h, rounds of the whole thing
+    p.op({0x02, u8(top >> 8), u8(top)});   // LJMP top
+
+    auto ff = start(p, true), step = start(p, false);
+    unsigned n = 0;
+    for(sim::Time t = 137 * sim::US; t < 400 * sim::MS; t += 997 * sim::US) {
+        bool a = ff->run_to(t), b = step->run_to(t);
+        std::string at = "fast-forward at " + std::to_string(t / sim::US) + " us: ";
+        n++;
+        if(!a || !b) {
+            fail(at + "scenario ended");
+            break;
+        }
+        if(ff->cycles() != step->cycles()) {
+            fail(at + "cycles " + std::to_string(ff->cycles()) + " vs " + std::to_string(step->cycles()));
+            break;
+        }
+        if(ff->pc() != step->pc() || ff->iram() != step->iram()) {
+            fail(at + "PC " + hex(ff->pc() >> 8) + hex(ff->pc() & 0xFF) + " vs " + hex(step->pc() >> 8) +
+                 hex(step->pc() & 0xFF) + (ff->iram() != step->iram() ? ", IRAM differs" : ""));
+            break;
+        }
+        bool same = true;
+        for(unsigned addr = 0x80; addr < 0x100; addr++) same = same && ff->sfr(u8(addr)) == step->sfr(u8(addr));
+        if(!same) {
+            fail(at + "SFRs differ");
+            break;
+        }
+    }
+    pauses = n;
+    auto fs = ff->stats(), ss = step->stats();
+    if(fs.interrupts != ss.interrupts || !fs.interrupts)
+        fail("fast-forward interrupts " + std::to_string(fs.interrupts) + " vs " + std::to_string(ss.interrupts));
+    if(!fs.spin_rounds || !fs.loop_rounds || ss.spin_rounds || ss.loop_rounds)
+        fail("fast-forward not exercised: spin rounds " + std::to_string(fs.spin_rounds) + ", loop rounds " +
+             std::to_string(fs.loop_rounds));
+    if(ff->iram()[0x39] < 2) fail("fast-forward program did not get round, 39h " + hex(ff->iram()[0x39]));
+    return n;
+}
+
+int main(int argc, char** argv) {
+    bool verbose = false;
+    for(int i = 1; i < argc; i++) {
+        if(std::strcmp(argv[i], "-v") == 0) verbose = true;
+        else {
+            std::fprintf(stderr, "usage: emutest [-v]\n");
+            return 2;
+        }
+    }
+    unsigned arith = check_arith();
+    unsigned da = check_da();
+    unsigned muldiv = check_muldiv();
+    unsigned cjne = check_cjne();
+    unsigned irq = check_priorities();
+    unsigned pauses = 0;
+    check_fast_forward(pauses);
+
+    if(verbose || failures) {
+        std::printf("%8u ADD/ADDC/SUBB\n%8u DA\n%8u MUL/DIV\n%8u CJNE\n%8u interrupt programs\n"
+                    "%8u fast-forward pauses compared\n",
+                    arith, da, muldiv, cjne, irq, pauses);
+    }
+    if(failures) {
+        std::printf("%u failures\n", failures);
+        return 1;
+    }
+    std::printf("emulator core ok\n");
+    return 0;
+}
+
+// g++ -std=c++17 -O2 -Isim -o emutest emutest.cpp
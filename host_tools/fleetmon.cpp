@@ -0,0 +1,439 @@
+/*
+    Fleet monitor daemon. Polls any number of boards over USB-serial adapters (or board_standin ptys) through
+    the supervisory interface, keeps a ring buffer of samples per board and serves aggregates over a unix
+    socket. Single thread, everything runs from one epoll loop, so dozens of ports are fine on a Raspberry Pi.
+
+    fleetmon [-s socket] [-i poll_ms] [-r ring_size] port[@addr[,addr...]] ...
+
+    Boards sharing one port (multi-drop bus) are polled one after another. Connect to the socket, send one
+    line and read the answer:
+        summary            one line per board: state, power, energy, faults, link quality
+        energy             energy per day for each board
+        occupancy          share of time spent in each control state, and unreachable (no answer for longer than a
+                           poll round, the state it was in is not known then)
+        samples <board>    recent samples of a single board (board = port@addr)
+*/
+
+#include "sup_proto.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <sstream>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+static uint64_t clock_ms(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// polls, timeouts and durations run on the monotonic clock so an NTP or manual step of the wall clock neither
+// stalls nor floods them, the wall clock only names the day a sample belongs to
+static uint64_t mono_ms() { return clock_ms(CLOCK_MONOTONIC); }
+static uint64_t wall_ms() { return clock_ms(CLOCK_REALTIME); }
+
+static long day_index(uint64_t ms) {  // local calendar day
+    time_t t = static_cast<time_t>(ms / 1000);
+    tm lt;
+    localtime_r(&t, &lt);
+    return (lt.tm_year + 1900L) * 1000 + lt.tm_yday;
+}
+
+static tm day_start(long day) {  // local midnight
+    tm lt{};
+    lt.tm_year = static_cast<int>(day / 1000) - 1900;
+    lt.tm_mday = static_cast<int>(day % 1000) + 1;  // mktime normalizes day of year into month and day
+    lt.tm_isdst = -1;
+    mktime(&lt);
+    return lt;
+}
+
+static std::string day_name(long day) {
+    tm lt = day_start(day);
+    char buf[16];
+    strftime(buf, sizeof(buf), "%Y-%m-%d", &lt);
+    return buf;
+}
+
+template <typename T>
+class Ring {  // fixed capacity, oldest entries overwritten
+public:
+    explicit Ring(size_t capacity) : buf_(capacity) {}
+    void push(const T& v) {
+        buf_[head_] = v;
+        head_ = (head_ + 1) % buf_.size();
+        if(size_ < buf_.size()) size_++;
+    }
+    size_t size() const { return size_; }
+    const T& operator[](size_t i) const {  // 0 = oldest
+        return buf_[(head_ + buf_.size() - size_ + i) % buf_.size()];
+    }
+    const T& back() const { return (*this)[size_ - 1]; }
+
+private:
+    std::vector<T> buf_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+struct Sample {
+    uint64_t time_ms;  // wall clock, for the per-day buckets and the samples listing
+    uint64_t mono_ms;  // monotonic, for the time between samples
+    sup::Snapshot snap;
+};
+
+static const size_t DAYS_KEPT = 31;
+static const unsigned SCHED_MS = 20;  // scheduler tick, well below a byte time
+
+struct Board {
+    std::string name;
+    uint8_t addr;
+    Ring<Sample> samples;
+    std::map<long, double> energy_per_day;  // Wh
+    std::map<long, double> pv_energy_per_day;  // Wh delivered during PV surplus
+    std::map<long, unsigned> faults_per_day;
+    std::array<uint64_t, 16> state_ms{};     // time spent in each SUP_STATE_*
+    uint64_t unreachable_ms = 0;             // gaps between samples beyond a poll round
+    unsigned polls = 0;
+    unsigned timeouts = 0;
+    uint64_t first_seen_ms = 0;  // wall clock
+
+    Board(std::string n, uint8_t a, size_t ring) : name(std::move(n)), addr(a), samples(ring) {}
+
+    void add(const Sample& s, uint64_t round_ms) {  // round_ms: longest a poll round takes when every board answers
+        if(samples.size()) {
+            const Sample& prev = samples.back();
+            long day = day_index(s.time_ms);
+            // counters restart from 0 when the board reboots, count the new value as the delta then
+            uint32_t de = (s.snap.energy_wh >= prev.snap.energy_wh) ? s.snap.energy_wh - prev.snap.energy_wh : s.snap.energy_wh;
+            unsigned df = (s.snap.err_count >= prev.snap.err_count) ? s.snap.err_count - prev.snap.err_count : s.snap.err_count;
+            // PV counter is only 16 bits, tell a reboot from a wrap-around by the main energy counter
+            uint16_t dpv = (s.snap.energy_wh >= prev.snap.energy_wh) ? uint16_t(s.snap.pv_energy_wh - prev.snap.pv_energy_wh)
+                                                                      : s.snap.pv_energy_wh;
+            energy_per_day[day] += de;
+            pv_energy_per_day[day] += dpv;
+            faults_per_day[day] += df;
+            uint64_t gap = s.mono_ms - prev.mono_ms;  // the previous state is only known for one round
+            state_ms[prev.snap.state & 0x0F] += std::min(gap, round_ms);
+            unreachable_ms += gap - std::min(gap, round_ms);
+            while(energy_per_day.size() > DAYS_KEPT) energy_per_day.erase(energy_per_day.begin());
+            while(pv_energy_per_day.size() > DAYS_KEPT) pv_energy_per_day.erase(pv_energy_per_day.begin());
+            while(faults_per_day.size() > DAYS_KEPT) faults_per_day.erase(faults_per_day.begin());
+        }
+        else first_seen_ms = s.time_ms;
+        samples.push(s);
+    }
+
+    double fault_hours() const {  // time covered by faults_per_day: since first seen, at most its oldest day
+        uint64_t from = first_seen_ms;
+        if(!faults_per_day.empty()) {
+            tm oldest = day_start(faults_per_day.begin()->first);
+            from = std::max<uint64_t>(from, uint64_t(mktime(&oldest)) * 1000);
+        }
+        uint64_t to = samples.back().time_ms;
+        return (to > from) ? (to - from) / 3600e3 : 0.0;
+    }
+};
+
+struct Port {
+    std::string path;
+    int fd = -1;
+    std::vector<Board*> boards;
+    size_t next = 0;            // board to poll next
+    Board* waiting = nullptr;   // board with a request in flight
+    uint64_t deadline_ms = 0;
+    uint64_t next_poll_ms = 0;
+    sup::ResponseDecoder dec;
+};
+
+struct Client {
+    int fd;
+    std::string in;
+    std::string out;       // reply, queued until the socket takes it
+    size_t sent = 0;
+    bool replied = false;
+
+    explicit Client(int f) : fd(f) {}
+};
+
+class Monitor {
+public:
+    Monitor(unsigned poll_ms, size_t ring) : poll_ms_(poll_ms), ring_(ring) { ep_ = epoll_create1(EPOLL_CLOEXEC); }
+
+    void add_port(const std::string& spec) {
+        auto port = std::make_unique<Port>();
+        auto at = spec.find('@');
+        port->path = spec.substr(0, at);
+        std::vector<uint8_t> addrs;
+        if(at == std::string::npos) addrs.push_back(SUP_ADDR_DEFAULT);
+        else {
+            std::stringstream ss(spec.substr(at + 1));
+            std::string a;
+            while(std::getline(ss, a, ',')) addrs.push_back(static_cast<uint8_t>(strtoul(a.c_str(), nullptr, 0)));
+        }
+        port->fd = sup::open_port(port->path, true);
+        for(uint8_t a : addrs) {
+            boards_.push_back(std::make_unique<Board>(port->path + "@" + std::to_string(a), a, ring_));
+            port->boards.push_back(boards_.back().get());
+        }
+        watch(port->fd, port.get());
+        ports_.push_back(std::move(port));
+    }
+
+    void listen_on(const std::string& path) {
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        sockaddr_un sa{};
+        sa.sun_family = AF_UNIX;
+        strncpy(sa.sun_path, path.c_str(), sizeof(sa.sun_path) - 1);
+        unlink(path.c_str());
+        if(bind(listen_fd_, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) || listen(listen_fd_, 16))
+            throw std::runtime_error("can't listen on " + path);
+        watch(listen_fd_, &listen_fd_);
+    }
+
+    void run() {
+        int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        itimerspec its{{0, SCHED_MS * 1000000}, {0, SCHED_MS * 1000000}};
+        timerfd_settime(tfd, 0, &its, nullptr);
+        watch(tfd, &tfd);
+        epoll_event evs[64];
+        for(;;) {
+            int n = epoll_wait(ep_, evs, 64, -1);
+            if(n < 0 && errno != EINTR) throw std::runtime_error("epoll_wait");
+            for(int i = 0; i < n; i++) {
+                void* p = evs[i].data.ptr;
+                if(p == &tfd) {
+                    uint64_t expirations;
+                    while(read(tfd, &expirations, sizeof(expirations)) > 0) {}
+                    schedule();
+                }
+                else if(p == &listen_fd_) accept_clients();
+                else if(is_port(p)) read_port(*static_cast<Port*>(p));
+                else serve_client(static_cast<Client*>(p));
+            }
+        }
+    }
+
+private:
+    void watch(int fd, void* ptr) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = ptr;
+        epoll_ctl(ep_, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    bool is_port(void* p) const {
+        return std::any_of(ports_.begin(), ports_.end(), [p](const auto& port) { return port.get() == p; });
+    }
+
+    void schedule() {
+        uint64_t now = mono_ms();
+        for(auto& port : ports_) {
+            if(port->waiting && now >= port->deadline_ms) {  // board didn't answer
+                port->waiting->timeouts++;
+                port->waiting = nullptr;
+                port->dec.reset();
+            }
+            if(port->waiting || now < port->next_poll_ms) continue;
+            Board* b = port->boards[port->next];
+            port->next = (port->next + 1) % port->boards.size();
+            if(port->next == 0) port->next_poll_ms = now + poll_ms_;  // whole bus polled, rest until next round
+            sup::Request req{b->addr, SUP_CMD_READ, 0, SUP_STATUS_LEN};
+            auto frame = req.encode();
+            if(write(port->fd, frame.data(), frame.size()) != static_cast<ssize_t>(frame.size())) continue;
+            b->polls++;
+            port->waiting = b;
+            port->deadline_ms = now + reply_ms();
+        }
+    }
+
+    static uint64_t reply_ms() { return 200 + sup::wire_time_ms(SUP_REQ_LEN + SUP_STATUS_LEN + 5); }  // answer or timeout
+
+    uint64_t round_ms(const Port& port) const {  // poll of the same board to the next, each board answering or timing out
+        return poll_ms_ + port.boards.size() * (reply_ms() + SCHED_MS);
+    }
+
+    void read_port(Port& port) {
+        uint8_t buf[256];
+        ssize_t n;
+        while((n = read(port.fd, buf, sizeof(buf))) > 0) {
+            for(ssize_t i = 0; i < n; i++) {
+                auto resp = port.dec.feed(buf[i]);
+                if(!resp || !port.waiting || resp->addr != port.waiting->addr) continue;
+                if(auto snap = sup::Snapshot::decode(*resp)) port.waiting->add(Sample{wall_ms(), mono_ms(), *snap}, round_ms(port));
+                port.waiting = nullptr;
+            }
+        }
+    }
+
+    void accept_clients() {
+        int fd;
+        while((fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            auto c = new Client(fd);
+            watch(fd, c);
+        }
+    }
+
+    void serve_client(Client* c) {
+        if(!c->replied) {
+            char buf[256];
+            ssize_t n = read(c->fd, buf, sizeof(buf));
+            if(n < 0 && errno == EAGAIN) return;
+            if(n > 0) c->in.append(buf, n);
+            auto eol = c->in.find('\n');
+            if(eol == std::string::npos) {
+                if(n > 0 && c->in.size() < 1024) return;  // wait for the rest of the line
+                drop_client(c);  // closed, failed or too long before a whole request line came in
+                return;
+            }
+            c->out = answer(c->in.substr(0, eol));
+            c->replied = true;
+        }
+        flush_client(c);
+    }
+
+    // a samples reply can be far larger than the socket buffer, write what fits and come back on EPOLLOUT
+    // rather than letting a slow reader stall the polling of every port
+    void flush_client(Client* c) {
+        while(c->sent < c->out.size()) {
+            ssize_t n = write(c->fd, c->out.data() + c->sent, c->out.size() - c->sent);
+            if(n > 0) c->sent += n;
+            else if(n < 0 && errno == EINTR) continue;
+            else if(n < 0 && errno == EAGAIN) {
+                epoll_event ev{};
+                ev.events = EPOLLOUT;
+                ev.data.ptr = c;
+                epoll_ctl(ep_, EPOLL_CTL_MOD, c->fd, &ev);
+                return;
+            }
+            else {
+                perror("client write");
+                break;
+            }
+        }
+        drop_client(c);
+    }
+
+    void drop_client(Client* c) {
+        epoll_ctl(ep_, EPOLL_CTL_DEL, c->fd, nullptr);
+        close(c->fd);
+        delete c;
+    }
+
+    std::string answer(std::string cmd) {
+        while(!cmd.empty() && isspace(static_cast<unsigned char>(cmd.back()))) cmd.pop_back();
+        std::ostringstream out;
+        char line[256];
+        if(cmd.empty() || cmd == "summary") {
+            for(auto& b : boards_) {
+                if(!b->samples.size()) {
+                    snprintf(line, sizeof(line), "%-24s no data, %u/%u timeouts\n", b->name.c_str(), b->timeouts, b->polls);
+                    out << line;
+                    continue;
+                }
+                const auto& s = b->samples.back().snap;
+                double hours = b->fault_hours();  // same window the faults are counted over
+                unsigned faults = 0;
+                for(auto& f : b->faults_per_day) faults += f.second;
+                snprintf(line, sizeof(line), "%-24s %-12s %5u W %8u Wh  faults %u (%.2f/h)  link %u/%u ok\n",
+                         b->name.c_str(), sup::state_name(s.state), s.power_w, s.energy_wh, faults,
+                         (hours > 0) ? faults / hours : 0.0, b->polls - b->timeouts, b->polls);
+                out << line;
+            }
+        }
+        else if(cmd == "energy") {
+            for(auto& b : boards_) {
+                out << b->name << "\n";
+                for(auto& e : b->energy_per_day) {  // a query never adds days, look the other buckets up
+                    auto pv = b->pv_energy_per_day.find(e.first);
+                    auto f = b->faults_per_day.find(e.first);
+                    snprintf(line, sizeof(line), "  %s %10.0f Wh  %10.0f Wh from PV  %u faults\n", day_name(e.first).c_str(),
+                             e.second, (pv != b->pv_energy_per_day.end()) ? pv->second : 0.0,
+                             (f != b->faults_per_day.end()) ? f->second : 0u);
+                    out << line;
+                }
+            }
+        }
+        else if(cmd == "occupancy") {
+            for(auto& b : boards_) {
+                uint64_t total = b->unreachable_ms;
+                for(auto t : b->state_ms) total += t;
+                out << b->name << "\n";
+                for(uint8_t st = 0; st < b->state_ms.size(); st++) {
+                    if(!b->state_ms[st]) continue;
+                    snprintf(line, sizeof(line), "  %-12s %6.2f%%\n", sup::state_name(st), 100.0 * b->state_ms[st] / total);
+                    out << line;
+                }
+                if(b->unreachable_ms) {
+                    snprintf(line, sizeof(line), "  %-12s %6.2f%%\n", "unreachable", 100.0 * b->unreachable_ms / total);
+                    out << line;
+                }
+            }
+        }
+        else if(cmd.rfind("samples ", 0) == 0) {
+            std::string name = cmd.substr(8);
+            for(auto& b : boards_) {
+                if(b->name != name) continue;
+                for(size_t i = 0; i < b->samples.size(); i++) {
+                    const auto& s = b->samples[i];
+                    snprintf(line, sizeof(line), "%llu %s %u %u %u %02X\n", static_cast<unsigned long long>(s.time_ms),
+                             sup::state_name(s.snap.state), s.snap.power_w, s.snap.energy_wh, s.snap.err_count, s.snap.flags);
+                    out << line;
+                }
+            }
+        }
+        else out << "unknown command\n";
+        return out.str();
+    }
+
+    int ep_;
+    int listen_fd_ = -1;
+    unsigned poll_ms_;
+    size_t ring_;
+    std::vector<std::unique_ptr<Port>> ports_;
+    std::vector<std::unique_ptr<Board>> boards_;
+};
+
+int main(int argc, char** argv) {
+    std::string sock = "/tmp/fleetmon.sock";
+    unsigned poll_ms = 5000;
+    size_t ring = 17280;  // a day of samples at the default rate
+    std::vector<std::string> ports;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) sock = argv[++i];
+        else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc) poll_ms = static_cast<unsigned>(atoi(argv[++i]));
+        else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) ring = static_cast<size_t>(atol(argv[++i]));
+        else ports.push_back(argv[i]);
+    }
+    if(ring == 0) {
+        fprintf(stderr, "fleetmon: ring size must be at least 1\n");
+        return 2;
+    }
+    if(ports.empty()) {
+        fprintf(stderr, "usage: fleetmon [-s socket] [-i poll_ms] [-r ring_size] port[@addr[,addr...]] ...\n");
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    try {
+        Monitor mon(poll_ms, ring);
+        for(auto& p : ports) mon.add_port(p);
+        mon.listen_on(sock);
+        mon.run();
+    }
+    catch(const std::exception& e) {
+        fprintf(stderr, "fleetmon: %s\n", e.what());
+        return 1;
+    }
+}
+
+// g++ -std=c++17 -O2 -o fleetmon fleetmon.cpp
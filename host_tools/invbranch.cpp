@@ -0,0 +1,202 @@
+/*
+    Branching scenario explorer on the instruction-level core (sim/emulator.hpp). The scenario runs once up to
+    each decision point, where the whole board is forked and every copy takes another turn: the scenario as it
+    was, the device unplugged, an overload plugged in or the LIN bus dead for a while. Each branch then runs for
+    a horizon and prints what happened in it. "What if it gets unplugged right while starting" costs one shared
+    run up to that point instead of a run from reset per case, and the copies share the decoded code until they
+    decode something new.
+
+    invbranch -x inverter.ihx [-l load] [-b battery] [-f faults] [-s seed] [-d days] [-p points] [-t s,s...]
+              [-w after_s] [-h horizon_s] [-o watts] [-k currents] [-j threads] [-a] [-r]
+
+    Decision points are -w seconds (default 1, the output is starting) after the first -p plug-ins of the
+    scenario (default 5), the one at power-up included, or the times given with -t. A branch starts at the
+    first instruction boundary at or after its point, the time printed. Overloads (-o, default 400 W) and bus
+    faults last a minute, branches run for -h seconds (default 600). Figures are for the branch alone: energy
+    served and wanted, plug-to-power latency, false shutdowns, controller trips, LIN frames, output at the end.
+    -r replays every branch from reset as well and checks it comes out the same.
+*/
+
+#include "sim/emulator.hpp"
+#include "sim/pool.hpp"
+#include "sim/scenario.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+enum { AS_IS, UNPLUG, OVERLOAD, BUS_DEAD, TURNS };
+static const char* turn_name[] = {"as-is", "unplug", "overload", "bus-dead"};
+
+struct Branch {
+    size_t point;
+    int turn;
+    std::shared_ptr<const sim::Scenario> scn;
+    std::unique_ptr<sim::Emulator> emu;
+    sim::Result res;
+    bool output = false;  // on at the end
+    bool same = true;     // replay from reset agreed
+};
+
+static int find_kind(const char* name, const char* (*kind_name)(int), int kinds) {
+    for(int k = 0; k < kinds; k++) {
+        if(strcmp(name, kind_name(k)) == 0) return k;
+    }
+    fprintf(stderr, "unknown kind %s\n", name);
+    exit(2);
+}
+
+static std::string clock(sim::Time t) {  // h:mm:ss.s since power-up
+    char buf[32];
+    uint64_t ds = t / (100 * sim::MS);
+    snprintf(buf, sizeof buf, "%llu:%02u:%02u.%u", (unsigned long long)(ds / 36000), unsigned(ds / 600 % 60),
+             unsigned(ds / 10 % 60), unsigned(ds % 10));
+    return buf;
+}
+
+static bool same(const sim::Result& a, const sim::Result& b) {  // bit for bit, both ran the same machine code
+    return a.hours == b.hours && a.served_wh == b.served_wh && a.demand_wh == b.demand_wh &&
+           a.battery_wh == b.battery_wh && a.requests == b.requests && a.served == b.served &&
+           a.latency_sum_s == b.latency_sum_s && a.false_shutdowns == b.false_shutdowns && a.trips == b.trips &&
+           a.led_blinks == b.led_blinks && a.lin_frames == b.lin_frames && a.final_soc == b.final_soc &&
+           a.energy.own_mah() == b.energy.own_mah();
+}
+
+static int usage() {
+    fprintf(stderr, "usage: invbranch -x inverter.ihx [-l load] [-b battery] [-f faults] [-s seed] [-d days] [-p points] "
+                    "[-t s,s...] [-w after_s] [-h horizon_s] [-o watts] [-k currents] [-j threads] [-a] [-r]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    int load = sim::LOAD_CHARGER, battery = sim::BATT_HEALTHY, faults = sim::FAULT_CLEAN;
+    uint64_t seed = 1;
+    double days = 1;
+    unsigned points = 5;
+    std::vector<sim::Time> times;
+    double after_s = 1, horizon_s = 600;
+    unsigned watts = 400;
+    unsigned threads = 0;
+    bool eco = true;
+    bool replay = false;
+    sim::Calibration cal;
+    std::shared_ptr<const sim::Image> image;
+    for(int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        try {
+            if(a == "-x" && has_value) image = sim::Image::load_ihx(argv[++i]);
+            else if(a == "-k" && has_value) cal = sim::Calibration::load(argv[++i]);
+            else if(a == "-l" && has_value) load = find_kind(argv[++i], sim::load_name, sim::LOAD_KINDS);
+            else if(a == "-b" && has_value) battery = find_kind(argv[++i], sim::battery_name, sim::BATT_KINDS);
+            else if(a == "-f" && has_value) faults = find_kind(argv[++i], sim::fault_name, sim::FAULT_KINDS);
+            else if(a == "-s" && has_value) seed = strtoull(argv[++i], nullptr, 0);
+            else if(a == "-d" && has_value) days = atof(argv[++i]);
+            else if(a == "-p" && has_value) points = unsigned(atoi(argv[++i]));
+            else if(a == "-t" && has_value) {
+                for(char* p = argv[++i]; *p;) {
+                    times.push_back(sim::Time(strtod(p, &p) * sim::SEC));
+                    if(*p == ',') p++;
+                    else if(*p) throw std::runtime_error("bad time list " + std::string(argv[i]));
+                }
+            }
+            else if(a == "-w" && has_value) after_s = atof(argv[++i]);
+            else if(a == "-h" && has_value) horizon_s = atof(argv[++i]);
+            else if(a == "-o" && has_value) watts = unsigned(atoi(argv[++i]));
+            else if(a == "-j" && has_value) threads = unsigned(atoi(argv[++i]));
+            else if(a == "-a") eco = false;
+            else if(a == "-r") replay = true;
+            else return usage();
+        }
+        catch(const std::exception& e) {
+            fprintf(stderr, "%s\n", e.what());
+            return 2;
+        }
+    }
+    if(!image) return usage();
+
+    auto scn = std::make_shared<sim::Scenario>(sim::make_scenario(load, battery, faults, seed, days, eco));
+    scn->cal = cal;
+    if(times.empty()) {
+        for(size_t i = 0; i < scn->load.size() && times.size() < points; i++) {
+            if(scn->load[i].plugged && (i == 0 || !scn->load[i - 1].plugged))
+                times.push_back(scn->load[i].t + sim::Time(after_s * sim::SEC));
+        }
+    }
+    std::sort(times.begin(), times.end());
+    const sim::Time horizon = sim::Time(horizon_s * sim::SEC), fault = 60 * sim::SEC;
+
+    // the main line runs once from point to point, each point forks one board per turn
+    auto start = std::chrono::steady_clock::now();
+    auto main_line = sim::Emulator::create(scn, image);
+    std::vector<sim::Time> at;   // where each point really is
+    std::vector<sim::Result> before;  // and what the board had done by then
+    std::vector<Branch> branches;
+    for(sim::Time t : times) {
+        if(!main_line->run_to(t)) break;
+        sim::Time now = main_line->now();
+        auto snap = main_line->fork();  // ends right here, for the figures up to the point
+        snap->set_end(now);
+        before.push_back(snap->run());
+        at.push_back(now);
+        sim::Time end = std::min(now + horizon, scn->duration);
+        for(int turn = 0; turn < TURNS; turn++) {
+            sim::Scenario v = (turn == UNPLUG) ? sim::unplug_at(*scn, now)
+                              : (turn == OVERLOAD) ? sim::overload_at(*scn, now, watts, fault)
+                              : (turn == BUS_DEAD) ? sim::bus_fault_at(*scn, now, fault)
+                                                   : *scn;
+            v.duration = end;
+            Branch b{at.size() - 1, turn, std::make_shared<sim::Scenario>(std::move(v)), main_line->fork(), {}};
+            b.emu->branch(b.scn);
+            branches.push_back(std::move(b));
+        }
+    }
+    sim::Pool pool(threads ? threads : std::thread::hardware_concurrency());
+    pool.run(branches.size(), [&](size_t i) {
+        Branch& b = branches[i];
+        b.res = b.emu->run();
+        b.output = b.emu->output_on();
+        b.emu.reset();  // drops its share of the decoded code
+    });
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-5s %-12s %-9s %9s %9s %7s %8s %6s %6s %6s\n", "point", "at", "branch", "served_Wh", "demand_Wh", "lat_s",
+           "false_sd", "trips", "lin", "output");
+    for(const Branch& b : branches) {
+        const sim::Result& r = b.res;
+        const sim::Result& p = before[b.point];
+        unsigned served = r.served - p.served;
+        printf("%-5zu %-12s %-9s %9.1f %9.1f %7.1f %8u %6u %6u %6s%s\n", b.point + 1,
+               b.turn == AS_IS ? clock(at[b.point]).c_str() : "", turn_name[b.turn], r.served_wh - p.served_wh,
+               r.demand_wh - p.demand_wh, served ? (r.latency_sum_s - p.latency_sum_s) / served : 0.0,
+               r.false_shutdowns - p.false_shutdowns, r.trips - p.trips, r.lin_frames - p.lin_frames,
+               b.output ? "on" : "off", r.shutdown ? "  SHUTDOWN" : "");
+    }
+    fprintf(stderr, "%zu branches at %zu points in %.2f s on %u threads\n", branches.size(), at.size(), wall,
+            pool.threads());
+
+    if(!replay) return 0;
+    start = std::chrono::steady_clock::now();
+    pool.run(branches.size(), [&](size_t i) {
+        Branch& b = branches[i];
+        auto emu = sim::Emulator::create(b.scn, image);
+        b.same = same(emu->run(), b.res) && emu->output_on() == b.output;
+    });
+    double replay_wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    unsigned differ = 0;
+    for(const Branch& b : branches) {
+        if(b.same) continue;
+        fprintf(stderr, "point %zu %s differs when replayed from reset\n", b.point + 1, turn_name[b.turn]);
+        differ++;
+    }
+    fprintf(stderr, "replayed from reset in %.2f s (%.1fx), %u branches differ\n", replay_wall,
+            wall ? replay_wall / wall : 0.0, differ);
+    return differ ? 1 : 0;
+}
+
+// g++ -std=c++17 -O2 -pthread -Isim -o invbranch invbranch.cpp
@@ -0,0 +1,307 @@
+/*
+    Parameter search for the policy constants of main(), start_inverter() and stop_inverter() (no load
+    back-off, load vote, start/stop retries, check intervals, start/stop status poll and load vote spacing) on top of the scenario simulator. Every
+    candidate configuration runs on the same scenarios and gets three scores, all lower is better: standby
+    energy per day, mean plug-to-power latency and false shutdowns per day. A small evolutionary search
+    mutates members of the current Pareto front; the final front is printed, followed by the configuration
+    block of the candidate with the best weighted score.
+
+    invopt [-g generations] [-p population] [-d days] [-n seeds] [-r search_seed] [-j threads]
+           [-w standby,latency,false_sd] [-l load] [-b battery] [-f faults] [-k currents] [-o block.bin]
+
+    Weights apply to scores relative to the default configuration, so -w 1,1,1 (the default) trades a 10%
+    standby saving for 10% slower starts. Scenarios are every load profile on the healthy and aged batteries
+    with a noisy bus unless -l/-b/-f pick one kind, -k reads measured supply currents (format of sim/currents.txt).
+    The block written with -o is the EEPROM image the USE_EEPROM firmware loads at boot (24C02 address 0,
+    CRC included); the same values can be set with supctl set and stored with supctl save, or pasted as
+    DEF_* lines into inverter.c for builds without EEPROM. Results only depend on the seeds, never on the
+    number of threads.
+*/
+
+#include "sup_proto.hpp"
+#include "sim/pool.hpp"
+#include "sim/scenario.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sim/firmware.hpp"
+
+#if !USE_EEPROM
+#error "build with -DUSE_EEPROM=1, candidates are handed to the firmware as an EEPROM image"
+#endif
+
+struct Param {  // one tuned field of the configuration block
+    uint8_t offset;
+    uint8_t lo, hi, step;
+};
+
+static const Param params[] = {
+    {SUP_CFG_NOLOAD_SHORT, 2, 60, 2},
+    {SUP_CFG_NOLOAD_LONG, 10, 200, 5},
+    {SUP_CFG_LOAD_VOTES, 1, 10, 1},
+    {SUP_CFG_LOAD_SAMPLES, 2, 20, 1},
+    {SUP_CFG_START_ATTEMPTS, 1, 6, 1},
+    {SUP_CFG_START_POLLS, 3, 20, 1},
+    {SUP_CFG_STOP_ATTEMPTS, 1, 6, 1},
+    {SUP_CFG_WAIT_SHORT, 6, 60, 2},
+    {SUP_CFG_WAIT_KEEP, 0, 90, 5},
+    {SUP_CFG_WAIT_LONG, 30, 250, 10},
+    {SUP_CFG_POLL_INTERVAL, 3, 30, 1},
+    {SUP_CFG_VOTE_INTERVAL, 12, 60, 4},
+};
+static constexpr int PARAMS = sizeof(params) / sizeof(params[0]);
+
+using Candidate = std::array<uint8_t, PARAMS>;
+
+struct Score {
+    double standby = 0, latency = 0, false_sd = 0;  // Wh/day, s, per day
+    double served = 0;                               // % of demanded energy, informative only
+    unsigned shutdowns = 0;
+
+    bool dominates(const Score& o) const {
+        return standby <= o.standby && latency <= o.latency && false_sd <= o.false_sd &&
+               (standby < o.standby || latency < o.latency || false_sd < o.false_sd);
+    }
+};
+
+struct Weights {
+    double standby = 1, latency = 1, false_sd = 1;
+};
+
+static double rel(double v, double ref) { return v / std::max(ref, 1e-3); }  // no division by a perfect default
+
+static double weighted(const Score& s, const Score& ref, const Weights& w) {
+    return w.standby * rel(s.standby, ref.standby) + w.latency * rel(s.latency, ref.latency) +
+           w.false_sd * rel(s.false_sd, ref.false_sd);
+}
+
+static const char* field_name(uint8_t offset) {
+    for(const auto& f : sup::config_fields()) {
+        if(f.offset == offset) return f.name;
+    }
+    return "?";
+}
+
+static Candidate defaults() {
+    sup::ConfigBlock def = sup::default_config();
+    Candidate c;
+    for(int i = 0; i < PARAMS; i++) c[i] = def[params[i].offset];
+    return c;
+}
+
+static sup::ConfigBlock block(const Candidate& c) {
+    sup::ConfigBlock cfg = sup::default_config();
+    for(int i = 0; i < PARAMS; i++) cfg[params[i].offset] = c[i];
+    cfg[SUP_CFG_CRC] = sup::config_crc(cfg);
+    return cfg;
+}
+
+static uint8_t on_grid(const Param& p, int v) { return uint8_t(std::clamp<int>(p.lo + (v - p.lo) / p.step * p.step, p.lo, p.hi)); }
+
+static void repair(Candidate& c) {  // keep every field in range, the vote reachable and the back-off stages in order
+    for(int i = 0; i < PARAMS; i++) c[i] = on_grid(params[i], c[i]);
+    if(c[0] > c[1]) c[0] = on_grid(params[0], c[1]);  // noload_short <= noload_long
+    if(c[2] > c[3]) c[2] = c[3];  // load_votes <= load_samples
+}
+
+static Candidate mutate(Candidate c, std::mt19937_64& rng, int changes) {
+    for(int k = 0; k < changes; k++) {
+        int i = int(rng() % PARAMS);
+        int steps = 1 + int(rng() % 3);
+        int v = c[i] + ((rng() & 1) ? steps : -steps) * params[i].step;
+        c[i] = uint8_t(std::clamp<int>(v, params[i].lo, params[i].hi));
+    }
+    repair(c);
+    return c;
+}
+
+static std::vector<Candidate> pareto_front(const std::map<Candidate, Score>& archive) {
+    std::vector<Candidate> front;
+    for(const auto& a : archive) {
+        bool dominated = false;
+        for(const auto& b : archive) {
+            if(b.second.dominates(a.second)) {
+                dominated = true;
+                break;
+            }
+        }
+        if(!dominated) front.push_back(a.first);
+    }
+    return front;
+}
+
+static int find_kind(const char* name, const char* (*kind_name)(int), int kinds) {
+    for(int k = 0; k < kinds; k++) {
+        if(strcmp(name, kind_name(k)) == 0) return k;
+    }
+    fprintf(stderr, "unknown kind %s\n", name);
+    exit(2);
+}
+
+static int usage() {
+    fprintf(stderr, "usage: invopt [-g generations] [-p population] [-d days] [-n seeds] [-r search_seed] [-j threads]\n"
+                    "              [-w standby,latency,false_sd] [-l load] [-b battery] [-f faults] [-k currents] [-o block.bin]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    unsigned generations = 10, population = 16, seeds = 2, threads = 0;
+    double days = 2;
+    uint64_t search_seed = 1;
+    Weights w;
+    int only_load = -1, only_battery = -1, only_faults = -1;
+    const char* out_path = nullptr;
+    sim::Calibration cal;
+    for(int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if(a == "-g" && has_value) generations = unsigned(atoi(argv[++i]));
+        else if(a == "-p" && has_value) population = std::max(2, atoi(argv[++i]));
+        else if(a == "-d" && has_value) days = atof(argv[++i]);
+        else if(a == "-n" && has_value) seeds = unsigned(atoi(argv[++i]));
+        else if(a == "-r" && has_value) search_seed = strtoull(argv[++i], nullptr, 0);
+        else if(a == "-j" && has_value) threads = unsigned(atoi(argv[++i]));
+        else if(a == "-w" && has_value) {
+            if(sscanf(argv[++i], "%lf,%lf,%lf", &w.standby, &w.latency, &w.false_sd) != 3) return usage();
+        }
+        else if(a == "-l" && has_value) only_load = find_kind(argv[++i], sim::load_name, sim::LOAD_KINDS);
+        else if(a == "-b" && has_value) only_battery = find_kind(argv[++i], sim::battery_name, sim::BATT_KINDS);
+        else if(a == "-f" && has_value) only_faults = find_kind(argv[++i], sim::fault_name, sim::FAULT_KINDS);
+        else if(a == "-k" && has_value) {
+            try {
+                cal = sim::Calibration::load(argv[++i]);
+            }
+            catch(const std::exception& e) {
+                fprintf(stderr, "%s\n", e.what());
+                return 2;
+            }
+        }
+        else if(a == "-o" && has_value) out_path = argv[++i];
+        else return usage();
+    }
+
+    // common scenarios for every candidate, only the EEPROM image differs
+    std::vector<sim::Scenario> scenarios;
+    for(int l = 0; l < sim::LOAD_KINDS; l++) {
+        for(int b = 0; b < sim::BATT_KINDS; b++) {
+            for(int f = 0; f < sim::FAULT_KINDS; f++) {
+                if((only_load >= 0) ? l != only_load : false) continue;
+                if((only_battery >= 0) ? b != only_battery : (b != sim::BATT_HEALTHY && b != sim::BATT_AGED)) continue;
+                if((only_faults >= 0) ? f != only_faults : f != sim::FAULT_NOISY) continue;
+                for(unsigned s = 0; s < seeds; s++) {
+                    scenarios.push_back(sim::make_scenario(l, b, f, 1 + s, days));
+                    scenarios.back().cal = cal;
+                }
+            }
+        }
+    }
+
+    sim::Pool pool(threads ? threads : std::thread::hardware_concurrency());
+    auto evaluate = [&](const std::vector<Candidate>& batch) {
+        std::vector<sim::Result> res(batch.size() * scenarios.size());
+        pool.run(res.size(), [&](size_t i) {
+            auto scn = std::make_shared<sim::Scenario>(scenarios[i % scenarios.size()]);
+            sup::ConfigBlock cfg = block(batch[i / scenarios.size()]);
+            std::copy(cfg.begin(), cfg.end(), scn->eeprom.begin());  // EE_CFG is address 0
+            res[i] = sim::Firmware::create(scn)->run();
+        });
+        std::vector<Score> scores(batch.size());
+        for(size_t c = 0; c < batch.size(); c++) {
+            double d = 0, demand = 0, served_wh = 0, latency = 0;
+            unsigned served = 0, false_sd = 0;
+            Score& s = scores[c];
+            for(size_t k = 0; k < scenarios.size(); k++) {
+                const sim::Result& r = res[c * scenarios.size() + k];
+                d += r.hours / 24;
+                demand += r.demand_wh;
+                served_wh += r.served_wh;
+                s.standby += r.standby_wh;
+                latency += r.latency_sum_s;
+                served += r.served;
+                false_sd += r.false_shutdowns;
+                s.shutdowns += r.shutdown;
+            }
+            s.standby /= d;
+            s.latency = served ? latency / served : 0;
+            s.false_sd = false_sd / d;
+            s.served = demand ? 100 * served_wh / demand : 100;
+        }
+        return scores;
+    };
+
+    std::mt19937_64 rng(sim::mix_seed(search_seed));
+    std::map<Candidate, Score> archive;
+    const Candidate def = defaults();
+    std::vector<Candidate> batch{def};
+    while(batch.size() < population) batch.push_back(mutate(def, rng, 2 + int(rng() % 4)));  // wider first spread
+    Score ref;
+    for(unsigned g = 0; g <= generations; g++) {
+        std::vector<Score> scores = evaluate(batch);
+        for(size_t i = 0; i < batch.size(); i++) archive.emplace(batch[i], scores[i]);
+        if(g == 0) ref = archive.at(def);
+        std::vector<Candidate> front = pareto_front(archive);
+        std::sort(front.begin(), front.end(), [&](const Candidate& a, const Candidate& b) {
+            return weighted(archive.at(a), ref, w) < weighted(archive.at(b), ref, w);
+        });
+        fprintf(stderr, "generation %u: %zu evaluated, front %zu, best score %.3f\n", g, archive.size(), front.size(),
+                weighted(archive.at(front[0]), ref, w));
+        if(g == generations) break;
+
+        batch.clear();  // half the children come from the best weighted candidate, the rest from anywhere on the front
+        for(unsigned tries = 0; batch.size() < population && tries < 50 * population; tries++) {
+            const Candidate& parent = (tries % 2 == 0) ? front[0] : front[rng() % front.size()];
+            Candidate c = mutate(parent, rng, 1 + int(rng() % 3));
+            if(!archive.count(c) && std::find(batch.begin(), batch.end(), c) == batch.end()) batch.push_back(c);
+        }
+        if(batch.empty()) break;  // neighbourhood exhausted
+    }
+
+    std::vector<Candidate> front = pareto_front(archive);
+    std::sort(front.begin(), front.end(), [&](const Candidate& a, const Candidate& b) {
+        return weighted(archive.at(a), ref, w) < weighted(archive.at(b), ref, w);
+    });
+    auto print_row = [&](const char* tag, const Candidate& c) {
+        const Score& s = archive.at(c);
+        printf("%-5s %6.3f %9.1f %6.1f %10.2f %6.1f%% %4u ", tag, weighted(s, ref, w), s.standby, s.latency, s.false_sd,
+               s.served, s.shutdowns);
+        for(int i = 0; i < PARAMS; i++) printf(" %*u", int(strlen(field_name(params[i].offset))), c[i]);
+        printf("\n");
+    };
+    printf("Pareto front: %zu of %zu configurations, %zu scenarios x %.1f days each\n", front.size(), archive.size(),
+           scenarios.size(), days);
+    printf("%-5s %6s %9s %6s %10s %7s %4s ", "", "score", "stby_Wh/d", "lat_s", "false_sd/d", "served", "shut");
+    for(int i = 0; i < PARAMS; i++) printf(" %s", field_name(params[i].offset));
+    printf("\n");
+    print_row("def", def);
+    for(const Candidate& c : front) print_row(c == def ? "def" : "", c);
+
+    const Candidate& best = front[0];
+    sup::ConfigBlock cfg = block(best);
+    printf("\nbest under weights %g,%g,%g:\n", w.standby, w.latency, w.false_sd);
+    for(int i = 0; i < PARAMS; i++) {
+        std::string def_name = field_name(params[i].offset);
+        for(char& ch : def_name) ch = char(toupper(ch));
+        printf("#define DEF_%-16s %u\n", def_name.c_str(), best[i]);
+    }
+    printf("config block:");
+    for(uint8_t b : cfg) printf(" %02X", b);
+    printf("\n");
+    if(out_path) {
+        FILE* f = fopen(out_path, "wb");
+        bool ok = f && fwrite(cfg.data(), 1, cfg.size(), f) == cfg.size();
+        if(f && fclose(f) != 0) ok = false;
+        if(!ok) {
+            perror(out_path);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// g++ -std=c++17 -O2 -pthread -Isim -DUSE_EEPROM=1 -o invopt invopt.cpp
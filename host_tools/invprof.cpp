@@ -0,0 +1,225 @@
+/*
+    Sampling profiler client for USE_PROFILER debug builds (sdcc -DUSE_SUPERVISOR=1 -DUSE_PROFILER=1, AT89C4051).
+    The board bins the program counter interrupted by Timer0 every 10 ms into 8 counters covering a window of
+    code memory (see SUP_REG_PROF_* in supervisor.h). This tool sets the window, lets the board sample for a while,
+    reads the counters back and names the code in each bucket from the sdcc .map file of the same build.
+
+    Each level after the first zooms into the hottest bucket of the previous one (8 times narrower buckets), so
+    three levels of 10 s go from 512 byte buckets over the whole 4 KB down to 8 bytes, which is about one C
+    statement. Buckets shared by several functions are split between them by size in the per-function summary
+    and marked with ~.
+
+    Time spent in idle mode waiting for an interrupt shows up at the instruction after the one entering idle,
+    time in power down is not sampled at all (Timer0 stops).
+
+    invprof <port> <firmware.map> [-a addr] [-t seconds per level] [-z levels] [-b base] [-s shift]
+*/
+
+#include "sup_proto.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <regex>
+#include <thread>
+
+struct Symbol {
+    std::string name;
+    unsigned start, end;  // end is exclusive
+};
+
+// Code symbols from an aslink map, each one running up to the next symbol or the end of its area. Area starts
+// before the first symbol get the area name, e.g. <HOME> for the reset and interrupt vectors.
+static std::vector<Symbol> load_map(const char* path) {
+    std::ifstream in(path);
+    if(!in) throw std::runtime_error(std::string("cannot open ") + path);
+    static const std::regex area_re(R"(^(\S+)\s+([0-9A-Fa-f]{4,8})\s+([0-9A-Fa-f]{4,8})\s*=.*\(([^)]*)\))");
+    static const std::regex sym_re(R"(^\s*(?:([A-Z]):\s+)?([0-9A-Fa-f]{4,8})\s+(\S+))");
+    struct Area {
+        std::string name;
+        unsigned start, end;
+    };
+    std::vector<Area> areas;
+    std::vector<std::pair<unsigned, std::string>> syms;
+    bool in_code = false;
+    std::string line;
+    while(std::getline(in, line)) {
+        std::smatch m;
+        if(std::regex_search(line, m, area_re)) {
+            in_code = m[4].str().find("CODE") != std::string::npos;
+            unsigned start = std::stoul(m[2].str(), nullptr, 16), size = std::stoul(m[3].str(), nullptr, 16);
+            if(in_code && size) areas.push_back({m[1].str(), start, start + size});
+        }
+        else if(std::regex_search(line, m, sym_re)) {
+            bool code = m[1].matched ? m[1].str() == "C" : in_code;  // older maps have no space prefix
+            if(code && m[3].str() != "Value") syms.push_back({std::stoul(m[2].str(), nullptr, 16), m[3].str()});
+        }
+    }
+    for(const auto& a : areas) syms.push_back({a.start, "<" + a.name + ">"});
+    std::sort(syms.begin(), syms.end());
+    std::vector<Symbol> out;
+    for(size_t i = 0; i < syms.size(); i++) {
+        unsigned start = syms[i].first;
+        if(i + 1 < syms.size() && syms[i + 1].first == start) continue;  // area start with a symbol of its own
+        auto area = std::find_if(areas.begin(), areas.end(), [&](const Area& a) { return start >= a.start && start < a.end; });
+        if(area == areas.end()) continue;  // absolute or empty
+        unsigned end = area->end;
+        if(i + 1 < syms.size()) end = std::min(end, syms[i + 1].first);
+        std::string name = syms[i].second;
+        if(name[0] == '_') name.erase(0, 1);  // C names get an underscore from sdcc
+        out.push_back({name, start, end});
+    }
+    if(out.empty()) throw std::runtime_error(std::string("no code symbols in ") + path);
+    return out;
+}
+
+static void write_reg(int fd, uint8_t addr, uint8_t reg, uint8_t value) {
+    for(int attempt = 0; attempt < 3; attempt++) {
+        auto resp = sup::transact(fd, {addr, SUP_CMD_WRITE, reg, value});
+        if(resp && !resp->data.empty()) return;
+    }
+    throw std::runtime_error("no answer to write, is this a USE_PROFILER build?");
+}
+
+struct Histogram {
+    unsigned hist[SUP_PROF_BUCKETS];
+    bool saturated;  // a counter reached 0xFFFF and the board stopped sampling early
+};
+
+static Histogram read_hist(int fd, uint8_t addr) {
+    for(int attempt = 0; attempt < 3; attempt++) {
+        auto resp = sup::transact(fd, {addr, SUP_CMD_READ, SUP_REG_PROF_RUN, SUP_REG_PROF_END - SUP_REG_PROF_RUN});
+        if(!resp || resp->data.size() != SUP_REG_PROF_END - SUP_REG_PROF_RUN) continue;
+        Histogram h;
+        const uint8_t* p = &resp->data[SUP_REG_PROF_HIST - SUP_REG_PROF_RUN];
+        for(int i = 0; i < SUP_PROF_BUCKETS; i++) h.hist[i] = p[2 * i] | (p[2 * i + 1] << 8);
+        h.saturated = *std::max_element(h.hist, h.hist + SUP_PROF_BUCKETS) == 0xFFFF;
+        return h;
+    }
+    throw std::runtime_error("no answer to read, is this a USE_PROFILER build?");
+}
+
+// Symbols overlapping [start, end) with the number of bytes each one covers.
+static std::vector<std::pair<const Symbol*, unsigned>> overlap(const std::vector<Symbol>& syms, unsigned start, unsigned end) {
+    std::vector<std::pair<const Symbol*, unsigned>> out;
+    for(const auto& s : syms) {
+        unsigned lo = std::max(start, s.start), hi = std::min(end, s.end);
+        if(lo < hi) out.push_back({&s, hi - lo});
+    }
+    return out;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: invprof <port> <firmware.map> [-a addr] [-t seconds] [-z levels] [-b base] [-s shift]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 3) return usage();
+    uint8_t addr = SUP_ADDR_DEFAULT;
+    double seconds = 10;
+    int levels = 3;
+    unsigned base = 0, shift = 9;  // whole AT89C4051
+    for(int i = 3; i < argc; i++) {
+        if(i + 1 >= argc) return usage();
+        const char* v = argv[++i];
+        if(strcmp(argv[i - 1], "-a") == 0) addr = static_cast<uint8_t>(strtoul(v, nullptr, 0));
+        else if(strcmp(argv[i - 1], "-t") == 0) seconds = atof(v);
+        else if(strcmp(argv[i - 1], "-z") == 0) levels = atoi(v);
+        else if(strcmp(argv[i - 1], "-b") == 0) base = strtoul(v, nullptr, 0);
+        else if(strcmp(argv[i - 1], "-s") == 0) shift = strtoul(v, nullptr, 0);
+        else return usage();
+    }
+    if(seconds <= 0 || levels < 1 || shift > 9 || base % 16 || base / 16 > 0xFF) {
+        fprintf(stderr, "base must be a multiple of 16 below 4 KB, shift 0-9\n");
+        return 2;
+    }
+
+    std::vector<Symbol> syms;
+    int fd;
+    try {
+        syms = load_map(argv[2]);
+        fd = sup::open_port(argv[1]);
+    }
+    catch(const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    try {
+        for(int level = 0; level < levels; level++) {
+            write_reg(fd, addr, SUP_REG_PROF_RUN, 0);
+            write_reg(fd, addr, SUP_REG_PROF_BASE, static_cast<uint8_t>(base / 16));
+            write_reg(fd, addr, SUP_REG_PROF_SHIFT, static_cast<uint8_t>(shift));
+            write_reg(fd, addr, SUP_REG_PROF_RUN, 1);
+            auto t0 = std::chrono::steady_clock::now();
+            std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+            write_reg(fd, addr, SUP_REG_PROF_RUN, 0);  // freeze, the counters are read a few bytes at a time
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            Histogram h = read_hist(fd, addr);
+
+            unsigned width = 1u << shift, in_window = 0;
+            for(unsigned c : h.hist) in_window += c;
+            double total = elapsed * 100;  // one sample per 10 ms tick
+            printf("window 0x%04X-0x%04X, %u byte buckets, %.1f s, %u of ~%.0f samples in window%s\n", base,
+                   base + SUP_PROF_BUCKETS * width - 1, width, elapsed, in_window, total,
+                   h.saturated ? " (a counter saturated, sampling stopped early)" : "");
+            std::vector<std::pair<std::string, double>> by_func;
+            std::vector<bool> split;
+            for(int b = 0; b < SUP_PROF_BUCKETS; b++) {
+                unsigned start = base + b * width;
+                auto parts = overlap(syms, start, start + width);
+                printf("  0x%04X-0x%04X %7u %5.1f%%  ", start, start + width - 1, h.hist[b],
+                       total > 0 ? 100.0 * h.hist[b] / total : 0.0);
+                for(size_t i = 0; i < parts.size(); i++) printf("%s%s", i ? ", " : "", parts[i].first->name.c_str());
+                printf("%s\n", parts.empty() ? "-" : "");
+                unsigned covered = 0;
+                for(const auto& p : parts) covered += p.second;
+                for(const auto& p : parts) {
+                    auto it = std::find_if(by_func.begin(), by_func.end(), [&](const auto& f) { return f.first == p.first->name; });
+                    if(it == by_func.end()) {
+                        by_func.push_back({p.first->name, 0});
+                        split.push_back(false);
+                        it = by_func.end() - 1;
+                    }
+                    it->second += double(h.hist[b]) * p.second / covered;
+                    if(parts.size() > 1 && h.hist[b]) split[it - by_func.begin()] = true;
+                }
+            }
+            std::vector<size_t> order(by_func.size());
+            for(size_t i = 0; i < order.size(); i++) order[i] = i;
+            std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return by_func[a].second > by_func[b].second; });
+            printf("  by function:\n");
+            for(size_t i : order) {
+                if(by_func[i].second < 0.5) break;
+                printf("    %-28s %s%7.0f %5.1f%%\n", by_func[i].first.c_str(), split[i] ? "~" : " ", by_func[i].second,
+                       100.0 * by_func[i].second / total);
+            }
+            printf("\n");
+
+            int hot = int(std::max_element(h.hist, h.hist + SUP_PROF_BUCKETS) - h.hist);
+            if(level + 1 == levels) break;
+            if(!in_window || shift < 4) {  // nothing to zoom into or buckets smaller than the base step
+                printf("can't zoom further\n");
+                break;
+            }
+            base += hot * width;
+            shift -= 3;  // SUP_PROF_BUCKETS buckets across the hot one
+        }
+        write_reg(fd, addr, SUP_REG_PROF_BASE, 0);  // leave the board sampling as after power-up
+        write_reg(fd, addr, SUP_REG_PROF_SHIFT, 9);
+        write_reg(fd, addr, SUP_REG_PROF_RUN, 1);
+    }
+    catch(const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        close(fd);
+        return 1;
+    }
+    close(fd);
+    return 0;
+}
+
+// g++ -std=c++17 -O2 -o invprof invprof.cpp
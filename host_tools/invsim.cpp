@@ -0,0 +1,335 @@
+/*
+    Scenario runner for the host build of the firmware (see sim/firmware.hpp). Runs every combination of load
+    profile x battery x LIN bus faults for a number of seeds across all cores and prints aggregates, so a
+    policy change can be judged on a few thousand simulated weeks instead of one bench afternoon.
+
+    invsim [-d days] [-n seeds] [-s first_seed] [-j threads] [-l load] [-b battery] [-f faults] [-k currents]
+           [-a] [-e] [-v] [-R minutes] [-S] [-W] [-x inverter.ihx [-F]] [-T trace.bin]
+
+    -l/-b/-f limit the run to one kind by name (see sim/scenario.hpp). Boards boot with something plugged
+    in (eco policy) unless -a is given (always-on). -k reads measured supply currents (format of sim/currents.txt),
+    own_mAh/d is what the board itself takes from the battery, -e splits it per part, lin/d counts LIN
+    frames, boot_ms is power-up to the first decision (LIN traffic, wake pulse, EN_OV or sleep). -v prints
+    every run. -R adds warm resets of the uC, one every that many minutes on average (what -DUSE_RESUME=1 is
+    for). -S runs the solar-idle scenario (sim/scenario.hpp) with the solar profile set in the EEPROM image instead,
+    it needs -DUSE_EEPROM=1 -DUSE_PROFILES=1 -DUSE_SOLAR=1. -W runs the window-idle scenario the same way with the
+    timed profile and its window, it needs -DUSE_EEPROM=1 -DUSE_PROFILES=1 -DUSE_SCHEDULER=1, and checks that
+    every plug-in inside the window got power and none after it did (exit code 1 if not). Results only depend on the seeds, never on the number of
+    threads. Feature switches are
+    compile time like on the real board, e.g. add -DUSE_PROFILES=1 to the build line below.
+    With -DUSE_SUPERVISOR=1 -DUSE_STAMPS=0x3F the cycle stamps of all boards are summed up and printed like
+    supctl stamps prints them from a real board. Simulated code runs in zero time, only the waits count.
+
+    -x runs the sdcc build on the instruction-level core instead (sim/emulator.hpp): real machine code and
+    real cycle counts, feature switches are whatever that binary was built with. Spin loops are fast-forwarded,
+    -F steps through every round instead, the results must not change.
+
+    -T writes a trace of the first run (trace.hpp: pins, LIN bytes and frames, demand, battery voltage and the
+    control state of USE_SUPERVISOR builds), pick it with -l/-b/-f and -n 1. invtrace turns it into VCD or CSV.
+*/
+
+#include "sim/emulator.hpp"
+#include "sim/pool.hpp"
+#include "sim/scenario.hpp"
+#include "sup_proto.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "sim/firmware.hpp"
+
+enum { RUN_SOLAR_IDLE = -1, RUN_WINDOW_IDLE = -2 };  // Run::load of the fixed scenarios
+
+struct Run {
+    int load, battery, faults;
+    uint64_t seed;
+    sim::Result res;
+    std::vector<sup::Stamp> stamps;
+    sim::Emulator::Stats emu;
+    unsigned in_window = 0, after_window = 0;  // plug-ins of the window-idle scenario
+};
+
+struct Totals {
+    unsigned runs = 0;
+    double days = 0, demand_wh = 0, served_wh = 0, standby_wh = 0, latency_sum_s = 0, latency_max_s = 0;
+    unsigned served = 0, false_shutdowns = 0, trips = 0, shutdowns = 0;
+    double lin_frames = 0;
+    double boot_ms = 0;  // summed over the runs that got that far
+    unsigned booted = 0;
+    sim::Ledger energy;
+
+    void add(const sim::Result& r) {
+        runs++;
+        days += r.hours / 24;
+        demand_wh += r.demand_wh;
+        served_wh += r.served_wh;
+        standby_wh += r.standby_wh;
+        latency_sum_s += r.latency_sum_s;
+        latency_max_s = std::max(latency_max_s, r.latency_max_s);
+        served += r.served;
+        false_shutdowns += r.false_shutdowns;
+        trips += r.trips;
+        shutdowns += r.shutdown;
+        energy.add(r.energy);
+        lin_frames += r.lin_frames;
+        if(r.boot_ms >= 0) boot_ms += r.boot_ms, booted++;
+    }
+    void print(const char* name, bool parts) const {
+        printf("%-24s %5u %7.1f%% %9.1f %9.0f %8.1f %8.1f %9.2f %7.2f %7.0f %7.0f %5u\n", name, runs,
+               demand_wh ? 100 * served_wh / demand_wh : 100.0, standby_wh / days, energy.own_mah() / days,
+               served ? latency_sum_s / served : 0.0, latency_max_s, false_shutdowns / days, trips / days, lin_frames / days,
+               booted ? boot_ms / booted : 0.0, shutdowns);
+        if(!parts) return;
+        for(int p = 0; p < sim::PARTS; p++) {
+            if(energy.hours[p] > 0)
+                printf("    %-14s %9.0f mAh/d %6.1f h/d\n", sim::part_name(p), energy.mah[p] / days, energy.hours[p] / days);
+        }
+        printf("    %-14s %9.0f mAh/d\n", "loads", energy.load_mah / days);
+    }
+};
+
+static int find_kind(const char* name, const char* (*kind_name)(int), int kinds) {
+    for(int k = 0; k < kinds; k++) {
+        if(strcmp(name, kind_name(k)) == 0) return k;
+    }
+    fprintf(stderr, "unknown kind %s\n", name);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    double days = 7;
+    unsigned seeds = 10;
+    uint64_t first_seed = 1;
+    unsigned threads = 0;
+    int only_load = -1, only_battery = -1, only_faults = -1;
+    bool verbose = false;
+    bool eco = true;
+    bool parts = false;
+    sim::Calibration cal;
+    std::shared_ptr<const sim::Image> image;
+    bool fast_forward = true;
+    const char* trace_path = nullptr;
+    double reset_min = 0;
+    bool solar_idle = false, window_idle = false;
+    for(int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if(a == "-d" && has_value) days = atof(argv[++i]);
+        else if(a == "-n" && has_value) seeds = unsigned(atoi(argv[++i]));
+        else if(a == "-s" && has_value) first_seed = strtoull(argv[++i], nullptr, 0);
+        else if(a == "-j" && has_value) threads = unsigned(atoi(argv[++i]));
+        else if(a == "-l" && has_value) only_load = find_kind(argv[++i], sim::load_name, sim::LOAD_KINDS);
+        else if(a == "-b" && has_value) only_battery = find_kind(argv[++i], sim::battery_name, sim::BATT_KINDS);
+        else if(a == "-f" && has_value) only_faults = find_kind(argv[++i], sim::fault_name, sim::FAULT_KINDS);
+        else if(a == "-k" && has_value) {
+            try {
+                cal = sim::Calibration::load(argv[++i]);
+            }
+            catch(const std::exception& e) {
+                fprintf(stderr, "%s\n", e.what());
+                return 2;
+            }
+        }
+        else if(a == "-x" && has_value) {
+            try {
+                image = sim::Image::load_ihx(argv[++i]);
+            }
+            catch(const std::exception& e) {
+                fprintf(stderr, "%s\n", e.what());
+                return 2;
+            }
+        }
+        else if(a == "-F") fast_forward = false;
+        else if(a == "-T" && has_value) trace_path = argv[++i];
+        else if(a == "-R" && has_value) reset_min = atof(argv[++i]);
+        else if(a == "-S") solar_idle = true;
+        else if(a == "-W") window_idle = true;
+        else if(a == "-a") eco = false;
+        else if(a == "-e") parts = true;
+        else if(a == "-v") verbose = true;
+        else {
+            fprintf(stderr, "usage: invsim [-d days] [-n seeds] [-s first_seed] [-j threads] [-l load] [-b battery] "
+                            "[-f faults] [-k currents] [-a] [-e] [-v] [-R minutes] [-S] [-W] [-x inverter.ihx [-F]] [-T trace.bin]\n");
+            return 2;
+        }
+    }
+
+#if !(USE_EEPROM && USE_SOLAR)
+    if(solar_idle && !image) {
+        fprintf(stderr, "-S needs a build with -DUSE_EEPROM=1 -DUSE_PROFILES=1 -DUSE_SOLAR=1\n");
+        return 2;
+    }
+#endif
+#if !(USE_EEPROM && USE_SCHEDULER)
+    if(window_idle && !image) {
+        fprintf(stderr, "-W needs a build with -DUSE_EEPROM=1 -DUSE_PROFILES=1 -DUSE_SCHEDULER=1\n");
+        return 2;
+    }
+#endif
+    std::vector<Run> runs;
+    for(unsigned s = 0; solar_idle && s < seeds; s++) runs.push_back({RUN_SOLAR_IDLE, sim::BATT_SOLAR, sim::FAULT_CLEAN, first_seed + s, {}, {}, {}});
+    for(unsigned s = 0; window_idle && s < seeds; s++)
+        runs.push_back({RUN_WINDOW_IDLE, sim::BATT_HEALTHY, sim::FAULT_CLEAN, first_seed + s, {}, {}, {}});
+    for(int l = 0; !solar_idle && !window_idle && l < sim::LOAD_KINDS; l++) {
+        for(int b = 0; b < sim::BATT_KINDS; b++) {
+            for(int f = 0; f < sim::FAULT_KINDS; f++) {
+                if((only_load >= 0 && l != only_load) || (only_battery >= 0 && b != only_battery) ||
+                   (only_faults >= 0 && f != only_faults))
+                    continue;
+                for(unsigned s = 0; s < seeds; s++) runs.push_back({l, b, f, first_seed + s, {}, {}, {}});
+            }
+        }
+    }
+
+    auto run_name = [](const Run& r) {
+        if(r.load == RUN_SOLAR_IDLE) return std::string("solar-idle");
+        if(r.load == RUN_WINDOW_IDLE) return std::string("window-idle");
+        return std::string(sim::load_name(r.load)) + "/" + sim::battery_name(r.battery) + "/" + sim::fault_name(r.faults);
+    };
+    std::unique_ptr<trace::Writer> tracer;
+    if(trace_path && !runs.empty()) {
+        const Run& r = runs[0];
+        char info[128];
+        snprintf(info, sizeof info, "invsim %s seed %llu", run_name(r).c_str(), (unsigned long long)r.seed);
+        try {
+            tracer = std::make_unique<trace::Writer>(trace_path, sim::Board::trace_channels(), info);
+        }
+        catch(const std::exception& e) {
+            fprintf(stderr, "%s\n", e.what());
+            return 2;
+        }
+    }
+
+    sim::Pool pool(threads ? threads : std::thread::hardware_concurrency());
+    auto start = std::chrono::steady_clock::now();
+    pool.run(runs.size(), [&](size_t i) {
+        Run& r = runs[i];
+        std::shared_ptr<sim::Scenario> scn;
+        if(r.load < 0) {
+            sup::ConfigBlock cfg = sup::default_config();
+            if(r.load == RUN_SOLAR_IDLE) {
+                scn = std::make_shared<sim::Scenario>(sim::solar_idle_scenario(r.seed, days));
+                cfg[SUP_CFG_PROFILE] = SUP_PROFILE_SOLAR;
+            }
+            else {
+                scn = std::make_shared<sim::Scenario>(sim::window_idle_scenario(r.seed, days));
+                cfg[SUP_CFG_PROFILE] = SUP_PROFILE_TIMED;
+                cfg[SUP_CFG_WINDOWS] = sim::WINDOW_IDLE_START;
+                cfg[SUP_CFG_WINDOWS + 1] = sim::WINDOW_IDLE_END;
+                for(const auto& step : scn->load) {  // steps alternate between plugged in and unplugged
+                    if(!step.plugged) continue;
+                    unsigned slot = unsigned(step.t % sim::DAY / (10 * 60 * sim::SEC));
+                    if(slot >= sim::WINDOW_IDLE_START && slot < sim::WINDOW_IDLE_END) r.in_window++;
+                    else r.after_window++;
+                }
+            }
+            cfg[SUP_CFG_CRC] = sup::config_crc(cfg);
+            std::copy(cfg.begin(), cfg.end(), scn->eeprom.begin());  // EE_CFG is address 0
+        }
+        else scn = std::make_shared<sim::Scenario>(sim::make_scenario(r.load, r.battery, r.faults, r.seed, days, eco));
+        scn->cal = cal;
+        if(reset_min > 0) sim::add_resets(*scn, reset_min);
+        if(image) {
+            auto emu = sim::Emulator::create(scn, image, fast_forward);
+            if(i == 0 && tracer) emu->trace_to(tracer.get());
+            r.res = emu->run();
+            r.emu = emu->stats();
+            return;
+        }
+        auto fw = sim::Firmware::create(scn);
+        if(i == 0 && tracer) fw->trace_to(tracer.get());
+        r.res = fw->run();
+#if USE_STAMPS
+        auto sites = sup::stamp_sites(USE_STAMPS);
+        for(size_t k = 0; k < sites.size(); k++) {
+            const auto& s = fw->stamp(int(k));
+            r.stamps.push_back({sites[k], s.count, s.min, s.max, s.total});
+        }
+#endif
+    });
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(tracer) {
+        try {
+            tracer->close();
+        }
+        catch(const std::exception& e) {
+            fprintf(stderr, "%s\n", e.what());
+            return 2;
+        }
+    }
+
+    printf("%-24s %5s %8s %9s %9s %8s %8s %9s %7s %7s %7s %5s\n", "scenario", "runs", "served", "stby_Wh/d", "own_mAh/d",
+           "lat_s", "lat_max", "false_sd/d", "trips/d", "lin/d", "boot_ms", "shut");
+    Totals all;
+    for(size_t i = 0; i < runs.size();) {
+        Totals t;
+        size_t j = i;
+        for(; j < runs.size() && runs[j].load == runs[i].load && runs[j].battery == runs[i].battery &&
+              runs[j].faults == runs[i].faults;
+            j++) {
+            t.add(runs[j].res);
+            all.add(runs[j].res);
+            if(verbose) {
+                const sim::Result& r = runs[j].res;
+                printf("  seed %-6llu served %6.1f/%6.1f Wh  standby %6.1f Wh  own %5.0f mAh/d  latency %5.1f/%5.1f s  "
+                       "false_sd %u  trips %u  cuts %u  resets %u  boot %.0f ms  soc %.2f%s\n",
+                       (unsigned long long)runs[j].seed, r.served_wh, r.demand_wh, r.standby_wh, r.own_mah_per_day(), r.latency_mean_s(),
+                       r.latency_max_s, r.false_shutdowns, r.trips, r.power_cuts, r.resets, r.boot_ms, r.final_soc, r.shutdown ? "  SHUTDOWN" : "");
+            }
+        }
+        t.print(run_name(runs[i]).c_str(), parts);
+        i = j;
+    }
+    all.print("all", parts);
+#if USE_STAMPS
+    if(!image) {
+        std::vector<sup::Stamp> stamps;
+        for(uint8_t site : sup::stamp_sites(USE_STAMPS)) stamps.push_back({site, 0, 0, 0, 0});
+        for(const auto& r : runs) {
+            for(size_t k = 0; k < stamps.size(); k++) stamps[k].add(r.stamps[k]);
+        }
+        printf("\n%s\n", sup::Stamp::header());
+        for(const auto& s : stamps) printf("%s\n", s.row().c_str());
+    }
+#endif
+    if(image) {
+        sim::Emulator::Stats emu;
+        for(const auto& r : runs) {
+            emu.insns += r.emu.insns;
+            emu.spin_rounds += r.emu.spin_rounds;
+            emu.spin_cycles += r.emu.spin_cycles;
+            emu.loop_rounds += r.emu.loop_rounds;
+            emu.loop_cycles += r.emu.loop_cycles;
+            emu.interrupts += r.emu.interrupts;
+            emu.sp_peak = std::max(emu.sp_peak, r.emu.sp_peak);
+        }
+        double cycles = all.days * 86400 * sim::FOSC / 12;
+        fprintf(stderr, "%.0f M instructions stepped, %.0f M spin rounds (%.1f%% of the cycles) and %.0f M loop rounds (%.1f%%) "
+                        "fast-forwarded, %.0f M interrupts, stack up to 0x%02X\n",
+                emu.insns / 1e6, emu.spin_rounds / 1e6, cycles ? 100 * emu.spin_cycles / cycles : 0.0, emu.loop_rounds / 1e6,
+                cycles ? 100 * emu.loop_cycles / cycles : 0.0, emu.interrupts / 1e6, emu.sp_peak);
+    }
+    fprintf(stderr, "%zu runs, %.0f simulated days in %.2f s on %u threads (%.0f days/s)\n", runs.size(), all.days, wall,
+            pool.threads(), all.days / wall);
+    if(window_idle) {  // every request asks for power, only the ones inside the window may get it
+        unsigned in_window = 0, after_window = 0, served = 0, refused = 0;
+        for(const auto& r : runs) {
+            in_window += r.in_window;
+            after_window += r.after_window;
+            served += r.res.served;
+            refused += r.res.requests - r.res.served;
+        }
+        bool ok = served == in_window && refused == after_window;
+        printf("\nwindow decisions: %u of %u plug-ins in the window served, %u of %u after it refused: %s\n", served,
+               in_window, refused, after_window, ok ? "ok" : "FAILED");
+        if(!ok) return 1;
+    }
+    return 0;
+}
+
+// g++ -std=c++17 -O2 -pthread -Isim -o invsim invsim.cpp
@@ -0,0 +1,134 @@
+/*
+    Reader for the binary traces of trace.hpp (invsim -T, linscan): summary, CSV and VCD for a waveform viewer.
+
+    invtrace info trace.bin
+    invtrace csv trace.bin [-s from_s] [-e to_s] [-c channel,channel...]
+    invtrace vcd trace.bin [-s from_s] [-e to_s] [-c channel,channel...]
+
+    info lists the channels with their record counts, the time span and how many bytes a record takes. csv
+    prints one record per line, "t_s,channel,value", frames as hex bytes. vcd writes a value change dump in ns
+    with the state at from_s first, frames are left out (no byte strings in VCD, take them from csv). Only the
+    chunks that reach into the window are read, so a few minutes out of a week of trace come out at once.
+*/
+
+#include "trace.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::vector<bool> pick(const trace::Reader& rd, const char* list) {  // channels by name, all without a list
+    std::vector<bool> on(rd.channels().size(), list == nullptr);
+    for(const char* p = list; p && *p;) {
+        const char* e = strchr(p, ',');
+        std::string name(p, e ? size_t(e - p) : strlen(p));
+        int c = rd.find(name);
+        if(c < 0) throw std::runtime_error("no channel " + name);
+        on[size_t(c)] = true;
+        p = e ? e + 1 : "";
+    }
+    return on;
+}
+
+static void info(const trace::Reader& rd) {
+    std::vector<uint64_t> count(rd.channels().size());
+    uint64_t total = 0;
+    trace::Record r;
+    for(auto c = rd.all(); c.next(r); total++) count[r.channel]++;
+    printf("%s\n", rd.info().c_str());
+    printf("%.3f s to %.3f s, %zu chunks%s, %" PRIu64 " records, %zu bytes (%.2f per record)\n", rd.begin() / 1e9,
+           rd.end() / 1e9, rd.chunks().size(), rd.complete() ? "" : " (no index, writer did not finish)", total,
+           rd.bytes(), total ? double(rd.bytes()) / double(total) : 0.0);
+    static const char* kinds[] = {"bit", "value", "bytes"};
+    for(size_t c = 0; c < count.size(); c++)
+        printf("  %-12s %-6s %12" PRIu64 "\n", rd.channels()[c].name.c_str(), kinds[rd.channels()[c].kind], count[c]);
+}
+
+static void csv(const trace::Reader& rd, trace::Time from, trace::Time to, const std::vector<bool>& on) {
+    printf("t_s,channel,value\n");
+    trace::Record r;
+    for(auto c = rd.seek(from); c.next(r) && r.t <= to;) {
+        if(!on[r.channel]) continue;
+        printf("%.9f,%s,", r.t / 1e9, rd.channels()[r.channel].name.c_str());
+        if(r.data) {
+            for(int64_t i = 0; i < r.value; i++) printf("%s%02X", i ? " " : "", r.data[i]);
+            printf("\n");
+        }
+        else printf("%" PRId64 "\n", r.value);
+    }
+}
+
+static std::string vcd_value(trace::Kind kind, int64_t v, const std::string& id) {
+    if(kind == trace::BIT) return std::string(v ? "1" : "0") + id;
+    std::string bits;
+    for(uint64_t u = uint64_t(v); u; u >>= 1) bits.insert(bits.begin(), char('0' + (u & 1)));
+    return "b" + (bits.empty() ? std::string("0") : bits) + " " + id;
+}
+
+static void vcd(const trace::Reader& rd, trace::Time from, trace::Time to, std::vector<bool> on) {
+    const auto& ch = rd.channels();
+    std::vector<std::string> id(ch.size());
+    printf("$comment %s $end\n$timescale 1ns $end\n$scope module board $end\n", rd.info().c_str());
+    for(size_t c = 0; c < ch.size(); c++) {
+        if(ch[c].kind == trace::BYTES) on[c] = false;
+        if(!on[c]) continue;
+        for(size_t n = c + 1; n; n /= 94) id[c] += char('!' + (n - 1) % 94);  // printable identifiers
+        printf("$var wire %d %s %s $end\n", ch[c].kind == trace::BIT ? 1 : 32, id[c].c_str(), ch[c].name.c_str());
+    }
+    printf("$upscope $end\n$enddefinitions $end\n");
+    auto cur = rd.seek(from);
+    printf("#%" PRIu64 "\n$dumpvars\n", from);
+    for(size_t c = 0; c < ch.size(); c++) {
+        if(on[c]) printf("%s\n", cur.known()[c] ? vcd_value(ch[c].kind, cur.state()[c], id[c]).c_str() : ("x" + id[c]).c_str());
+    }
+    printf("$end\n");
+    trace::Record r;
+    trace::Time at = from;
+    while(cur.next(r) && r.t <= to) {
+        if(!on[r.channel]) continue;
+        if(r.t != at) printf("#%" PRIu64 "\n", at = r.t);
+        printf("%s\n", vcd_value(ch[r.channel].kind, r.value, id[r.channel]).c_str());
+    }
+}
+
+int main(int argc, char** argv) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: invtrace info|csv|vcd trace.bin [-s from_s] [-e to_s] [-c channel,channel...]\n");
+        return 2;
+    }
+    std::string cmd = argv[1];
+    double from_s = 0, to_s = -1;
+    const char* channels = nullptr;
+    for(int i = 3; i < argc; i++) {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if(a == "-s" && has_value) from_s = atof(argv[++i]);
+        else if(a == "-e" && has_value) to_s = atof(argv[++i]);
+        else if(a == "-c" && has_value) channels = argv[++i];
+        else {
+            fprintf(stderr, "unknown option %s\n", a.c_str());
+            return 2;
+        }
+    }
+    try {
+        trace::Reader rd(argv[2]);
+        trace::Time from = trace::Time(from_s * 1e9), to = (to_s < 0) ? ~trace::Time(0) : trace::Time(to_s * 1e9);
+        if(cmd == "info") info(rd);
+        else if(cmd == "csv") csv(rd, from, to, pick(rd, channels));
+        else if(cmd == "vcd") vcd(rd, from, to, pick(rd, channels));
+        else {
+            fprintf(stderr, "unknown command %s\n", cmd.c_str());
+            return 2;
+        }
+    }
+    catch(const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
+
+// g++ -std=c++17 -O2 -o invtrace invtrace.cpp
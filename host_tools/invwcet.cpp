@@ -0,0 +1,1217 @@
+/*
+    Static worst-case reaction time of the firmware main loop. For every SET_STATE() in main(), and for reset as
+    BOOT, it bounds the time until the code next looks at PLUG and at P_GOOD over every path through the retries,
+    waits and calls in between, and flags the ones over the reaction budget if one is given. That is what a missed
+    unplug or undervoltage costs in the worst case, shown on paper instead of on the bench.
+
+    inverter.c is read with the same -D switches as the sdcc build. A small preprocessor is built in, so SET_STATE()
+    is seen in the base build too. Loop bounds come from the for loop headers, with cfg.* fields at their SUP_DEF_*
+    defaults unless overridden with -c, and from "bound: N" comments on while / do-while lines. A loop without a
+    bound makes every path through it unbounded. delay(ms) counts at its nominal length. The rest counts machine
+    cycles per source line from the .asm listing sdcc writes next to the .ihx (-a), otherwise a flat guess per
+    line, and is stretched by the interrupt load (-i, 12.5% with the Timer0 tick, none without). The uC only idles
+    while nothing is plugged in, with the output off, until a plug-in. That has no bound. For PLUG it counts as
+    nothing: the idle loop looks at PLUG after every wake-up (tick or plug interrupt), and a plug-in just before
+    entering idle is latched by the edge-triggered interrupt and ends it at once. Nothing looks at P_GOOD until that plug-in, so paths
+    through idle are unbounded for P_GOOD and shown as "idle". Those are not counted against the budget, the output
+    is off all along.
+
+    Branch conditions are not evaluated, so the bound also covers paths that cannot happen, e.g. every start
+    attempt failing and then every stop attempt failing too. Exits with 1 when a path is unbounded or over a -b / -g
+    budget.
+
+    invwcet <inverter.c> [-D NAME[=value]]... [-a inverter.asm] [-c field=value]... [-b PLUG budget ms]
+            [-g P_GOOD budget ms] [-l cycles per line] [-f clock MHz] [-i interrupt load %] [-v]
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static const double NONE = -INFINITY;  // no path gets there
+static const double UNBOUNDED = INFINITY;
+static const double IDLE = 1e300;  // waits in idle for a plug-in: no bound, but worse than any bound and better than a real unbounded loop
+
+struct Tok {
+    std::string s;
+    int line;  // 0 outside the main source file
+    bool ident() const { return std::isalpha((unsigned char)s[0]) || s[0] == '_'; }
+    bool number() const { return std::isdigit((unsigned char)s[0]); }
+};
+using Toks = std::vector<Tok>;
+
+static void lex(const std::string& text, int line, Toks& out) {
+    static const char* puncts[] = {"<<=", ">>=", "...", "->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||",
+                                   "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=", "##"};
+    size_t i = 0;
+    while(i < text.size()) {
+        char c = text[i];
+        if(std::isspace((unsigned char)c)) { i++; continue; }
+        size_t j = i + 1;
+        if(std::isalnum((unsigned char)c) || c == '_') {
+            while(j < text.size() && (std::isalnum((unsigned char)text[j]) || text[j] == '_')) j++;
+        }
+        else if(c == '"' || c == '\'') {
+            while(j < text.size() && text[j] != c) j += (text[j] == '\\') ? 2 : 1;
+            j = std::min(j + 1, text.size());
+        }
+        else {
+            for(const char* p : puncts) {
+                if(text.compare(i, std::strlen(p), p) == 0) {
+                    j = i + std::strlen(p);
+                    break;
+                }
+            }
+        }
+        out.push_back({text.substr(i, j - i), line});
+        i = j;
+    }
+}
+
+// integer constant expressions, for #if and for loop bounds. Values are ranges, so a ternary with an unknown
+// condition covers both arms and x & 4 is 0 to 4.
+struct Val {
+    long v, lo;
+    bool exact() const { return v == lo; }
+};
+using OptVal = std::optional<Val>;
+
+class Expr {
+public:
+    using Ident = std::function<OptVal(const Toks&, size_t&)>;  // resolves an identifier, may eat more tokens
+    Expr(const Toks& t, Ident id) : t_(t), id_(std::move(id)) {}
+    OptVal eval() {
+        OptVal v = ternary();
+        return (pos_ == t_.size()) ? v : std::nullopt;
+    }
+
+private:
+    const Toks& t_;
+    Ident id_;
+    size_t pos_ = 0;
+
+    bool eat(const char* s) {
+        if(pos_ < t_.size() && t_[pos_].s == s) {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+    static OptVal exact(long v) { return Val{v, v}; }
+    static bool both(const OptVal& a, const OptVal& b) { return a && b && a->exact() && b->exact(); }
+
+    OptVal ternary() {
+        OptVal c = binary(0);
+        if(!eat("?")) return c;
+        OptVal a = ternary();
+        if(!eat(":")) return std::nullopt;
+        OptVal b = ternary();
+        if(c && c->exact()) return (c->v) ? a : b;
+        if(!a || !b) return std::nullopt;
+        return Val{std::max(a->v, b->v), std::min(a->lo, b->lo)};
+    }
+    OptVal binary(int level) {
+        static const std::vector<std::vector<std::string>> ops = {
+            {"||"}, {"&&"}, {"|"}, {"^"}, {"&"}, {"==", "!="}, {"<", ">", "<=", ">="}, {"<<", ">>"}, {"+", "-"},
+            {"*", "/", "%"}};
+        if(level == (int)ops.size()) return unary();
+        OptVal a = binary(level + 1);
+        for(;;) {
+            std::string op;
+            for(const auto& o : ops[level]) {
+                if(pos_ < t_.size() && t_[pos_].s == o) op = o;
+            }
+            if(op.empty()) return a;
+            pos_++;
+            OptVal b = binary(level + 1);
+            a = apply(op, a, b);
+        }
+    }
+    static OptVal apply(const std::string& op, const OptVal& a, const OptVal& b) {
+        if(op == "&" && (a || b)) {  // masking bounds the result even when the other side is unknown
+            long m = (a && b) ? std::min(a->v, b->v) : (a) ? a->v : b->v;
+            if(both(a, b)) return exact(a->v & b->v);
+            if((a && a->exact()) || (b && b->exact())) return Val{m, 0};
+        }
+        if(!a || !b) return std::nullopt;
+        long x = a->v, y = b->v;
+        if(op == "+") return Val{x + y, a->lo + b->lo};
+        if(op == "*") return Val{x * y, a->lo * b->lo};
+        if(b->exact()) {
+            if(op == "<<") return Val{x << y, a->lo << y};
+            if(op == "-") return Val{x - y, a->lo - y};
+            if(op == "/" && y) return Val{x / y, a->lo / y};
+            if(op == ">>") return Val{x >> y, a->lo >> y};
+        }
+        if(!both(a, b)) return std::nullopt;
+        if(op == "%") return (y) ? exact(x % y) : std::nullopt;
+        if(op == "^") return exact(x ^ y);
+        if(op == "&") return exact(x & y);
+        if(op == "||") return exact(x || y);
+        if(op == "&&") return exact(x && y);
+        if(op == "==") return exact(x == y);
+        if(op == "!=") return exact(x != y);
+        if(op == "<") return exact(x < y);
+        if(op == ">") return exact(x > y);
+        if(op == "<=") return exact(x <= y);
+        return exact(x >= y);
+    }
+    OptVal unary() {
+        if(eat("!")) {
+            OptVal v = unary();
+            return (v && v->exact()) ? exact(!v->v) : std::nullopt;
+        }
+        if(eat("~")) {
+            OptVal v = unary();
+            return (v && v->exact()) ? exact(~v->v) : std::nullopt;
+        }
+        if(eat("-")) {
+            OptVal v = unary();
+            return (v && v->exact()) ? exact(-v->v) : std::nullopt;
+        }
+        if(eat("+")) return unary();
+        return primary();
+    }
+    OptVal primary() {
+        if(pos_ >= t_.size()) return std::nullopt;
+        static const std::set<std::string> types = {"byte", "word", "bool", "char", "int", "long", "unsigned"};
+        if(t_[pos_].s == "(" && pos_ + 2 < t_.size() && types.count(t_[pos_ + 1].s)) {  // cast
+            size_t p = pos_ + 1;
+            while(p < t_.size() && (types.count(t_[p].s) || t_[p].s == "*")) p++;
+            if(p < t_.size() && t_[p].s == ")") {
+                pos_ = p + 1;
+                return unary();
+            }
+        }
+        if(eat("(")) {
+            OptVal v = ternary();
+            return eat(")") ? v : std::nullopt;
+        }
+        const Tok& tok = t_[pos_];
+        if(tok.number()) {
+            pos_++;
+            std::string s = tok.s;
+            while(!s.empty() && std::strchr("uUlL", s.back())) s.pop_back();
+            try {
+                return exact(std::stol(s, nullptr, 0));
+            }
+            catch(const std::exception&) {
+                return std::nullopt;
+            }
+        }
+        if(tok.ident()) return id_(t_, pos_);
+        return std::nullopt;
+    }
+};
+
+struct Macro {
+    bool func = false;
+    std::vector<std::string> params;
+    Toks body;
+};
+
+// Just enough of the C preprocessor for inverter.c. SET_STATE, PLUG and P_GOOD are left unexpanded, they are
+// what the analysis looks for.
+class Pre {
+public:
+    std::map<std::string, Macro> macros;
+    std::map<int, std::string> comments;  // // comment of each line of the main file
+    Toks out;
+
+    void define(const std::string& name, const std::string& value) {
+        Macro m;
+        lex(value, 0, m.body);
+        macros[name] = m;
+    }
+    void file(const std::string& path, bool main) {
+        std::ifstream in(path);
+        if(!in) throw std::runtime_error("cannot open " + path);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        std::vector<std::string> lines = strip_comments(ss.str(), main);
+        std::vector<bool> active{true};  // one per #if level
+        std::vector<bool> taken{true};   // some branch of that level was taken already
+        for(size_t n = 0; n < lines.size(); n++) {
+            std::string text = lines[n];
+            int line = (main) ? (int)n + 1 : 0;
+            while(!text.empty() && text.back() == '\\' && n + 1 < lines.size()) text = text.substr(0, text.size() - 1) + lines[++n];
+            size_t p = text.find_first_not_of(" \t");
+            bool on = active.back();
+            if(p == std::string::npos || text[p] != '#') {
+                if(on) {
+                    Toks t;
+                    lex(text, line, t);
+                    std::set<std::string> hide;
+                    Toks e = expand(t, hide, line);
+                    out.insert(out.end(), e.begin(), e.end());
+                }
+                continue;
+            }
+            Toks d;
+            lex(text.substr(p + 1), line, d);
+            if(d.empty()) continue;
+            const std::string& dir = d[0].s;
+            Toks rest(d.begin() + 1, d.end());
+            if(dir == "if" || dir == "ifdef" || dir == "ifndef") {
+                bool c = false;
+                if(on) {
+                    if(dir == "if") c = cond(rest);
+                    else c = !rest.empty() && macros.count(rest[0].s) == (dir == "ifdef" ? 1u : 0u);
+                }
+                active.push_back(on && c);
+                taken.push_back(!on || c);
+            }
+            else if(dir == "elif") {
+                bool outer = active[active.size() - 2];
+                bool c = outer && !taken.back() && cond(rest);
+                active.back() = c;
+                if(c) taken.back() = true;
+            }
+            else if(dir == "else") {
+                active.back() = active[active.size() - 2] && !taken.back();
+                taken.back() = true;
+            }
+            else if(dir == "endif") {
+                if(active.size() > 1) {
+                    active.pop_back();
+                    taken.pop_back();
+                }
+            }
+            else if(!on) continue;
+            else if(dir == "define" && !rest.empty()) {
+                Macro m;
+                size_t b = 1;
+                size_t name_end = text.find(rest[0].s, text.find(dir, p) + dir.size()) + rest[0].s.size();
+                if(name_end < text.size() && text[name_end] == '(') {  // function-like only without a space
+                    m.func = true;
+                    for(b = 2; b < rest.size() && rest[b].s != ")"; b++) {
+                        if(rest[b].s != ",") m.params.push_back(rest[b].s);
+                    }
+                    b++;
+                }
+                if(b < rest.size()) m.body.assign(rest.begin() + b, rest.end());
+                macros[rest[0].s] = m;
+            }
+            else if(dir == "undef" && !rest.empty()) macros.erase(rest[0].s);
+            else if(dir == "include" && !rest.empty() && rest[0].s[0] == '"') {
+                std::string dir_name = path.substr(0, path.find_last_of('/') + 1);
+                file(dir_name + rest[0].s.substr(1, rest[0].s.size() - 2), false);
+            }
+            else if(dir == "error") throw std::runtime_error(path + ":" + std::to_string(n + 1) + ": #error " + text.substr(text.find("error") + 5));
+        }
+    }
+    // #if expression, also used for the USE_* switches after the run
+    bool cond(Toks t) {
+        Toks d;
+        for(size_t i = 0; i < t.size(); i++) {  // defined() before expansion
+            if(t[i].s != "defined") {
+                d.push_back(t[i]);
+                continue;
+            }
+            bool paren = i + 1 < t.size() && t[i + 1].s == "(";
+            size_t n = i + (paren ? 2 : 1);
+            if(n < t.size()) d.push_back({macros.count(t[n].s) ? "1" : "0", 0});
+            i = n + (paren ? 1 : 0);
+        }
+        std::set<std::string> hide;
+        Toks e = expand(d, hide, 0);
+        OptVal v = Expr(e, [](const Toks& t, size_t& p) -> OptVal {
+            p++;
+            long v = (t[p - 1].s == "true") ? 1 : 0;  // undefined names are 0
+            return Val{v, v};
+        }).eval();
+        return v && v->v;
+    }
+
+private:
+    std::vector<std::string> strip_comments(const std::string& src, bool main) {
+        std::vector<std::string> lines(1);
+        bool block = false;
+        for(size_t i = 0; i < src.size(); i++) {
+            char c = src[i];
+            if(c == '\n') {
+                lines.emplace_back();
+                continue;
+            }
+            if(block) {
+                if(c == '*' && i + 1 < src.size() && src[i + 1] == '/') block = false, i++;
+                continue;
+            }
+            if(c == '/' && i + 1 < src.size() && src[i + 1] == '*') {
+                block = true;
+                i++;
+                continue;
+            }
+            if(c == '/' && i + 1 < src.size() && src[i + 1] == '/') {
+                size_t e = src.find('\n', i);
+                if(e == std::string::npos) e = src.size();
+                if(main) comments[(int)lines.size()] = src.substr(i + 2, e - i - 2);
+                i = e - 1;
+                continue;
+            }
+            if(c == '"' || c == '\'') {  // no comments inside literals
+                size_t e = i + 1;
+                while(e < src.size() && src[e] != c && src[e] != '\n') e += (src[e] == '\\') ? 2 : 1;
+                lines.back() += src.substr(i, e - i + 1);
+                i = e;
+                continue;
+            }
+            lines.back() += c;
+        }
+        return lines;
+    }
+    Toks expand(const Toks& in, std::set<std::string>& hide, int line) {
+        static const std::set<std::string> keep = {"SET_STATE", "PLUG", "P_GOOD"};
+        Toks out;
+        for(size_t i = 0; i < in.size(); i++) {
+            const Tok& t = in[i];
+            auto m = macros.find(t.s);
+            if(t.s == "SET_STATE" && i + 1 < in.size() && in[i + 1].s == "(") {  // keep the state name too
+                for(int depth = 0; i < in.size(); i++) {
+                    out.push_back({in[i].s, (line) ? line : in[i].line});
+                    if(in[i].s == "(") depth++;
+                    if(in[i].s == ")" && --depth == 0) break;
+                }
+                continue;
+            }
+            if(!t.ident() || m == macros.end() || hide.count(t.s) || keep.count(t.s)) {
+                out.push_back({t.s, (line) ? line : t.line});
+                continue;
+            }
+            Toks body;
+            if(m->second.func) {
+                if(i + 1 >= in.size() || in[i + 1].s != "(") {
+                    out.push_back({t.s, (line) ? line : t.line});
+                    continue;
+                }
+                std::vector<Toks> args(1);
+                int depth = 0;
+                size_t j = i + 2;
+                for(; j < in.size(); j++) {
+                    const std::string& s = in[j].s;
+                    if(depth == 0 && s == ")") break;
+                    if(s == "(") depth++;
+                    if(s == ")") depth--;
+                    if(depth == 0 && s == ",") args.emplace_back();
+                    else args.back().push_back(in[j]);
+                }
+                for(auto& a : args) a = expand(a, hide, line);
+                for(const Tok& b : m->second.body) {
+                    auto p = std::find(m->second.params.begin(), m->second.params.end(), b.s);
+                    size_t k = p - m->second.params.begin();
+                    if(p != m->second.params.end() && k < args.size()) body.insert(body.end(), args[k].begin(), args[k].end());
+                    else body.push_back(b);
+                }
+                i = j;
+            }
+            else body = m->second.body;
+            hide.insert(t.s);
+            Toks e = expand(body, hide, line);
+            hide.erase(t.s);
+            out.insert(out.end(), e.begin(), e.end());
+        }
+        return out;
+    }
+};
+
+struct Stmt {
+    enum Kind { EXPR, BLOCK, IF, FOR, WHILE, DO, RETURN, BREAK, CONTINUE, MARKER, EMPTY } kind = EMPTY;
+    int line = 0;
+    Toks e;           // expression, condition or returned value
+    Toks init, step;  // for loops
+    std::vector<std::unique_ptr<Stmt>> kids;  // block statements, if then / else, loop body
+    std::string state;  // SET_STATE() argument of a marker
+    int marker = -1;
+};
+
+struct Func {
+    std::string name;
+    std::vector<std::string> params;
+    int line = 0, end_line = 0;
+    bool isr = false;
+    std::unique_ptr<Stmt> body;
+};
+
+class Parser {
+public:
+    std::map<std::string, Func> funcs;
+    std::vector<const Stmt*> markers;  // SET_STATE() calls in main()
+
+    explicit Parser(const Toks& t) : t_(t) {
+        while(pos_ < t_.size()) top();
+    }
+
+private:
+    const Toks& t_;
+    size_t pos_ = 0;
+    std::string func_;  // being parsed
+
+    const std::string& peek(size_t ahead = 0) const {
+        static const std::string end;
+        return (pos_ + ahead < t_.size()) ? t_[pos_ + ahead].s : end;
+    }
+    void expect(const char* s) {
+        if(peek() != s) throw std::runtime_error("parse error at line " + std::to_string(line()) + ", expected " + s + " got " + peek());
+        pos_++;
+    }
+    int line() const { return (pos_ < t_.size()) ? t_[pos_].line : 0; }
+    void skip_braces() {
+        int depth = 0;
+        do {
+            if(peek() == "{") depth++;
+            if(peek() == "}") depth--;
+            pos_++;
+        } while(depth > 0 && pos_ < t_.size());
+    }
+    void top() {  // declaration or function definition
+        size_t start = pos_;
+        bool data = false;
+        while(pos_ < t_.size() && peek() != ";" && peek() != "{") {
+            if(peek() == "=" || peek() == "struct" || peek() == "union" || peek() == "typedef" || peek() == "enum") data = true;
+            pos_++;
+        }
+        if(peek() == ";") {
+            pos_++;
+            return;
+        }
+        if(data || pos_ >= t_.size()) {
+            skip_braces();
+            while(pos_ < t_.size() && peek() != ";") {
+                if(peek() == "{") skip_braces();
+                else pos_++;
+            }
+            pos_++;
+            return;
+        }
+        Func f;
+        size_t open = start;
+        while(open < pos_ && t_[open].s != "(") open++;
+        if(open == start || open == pos_) {
+            skip_braces();
+            return;
+        }
+        f.name = t_[open - 1].s;
+        f.line = t_[open - 1].line;
+        size_t close = open + 1;
+        Toks param;
+        for(int depth = 0; close < pos_ && !(depth == 0 && t_[close].s == ")"); close++) {
+            const std::string& s = t_[close].s;
+            if(s == "(") depth++;
+            if(s == ")") depth--;
+            if(depth == 0 && s == ",") {
+                add_param(f, param);
+                param.clear();
+            }
+            else param.push_back(t_[close]);
+        }
+        add_param(f, param);
+        for(size_t i = close; i < pos_; i++) f.isr |= t_[i].s == "__interrupt";
+        func_ = f.name;
+        f.body = block();
+        f.end_line = t_[pos_ - 1].line;
+        std::string name = f.name;
+        funcs[name] = std::move(f);
+    }
+    static void add_param(Func& f, const Toks& p) {
+        if(p.empty() || (p.size() == 1 && p[0].s == "void")) return;
+        f.params.push_back(p.back().s);
+    }
+    Toks until(const char* end) {  // tokens up to end at depth 0, end eaten
+        Toks r;
+        int depth = 0;
+        while(pos_ < t_.size() && !(depth == 0 && peek() == end)) {
+            if(peek() == "(" || peek() == "[" || peek() == "{") depth++;
+            if(peek() == ")" || peek() == "]" || peek() == "}") depth--;
+            r.push_back(t_[pos_++]);
+        }
+        expect(end);
+        return r;
+    }
+    std::unique_ptr<Stmt> block() {
+        auto s = std::make_unique<Stmt>();
+        s->kind = Stmt::BLOCK;
+        s->line = line();
+        expect("{");
+        while(pos_ < t_.size() && peek() != "}") s->kids.push_back(stmt());
+        expect("}");
+        return s;
+    }
+    std::unique_ptr<Stmt> stmt() {
+        if(peek() == "{") return block();
+        auto s = std::make_unique<Stmt>();
+        s->line = line();
+        const std::string w = peek();
+        if(w == ";") {
+            pos_++;
+            return s;
+        }
+        if(w == "__asm") {
+            while(pos_ < t_.size() && peek() != "__endasm") pos_++;
+            pos_++;
+            if(peek() == ";") pos_++;
+            return s;
+        }
+        if(w == "if") {
+            pos_++;
+            s->kind = Stmt::IF;
+            expect("(");
+            s->e = until(")");
+            s->kids.push_back(stmt());
+            if(peek() == "else") {
+                pos_++;
+                s->kids.push_back(stmt());
+            }
+            return s;
+        }
+        if(w == "for") {
+            pos_++;
+            s->kind = Stmt::FOR;
+            expect("(");
+            s->init = until(";");
+            s->e = until(";");
+            s->step = until(")");
+            s->kids.push_back(stmt());
+            return s;
+        }
+        if(w == "while") {
+            pos_++;
+            s->kind = Stmt::WHILE;
+            expect("(");
+            s->e = until(")");
+            s->kids.push_back(stmt());
+            return s;
+        }
+        if(w == "do") {
+            pos_++;
+            s->kind = Stmt::DO;
+            s->kids.push_back(stmt());
+            s->line = line();  // bound and cost belong to the while line
+            expect("while");
+            expect("(");
+            s->e = until(")");
+            expect(";");
+            return s;
+        }
+        if(w == "return" || w == "break" || w == "continue") {
+            pos_++;
+            s->kind = (w == "return") ? Stmt::RETURN : (w == "break") ? Stmt::BREAK : Stmt::CONTINUE;
+            s->e = until(";");
+            return s;
+        }
+        if(w == "switch" || w == "goto" || w == "case") throw std::runtime_error("unsupported " + w + " at line " + std::to_string(s->line));
+        s->kind = Stmt::EXPR;
+        s->e = until(";");
+        if(!s->e.empty() && s->e[0].s == "SET_STATE") {
+            s->kind = Stmt::MARKER;
+            for(size_t i = 2; i + 1 < s->e.size(); i++) s->state += s->e[i].s;
+            if(s->state.rfind("SUP_STATE_", 0) == 0) s->state = s->state.substr(10);
+            if(func_ == "main") {
+                s->marker = (int)markers.size();
+                markers.push_back(s.get());
+            }
+        }
+        return s;
+    }
+};
+
+// worst case time in ms along one kind of exit, with the delay() lines it was spent in (line 0 is code)
+struct Time {
+    double t = NONE;
+    std::map<int, double> why;
+
+    static Time zero() {
+        Time z;
+        z.t = 0;
+        return z;
+    }
+    bool none() const { return t == NONE; }
+    Time plus(double ms, int line) const {
+        if(none()) return *this;
+        Time r = *this;
+        r.t += ms;
+        if(ms) r.why[line] += ms;
+        return r;
+    }
+    Time plus(const Time& b) const {
+        if(none() || b.none()) return Time();
+        Time r = *this;
+        r.t += b.t;
+        for(const auto& w : b.why) r.why[w.first] += w.second;
+        return r;
+    }
+};
+
+static Time worst(const Time& a, const Time& b) { return (b.t > a.t) ? b : a; }
+
+// how a statement can end: hitting the check, or leaving without it in one of the ways C allows
+struct Res {
+    Time hit, norm, brk, cont, ret;
+
+    static Res pass() {
+        Res r;
+        r.norm = Time::zero();
+        return r;
+    }
+    Res then(const Res& b) const {  // this statement, then b
+        Res r = *this;
+        r.hit = worst(hit, norm.plus(b.hit));
+        r.norm = norm.plus(b.norm);
+        r.brk = worst(brk, norm.plus(b.brk));
+        r.cont = worst(cont, norm.plus(b.cont));
+        r.ret = worst(ret, norm.plus(b.ret));
+        return r;
+    }
+    Res after(const Time& t) const {  // started at t
+        Res r;
+        r.hit = t.plus(hit);
+        r.norm = t.plus(norm);
+        r.brk = t.plus(brk);
+        r.cont = t.plus(cont);
+        r.ret = t.plus(ret);
+        return r;
+    }
+    void merge(const Res& b) {
+        hit = worst(hit, b.hit);
+        norm = worst(norm, b.norm);
+        brk = worst(brk, b.brk);
+        cont = worst(cont, b.cont);
+        ret = worst(ret, b.ret);
+    }
+};
+
+struct Options {
+    std::map<std::string, long> cfg;  // -c overrides
+    std::map<int, long> cycles;       // per source line, from the sdcc listing
+    bool listing = false;
+    long flat_cycles = 32;
+    double cycle_ms = 12.0 / 7372.8;
+    double stretch = 1.0;
+};
+
+class Analyzer {
+public:
+    std::set<std::string> warned;
+
+    Analyzer(const Parser& p, Pre& pre, const Options& o) : p_(p), pre_(pre), o_(o) {}
+
+    // worst time from the start of f (or from right after marker in it) to the first look at check
+    Time run(const std::string& check, const Func& f, int marker) {
+        check_ = check;
+        marker_ = marker;
+        env_.clear();
+        Res r = (marker < 0) ? stmt(*f.body) : from(*f.body);
+        return r.hit;
+    }
+
+private:
+    struct Exit {
+        Time hit, exit;
+    };
+    const Parser& p_;
+    Pre& pre_;
+    const Options& o_;
+    std::string check_;
+    int marker_ = -1;
+    std::vector<std::map<std::string, OptVal>> env_;  // parameter bounds of the calls being analyzed
+    std::map<std::string, Exit> cache_;
+    std::set<std::string> active_;
+
+    void warn(const std::string& msg) {
+        if(warned.insert(msg).second) std::fprintf(stderr, "invwcet: %s\n", msg.c_str());
+    }
+    double code(int line) const {  // one pass over the code of a source line
+        if(!line) return 0;
+        long c = o_.flat_cycles;
+        if(o_.listing) {
+            auto it = o_.cycles.find(line);
+            c = (it == o_.cycles.end()) ? 0 : it->second;
+        }
+        return c * o_.cycle_ms * o_.stretch;
+    }
+    double code(const Toks& t, int line) const {
+        std::set<int> lines{line};
+        for(const Tok& k : t) lines.insert(k.line);
+        double ms = 0;
+        for(int l : lines) ms += code(l);
+        return ms;
+    }
+
+    OptVal value(const Toks& t) {
+        return Expr(t, [this](const Toks& k, size_t& p) -> OptVal {
+            const std::string& s = k[p++].s;
+            if(s == "true") return Val{1, 1};
+            if(s == "false") return Val{0, 0};
+            if(s == "sizeof" && p + 2 < k.size() && k[p].s == "(" && k[p + 2].s == ")") {
+                std::string what = k[p + 1].s;
+                p += 3;
+                auto len = pre_.macros.find("SUP_CFG_LEN");
+                if(what != "cfg_t" || len == pre_.macros.end()) return std::nullopt;
+                return value(len->second.body);
+            }
+            if(s == "cfg" && p + 1 < k.size() && k[p].s == ".") {
+                std::string field = k[p + 1].s;
+                p += 2;
+                auto o = o_.cfg.find(field);
+                if(o != o_.cfg.end()) return Val{o->second, o->second};
+                std::string def = "SUP_DEF_" + field;
+                for(char& c : def) c = std::toupper((unsigned char)c);
+                auto m = pre_.macros.find(def);
+                if(m == pre_.macros.end()) return std::nullopt;
+                return value(m->second.body);
+            }
+            if(!env_.empty()) {
+                auto e = env_.back().find(s);
+                if(e != env_.back().end()) return e->second;
+            }
+            auto m = pre_.macros.find(s);  // left in SUP_DEF_* bodies
+            if(m != pre_.macros.end() && !m->second.func) return value(m->second.body);
+            return std::nullopt;
+        }).eval();
+    }
+    static std::vector<Toks> args(const Toks& t, size_t open, size_t close) {
+        std::vector<Toks> a;
+        if(close == open + 1) return a;
+        a.emplace_back();
+        int depth = 0;
+        for(size_t i = open + 1; i < close; i++) {
+            if(t[i].s == "(") depth++;
+            if(t[i].s == ")") depth--;
+            if(depth == 0 && t[i].s == ",") a.emplace_back();
+            else a.back().push_back(t[i]);
+        }
+        return a;
+    }
+
+    // left to right, a call counting where its arguments are done. Whatever follows &&, || or ? may be
+    // skipped, so a check there does not end the path.
+    Res expr(const Toks& t, double ms) {
+        struct Event {
+            size_t at, start;
+            bool call;
+            size_t close;
+        };
+        std::vector<Event> ev;
+        size_t lazy = t.size();
+        for(size_t i = 0; i < t.size(); i++) {
+            const std::string& s = t[i].s;
+            if((s == "&&" || s == "||" || s == "?") && lazy == t.size()) lazy = i;
+            if(s == check_ || s == "IDL") ev.push_back({i, i, false, 0});
+            else if(t[i].ident() && i + 1 < t.size() && t[i + 1].s == "(" && (s == "delay" || p_.funcs.count(s))) {
+                size_t j = i + 2;
+                for(int depth = 0; j < t.size() && !(depth == 0 && t[j].s == ")"); j++) {
+                    if(t[j].s == "(") depth++;
+                    if(t[j].s == ")") depth--;
+                }
+                ev.push_back({j, i, true, j});
+            }
+        }
+        std::sort(ev.begin(), ev.end(), [](const Event& a, const Event& b) { return a.at < b.at; });
+        Res r;
+        Time now = Time::zero().plus(ms, 0);
+        for(const Event& e : ev) {
+            bool may_skip = e.start > lazy;
+            if(!e.call && t[e.at].s == "IDL") {
+                if(check_ != "PLUG") now = now.plus(IDLE, t[e.at].line);  // until a plug-in, which may never come
+                continue;
+            }
+            if(!e.call) {
+                r.hit = worst(r.hit, now);
+                if(!may_skip) return r;
+                continue;
+            }
+            const std::string& name = t[e.start].s;
+            Exit x;
+            if(name == "delay") {
+                std::vector<Toks> a = args(t, e.start + 1, e.close);
+                OptVal v = (a.size() == 1) ? value(a[0]) : std::nullopt;
+                if(!v) warn("line " + std::to_string(t[e.start].line) + ": delay() of unknown length, taken as unbounded");
+                x.exit = Time::zero().plus((v) ? (double)v->v : UNBOUNDED, t[e.start].line);
+            }
+            else x = call(p_.funcs.at(name), args(t, e.start + 1, e.close));
+            r.hit = worst(r.hit, now.plus(x.hit));
+            if(may_skip) now = worst(now, now.plus(x.exit));
+            else now = now.plus(x.exit);
+            if(now.none()) return r;
+        }
+        r.norm = now;
+        return r;
+    }
+
+    Exit call(const Func& f, const std::vector<Toks>& a) {
+        std::map<std::string, OptVal> bind;
+        std::string key = check_ + ":" + f.name;
+        for(size_t i = 0; i < f.params.size(); i++) {
+            OptVal v = (i < a.size()) ? value(a[i]) : std::nullopt;
+            bind[f.params[i]] = v;
+            key += "," + ((v) ? std::to_string(v->lo) + ".." + std::to_string(v->v) : std::string("?"));
+        }
+        auto c = cache_.find(key);
+        if(c != cache_.end()) return c->second;
+        Exit x;
+        if(active_.count(f.name)) {
+            warn(f.name + "() is recursive, taken as unbounded");
+            x.exit = x.hit = Time::zero().plus(UNBOUNDED, f.line);
+            return x;
+        }
+        active_.insert(f.name);
+        env_.push_back(bind);
+        int saved = marker_;
+        marker_ = -1;
+        Res r = stmt(*f.body).after(Time::zero().plus(code(f.line), 0));
+        marker_ = saved;
+        env_.pop_back();
+        active_.erase(f.name);
+        x.hit = r.hit;
+        x.exit = worst(r.norm, r.ret).plus(code(f.end_line), 0);
+        cache_[key] = x;
+        return x;
+    }
+
+    struct Bound {
+        std::optional<long> max;  // rounds, none when unbounded
+        long min = 0;             // the condition cannot end the loop before
+        bool forever = false;     // no condition at all
+    };
+
+    Bound bound(const Stmt& s) {
+        Bound r;
+        auto c = pre_.comments.find(s.line);
+        static const std::regex bound_re(R"(bound:\s*(\d+))");
+        std::smatch m;
+        r.forever = s.e.empty() || (s.e.size() == 1 && s.e[0].s == "1");
+        if(c != pre_.comments.end() && std::regex_search(c->second, m, bound_re)) {
+            r.max = std::stol(m[1].str());
+            return r;
+        }
+        if(r.forever || s.kind != Stmt::FOR) return r;
+        // for([type] i = a; ... i < b ...; i++ / i += c / i--)
+        size_t eq = 0;
+        while(eq < s.init.size() && s.init[eq].s != "=") eq++;
+        if(eq == 0 || eq >= s.init.size()) return r;
+        std::string var = s.init[eq - 1].s;
+        std::string type = (eq >= 2) ? s.init[eq - 2].s : "";
+        OptVal from = value(Toks(s.init.begin() + eq + 1, s.init.end()));
+        long stride = 0;
+        if(s.step.size() == 2 && (s.step[0].s == var || s.step[1].s == var)) {
+            std::string op = (s.step[0].s == var) ? s.step[1].s : s.step[0].s;
+            stride = (op == "++") ? 1 : (op == "--") ? -1 : 0;
+        }
+        else if(s.step.size() >= 3 && s.step[0].s == var && (s.step[1].s == "+=" || s.step[1].s == "-=")) {
+            OptVal v = value(Toks(s.step.begin() + 2, s.step.end()));
+            if(v && v->exact()) stride = (s.step[1].s == "+=") ? v->v : -v->v;
+        }
+        std::optional<long>& n = r.max;
+        for(size_t i = 0; i + 1 < s.e.size(); i++) {  // the conjunct comparing var
+            if(s.e[i].s != var || (i > 0 && s.e[i - 1].s != "&&" && s.e[i - 1].s != "(")) continue;
+            size_t end = i + 2;
+            while(end < s.e.size() && s.e[end].s != "&&") end++;
+            OptVal to = value(Toks(s.e.begin() + i + 2, s.e.begin() + end));
+            const std::string& op = s.e[i + 1].s;
+            if(!from || !from->exact() || !to || !stride) break;
+            long st = std::labs(stride);
+            bool incl = (op == "<=" || op == ">=");
+            auto rounds = [&](long to) {
+                long span = (stride > 0) ? to - from->v : from->v - to;
+                return std::max(0L, (span + (incl ? st : st - 1)) / st);
+            };
+            if((stride > 0 && (op == "<" || op == "<=")) || (stride < 0 && (op == ">" || op == ">="))) {
+                n = rounds((stride > 0) ? to->v : to->lo);
+                if(end == s.e.size() && i == 0) r.min = rounds((stride > 0) ? to->lo : to->v);  // nothing else in the condition
+            }
+            break;
+        }
+        if(!n && (type == "byte" || type == "word")) {
+            warn("line " + std::to_string(s.line) + ": loop bound taken from the " + type + " counter");
+            n = (type == "byte") ? 0xFF : 0xFFFF;
+        }
+        return r;
+    }
+
+    // iterations of a loop from its next condition check, cur being the time there
+    Res loop(const Stmt& s, Time cur, const Bound& bd, bool cond_first) {
+        const std::optional<long>& n = bd.max;
+        Res c = expr(s.e, code(s.line));
+        Res step = expr(s.step, 0);
+        Res b = stmt(*s.kids[0]);
+        Res out;
+        long limit = (n) ? *n : 3;  // unbounded: a few rounds show which ways out there are
+        for(long k = 0; k <= limit && !cur.none(); k++) {
+            if(k > 0 || cond_first) {
+                out.hit = worst(out.hit, cur.plus(c.hit));
+                if(!bd.forever && k >= bd.min) out.norm = worst(out.norm, cur.plus(c.norm));
+                cur = cur.plus(c.norm);
+            }
+            if(k == limit) break;
+            out.hit = worst(out.hit, cur.plus(b.hit));
+            out.norm = worst(out.norm, cur.plus(b.brk));
+            out.ret = worst(out.ret, cur.plus(b.ret));
+            cur = worst(cur.plus(b.norm), cur.plus(b.cont)).plus(step.norm);
+        }
+        if(n) {
+            if(bd.forever) out.norm = worst(out.norm, cur);  // bound comment on an endless loop
+        }
+        else if(!cur.none()) {  // can still go round, whatever may happen later may take forever
+            if(!bd.forever) warn("line " + std::to_string(s.line) + ": loop without a bound, paths through it are unbounded");
+            Time inf = Time::zero().plus(UNBOUNDED, s.line);
+            if(!c.hit.none() || !b.hit.none()) out.hit = inf;
+            if((!bd.forever && !c.norm.none()) || !b.brk.none()) out.norm = inf;
+            if(!b.ret.none()) out.ret = inf;
+        }
+        return out;
+    }
+
+    bool contains(const Stmt& s) const {
+        if(s.marker >= 0) return s.marker == marker_;
+        for(const auto& k : s.kids) {
+            if(contains(*k)) return true;
+        }
+        return false;
+    }
+
+    Res stmt(const Stmt& s) {
+        switch(s.kind) {
+        case Stmt::EMPTY:
+        case Stmt::MARKER:
+            return Res::pass();
+        case Stmt::EXPR:
+            return expr(s.e, code(s.e, s.line));
+        case Stmt::RETURN: {
+            Res r = expr(s.e, code(s.e, s.line));
+            r.ret = r.norm;
+            r.norm = Time();
+            return r;
+        }
+        case Stmt::BREAK:
+        case Stmt::CONTINUE: {
+            Res r;
+            ((s.kind == Stmt::BREAK) ? r.brk : r.cont) = Time::zero();
+            return r;
+        }
+        case Stmt::BLOCK: {
+            Res r = Res::pass();
+            for(const auto& k : s.kids) r = r.then(stmt(*k));
+            return r;
+        }
+        case Stmt::IF: {
+            Res c = expr(s.e, code(s.line));
+            Res b = stmt(*s.kids[0]);
+            if(s.kids.size() > 1) b.merge(stmt(*s.kids[1]));
+            else b.merge(Res::pass());
+            return c.then(b);
+        }
+        default: {
+            Res init = expr(s.init, 0);
+            Res r = loop(s, init.norm, bound(s), s.kind != Stmt::DO);
+            r.hit = worst(r.hit, init.hit);
+            return r;
+        }
+        }
+    }
+
+    // like stmt(), but starting right after the marker somewhere inside s
+    Res from(const Stmt& s) {
+        switch(s.kind) {
+        case Stmt::MARKER:
+            return Res::pass();
+        case Stmt::BLOCK: {
+            size_t i = 0;
+            while(!contains(*s.kids[i])) i++;
+            Res r = from(*s.kids[i]);
+            for(i++; i < s.kids.size(); i++) r = r.then(stmt(*s.kids[i]));
+            return r;
+        }
+        case Stmt::IF:
+            return from(*s.kids[contains(*s.kids[0]) ? 0 : 1]);
+        default: {  // a loop, finish this round and go on with the rest of the bound
+            Bound bd = bound(s);
+            if(bd.max) *bd.max = std::max(0L, *bd.max - 1);
+            bd.min = 0;  // the round the marker is in is not known
+            Res b = from(*s.kids[0]);
+            Res step = expr(s.step, 0);
+            Res r = loop(s, worst(b.norm, b.cont).plus(step.norm), bd, true);
+            r.hit = worst(r.hit, b.hit);
+            r.norm = worst(r.norm, b.brk);
+            r.ret = worst(r.ret, b.ret);
+            return r;
+        }
+        }
+    }
+};
+
+// machine cycles of every 8051 instruction sdcc put under each "; inverter.c:<line>:" comment. Code the
+// optimizer moved or shared may be counted for a neighbouring line, which only shifts cost between lines.
+static std::map<int, long> load_listing(const std::string& path, const std::string& source) {
+    std::ifstream in(path);
+    if(!in) throw std::runtime_error("cannot open " + path);
+    std::string base = source.substr(source.find_last_of('/') + 1);
+    static const std::regex line_re(R"(^;\s*(\S+):(\d+):)");
+    static const std::regex insn_re(R"(^\s+([a-z]+)\s*([^;]*))");
+    std::map<int, long> cycles;
+    int line = 0;
+    std::string text;
+    while(std::getline(in, text)) {
+        std::smatch m;
+        if(std::regex_search(text, m, line_re)) {
+            std::string f = m[1].str();
+            line = (f.substr(f.find_last_of('/') + 1) == base) ? std::stoi(m[2].str()) : 0;
+            continue;
+        }
+        if(!line || !std::regex_search(text, m, insn_re)) continue;
+        std::string mn = m[1].str();
+        std::vector<std::string> ops;
+        std::stringstream ss(m[2].str());
+        for(std::string op; std::getline(ss, op, ',');) {
+            op.erase(0, op.find_first_not_of(" \t"));
+            op.erase(op.find_last_not_of(" \t") + 1);
+            for(char& c : op) c = std::tolower((unsigned char)c);
+            ops.push_back(op);
+        }
+        auto reg = [](const std::string& o) { return o.size() == 2 && o[0] == 'r' && std::isdigit((unsigned char)o[1]); };
+        auto direct = [&](const std::string& o) {
+            return !(o == "a" || o == "c" || o == "ab" || o == "dptr" || o.empty() || o[0] == '#' || o[0] == '@' || reg(o));
+        };
+        static const std::set<std::string> two = {"ajmp", "ljmp", "sjmp", "jmp", "acall", "lcall", "ret", "reti",
+                                                  "jc", "jnc", "jb", "jnb", "jbc", "jz", "jnz", "cjne", "djnz",
+                                                  "movc", "movx", "push", "pop"};
+        long c = 1;
+        if(mn == "mul" || mn == "div") c = 4;
+        else if(two.count(mn)) c = 2;
+        else if(mn == "inc" && !ops.empty() && ops[0] == "dptr") c = 2;
+        else if(mn == "mov" && ops.size() == 2) {
+            if(ops[0] == "dptr" || (direct(ops[0]) && ops[1] != "a") || ((reg(ops[0]) || ops[0][0] == '@') && direct(ops[1]))) c = 2;
+        }
+        else if((mn == "anl" || mn == "orl" || mn == "xrl") && ops.size() == 2) {
+            if(ops[0] == "c" || (direct(ops[0]) && ops[1][0] == '#')) c = 2;
+        }
+        cycles[line] += c;
+    }
+    return cycles;
+}
+
+static std::string ms(double t) {
+    if(t == UNBOUNDED) return "unbounded";
+    if(t >= IDLE) return "idle";
+    if(t == NONE) return "never";
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.1f", t);
+    return buf;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        std::fprintf(stderr, "usage: invwcet <inverter.c> [-D NAME[=value]]... [-a inverter.asm] [-c field=value]... "
+                             "[-b PLUG budget ms] [-g P_GOOD budget ms] [-l cycles per line] [-f MHz] [-i load %%] [-v]\n");
+        return 2;
+    }
+    std::string source = argv[1], listing;
+    Options o;
+    double plug_budget = UNBOUNDED, pgood_budget = UNBOUNDED, mhz = 7.3728, load = -1;  // no budget by default
+    bool verbose = false;
+    Pre pre;
+    try {
+        for(int i = 2; i < argc; i++) {
+            std::string a = argv[i];
+            auto arg = [&]() -> std::string {
+                if(a.size() > 2) return a.substr(2);
+                if(i + 1 >= argc) throw std::runtime_error(a + " needs a value");
+                return argv[++i];
+            };
+            if(a.rfind("-D", 0) == 0) {
+                std::string d = arg();
+                size_t eq = d.find('=');
+                if(eq == std::string::npos) pre.define(d, "1");
+                else pre.define(d.substr(0, eq), d.substr(eq + 1));
+            }
+            else if(a.rfind("-c", 0) == 0) {
+                std::string c = arg();
+                size_t eq = c.find('=');
+                if(eq == std::string::npos) throw std::runtime_error("-c needs field=value");
+                o.cfg[c.substr(0, eq)] = std::stol(c.substr(eq + 1), nullptr, 0);
+            }
+            else if(a.rfind("-a", 0) == 0) listing = arg();
+            else if(a.rfind("-b", 0) == 0) plug_budget = std::stod(arg());
+            else if(a.rfind("-g", 0) == 0) pgood_budget = std::stod(arg());
+            else if(a.rfind("-l", 0) == 0) o.flat_cycles = std::stol(arg());
+            else if(a.rfind("-f", 0) == 0) mhz = std::stod(arg());
+            else if(a.rfind("-i", 0) == 0) load = std::stod(arg());
+            else if(a == "-v") verbose = true;
+            else throw std::runtime_error("unknown option " + a);
+        }
+        pre.file(source, true);
+        if(!listing.empty()) {
+            o.cycles = load_listing(listing, source);
+            o.listing = true;
+        }
+        Toks tick;
+        lex("USE_TICK", 0, tick);
+        if(load < 0) load = pre.cond(tick) ? 12.5 : 0;  // a guess at the Timer0 interrupt's share, delay() is timed by Timer0 itself
+        o.cycle_ms = 12.0 / (mhz * 1000);
+        o.stretch = 100 / (100 - std::min(load, 99.0));
+
+        Parser p(pre.out);
+        auto main_fn = p.funcs.find("main");
+        if(main_fn == p.funcs.end()) throw std::runtime_error("no main() in " + source);
+        std::vector<std::pair<int, std::string>> where;  // function of each source line, for the reasons
+        for(const auto& f : p.funcs) where.push_back({f.second.line, f.first});
+        std::sort(where.begin(), where.end());
+        auto func_of = [&](int line) {
+            std::string name;
+            for(const auto& w : where) {
+                if(w.first <= line) name = w.second;
+            }
+            return name;
+        };
+
+        Analyzer an(p, pre, o);
+        auto budget = [](double b) { return (b == UNBOUNDED) ? std::string("none") : ms(b) + " ms"; };
+        std::printf("worst case from state entry to the next look at PLUG / P_GOOD, budget %s / %s\n",
+                    budget(plug_budget).c_str(), budget(pgood_budget).c_str());
+        std::printf("code time %s, %.4g MHz, interrupt load %.1f%%\n",
+                    (o.listing) ? ("cycles from " + listing).c_str() : (std::to_string(o.flat_cycles) + " cycles per line").c_str(), mhz, load);
+        std::printf("\n%-15s %5s %12s %12s\n", "state", "line", "PLUG ms", "P_GOOD ms");
+        bool over = false;
+        for(int m = -1; m < (int)p.markers.size(); m++) {
+            std::string name = (m < 0) ? "BOOT" : p.markers[m]->state;
+            int line = (m < 0) ? main_fn->second.line : p.markers[m]->line;
+            Time plug = an.run("PLUG", main_fn->second, m);
+            Time pgood = an.run("P_GOOD", main_fn->second, m);
+            bool plug_over = (plug.t > plug_budget && plug.t < IDLE) || plug.t == UNBOUNDED;  // idle: the output is off
+            bool pgood_over = (pgood.t > pgood_budget && pgood.t < IDLE) || pgood.t == UNBOUNDED;
+            over |= plug_over || pgood_over;
+            std::printf("%-15s %5d %11s%s %11s%s\n", name.c_str(), line, ms(plug.t).c_str(), (plug_over) ? "!" : " ",
+                        ms(pgood.t).c_str(), (pgood_over) ? "!" : " ");
+            for(const Time* t : {&plug, &pgood}) {
+                if(!verbose && !(t == &plug ? plug_over : pgood_over)) continue;
+                std::vector<std::pair<double, int>> why;
+                for(const auto& w : t->why) why.push_back({w.second, w.first});
+                std::sort(why.rbegin(), why.rend());
+                for(size_t k = 0; k < why.size() && k < 4; k++) {
+                    std::string at = (why[k].second) ? std::to_string(why[k].second) + " " + func_of(why[k].second) + "()" : "code";
+                    std::printf("    %-6s %10s ms  %s\n", (k == 0) ? (t == &plug ? "PLUG" : "P_GOOD") : "", ms(why[k].first).c_str(), at.c_str());
+                }
+            }
+        }
+        if(over) std::printf("\n! unbounded or over budget\n");
+        return (over) ? 1 : 0;
+    }
+    catch(const std::exception& e) {
+        std::fprintf(stderr, "invwcet: %s\n", e.what());
+        return 2;
+    }
+}
+
+// g++ -std=c++17 -O2 -o invwcet invwcet.cpp
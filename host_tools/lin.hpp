@@ -0,0 +1,108 @@
+/*
+    Host side of the LIN core, see software/lin.h for the frame layout. Header-only, shared by the simulator,
+    linscan, linexplore and the supervisory protocol (same checksum). The static_asserts at the end go through
+    all 64 IDs and every byte value against the definitions in the LIN spec, so any tool that includes this
+    has checked the macros the firmware is built with.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include "../software/lin.h"
+}
+
+namespace lin {
+
+constexpr double BIT_S = 1.0 / LIN_BAUD;
+constexpr double BYTE_S = 10 * BIT_S;  // start, 8 data, stop
+
+constexpr uint8_t pid(uint8_t id) { return uint8_t(LIN_PID(id)); }
+constexpr bool parity_ok(uint8_t pid) { return LIN_PID(pid) == pid; }
+constexpr bool classic(uint8_t id) { return LIN_CLASSIC(id); }
+
+constexpr std::array<uint8_t, 64> make_pids() {
+    std::array<uint8_t, 64> t{};
+    for(unsigned id = 0; id < 64; id++) t[id] = pid(uint8_t(id));
+    return t;
+}
+constexpr std::array<uint8_t, 64> pids = make_pids();  // protected ID of every ID
+
+constexpr uint8_t add(uint8_t sum, uint8_t b) { return uint8_t(LIN_ADD(sum, b)); }
+
+// seed = PID for enhanced, 0 for classic, for when the kind is what's being found out (linexplore)
+constexpr uint8_t sum(uint8_t seed, const uint8_t* data, size_t len) {
+    uint8_t s = seed;
+    for(size_t i = 0; i < len; i++) s = add(s, data[i]);
+    return uint8_t(~s);
+}
+constexpr uint8_t checksum(uint8_t pid, const uint8_t* data, size_t len) {  // the one the ID calls for
+    return sum(classic(pid) ? 0 : pid, data, len);
+}
+
+inline std::vector<uint8_t> encode(uint8_t id, const std::vector<uint8_t>& data) {  // PID, data, checksum
+    std::vector<uint8_t> frame(data.size() + 2);
+    frame.resize(lin_encode(id, data.data(), uint8_t(data.size()), frame.data()));
+    return frame;
+}
+inline int decode(const uint8_t* frame, size_t len) {  // LIN_OK or LIN_ERR_*
+    return len > LIN_FRAME_MAX ? LIN_ERR_FRAMING : lin_decode(frame, uint8_t(len));
+}
+inline int decode(const std::vector<uint8_t>& frame) { return decode(frame.data(), frame.size()); }
+
+namespace check {  // the spec, written out the long way
+
+constexpr unsigned bit(unsigned v, int n) { return (v >> n) & 1; }
+constexpr unsigned spec_pid(unsigned id) {
+    unsigned p0 = bit(id, 0) ^ bit(id, 1) ^ bit(id, 2) ^ bit(id, 4);
+    unsigned p1 = 1 - (bit(id, 1) ^ bit(id, 3) ^ bit(id, 4) ^ bit(id, 5));
+    return id + 64 * p0 + 128 * p1;
+}
+constexpr unsigned spec_fold(unsigned total) { return total ? (total - 1) % 255 + 1 : 0; }  // carry wrap-around
+
+constexpr bool pids_match() {
+    for(unsigned id = 0; id < 64; id++) {
+        if(pids[id] != spec_pid(id) || !parity_ok(pids[id])) return false;
+    }
+    return true;
+}
+constexpr bool parity_exact() {  // exactly one valid PID per ID, every other byte rejected
+    unsigned valid = 0;
+    for(unsigned v = 0; v < 256; v++) {
+        if(parity_ok(uint8_t(v)) != (v == spec_pid(v & 0x3F))) return false;
+        valid += parity_ok(uint8_t(v));
+    }
+    return valid == 64;
+}
+constexpr bool add_exact() {  // every step from every sum, so any frame length is covered
+    for(unsigned s = 0; s < 256; s++) {
+        for(unsigned b = 0; b < 256; b++) {
+            if(add(uint8_t(s), uint8_t(b)) != spec_fold(s + b)) return false;
+        }
+    }
+    return true;
+}
+constexpr bool checksums_match() {  // a full 8 byte frame of each ID, against the plain sum
+    for(unsigned id = 0; id < 64; id++) {
+        uint8_t data[LIN_MAX_DATA] = {};
+        unsigned total = LIN_CLASSIC(id) ? 0 : pids[id];
+        for(unsigned i = 0; i < LIN_MAX_DATA; i++) total += data[i] = uint8_t(0xF9 - 37 * i - id);
+        if(checksum(pids[id], data, LIN_MAX_DATA) != uint8_t(~spec_fold(total))) return false;
+    }
+    return true;
+}
+
+static_assert(pids_match(), "LIN_PID differs from the spec");
+static_assert(parity_exact(), "LIN_PID parity check is not exact");
+static_assert(add_exact(), "LIN_ADD differs from an 8-bit sum with carry wrap-around");
+static_assert(checksums_match(), "LIN checksum differs from the spec");
+static_assert(pids[LIN_ID_COMMAND] == 0xBA && pids[LIN_ID_STATUS] == 0xFB && pids[LIN_ID_MASTER_REQ] == 0x3C,
+              "protected IDs of the controller frames");
+
+}  // namespace check
+
+}  // namespace lin
@@ -0,0 +1,362 @@
+/*
+    Correlation analyzer for the 0x3B status response. The firmware only uses byte 0 (power, 5W * x), the
+    two low bits of byte 1 (running, power good) and the 0xFF marker in byte 3; the controller sends up to
+    9 bytes. Given a log of responses and a log of bench measurements taken at the same time, this tool
+    correlates every byte, byte pair and bit with every measured signal and prints a candidate field map.
+
+    lincorr [-g max_gap_ms] [-r min_r] frames.csv bench.csv
+
+    frames.csv: one response per line, "<t_ms>,<hex bytes>", e.g. "1200,1E 03 41 FF 7A". Checksum may be
+                included, it is just another byte that correlates with nothing.
+    bench.csv:  header "t_ms,<signal>,<signal>..." (e.g. t_ms,vbat,iout,temp) followed by samples. Both
+                logs use the same clock, signals are interpolated linearly to each frame time and frames
+                with no bench sample within max_gap_ms (default 2000) on both sides are skipped.
+    Lines starting with # are ignored.
+
+    Candidates are linear fits, signal = scale * field + offset. Pearson r catches linear fields, Spearman
+    rho catches monotonic ones (thermistor readings, log scales); the better of the two ranks a candidate
+    and anything below min_r (default 0.9) is left out of the map. Run the bench through the whole range of
+    each signal, a field that stays put while a signal sweeps can not be found.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static constexpr int MAX_BYTES = 9;
+
+struct Frame {
+    double t;
+    std::vector<int> bytes;
+};
+
+struct Bench {
+    std::vector<std::string> names;
+    std::vector<double> t;
+    std::vector<std::vector<double>> values;  // [sample][signal]
+};
+
+struct Feature {  // a way of reading part of the response as a number
+    std::string name;
+    int byte, width;  // bytes used, width 2 = 16-bit
+    int bit;          // -1 for whole bytes
+    bool big_endian, is_signed;
+
+    bool present(const Frame& f) const { return int(f.bytes.size()) >= byte + width; }
+    double value(const Frame& f) const {
+        if(bit >= 0) return (f.bytes[byte] >> bit) & 1;
+        if(width == 2) {
+            int v = big_endian ? (f.bytes[byte] << 8) | f.bytes[byte + 1] : f.bytes[byte] | (f.bytes[byte + 1] << 8);
+            return is_signed ? int16_t(v) : v;
+        }
+        return is_signed ? int8_t(f.bytes[byte]) : f.bytes[byte];
+    }
+};
+
+struct Candidate {
+    const Feature* feature;
+    int signal;
+    size_t n;
+    double r, rho, scale, offset;
+    double score() const { return std::max(std::fabs(r), std::fabs(rho)); }
+};
+
+static bool skip_line(const char* line) {
+    while(*line == ' ' || *line == '\t') line++;
+    return *line == '#' || *line == '\n' || *line == '\r' || *line == 0;
+}
+
+static std::vector<Frame> read_frames(const char* path) {
+    FILE* f = fopen(path, "r");
+    if(!f) {
+        perror(path);
+        exit(1);
+    }
+    std::vector<Frame> frames;
+    char line[256];
+    for(unsigned n = 1; fgets(line, sizeof(line), f); n++) {
+        if(skip_line(line)) continue;
+        Frame fr;
+        char* p = line;
+        fr.t = strtod(p, &p);
+        if(*p != ',') {
+            fprintf(stderr, "%s:%u: expected <t_ms>,<hex bytes>\n", path, n);
+            exit(1);
+        }
+        p++;
+        for(;;) {
+            char* end;
+            long b = strtol(p, &end, 16);
+            if(end == p) break;
+            if(b < 0 || b > 0xFF || fr.bytes.size() == MAX_BYTES) {
+                fprintf(stderr, "%s:%u: bad byte\n", path, n);
+                exit(1);
+            }
+            fr.bytes.push_back(int(b));
+            p = end;
+        }
+        frames.push_back(std::move(fr));
+    }
+    fclose(f);
+    std::stable_sort(frames.begin(), frames.end(), [](const Frame& a, const Frame& b) { return a.t < b.t; });
+    return frames;
+}
+
+static Bench read_bench(const char* path) {
+    FILE* f = fopen(path, "r");
+    if(!f) {
+        perror(path);
+        exit(1);
+    }
+    Bench b;
+    char line[1024];
+    for(unsigned n = 1; fgets(line, sizeof(line), f); n++) {
+        if(skip_line(line)) continue;
+        line[strcspn(line, "\r\n")] = 0;
+        std::vector<std::string> cols;
+        for(char* tok = strtok(line, ","); tok; tok = strtok(nullptr, ",")) cols.push_back(tok);
+        if(b.names.empty()) {  // header
+            if(cols.size() < 2) {
+                fprintf(stderr, "%s:%u: header needs t_ms and at least one signal\n", path, n);
+                exit(1);
+            }
+            b.names.assign(cols.begin() + 1, cols.end());
+            continue;
+        }
+        if(cols.size() != b.names.size() + 1) {
+            fprintf(stderr, "%s:%u: expected %zu columns\n", path, n, b.names.size() + 1);
+            exit(1);
+        }
+        b.t.push_back(atof(cols[0].c_str()));
+        std::vector<double> v;
+        for(size_t i = 1; i < cols.size(); i++) v.push_back(atof(cols[i].c_str()));
+        b.values.push_back(std::move(v));
+    }
+    fclose(f);
+    for(size_t i = 1; i < b.t.size(); i++) {
+        if(b.t[i] < b.t[i - 1]) {
+            fprintf(stderr, "%s: samples must be in time order\n", path);
+            exit(1);
+        }
+    }
+    return b;
+}
+
+static bool interpolate(const Bench& b, double t, double max_gap, std::vector<double>& out) {
+    auto it = std::lower_bound(b.t.begin(), b.t.end(), t);
+    if(it == b.t.end()) return false;
+    size_t hi = size_t(it - b.t.begin());
+    if(*it == t) {
+        out = b.values[hi];
+        return true;
+    }
+    if(hi == 0 || t - b.t[hi - 1] > max_gap || b.t[hi] - t > max_gap) return false;
+    double a = (t - b.t[hi - 1]) / (b.t[hi] - b.t[hi - 1]);
+    out.resize(b.names.size());
+    for(size_t s = 0; s < out.size(); s++) out[s] = b.values[hi - 1][s] + a * (b.values[hi][s] - b.values[hi - 1][s]);
+    return true;
+}
+
+static double pearson(const std::vector<double>& x, const std::vector<double>& y, double* scale, double* offset) {
+    double n = double(x.size()), mx = 0, my = 0;
+    for(size_t i = 0; i < x.size(); i++) {
+        mx += x[i];
+        my += y[i];
+    }
+    mx /= n;
+    my /= n;
+    double sxy = 0, sxx = 0, syy = 0;
+    for(size_t i = 0; i < x.size(); i++) {
+        sxy += (x[i] - mx) * (y[i] - my);
+        sxx += (x[i] - mx) * (x[i] - mx);
+        syy += (y[i] - my) * (y[i] - my);
+    }
+    if(sxx == 0 || syy == 0) return 0;  // constant field or signal, nothing to say
+    if(scale) {
+        *scale = sxy / sxx;
+        *offset = my - *scale * mx;
+    }
+    return sxy / std::sqrt(sxx * syy);
+}
+
+static std::vector<double> ranks(const std::vector<double>& v) {  // average ranks for ties
+    std::vector<size_t> idx(v.size());
+    for(size_t i = 0; i < idx.size(); i++) idx[i] = i;
+    std::sort(idx.begin(), idx.end(), [&](size_t a, size_t b) { return v[a] < v[b]; });
+    std::vector<double> r(v.size());
+    for(size_t i = 0; i < idx.size();) {
+        size_t j = i;
+        while(j < idx.size() && v[idx[j]] == v[idx[i]]) j++;
+        for(size_t k = i; k < j; k++) r[idx[k]] = (i + j - 1) / 2.0;
+        i = j;
+    }
+    return r;
+}
+
+static std::vector<Feature> features() {
+    std::vector<Feature> fs;
+    char name[32];
+    for(int b = 0; b < MAX_BYTES; b++) {
+        snprintf(name, sizeof(name), "byte%d", b);
+        fs.push_back({name, b, 1, -1, false, false});
+        snprintf(name, sizeof(name), "byte%d s8", b);
+        fs.push_back({name, b, 1, -1, false, true});
+        if(b + 1 < MAX_BYTES) {
+            snprintf(name, sizeof(name), "byte%d-%d le", b, b + 1);
+            fs.push_back({name, b, 2, -1, false, false});
+            snprintf(name, sizeof(name), "byte%d-%d be", b, b + 1);
+            fs.push_back({name, b, 2, -1, true, false});
+        }
+        for(int bit = 0; bit < 8; bit++) {
+            snprintf(name, sizeof(name), "byte%d.%d", b, bit);
+            fs.push_back({name, b, 1, bit, false, false});
+        }
+    }
+    return fs;
+}
+
+static const char* known_field(const Feature& f) {  // what the firmware already knows
+    if(f.bit < 0 && f.width == 1 && !f.is_signed && f.byte == 0) return "power, 5W * x";
+    if(f.bit == 0 && f.byte == 1) return "running";
+    if(f.bit == 1 && f.byte == 1) return "power good";
+    return nullptr;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: lincorr [-g max_gap_ms] [-r min_r] frames.csv bench.csv\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    double max_gap = 2000, min_r = 0.9;
+    const char* paths[2] = {nullptr, nullptr};
+    int npaths = 0;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-g") == 0 && i + 1 < argc) max_gap = atof(argv[++i]);
+        else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) min_r = atof(argv[++i]);
+        else if(argv[i][0] != '-' && npaths < 2) paths[npaths++] = argv[i];
+        else return usage();
+    }
+    if(npaths != 2) return usage();
+
+    std::vector<Frame> frames = read_frames(paths[0]);
+    Bench bench = read_bench(paths[1]);
+    std::vector<const Frame*> used;
+    std::vector<std::vector<double>> sig;  // [signal][frame]
+    sig.resize(bench.names.size());
+    std::vector<double> v;
+    for(const Frame& f : frames) {
+        if(!interpolate(bench, f.t, max_gap, v)) continue;
+        used.push_back(&f);
+        for(size_t s = 0; s < v.size(); s++) sig[s].push_back(v[s]);
+    }
+    printf("%zu of %zu frames matched to bench samples\n", used.size(), frames.size());
+    if(used.size() < 10) {
+        fprintf(stderr, "not enough overlapping data\n");
+        return 1;
+    }
+
+    // byte overview: how many frames carry it and whether it ever changes
+    printf("\nbyte  frames   min   max  distinct\n");
+    bool constant[MAX_BYTES], high[MAX_BYTES];  // high: reaches 0x80, so signed and unsigned readings differ
+    for(int b = 0; b < MAX_BYTES; b++) {
+        int lo = 0x100, hi = -1;
+        size_t n = 0;
+        bool seen[256] = {};
+        unsigned distinct = 0;
+        for(const Frame* f : used) {
+            if(int(f->bytes.size()) <= b) continue;
+            int x = f->bytes[b];
+            n++;
+            lo = std::min(lo, x);
+            hi = std::max(hi, x);
+            if(!seen[x]) distinct++;
+            seen[x] = true;
+        }
+        constant[b] = (lo >= hi);
+        high[b] = (hi >= 0x80);
+        if(!n) continue;
+        printf("%4d %7zu  0x%02X  0x%02X  %8u%s\n", b, n, lo, hi, distinct, (lo == hi) ? "  constant" : "");
+    }
+
+    std::vector<Feature> fs = features();
+    std::vector<Candidate> cands;
+    for(const Feature& fe : fs) {
+        if(constant[fe.byte] || (fe.width == 2 && constant[fe.byte + 1])) continue;  // pairs reduce to one byte
+        if(fe.is_signed && !high[fe.byte]) continue;  // same as unsigned
+        std::vector<size_t> rows;
+        std::vector<double> x;
+        for(size_t i = 0; i < used.size(); i++) {
+            if(!fe.present(*used[i])) continue;
+            rows.push_back(i);
+            x.push_back(fe.value(*used[i]));
+        }
+        if(rows.size() < 10) continue;
+        std::vector<double> rx = ranks(x);
+        for(size_t s = 0; s < sig.size(); s++) {
+            std::vector<double> y;
+            for(size_t i : rows) y.push_back(sig[s][i]);
+            Candidate c{&fe, int(s), rows.size(), 0, 0, 0, 0};
+            c.r = pearson(x, y, &c.scale, &c.offset);
+            c.rho = pearson(rx, ranks(y), nullptr, nullptr);
+            cands.push_back(c);
+        }
+    }
+    std::sort(cands.begin(), cands.end(), [](const Candidate& a, const Candidate& b) { return a.score() > b.score(); });
+
+    printf("\nbest matches per signal\n");
+    for(size_t s = 0; s < sig.size(); s++) {
+        printf("%s:\n", bench.names[s].c_str());
+        int shown = 0;
+        for(const Candidate& c : cands) {
+            if(c.signal != int(s) || shown == 5) continue;
+            printf("    %-14s r %+6.3f  rho %+6.3f  n %zu\n", c.feature->name.c_str(), c.r, c.rho, c.n);
+            shown++;
+        }
+    }
+
+    // field map: greedy, best candidates first, each byte explains one signal (a signal may show up twice,
+    // e.g. heat sink temperature as degrees and as a raw thermistor reading)
+    printf("\ncandidate field map (|r| or |rho| >= %.2f)\n", min_r);
+    std::vector<bool> byte_used(MAX_BYTES), signal_used(sig.size());
+    auto single_score = [&](int byte, int signal) {
+        double best = 0;
+        for(const Candidate& c : cands) {
+            if(c.signal == signal && c.feature->byte == byte && c.feature->width == 1 && c.feature->bit < 0)
+                best = std::max(best, c.score());
+        }
+        return best;
+    };
+    for(const Candidate& c : cands) {
+        const Feature& fe = *c.feature;
+        if(c.score() < min_r) break;
+        if(fe.width == 2 && c.score() < 0.01 + std::max(single_score(fe.byte, c.signal), single_score(fe.byte + 1, c.signal)))
+            continue;  // a 16-bit field has to explain clearly more than either of its bytes
+        bool clash = false;
+        for(int b = fe.byte; b < fe.byte + fe.width; b++) clash |= byte_used[b];
+        if(clash && fe.bit < 0) continue;
+        if(fe.bit >= 0 && byte_used[fe.byte]) continue;
+        signal_used[c.signal] = true;
+        for(int b = fe.byte; b < fe.byte + fe.width; b++) byte_used[b] = true;
+        const char* known = known_field(fe);
+        if(fe.bit >= 0) {
+            printf("  %-14s %-8s bit follows the signal (r %+.3f)%s%s\n", fe.name.c_str(), bench.names[c.signal].c_str(),
+                   c.r, known ? ", known: " : "", known ? known : "");
+        }
+        else {
+            printf("  %-14s %-8s = %.4g * x %c %.4g  (r %+.3f, rho %+.3f)%s%s\n", fe.name.c_str(),
+                   bench.names[c.signal].c_str(), c.scale, (c.offset < 0) ? '-' : '+', std::fabs(c.offset), c.r, c.rho,
+                   known ? ", known: " : "", known ? known : "");
+        }
+    }
+    for(size_t s = 0; s < sig.size(); s++) {
+        if(!signal_used[s]) printf("  %-14s %-8s no field found\n", "-", bench.names[s].c_str());
+    }
+    return 0;
+}
+
+// g++ -std=c++17 -O2 -o lincorr lincorr.cpp
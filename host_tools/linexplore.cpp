@@ -0,0 +1,352 @@
+/*
+    LIN command-space explorer for the Audi inverter controller. Talks to the controller directly through a
+    USB-serial adapter with a LIN transceiver (auxiliary board disconnected or held in reset), acting as
+    the master the same way the firmware does: break as a 0x00 byte at half baud rate, sync, protected ID,
+    enhanced checksum.
+
+    linexplore <port> ids [-D] [-o log.csv]
+        sends a header for every frame ID and lists the ones a slave answers, with length and checksum
+        type. Diagnostic IDs 0x3C/0x3D are skipped unless -D is given.
+    linexplore <port> cmd [-0 lo-hi] [-1 lo-hi] [-n len] [-s settle_ms] [-i probe_ms] [-o log.csv]
+        sweeps the 0x3A payload (byte 0 over -0, default 0x00-0xFF, byte 1 over -1, default 0x00, other
+        bytes 0x00, -n data bytes, default 2), polls 0x3B for settle_ms (default 1500) after each command
+        and prints a behaviour table: payloads grouped by how the status response reacted, compared with
+        the stopped baseline.
+
+    Safety: nothing may be plugged into the inverter output, some payloads start it. After every probe the
+    controller is stopped with {0x00, 0x00} and the sweep aborts if it does not stop. Commands are at
+    least probe_ms apart (default 1000), frames at least 20 ms. Ctrl-C stops the controller before exit.
+    Every 0x3B response goes to -o in the lincorr frames format, so a bench log taken along can be
+    correlated afterwards.
+*/
+
+#include "lin.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static volatile sig_atomic_t interrupted = 0;
+
+struct Reply {
+    std::vector<uint8_t> data;  // without checksum
+    bool enhanced = false, classic = false;  // which checksum matched
+};
+
+static Reply split_reply(uint8_t pid, const std::vector<uint8_t>& raw) {
+    Reply r;
+    if(raw.size() < 2) {
+        r.data = raw;
+        return r;
+    }
+    r.data.assign(raw.begin(), raw.end() - 1);
+    r.enhanced = lin::sum(pid, r.data.data(), r.data.size()) == raw.back();
+    r.classic = lin::sum(0, r.data.data(), r.data.size()) == raw.back();
+    return r;
+}
+
+class LinMaster {
+public:
+    explicit LinMaster(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_NOCTTY);
+        if(fd_ < 0) throw std::runtime_error("can't open " + path);
+        if(tcgetattr(fd_, &tio_) == 0) {
+            cfmakeraw(&tio_);
+            tio_.c_cflag |= CLOCAL | CREAD;
+            tio_.c_cc[VMIN] = 0;
+            tio_.c_cc[VTIME] = 0;
+            speed(B19200);
+        }
+    }
+    ~LinMaster() { ::close(fd_); }
+    LinMaster(const LinMaster&) = delete;
+    LinMaster& operator=(const LinMaster&) = delete;
+
+    FILE* log = nullptr;  // 0x3B responses, lincorr frames format
+
+    std::vector<uint8_t> request(uint8_t id, int timeout_ms = 30) {  // header only, returns what the slave sent
+        header(id);
+        std::vector<uint8_t> raw = receive(timeout_ms);
+        if(log && (id & 0x3F) == LIN_ID_STATUS && !raw.empty()) {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_).count();
+            fprintf(log, "%lld,", (long long)ms);
+            for(size_t i = 0; i < raw.size(); i++) fprintf(log, "%s%02X", i ? " " : "", raw[i]);
+            fprintf(log, "\n");
+        }
+        return raw;
+    }
+
+    void command(uint8_t id, const std::vector<uint8_t>& data) {  // master frame with enhanced checksum
+        uint8_t pid = header(id);
+        std::vector<uint8_t> out = data;
+        out.push_back(lin::sum(pid, data.data(), data.size()));
+        send(out);
+        receive(5);  // swallow the echo
+    }
+
+private:
+    uint8_t header(uint8_t id) {
+        pace();
+        tcflush(fd_, TCIFLUSH);
+        speed(B9600);  // 0x00 at half baud rate is 18 bit times low, long enough for a break
+        send({0x00});
+        tcdrain(fd_);
+        speed(B19200);
+        uint8_t pid = lin::pid(id);
+        send({LIN_SYNC, pid});
+        return pid;
+    }
+
+    void pace() {  // frames at least 20 ms apart
+        auto next = last_ + std::chrono::milliseconds(20);
+        if(Clock::now() < next) std::this_thread::sleep_until(next);
+        last_ = Clock::now();
+    }
+
+    void speed(speed_t s) {
+        cfsetispeed(&tio_, s);
+        cfsetospeed(&tio_, s);
+        tcsetattr(fd_, TCSADRAIN, &tio_);
+    }
+
+    void send(const std::vector<uint8_t>& bytes) {
+        if(write(fd_, bytes.data(), bytes.size()) != ssize_t(bytes.size())) throw std::runtime_error("write failed");
+        echo_.insert(echo_.end(), bytes.begin(), bytes.end());
+    }
+
+    std::vector<uint8_t> receive(int timeout_ms) {  // until the line stays quiet, own echo removed
+        std::vector<uint8_t> in;
+        auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+        for(;;) {
+            int left = int(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count());
+            pollfd pfd{fd_, POLLIN, 0};
+            if(left <= 0 || poll(&pfd, 1, left) <= 0) break;
+            uint8_t buf[32];
+            ssize_t n = read(fd_, buf, sizeof(buf));
+            if(n <= 0) break;
+            in.insert(in.end(), buf, buf + n);
+            deadline = Clock::now() + std::chrono::milliseconds(5);  // slave bytes follow each other closely
+        }
+        // a transceiver reads back what we sent, the break may show up as 0x00 or not at all
+        size_t skip = 0;
+        if(!echo_.empty() && echo_[0] == 0x00 && !in.empty() && in[0] != 0x00) echo_.erase(echo_.begin());
+        while(skip < in.size() && skip < echo_.size() && in[skip] == echo_[skip]) skip++;
+        if(skip < echo_.size() && skip != 0) skip = 0;  // partial match, rather keep everything
+        echo_.clear();
+        in.erase(in.begin(), in.begin() + std::ptrdiff_t(skip));
+        return in;
+    }
+
+    int fd_;
+    termios tio_{};
+    std::vector<uint8_t> echo_;
+    Clock::time_point last_ = Clock::now();
+    Clock::time_point start_ = Clock::now();
+};
+
+struct Status {
+    bool valid = false;
+    Reply reply;
+    bool running() const { return valid && (reply.data[1] & 0x01); }
+    bool pgood() const { return valid && (reply.data[1] & 0x02); }
+};
+
+static Status read_status(LinMaster& lin) {  // same validity rule as the firmware: 4+ bytes, byte 3 = 0xFF
+    Status s;
+    s.reply = split_reply(lin::pid(LIN_ID_STATUS), lin.request(LIN_ID_STATUS));
+    s.valid = s.reply.data.size() >= 4 && s.reply.data[3] == 0xFF;
+    return s;
+}
+
+static bool stop(LinMaster& lin) {  // stopped controller, or false after 3 s of trying
+    auto deadline = Clock::now() + std::chrono::seconds(3);
+    for(int tries = 0; Clock::now() < deadline; tries++) {
+        if(tries % 5 == 0) lin.command(LIN_ID_COMMAND, {0x00, 0x00});
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        Status s = read_status(lin);
+        if(s.valid && !s.running()) return true;
+    }
+    return false;
+}
+
+static std::string hex(const std::vector<uint8_t>& v) {
+    std::string s;
+    char b[4];
+    for(size_t i = 0; i < v.size(); i++) {
+        snprintf(b, sizeof(b), "%s%02X", i ? " " : "", v[i]);
+        s += b;
+    }
+    return s;
+}
+
+static int sweep_ids(LinMaster& lin, bool diagnostic) {
+    printf("id    pid  len  checksum  data\n");
+    for(int id = 0; id < 0x40 && !interrupted; id++) {
+        if(!diagnostic && (id == 0x3C || id == 0x3D)) continue;
+        if(id == LIN_ID_COMMAND) continue;  // master command frame, a header alone would leave it waiting
+        uint8_t pid = lin::pid(uint8_t(id));
+        Reply r = split_reply(pid, lin.request(uint8_t(id)));
+        if(r.data.empty()) continue;
+        printf("0x%02X  %02X  %3zu  %-8s  %s\n", id, pid, r.data.size(),
+               r.enhanced ? "enhanced" : r.classic ? "classic" : "bad", hex(r.data).c_str());
+    }
+    return 0;
+}
+
+static bool parse_range(const char* s, int& lo, int& hi) {
+    char* end;
+    lo = int(strtol(s, &end, 0));
+    hi = lo;
+    if(*end == '-') hi = int(strtol(end + 1, &end, 0));
+    return *end == 0 && lo >= 0 && hi <= 0xFF && lo <= hi;
+}
+
+static int sweep_commands(LinMaster& lin, int lo0, int hi0, int lo1, int hi1, int len, int settle_ms, int probe_ms) {
+    if(!stop(lin)) {
+        fprintf(stderr, "controller does not answer or does not stop\n");
+        return 1;
+    }
+    // stopped baseline, which bytes move on their own (temperature, voltage...)
+    std::vector<std::vector<uint8_t>> seen;
+    for(int i = 0; i < 10; i++) {
+        Status s = read_status(lin);
+        if(s.valid) seen.push_back(s.reply.data);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if(seen.empty()) {
+        fprintf(stderr, "no valid status while stopped\n");
+        return 1;
+    }
+    std::vector<bool> moving(seen[0].size());
+    for(const auto& v : seen) {
+        for(size_t b = 0; b < moving.size(); b++) moving[b] = moving[b] || b >= v.size() || v[b] != seen[0][b];
+    }
+    auto signature = [&](const std::vector<uint8_t>& v) {  // response with the bytes that move anyway masked
+        std::string s;
+        char b[4];
+        for(size_t i = 0; i < v.size(); i++) {
+            if(i < moving.size() && moving[i]) snprintf(b, sizeof(b), "%s..", i ? " " : "");
+            else snprintf(b, sizeof(b), "%s%02X", i ? " " : "", v[i]);
+            s += b;
+        }
+        return s;
+    };
+    std::string base = signature(seen[0]);
+    printf("baseline (stopped): %s\n\n", base.c_str());
+    printf("payload                   running  pgood  power_W  status\n");
+
+    std::map<std::string, std::vector<std::string>> groups;  // reaction -> payloads
+    auto last_cmd = Clock::now() - std::chrono::milliseconds(probe_ms);
+    for(int b0 = lo0; b0 <= hi0 && !interrupted; b0++) {
+        for(int b1 = lo1; b1 <= hi1 && !interrupted; b1++) {
+            std::vector<uint8_t> payload(size_t(len), 0x00);
+            payload[0] = uint8_t(b0);
+            if(len > 1) payload[1] = uint8_t(b1);
+            std::this_thread::sleep_until(last_cmd + std::chrono::milliseconds(probe_ms));
+            last_cmd = Clock::now();
+            lin.command(LIN_ID_COMMAND, payload);
+            Status last;
+            unsigned running = 0, polls = 0;
+            for(auto until = Clock::now() + std::chrono::milliseconds(settle_ms); Clock::now() < until;) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                Status s = read_status(lin);
+                polls++;
+                if(!s.valid) continue;
+                last = s;
+                running += s.running();
+            }
+            std::string reaction = last.valid ? signature(last.reply.data) : "no valid status";
+            if(reaction == base) reaction = "none";
+            printf("%-24s  %3u/%-3u  %5d  %7u  %s\n", hex(payload).c_str(), running, polls, last.pgood(),
+                   last.valid ? last.reply.data[0] * 5u : 0u, reaction.c_str());
+            fflush(stdout);
+            groups[reaction].push_back(hex(payload));
+            if(!stop(lin)) {
+                fprintf(stderr, "controller does not stop after %s, giving up\n", hex(payload).c_str());
+                return 1;
+            }
+        }
+    }
+    if(interrupted) stop(lin);
+
+    printf("\nbehaviour table (status bytes that move while stopped shown as ..)\n");
+    for(const auto& g : groups) {
+        printf("%-32s %zu payload%s:", g.first.c_str(), g.second.size(), g.second.size() == 1 ? "" : "s");
+        for(size_t i = 0; i < g.second.size() && i < 8; i++) printf(" [%s]", g.second[i].c_str());
+        if(g.second.size() > 8) printf(" ...");
+        printf("\n");
+    }
+    return interrupted ? 1 : 0;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: linexplore <port> ids [-D] [-o log.csv]\n"
+                    "       linexplore <port> cmd [-0 lo-hi] [-1 lo-hi] [-n len] [-s settle_ms] [-i probe_ms] "
+                    "[-o log.csv]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 3) return usage();
+    std::string mode = argv[2];
+    bool diagnostic = false;
+    int lo0 = 0, hi0 = 0xFF, lo1 = 0, hi1 = 0, len = 2, settle_ms = 1500, probe_ms = 1000;
+    const char* log_path = nullptr;
+    for(int i = 3; i < argc; i++) {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if(a == "-D") diagnostic = true;
+        else if(a == "-0" && has_value) {
+            if(!parse_range(argv[++i], lo0, hi0)) return usage();
+        }
+        else if(a == "-1" && has_value) {
+            if(!parse_range(argv[++i], lo1, hi1)) return usage();
+        }
+        else if(a == "-n" && has_value) len = std::clamp(atoi(argv[++i]), 1, 8);
+        else if(a == "-s" && has_value) settle_ms = std::max(100, atoi(argv[++i]));
+        else if(a == "-i" && has_value) probe_ms = std::max(200, atoi(argv[++i]));  // no faster than 5 commands/s
+        else if(a == "-o" && has_value) log_path = argv[++i];
+        else return usage();
+    }
+    if(mode != "ids" && mode != "cmd") return usage();
+
+    struct sigaction sa {};
+    sa.sa_handler = [](int) { interrupted = 1; };
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    try {
+        LinMaster lin(argv[1]);
+        if(log_path) {
+            lin.log = fopen(log_path, "w");
+            if(!lin.log) {
+                perror(log_path);
+                return 1;
+            }
+        }
+        int rc = (mode == "ids") ? sweep_ids(lin, diagnostic) : sweep_commands(lin, lo0, hi0, lo1, hi1, len, settle_ms, probe_ms);
+        if(lin.log) fclose(lin.log);
+        return rc;
+    }
+    catch(const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
+
+// g++ -std=c++17 -O2 -pthread -o linexplore linexplore.cpp
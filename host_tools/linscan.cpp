@@ -0,0 +1,258 @@
+/*
+    LIN decoder for logic analyzer captures of the bench: hours of the LIN bus, TX and POW_5V sampled at a few
+    MHz. The raw dump (one byte per sample, bit n = probe n, what sigrok's "binary" output and most analyzers'
+    raw export write) is mapped and scanned for edges 32 or 16 samples at a time with SSE2/AVX2 compares, so
+    the long idle stretches go by at memory bandwidth and only the edges are looked at one by one. Frames are
+    decoded from the bus line the way the controller sees them: break (dominant for 11 bits or more), sync 0x55,
+    protected ID with its parity bits, data and checksum (enhanced, classic for the diagnostic IDs 0x3C/0x3D).
+
+    linscan -r rate_hz [-c rx,tx,pow] [-b baud] [-g gap_ms] [-e] [-q] capture.bin out.trace
+
+    -c gives the probe of the bus line, TX and POW_5V (default 0,1,2, - for a probe not connected). A frame ends
+    at the next break or after -g ms of silence (default 20), its last byte is the checksum. Frames go to the
+    "lin" channel of the trace in the same layout invsim -T writes (PID, data, checksum; the header alone when
+    nobody answered), decoding errors to "lin_error" (LIN_ERR_* of software/lin.h) and POW_5V edges to "pow_5v". -e also
+    records every edge of the bus line and TX, which makes the trace much bigger. A summary goes to stderr
+    unless -q. invtrace reads the result.
+*/
+
+#include "lin.hpp"
+#include "trace.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+enum { CH_LIN, CH_ERROR, CH_POW, CH_RX, CH_TX };
+
+struct Capture {  // the mapped dump
+    const uint8_t* s = nullptr;
+    uint64_t n = 0;
+    uint64_t rate = 0;
+
+    trace::Time time(uint64_t i) const { return i / rate * 1000000000 + i % rate * 1000000000 / rate; }
+    bool level(uint64_t i, int bit) const { return i < n ? (s[i] >> bit) & 1 : true; }  // idle past the end
+};
+
+class LinDecoder {  // bus line edges in, frames out. Records of other channels pass through put() to stay in time order
+public:
+    LinDecoder(const Capture& cap, int bit, double baud, double gap_ms, trace::Writer& out)
+        : cap_(cap), bit_(bit), period_(double(cap.rate) / baud), gap_(uint64_t(gap_ms * 1e-3 * double(cap.rate))),
+          out_(out) {}
+
+    void edge(uint64_t i, bool level) {
+        if(frame_ && i > last_ + gap_) end(last_);  // silence ends a frame as well
+        if(!level) {
+            low_ = i;
+            if(i >= busy_) byte(i);
+            return;
+        }
+        if(double(i - low_) >= 11 * period_) {  // that low was a break
+            if(frame_) end(last_);
+            frame_ = true;
+            state_ = SYNC;
+            bytes_.clear();
+            busy_ = last_ = i;
+        }
+        else if(stop_low_ && frame_) error(i, LIN_ERR_FRAMING);
+        stop_low_ = false;
+    }
+    void put(uint64_t i, int ch, int64_t v) {  // held back while a frame is open, it is stamped with its last byte
+        if(frame_ && i > last_ + gap_) end(last_);
+        if(frame_) held_.push_back({i, ch, v});
+        else write({i, ch, v});
+    }
+    void finish() {
+        if(frame_) end(last_);
+    }
+
+    uint64_t frames = 0, errors = 0;
+
+private:
+    enum { SYNC, PID, DATA };
+    struct Held {
+        uint64_t i;
+        int ch;
+        int64_t v;
+    };
+
+    void byte(uint64_t start) {  // start bit begins here, sampled in the middle of each bit
+        if(cap_.level(at(start, 0), bit_)) return;  // glitch, the line is back up already
+        unsigned v = 0;
+        for(int b = 0; b < 8; b++) v |= unsigned(cap_.level(at(start, b + 1), bit_)) << b;
+        busy_ = at(start, 9);  // next start bit can come after the middle of the stop bit
+        if(!cap_.level(busy_, bit_)) {  // a break or a framing error, the rising edge tells
+            stop_low_ = true;
+            return;
+        }
+        if(!frame_) return;  // bytes outside a frame, nothing to sync to
+        last_ = busy_;
+        switch(state_) {
+            case SYNC:
+                if(v == LIN_SYNC) state_ = PID;
+                else error(start, LIN_ERR_SYNC);
+                break;
+            case PID:
+                if(!lin::parity_ok(uint8_t(v))) error(start, LIN_ERR_PARITY);
+                bytes_.push_back(uint8_t(v));
+                state_ = DATA;
+                break;
+            default:
+                if(bytes_.size() < LIN_FRAME_MAX) bytes_.push_back(uint8_t(v));
+                else error(start, LIN_ERR_FRAMING);  // longer than any LIN frame
+        }
+    }
+    uint64_t at(uint64_t start, int bitno) const { return start + uint64_t((bitno + 0.5) * period_); }
+
+    void end(uint64_t i) {  // frame done, bytes_ = PID, data, checksum
+        frame_ = false;
+        size_t k = 0;
+        for(; k < held_.size() && held_[k].i <= i; k++) write(held_[k]);
+        if(state_ == DATA) {  // anything before is an error already counted
+            if(lin::decode(bytes_) == LIN_ERR_CHECKSUM) write({i, CH_ERROR, LIN_ERR_CHECKSUM}), errors++;
+            out_.bytes(CH_LIN, cap_.time(i), bytes_.data(), bytes_.size());
+            frames++;
+        }
+        for(; k < held_.size(); k++) write(held_[k]);
+        held_.clear();
+    }
+    void error(uint64_t i, int code) {
+        put(i, CH_ERROR, code);
+        errors++;
+        if(code == LIN_ERR_SYNC) end(i);
+    }
+    void write(const Held& h) {
+        if(h.ch == CH_ERROR) out_.value(h.ch, cap_.time(h.i), h.v);
+        else out_.bit(h.ch, cap_.time(h.i), h.v != 0);
+    }
+
+    const Capture& cap_;
+    int bit_;
+    double period_;  // samples per bit
+    uint64_t gap_;
+    trace::Writer& out_;
+    uint64_t low_ = 0;   // last falling edge
+    uint64_t busy_ = 0;  // inside a byte until here
+    uint64_t last_ = 0;  // end of the last byte of the frame
+    bool stop_low_ = false;
+    bool frame_ = false;
+    int state_ = SYNC;
+    std::vector<uint8_t> bytes_;
+    std::vector<Held> held_;
+};
+
+// calls f(sample index, changed bits) for every sample that differs from the one before it in the mask
+template <class F>
+static void scan(const Capture& cap, uint8_t mask, F&& f) {
+    const uint8_t* s = cap.s;
+    uint64_t n = cap.n, i = 1;
+#if defined(__AVX2__)
+    const __m256i m = _mm256_set1_epi8(char(mask)), zero = _mm256_setzero_si256();
+    for(; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(s + i)), _mm256_loadu_si256((const __m256i*)(s + i - 1)));
+        uint32_t quiet = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(x, m), zero)));
+        for(uint32_t e = ~quiet; e; e &= e - 1) {
+            uint64_t k = i + uint64_t(__builtin_ctz(e));
+            f(k, uint8_t((s[k] ^ s[k - 1]) & mask));
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i m = _mm_set1_epi8(char(mask)), zero = _mm_setzero_si128();
+    for(; i + 16 <= n; i += 16) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(s + i)), _mm_loadu_si128((const __m128i*)(s + i - 1)));
+        uint32_t quiet = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(x, m), zero)));
+        for(uint32_t e = ~quiet & 0xFFFF; e; e &= e - 1) {
+            uint64_t k = i + uint64_t(__builtin_ctz(e));
+            f(k, uint8_t((s[k] ^ s[k - 1]) & mask));
+        }
+    }
+#endif
+    for(; i < n; i++) {
+        if((s[i] ^ s[i - 1]) & mask) f(i, uint8_t((s[i] ^ s[i - 1]) & mask));
+    }
+}
+
+static int usage() {
+    fprintf(stderr, "usage: linscan -r rate_hz [-c rx,tx,pow] [-b baud] [-g gap_ms] [-e] [-q] capture.bin out.trace\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    double rate = 0, baud = 19200, gap_ms = 20;
+    int probe[3] = {0, 1, 2};  // bus, TX, POW_5V
+    bool edges = false, quiet = false;
+    std::vector<const char*> files;
+    for(int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if(a == "-r" && has_value) rate = atof(argv[++i]);
+        else if(a == "-b" && has_value) baud = atof(argv[++i]);
+        else if(a == "-g" && has_value) gap_ms = atof(argv[++i]);
+        else if(a == "-c" && has_value) {
+            const char* p = argv[++i];
+            for(int k = 0; k < 3; k++) {
+                probe[k] = (*p == '-') ? -1 : int(strtol(p, nullptr, 10));
+                p = strchr(p, ',');
+                if(!p) break;
+                p++;
+            }
+        }
+        else if(a == "-e") edges = true;
+        else if(a == "-q") quiet = true;
+        else if(a[0] != '-') files.push_back(argv[i]);
+        else return usage();
+    }
+    if(files.size() != 2 || rate < 1 || probe[0] < 0 || probe[0] > 7 || probe[1] > 7 || probe[2] > 7) return usage();
+
+    try {
+        trace::Mapping map(files[0]);
+        Capture cap{map.data(), map.size(), uint64_t(rate)};
+        char info[256];
+        snprintf(info, sizeof info, "linscan %s at %.0f Hz", files[0], rate);
+        trace::Writer out(files[1],
+                          {{"lin", trace::BYTES}, {"lin_error", trace::VALUE}, {"pow_5v", trace::BIT},
+                           {"rx", trace::BIT}, {"tx", trace::BIT}},
+                          info);
+        auto start = std::chrono::steady_clock::now();
+        LinDecoder lin(cap, probe[0], baud, gap_ms, out);
+        uint8_t rx = uint8_t(1 << probe[0]), tx = probe[1] >= 0 ? uint8_t(1 << probe[1]) : 0;
+        uint8_t pow = probe[2] >= 0 ? uint8_t(1 << probe[2]) : 0;
+        if(cap.n) {  // levels at the start
+            if(pow) out.bit(CH_POW, 0, cap.s[0] & pow);
+            if(edges) out.bit(CH_RX, 0, cap.s[0] & rx);
+            if(edges && tx) out.bit(CH_TX, 0, cap.s[0] & tx);
+            if(!(cap.s[0] & rx)) lin.edge(0, false);
+        }
+        uint64_t n_edges = 0;
+        scan(cap, uint8_t(rx | (edges ? tx : 0) | pow), [&](uint64_t i, uint8_t changed) {
+            n_edges++;
+            if(changed & pow) lin.put(i, CH_POW, cap.s[i] & pow);
+            if(changed & tx) lin.put(i, CH_TX, cap.s[i] & tx);
+            if(changed & rx) {
+                if(edges) lin.put(i, CH_RX, cap.s[i] & rx);
+                lin.edge(i, cap.s[i] & rx);
+            }
+        });
+        lin.finish();
+        out.close();
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if(!quiet)
+            fprintf(stderr, "%.1f s of capture, %llu edges, %llu frames, %llu errors in %.2f s (%.0f MB/s)\n",
+                    double(cap.n) / rate, (unsigned long long)n_edges, (unsigned long long)lin.frames,
+                    (unsigned long long)lin.errors, wall, wall ? double(cap.n) / wall / 1e6 : 0.0);
+    }
+    catch(const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
+
+// g++ -std=c++17 -O2 -march=native -o linscan linscan.cpp
@@ -0,0 +1,140 @@
+/*
+    Exhaustive check of the LIN frame helpers in software/lin.h (lin_encode, lin_decode, lin_checksum), the ones
+    the simulator, linscan and linexplore build and judge frames with. lin.hpp already checks the macros at
+    compile time; this runs the helpers themselves over every ID, every data length and every way a frame can be
+    broken, against the LIN spec written out in lin::check.
+
+    lintest [-v]
+
+    Every ID with 0 to LIN_MAX_DATA data bytes of a few patterns is encoded and decoded again. The PID and the
+    checksum, classic for 0x3C..0x3F and enhanced for the rest, must match the spec. A frame carrying the other
+    kind of checksum, any of the 192 PIDs with bad parity, any other checksum byte, any single bit flipped in the
+    data and a frame of a length no frame can have must all be rejected with the right LIN_ERR_*. Lists the first
+    few failures and exits with 1 if there are any, -v prints the counts per check.
+*/
+
+#include "lin.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static unsigned failures = 0;
+
+static void fail(const std::string& what, const std::vector<uint8_t>& frame) {
+    if(++failures > 10) return;
+    std::printf("FAIL %s:", what.c_str());
+    for(uint8_t b : frame) std::printf(" %02X", b);
+    std::printf("\n");
+}
+
+// checksum of the spec, the plain sum folded with carry wrap-around and inverted
+static uint8_t spec_checksum(unsigned id, bool enhanced, const std::vector<uint8_t>& data) {
+    unsigned total = enhanced ? lin::check::spec_pid(id) : 0;
+    for(uint8_t b : data) total += b;
+    return uint8_t(~lin::check::spec_fold(total));
+}
+
+static std::vector<uint8_t> pattern(int kind, unsigned id, unsigned len) {
+    std::vector<uint8_t> data(len);
+    for(unsigned i = 0; i < len; i++) {
+        switch(kind) {
+            case 0: data[i] = 0x00; break;
+            case 1: data[i] = 0xFF; break;  // sums that wrap on every byte
+            case 2: data[i] = uint8_t(0xF9 - 37 * i - id); break;
+            default: data[i] = uint8_t((id * 7 + i * 53 + kind * 101) ^ 0xA5); break;
+        }
+    }
+    return data;
+}
+
+int main(int argc, char** argv) {
+    bool verbose = false;
+    for(int i = 1; i < argc; i++) {
+        if(std::strcmp(argv[i], "-v") == 0) verbose = true;
+        else {
+            std::fprintf(stderr, "usage: lintest [-v]\n");
+            return 2;
+        }
+    }
+    const int PATTERNS = 6;
+    unsigned round_trips = 0, kinds = 0, parity = 0, checksums = 0, flips = 0, framing = 0;
+    for(unsigned id = 0; id < 64; id++) {
+        bool classic = id >= LIN_ID_MASTER_REQ;
+        for(unsigned len = 0; len <= LIN_MAX_DATA; len++) {
+            for(int k = 0; k < PATTERNS; k++) {
+                std::vector<uint8_t> data = pattern(k, id, len);
+                std::vector<uint8_t> frame = lin::encode(uint8_t(id), data);
+                std::string at = "id " + std::to_string(id) + " len " + std::to_string(len);
+
+                // round trip
+                uint8_t want = spec_checksum(id, !classic, data);
+                if(frame.size() != len + 2 || frame[0] != lin::check::spec_pid(id) ||
+                   std::memcmp(frame.data() + 1, data.data(), len) != 0 || frame[len + 1] != want)
+                    fail("encode " + at, frame);
+                if(lin::decode(frame) != LIN_OK) fail("decode " + at, frame);
+                round_trips++;
+
+                // the other checksum kind, rejected unless both happen to agree
+                std::vector<uint8_t> other = frame;
+                other[len + 1] = spec_checksum(id, classic, data);
+                if(other[len + 1] != want) {
+                    if(lin::decode(other) != LIN_ERR_CHECKSUM) fail("wrong checksum kind accepted, " + at, other);
+                    kinds++;
+                }
+
+                // every PID byte with bad parity
+                for(unsigned v = 0; v < 256; v++) {
+                    if(v == lin::check::spec_pid(v & 0x3F)) continue;
+                    std::vector<uint8_t> bad = frame;
+                    bad[0] = uint8_t(v);
+                    if(lin::decode(bad) != LIN_ERR_PARITY) fail("bad parity accepted, " + at, bad);
+                    parity++;
+                }
+
+                // every other checksum byte
+                for(unsigned c = 0; c < 256; c++) {
+                    if(c == want) continue;
+                    std::vector<uint8_t> bad = frame;
+                    bad[len + 1] = uint8_t(c);
+                    if(lin::decode(bad) != LIN_ERR_CHECKSUM) fail("bad checksum accepted, " + at, bad);
+                    checksums++;
+                }
+
+                // a single bit flipped anywhere in the data changes the sum modulo 255, so it is always caught
+                for(unsigned bit = 0; bit < 8 * len; bit++) {
+                    std::vector<uint8_t> bad = frame;
+                    bad[1 + bit / 8] ^= uint8_t(1 << (bit % 8));
+                    if(lin::decode(bad) != LIN_ERR_CHECKSUM) fail("bit flip accepted, " + at, bad);
+                    flips++;
+                }
+            }
+        }
+
+        // header alone is fine (nobody answered), no bytes or more than a frame can hold is not
+        std::vector<uint8_t> header{lin::pids[id]};
+        if(lin::decode(header) != LIN_OK) fail("header id " + std::to_string(id), header);
+        std::vector<uint8_t> longer = lin::encode(uint8_t(id), pattern(2, id, LIN_MAX_DATA));
+        longer.push_back(0x00);
+        if(lin::decode(longer) != LIN_ERR_FRAMING) fail("overlong frame accepted, id " + std::to_string(id), longer);
+        if(lin_decode(longer.data(), uint8_t(longer.size())) != LIN_ERR_FRAMING) fail("overlong lin_decode, id " + std::to_string(id), longer);
+        framing += 3;
+    }
+    if(lin_decode(nullptr, 0) != LIN_ERR_FRAMING) fail("empty frame accepted", {});
+    framing++;
+
+    if(verbose || failures) {
+        std::printf("%8u round trips\n%8u frames with the other checksum kind\n%8u bad parity\n%8u bad checksums\n"
+                    "%8u bit flips\n%8u framing\n",
+                    round_trips, kinds, parity, checksums, flips, framing);
+    }
+    if(failures) {
+        std::printf("%u failures\n", failures);
+        return 1;
+    }
+    std::printf("lin.h frame helpers ok\n");
+    return 0;
+}
+
+// g++ -std=c++17 -O2 -o lintest lintest.cpp
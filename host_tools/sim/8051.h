@@ -0,0 +1,73 @@
+/*
+    Host stand-in for sdcc's <8051.h>, used when inverter.c is compiled with -DHOST_BUILD inside sim::Mcu
+    (see firmware.hpp). Only macros live here, the header ends up inside a class body. Bits and SFRs become
+    proxies that call back into the simulated hardware.
+*/
+
+#ifndef SIM_8051_H
+#define SIM_8051_H
+
+#define __interrupt(vector)
+#define __code
+#define __data
+#define __idata
+#define __at(addr)
+#define __bit bool
+
+#define IE0_VECTOR 0
+#define TF0_VECTOR 1
+#define IE1_VECTOR 2
+#define TF1_VECTOR 3
+#define SI0_VECTOR 4
+
+// SFRs by their direct address
+#define P1 sfr(0x90)
+#define P3 sfr(0xB0)
+#define PCON sfr(0x87)
+#define TCON sfr(0x88)
+#define TMOD sfr(0x89)
+#define TL0 sfr(0x8A)
+#define TL1 sfr(0x8B)
+#define TH0 sfr(0x8C)
+#define TH1 sfr(0x8D)
+#define SCON sfr(0x98)
+#define SBUF sfr(0x99)
+#define IE sfr(0xA8)
+#define IP sfr(0xB8)
+
+// bits by their bit address
+#define P1_0 bit(0x90)
+#define P1_1 bit(0x91)
+#define P1_2 bit(0x92)
+#define P1_3 bit(0x93)
+#define P1_4 bit(0x94)
+#define P1_5 bit(0x95)
+#define P1_6 bit(0x96)
+#define P1_7 bit(0x97)
+#define P3_0 bit(0xB0)
+#define P3_1 bit(0xB1)
+#define P3_2 bit(0xB2)
+#define P3_3 bit(0xB3)
+#define P3_4 bit(0xB4)
+#define P3_5 bit(0xB5)
+#define P3_6 bit(0xB6)
+#define P3_7 bit(0xB7)
+#define IT0 bit(0x88)
+#define IE0 bit(0x89)
+#define TR0 bit(0x8C)
+#define TF0 bit(0x8D)
+#define TR1 bit(0x8E)
+#define RI bit(0x98)
+#define TI bit(0x99)
+#define EX0 bit(0xA8)
+#define ET0 bit(0xA9)
+#define ES bit(0xAC)
+#define EA bit(0xAF)
+#define PS bit(0xBC)
+
+// PCON bits
+#define IDL 0x01
+#define PD 0x02
+#define SMOD 0x80
+
+#endif
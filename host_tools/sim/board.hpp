@@ -0,0 +1,536 @@
+/*
+    Everything around the auxiliary controller: the Audi inverter controller behind LIN, the battery, the
+    plugged load and the PV surplus signal. Timing figures are rough bench numbers, good enough to compare
+    policies against each other. Supply currents come from the calibration table of the scenario (energy.hpp),
+    so with measured currents (-k) the mAh/day figures hold for a real board too.
+
+    The board keeps score while it runs (Result) and never looks inside the firmware, so the same metrics
+    work for every feature combination.
+*/
+
+#ifndef SIM_BOARD_HPP
+#define SIM_BOARD_HPP
+
+#include "../lin.hpp"
+#include "../trace.hpp"
+#include "energy.hpp"
+#include "mcu.hpp"
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+
+namespace sim {
+
+struct Battery {
+    std::string name;
+    double capacity_ah = 100;
+    double soc = 0.9;              // state of charge at start
+    double r_ohm = 0.01;           // internal resistance, makes the voltage sag under load
+    double charge_a = 0;           // PV charging current during the sun window, which is also PV surplus
+    double sun_from_h = 9, sun_to_h = 16;
+
+    static double ocv(double soc) {  // lead-acid-ish open circuit voltage
+        return (soc > 0.1) ? 11.8 + 1.0 * soc : 10.5 + 13.0 * soc;
+    }
+    bool sunny(Time time_of_day) const { return time_of_day >= sun_from_h * HOUR && time_of_day < sun_to_h * HOUR; }
+};
+
+struct LoadStep {
+    Time t;
+    bool plugged;
+    uint16_t watts;  // what the load would draw with the output on
+};
+
+struct Scenario {
+    std::string name;
+    uint64_t seed = 1;
+    Time duration = DAY;
+    Time start_of_day = 0;               // time of day at t = 0
+    std::vector<LoadStep> load;          // sorted by time
+    Battery battery;
+    double lin_drop = 0;                 // chance a 0x3B response goes missing
+    double lin_corrupt = 0;              // chance one response bit flips
+    std::vector<std::pair<Time, bool>> bus_dead;  // LIN bus unusable from .first while .second
+    std::vector<Time> resets;            // warm resets of the uC (brownout, watchdog), sorted
+    bool lin_sleep = true;               // controller obeys the LIN go-to-sleep command
+    bool jumper = false;                 // P1.3 jumper fitted
+    std::array<uint8_t, 256> eeprom;     // 24C02 contents, 0xFF when blank
+    bool eeprom_present = true;
+    Calibration cal;                     // supply currents
+
+    Scenario() { eeprom.fill(0xFF); }
+};
+
+struct Result {
+    double hours = 0;
+    double demand_wh = 0;      // energy the plugged loads wanted
+    double served_wh = 0;      // energy they got
+    double battery_wh = 0;     // energy taken from the battery
+    double standby_wh = 0;     // battery energy used while no load wanted power
+    unsigned requests = 0;     // times a load wanted power while the output was off
+    unsigned served = 0;       // ... and got it before being unplugged
+    double latency_sum_s = 0;  // time from wanting power to getting it
+    double latency_max_s = 0;
+    unsigned false_shutdowns = 0;  // output turned off while a load was drawing power, once per demand episode
+    unsigned trips = 0;        // controller overload or undervoltage trips
+    unsigned led_blinks = 0;
+    unsigned resets = 0;       // warm resets the firmware went through
+    unsigned power_cuts = 0;   // controller power force-cut with EN_OV
+    unsigned lin_frames = 0;
+    unsigned lin_lost = 0;     // responses dropped or corrupted by the fault model
+    double output_on_h = 0;
+    double controller_on_h = 0;
+    bool shutdown = false;     // firmware powered itself down for good
+    double shutdown_h = 0;
+    double final_soc = 0;
+    double min_voltage = 99;
+    double boot_ms = -1;       // power-up to the first decision: LIN traffic, wake pulse, EN_OV or going to sleep
+    Ledger energy;             // hours and mAh per part
+
+    double latency_mean_s() const { return served ? latency_sum_s / served : 0; }
+    double own_mah_per_day() const { return hours ? energy.own_mah() * 24 / hours : 0; }
+};
+
+class Board : public Mcu {
+public:
+    // inverter controller constants
+    static constexpr Time WAKE_TIME = 50 * MS;     // LIN wake-up pulse to 5V present
+    static constexpr Time START_TIME = 300 * MS;   // start command to 230V present
+    static constexpr Time STOP_TIME = 50 * MS;
+    static constexpr Time SLEEP_TIMEOUT = 4 * SEC; // stopped controller cuts its own power after this much bus silence
+    static constexpr Time SLEEP_CMD_TIME = 20 * MS; // go-to-sleep command to 5V gone
+    static constexpr Time TRIP_TIME = 10 * SEC;    // reports power failure for this long after a trip
+    static constexpr unsigned TRIP_WATTS = 300;
+    static constexpr double CTRL_MIN_VOLTAGE = 10.5;
+    static constexpr double PGOOD_VOLTAGE = 11.0;  // auxiliary comparator threshold
+
+    void load(std::shared_ptr<const Scenario> s) {  // once, before run()
+        scn_ = std::move(s);
+        rng_.seed(scn_->seed);
+        soc_ = scn_->battery.soc;
+        eeprom = scn_->eeprom;
+        eeprom_present = scn_->eeprom_present;
+        set_end(scn_->duration);
+        if(!scn_->load.empty()) schedule(scn_->load[0].t, EV_LOAD, 0);
+        if(!scn_->bus_dead.empty()) schedule(scn_->bus_dead[0].first, EV_DEAD, 0);
+        if(!scn_->resets.empty()) schedule(scn_->resets[0], EV_RESET, 0);
+        if(scn_->battery.charge_a > 0) {
+            sun_ = scn_->battery.sunny(scn_->start_of_day % DAY);
+            schedule_sun(0);
+        }
+    }
+
+    const Scenario& scenario() const { return *scn_; }
+    bool output_on() const { return powered_ && running_; }
+    unsigned demand() const { return plugged_ ? demand_ : 0; }
+    double soc() const { return soc_; }
+    double voltage() const { return Battery::ocv(soc_) - current() * scn_->battery.r_ohm; }
+
+    Result run() {  // boot the firmware and run it until the scenario ends
+        while(!ended_) {
+            try {
+                firmware();
+            }
+            catch(const Reset&) {
+                warm_reset();
+                continue;  // and boot again
+            }
+            catch(const SimEnd&) {
+            }
+            catch(const PowerDown&) {
+                decided();
+                res_.shutdown = true;
+                res_.shutdown_h = double(now()) / HOUR;
+                drain();
+            }
+            ended_ = true;
+        }
+        account();
+        res_.hours = double(now()) / HOUR;
+        res_.final_soc = soc_;
+        return res_;
+    }
+
+    const Result& result() const { return res_; }
+    bool ended() const { return ended_; }
+
+    // trace of what the board shows (trace.hpp) on TR_* channels, written as it changes. Not for copies of a board.
+    enum { TR_PLUG, TR_POW_5V, TR_P_GOOD, TR_PV, TR_EN_OV, TR_LED, TR_IDLE, TR_OUTPUT, TR_BITS = TR_OUTPUT + 1,
+           TR_DEMAND = TR_BITS, TR_BATT_MV, TR_STATE, TR_VALUES, TR_LIN_TX = TR_VALUES, TR_LIN_RX, TR_LIN };
+    static std::vector<trace::Channel> trace_channels() {
+        return {{"plug", trace::BIT},       {"pow_5v", trace::BIT},    {"p_good", trace::BIT},
+                {"pv_in", trace::BIT},      {"en_ov", trace::BIT},     {"led", trace::BIT},
+                {"idle", trace::BIT},       {"output", trace::BIT},    {"demand_w", trace::VALUE},
+                {"batt_mv", trace::VALUE},  {"state", trace::VALUE},   {"lin_tx", trace::VALUE},
+                {"lin_rx", trace::VALUE},   {"lin", trace::BYTES}};
+    }
+    void trace_to(trace::Writer* w) {
+        trace_ = w;
+        shown_.fill(-1);
+        observe();
+    }
+
+    // on a copy of a running board (Emulator::fork): the scenario changes from now on, what the board has been
+    // through so far must be the same in both (see the *_at() variants in scenario.hpp)
+    void branch(std::shared_ptr<const Scenario> s) {
+        scn_ = std::move(s);
+        unschedule(EV_LOAD);
+        unschedule(EV_DEAD);
+        unschedule(EV_RESET);
+        set_end(scn_->duration);
+        if(load_next_ < scn_->load.size()) schedule(scn_->load[load_next_].t, EV_LOAD, load_next_);
+        if(dead_next_ < scn_->bus_dead.size()) schedule(scn_->bus_dead[dead_next_].first, EV_DEAD, dead_next_);
+        if(reset_next_ < scn_->resets.size()) schedule(scn_->resets[reset_next_], EV_RESET, reset_next_);
+    }
+
+protected:
+    enum : uint16_t { EV_LOAD = EV_BOARD, EV_DEAD, EV_SUN, EV_WAKE, EV_STARTED, EV_STOPPED, EV_SLEEP, EV_RESET };
+
+    bool pin_input(u8 addr) override {
+        switch(addr) {
+            case 0xB2: return !plugged_;            // PLUG, active low
+            case 0xB3: return powered_;             // POW_5V
+            case 0xB6: return voltage() >= PGOOD_VOLTAGE;  // P_GOOD
+            case 0x92: return !sun_;                // PV_IN, active low
+            case 0x93: return !scn_->jumper;        // PROFILE_JMP
+            default: return true;
+        }
+    }
+
+    void pin_output(u8 addr, bool level) override {
+        if((addr == 0xB4 && level) || (addr == 0xB1 && !level)) decided();
+        if(addr == 0xB4 && level && powered_) {  // EN_OV, force-cut controller power
+            res_.power_cuts++;
+            stopped();
+            powered_ = false;
+        }
+        else if(addr == 0xB1 && !level && !powered_ && !wake_pending_ && !latch(0xB4)) {  // LIN wake-up pulse
+            wake_pending_ = true;
+            schedule(now() + WAKE_TIME, EV_WAKE, 0);
+        }
+        else if(addr == 0xB5 && level) res_.led_blinks++;
+        update_wait();
+    }
+
+    void uart_tx(u8 data, Time byte_time) override {  // LIN master output, decoded by the controller
+        decided();
+        if(trace_) trace_lin(data, byte_time, true);
+        if(!powered_ || dead_) return;
+        if(data == 0 && byte_time > 900 * US) {  // sent at half baud rate, long enough for a break
+            lin_state_ = BUS_SYNC;
+            bus_activity();
+            return;
+        }
+        switch(lin_state_) {
+            case BUS_SYNC: lin_state_ = (data == LIN_SYNC) ? BUS_PID : BUS_IDLE; break;
+            case BUS_PID:
+                lin_pid_ = data;
+                lin_state_ = BUS_IDLE;
+                res_.lin_frames++;
+                if(data == lin::pids[LIN_ID_COMMAND] || data == lin::pids[LIN_ID_MASTER_REQ]) {
+                    lin_state_ = BUS_DATA;
+                    lin_len_ = 0;
+                }
+                else if(data == lin::pids[LIN_ID_STATUS]) respond(now() + byte_time);
+                break;
+            case BUS_DATA:
+                lin_data_[lin_len_++] = data;
+                if(lin_len_ == data_len(lin_pid_) + 1) {
+                    lin_state_ = BUS_IDLE;
+                    command();
+                }
+                break;
+            default: break;
+        }
+    }
+
+    void on_event(const Event& e) override {
+        switch(e.kind) {
+            case EV_LOAD: {
+                const LoadStep& st = scn_->load[e.arg];
+                load_next_ = e.arg + 1;
+                bool was_plugged = plugged_;
+                plugged_ = st.plugged;
+                demand_ = st.watts;
+                if(!demand()) cut_in_episode_ = false;
+                if(was_plugged != plugged_) input_changed(0xB2);
+                if(output_on() && demand() > TRIP_WATTS) trip();
+                if(e.arg + 1 < scn_->load.size()) schedule(scn_->load[e.arg + 1].t, EV_LOAD, e.arg + 1);
+                break;
+            }
+            case EV_DEAD:
+                dead_ = scn_->bus_dead[e.arg].second;
+                dead_next_ = e.arg + 1;
+                if(e.arg + 1 < scn_->bus_dead.size()) schedule(scn_->bus_dead[e.arg + 1].first, EV_DEAD, e.arg + 1);
+                break;
+            case EV_SUN:
+                sun_ = !sun_;
+                input_changed(0x92);
+                schedule_sun(now() + 1);
+                break;
+            case EV_WAKE:
+                wake_pending_ = false;
+                if(!latch(0xB4) && !powered_) {
+                    powered_ = true;
+                    lin_state_ = BUS_IDLE;
+                    bus_activity();
+                }
+                break;
+            case EV_STARTED:
+                start_pending_ = false;
+                if(powered_ && ctrl_pgood()) {
+                    running_ = true;
+                    if(demand() > TRIP_WATTS) trip();
+                }
+                break;
+            case EV_STOPPED:
+                if(powered_ && running_) stopped();
+                bus_activity();
+                break;
+            case EV_SLEEP:
+                if(e.arg == sleep_gen_ && powered_ && !running_ && !start_pending_) powered_ = false;
+                break;
+            case EV_RESET:
+                reset_next_ = e.arg + 1;
+                if(e.arg + 1 < scn_->resets.size()) schedule(scn_->resets[e.arg + 1], EV_RESET, e.arg + 1);
+                if(powered_down()) break;  // shut down for good, scenarios are about the resets that hit a working board
+                res_.resets++;
+                throw Reset{};  // out of the firmware, run() boots it again
+        }
+        if(output_on() && voltage() < CTRL_MIN_VOLTAGE) trip();  // undervoltage under load
+        update_wait();
+    }
+
+    void uart_rx(u8 data) override {
+        if(trace_) trace_lin(data, 0, false);
+    }
+
+    void observe() override {
+        if(cpu_idle()) decided();
+        if(!trace_) return;
+        int64_t now_v[TR_VALUES] = {plugged_, powered_, voltage() >= PGOOD_VOLTAGE, sun_, latch(0xB4), latch(0xB5),
+                                    cpu_idle(), output_on(), demand(), std::lround(voltage() * 1000), control_state()};
+        for(int c = 0; c < TR_VALUES; c++) {
+            if(now_v[c] == shown_[c] || (c == TR_STATE && now_v[c] < 0)) continue;
+            if(c == TR_BATT_MV && shown_[c] >= 0 && std::abs(now_v[c] - shown_[c]) < 10) continue;  // 10 mV steps
+            if(c < TR_BITS) trace_->bit(c, now(), now_v[c]);
+            else trace_->value(c, now(), now_v[c]);
+            shown_[c] = now_v[c];
+        }
+    }
+
+    // implemented by the firmware wrapper, if it can tell
+    virtual int control_state() const { return -1; }  // SUP_STATE_*
+    // implemented by the firmware wrapper: RAM as the startup code leaves it after a warm reset
+    virtual void warm_reset() { reset_cpu(); }
+
+    void account() override {  // integrate battery and metrics since the last call
+        Time t = now();
+        if(t <= last_) return;
+        double dt = double(t - last_) / SEC;
+        double i = current();
+        double v = voltage();
+        const Calibration& cal = scn_->cal;
+        unsigned parts = active_parts();
+        double tick = (idle_tick()) ? dt * cal.tick_load : 0;  // the tick ISR's share of the idle time, CPU awake
+        for(int p = 0; p < PARTS; p++) {
+            if(parts & (1u << p)) res_.energy.charge(p, cal.ma[p], (p == PART_MCU_IDLE) ? dt - tick : dt);
+        }
+        if(tick > 0) res_.energy.charge(PART_MCU_ACTIVE, cal.ma[PART_MCU_ACTIVE], tick);
+        res_.energy.load_mah += load_ma() * dt / 3600;
+        double charge = sun_ ? scn_->battery.charge_a : 0;
+        soc_ = std::min(1.0, std::max(0.0, soc_ - (i - charge) * dt / 3600 / scn_->battery.capacity_ah));
+        double wh = v * i * dt / 3600;
+        res_.battery_wh += wh;
+        res_.demand_wh += demand() * dt / 3600;
+        if(output_on()) {
+            res_.served_wh += demand() * dt / 3600;
+            res_.output_on_h += dt / 3600;
+        }
+        if(demand() == 0) res_.standby_wh += wh;
+        if(powered_) res_.controller_on_h += dt / 3600;
+        res_.min_voltage = std::min(res_.min_voltage, v);
+        double target = 25 + (output_on() ? demand() * 0.12 : 0);  // controller heat sink, 10 min time constant
+        temp_ += (target - temp_) * (1 - std::exp(-dt / 600));
+        last_ = t;
+    }
+
+    unsigned active_parts() const {  // bit mask of the parts drawing current right now
+        unsigned m = 1u << (powered_down() ? PART_MCU_PD : cpu_idle() ? PART_MCU_IDLE : PART_MCU_ACTIVE);
+        m |= 1u << (powered_ ? PART_LIN_AWAKE : PART_LIN_SLEEP);
+        if(powered_) m |= 1u << PART_CONTROLLER;
+        if(output_on()) m |= 1u << PART_INVERTER;
+        if(latch(0xB5)) m |= 1u << PART_LED;
+        return m;
+    }
+
+    bool idle_tick() const { return cpu_idle() && tick_on() && !core_; }  // the core runs the ISR cycles itself
+
+    double load_ma() const { return output_on() ? demand() * 1000 / (scn_->cal.efficiency * 12.0) : 0; }
+
+    double current() const {  // A drawn from the 12V battery
+        double ma = load_ma();
+        unsigned parts = active_parts();
+        for(int p = 0; p < PARTS; p++) {
+            if(parts & (1u << p)) ma += scn_->cal.ma[p];
+        }
+        if(idle_tick()) ma += (scn_->cal.ma[PART_MCU_ACTIVE] - scn_->cal.ma[PART_MCU_IDLE]) * scn_->cal.tick_load;
+        return ma / 1000;
+    }
+
+private:
+    enum : u8 { BUS_IDLE, BUS_SYNC, BUS_PID, BUS_DATA };
+
+    bool ctrl_pgood() const { return now() >= trip_until_ && voltage() >= CTRL_MIN_VOLTAGE; }
+
+    void decided() {  // the firmware did something about the load or the battery, the first time ends the boot
+        if(res_.boot_ms < 0) res_.boot_ms = double(now()) / MS;
+    }
+
+    void bus_activity() {  // any frame keeps a stopped controller awake
+        schedule(now() + SLEEP_TIMEOUT, EV_SLEEP, ++sleep_gen_);
+    }
+
+    void respond(Time t) {  // answer 0x3B: power, status, temperature, 0xFF, checksum
+        std::uniform_real_distribution<double> u(0, 1);
+        if(u(rng_) < scn_->lin_drop) {
+            res_.lin_lost++;
+            return;
+        }
+        u8 data[LIN_LEN_STATUS + 1];
+        data[0] = output_on() ? u8(std::min(255u, (demand() + 2) / 5)) : 0;
+        data[1] = (running_ ? 0x01 : 0) | (ctrl_pgood() ? 0x02 : 0);
+        data[2] = u8(std::lround(std::min(200.0, std::max(-40.0, temp_)) + 40));
+        data[3] = 0xFF;
+        data[LIN_LEN_STATUS] = lin::checksum(lin_pid_, data, LIN_LEN_STATUS);
+        if(u(rng_) < scn_->lin_corrupt) {
+            res_.lin_lost++;
+            data[rng_() % sizeof data] ^= u8(1 << (rng_() % 8));
+        }
+        Time bt = uart_byte_time();
+        t += MS;  // response space
+        for(size_t i = 0; i < sizeof data; i++) schedule(t + i * bt, EV_RX, data[i]);
+    }
+
+    static u8 data_len(u8 pid) { return (pid == lin::pids[LIN_ID_MASTER_REQ]) ? LIN_MAX_DATA : LIN_LEN_COMMAND; }
+
+    void command() {  // master frames: 0x3A {0x02, 0x00} starts, {0x00, 0x00} stops, 0x3C {0x00, 0xFF...} is go-to-sleep
+        u8 len = data_len(lin_pid_);
+        if(lin::checksum(lin_pid_, lin_data_, len) != lin_data_[len]) return;
+        if(lin_pid_ == lin::pids[LIN_ID_MASTER_REQ]) {  // a running controller keeps its output, the firmware stops it first
+            if(lin_data_[0] == LIN_GOTO_SLEEP && scn_->lin_sleep) schedule(now() + SLEEP_CMD_TIME, EV_SLEEP, ++sleep_gen_);
+            return;
+        }
+        if(lin_data_[0] == 0x02 && !running_ && !start_pending_ && ctrl_pgood()) {
+            start_pending_ = true;
+            schedule(now() + START_TIME, EV_STARTED, 0);
+        }
+        else if(lin_data_[0] == 0x00 && running_) schedule(now() + STOP_TIME, EV_STOPPED, 0);
+    }
+
+    void stopped() {  // unplugging first is fine, stopping under load is not
+        if(running_ && demand() > 0 && !cut_in_episode_) {
+            res_.false_shutdowns++;
+            cut_in_episode_ = true;  // probing restarts that stop again are the same episode
+        }
+        running_ = false;
+    }
+
+    void trip() {
+        res_.trips++;
+        running_ = false;
+        trip_until_ = now() + TRIP_TIME;
+    }
+
+    void trace_lin(u8 data, Time byte_time, bool tx) {  // bytes, and frames put together from them
+        trace_->value(tx ? TR_LIN_TX : TR_LIN_RX, now(), data);
+        if(tx && data == 0 && byte_time > 900 * US) {  // break, whatever came before was all of that frame
+            if(!frame_.empty()) trace_->bytes(TR_LIN, now(), frame_.data(), frame_.size());
+            frame_.clear();
+            frame_state_ = BUS_SYNC;
+            return;
+        }
+        if(frame_state_ == BUS_SYNC) {
+            frame_state_ = (tx && data == LIN_SYNC) ? BUS_DATA : BUS_IDLE;
+            return;
+        }
+        if(frame_state_ != BUS_DATA) return;
+        frame_.push_back(data);  // PID, data, checksum
+        size_t len = (frame_[0] == lin::pids[LIN_ID_STATUS])    ? LIN_LEN_STATUS + 2
+                     : (frame_[0] == lin::pids[LIN_ID_COMMAND]) ? LIN_LEN_COMMAND + 2
+                                                                : LIN_FRAME_MAX;
+        if(frame_.size() == len) {  // complete, no need to wait for the next break
+            trace_->bytes(TR_LIN, now(), frame_.data(), frame_.size());
+            frame_.clear();
+            frame_state_ = BUS_IDLE;
+        }
+    }
+
+    void schedule_sun(Time from) {  // next edge of the daily sun window
+        const Battery& b = scn_->battery;
+        Time day_t = (from + scn_->start_of_day) % DAY;
+        Time on = Time(b.sun_from_h * HOUR), off = Time(b.sun_to_h * HOUR);
+        Time edge = sun_ ? off : on;
+        Time wait = (edge >= day_t) ? edge - day_t : DAY - day_t + edge;
+        schedule(from + wait, EV_SUN, 0);
+    }
+
+    void update_wait() {  // plug-to-power latency bookkeeping
+        bool want = demand() > 0;
+        if(want && !output_on()) {
+            if(!waiting_) {
+                waiting_ = true;
+                wait_since_ = now();
+                res_.requests++;
+            }
+        }
+        else if(waiting_) {
+            waiting_ = false;
+            if(want) {
+                double s = double(now() - wait_since_) / SEC;
+                res_.served++;
+                res_.latency_sum_s += s;
+                res_.latency_max_s = std::max(res_.latency_max_s, s);
+            }
+        }
+    }
+
+    std::shared_ptr<const Scenario> scn_;
+    std::mt19937_64 rng_;
+    Result res_;
+    Time last_ = 0;
+    double soc_ = 0;
+    double temp_ = 25;
+    bool plugged_ = false;
+    unsigned demand_ = 0;
+    bool sun_ = false;
+    bool dead_ = false;
+    bool powered_ = false;
+    bool running_ = false;
+    bool start_pending_ = false;
+    bool wake_pending_ = false;
+    Time trip_until_ = 0;
+    uint32_t sleep_gen_ = 0;
+    u8 lin_state_ = BUS_IDLE;
+    u8 lin_pid_ = 0;
+    u8 lin_data_[LIN_MAX_DATA + 1] = {};
+    u8 lin_len_ = 0;
+    bool waiting_ = false;
+    Time wait_since_ = 0;
+    bool cut_in_episode_ = false;
+    trace::Writer* trace_ = nullptr;
+    std::array<int64_t, TR_VALUES> shown_;  // last traced
+    std::vector<u8> frame_;  // LIN frame being traced
+    u8 frame_state_ = BUS_IDLE;
+    uint32_t load_next_ = 0;  // scenario steps applied so far
+    uint32_t dead_next_ = 0;
+    uint32_t reset_next_ = 0;
+    bool ended_ = false;
+};
+
+}  // namespace sim
+
+#endif
@@ -0,0 +1,1055 @@
+/*
+    Instruction-level AT89C2051 core running the sdcc build of the firmware (inverter.ihx) against the same
+    board and peripheral models as the host build. It runs the real machine code, so compiler output, stack
+    depth, interrupt latency and cycle counts are the chip's instead of the host compiler's.
+
+    Time is counted in machine cycles (12 clocks). Code is decoded once into basic blocks that carry their
+    cycle sum, and a block that ends before the next peripheral activity (event or Timer0 overflow) runs
+    without any checks in between. Pure spin loops like the delay() inner loop of builds without the tick
+    (`while(wait--)`, ~100 rounds per ms) are recognised and fast-forwarded in closed form: every round but the
+    last that fits before the next activity is skipped at once. A loop that waits for an interrupt to change
+    memory, like `while(tick_div == last)` in delay() of tick builds, skips straight to that activity. Registers,
+    memory and cycle count come out exactly as stepping through the rounds would have left them,
+    fast_forward = false does that to compare.
+
+    Interrupts are taken at the first instruction boundary after their flag went up. The 24C02 is not there
+    at pin level (a USE_EEPROM build runs on defaults) and MOVX reads 0xFF, the chip has no external bus.
+*/
+
+#ifndef SIM_EMULATOR_HPP
+#define SIM_EMULATOR_HPP
+
+#include "board.hpp"
+
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+using u16 = uint16_t;
+
+struct Image {  // code memory as loaded from the Intel HEX file sdcc writes
+    std::vector<u8> code = std::vector<u8>(0x10000, 0xFF);  // erased flash
+    size_t size = 0;
+
+    static std::shared_ptr<const Image> load_ihx(const std::string& path) {
+        std::ifstream in(path);
+        if(!in) throw std::runtime_error("cannot open " + path);
+        auto img = std::make_shared<Image>();
+        std::string line;
+        for(int n = 1; std::getline(in, line); n++) {
+            while(!line.empty() && isspace((unsigned char)line.back())) line.pop_back();
+            if(line.empty()) continue;
+            std::runtime_error bad(path + ":" + std::to_string(n) + ": bad HEX record");
+            if(line[0] != ':' || line.size() < 11 || line.size() % 2 == 0) throw bad;
+            std::vector<u8> b;
+            for(size_t i = 1; i < line.size(); i += 2) {
+                if(!isxdigit((unsigned char)line[i]) || !isxdigit((unsigned char)line[i + 1])) throw bad;
+                b.push_back(u8(std::stoul(line.substr(i, 2), nullptr, 16)));
+            }
+            u8 sum = 0;
+            for(u8 x : b) sum += x;
+            if(sum || b.size() != b[0] + 5u) throw bad;
+            if(b[3] == 0x01) break;  // end of file
+            if(b[3] != 0x00) continue;  // extended address records, nothing up there on this chip
+            unsigned addr = b[1] << 8 | b[2];
+            for(unsigned i = 0; i < b[0]; i++) img->code[(addr + i) & 0xFFFF] = b[4 + i];
+            img->size = std::max<size_t>(img->size, addr + b[0]);
+        }
+        return img;
+    }
+};
+
+class Emulator : public Board {
+public:
+    struct Stats {
+        uint64_t insns = 0;        // executed one by one
+        uint64_t spin_rounds = 0;  // spin loop rounds fast-forwarded in closed form
+        uint64_t spin_cycles = 0;  // machine cycles those took
+        uint64_t loop_rounds = 0;  // loop rounds applied from a trace
+        uint64_t loop_cycles = 0;
+        uint64_t interrupts = 0;
+        size_t blocks = 0;         // basic blocks decoded
+        u8 sp_peak = 0x07;         // highest stack byte pushed, must stay below the RETAIN_ADDR of USE_RESUME images
+    };
+
+    static std::unique_ptr<Emulator> create(std::shared_ptr<const Scenario> s, std::shared_ptr<const Image> img,
+                                            bool fast_forward = true) {
+        std::unique_ptr<Emulator> emu(new Emulator(std::move(img), fast_forward));
+        emu->load(std::move(s));
+        return emu;
+    }
+
+    uint64_t cycles() const { return cycles_; }
+    Stats stats() const {
+        Stats s = stats_;
+        s.blocks = dec_->blocks.size();
+        return s;
+    }
+    // core state, for comparing runs
+    u16 pc() const { return pc_; }
+    u8 acc() const { return acc_; }
+    u8 sp() const { return sp_; }
+    const std::array<u8, 256>& iram() const { return iram_; }
+    u8 sfr(u8 addr) const {  // register as the core holds it, port and Timer0 SFRs as latched (no pins, no count)
+        switch(addr) {
+            case 0xE0: return acc_;
+            case 0xF0: return b_;
+            case 0xD0: return psw();
+            case 0x81: return sp_;
+            case 0x82: return u8(dptr_);
+            case 0x83: return u8(dptr_ >> 8);
+        }
+        return sfr_latch(addr);
+    }
+
+    // snapshots for branching: run to a decision point, fork() there and branch() the copies into what happens next.
+    // A fork is the whole board by value (IRAM is 128 bytes) except the decoded code, which is shared until written.
+    bool run_to(Time t) {  // stops at the first instruction boundary at or after t, false if the scenario ended first
+        if(ended()) return false;
+        pause_ = cycle_at(t);
+        stop_ = 0;
+        try {
+            run();
+        }
+        catch(const Pause&) {
+            pause_ = ~uint64_t(0);
+            return true;
+        }
+        return false;
+    }
+    std::unique_ptr<Emulator> fork() const {
+        std::unique_ptr<Emulator> e(new Emulator(*this));
+        e->trace_to(nullptr);
+        return e;
+    }
+
+protected:
+    Emulator(std::shared_ptr<const Image> img, bool fast_forward) : img_(std::move(img)), ff_(fast_forward) {
+        core_ = true;
+        dec_ = std::make_shared<Decoded>();
+    }
+    Emulator(const Emulator&) = default;
+
+    void firmware() override {
+        for(;;) {
+            if(cycles_ >= stop_) boundary();
+            uint32_t bi = block(pc_);
+            if(ff_) {
+                if(dec_->blocks[bi].spin[psw_ >> 3 & 3] != -1 && spin(bi)) continue;
+                if(dec_->blocks[bi].head && loop(bi)) continue;
+            }
+            const Block& b = dec_->blocks[bi];
+            const Insn* in = &dec_->insns[b.first];
+            const Insn* end = in + b.count;
+            bool checked = b.io || cycles_ + b.cycles > stop_;  // otherwise nothing can happen in between
+            do {
+                exec(*in++);
+            } while(in != end && !(checked && cycles_ >= stop_));
+            stats_.insns += uint64_t(in - &dec_->insns[b.first]);
+        }
+    }
+
+    bool wake_up() override { return irq() != 0; }
+    void warm_reset() override {  // IRAM stays, what the startup code of the image clears is up to it
+        reset_cpu();
+        pc_ = 0;
+        sp_ = 0x07;
+        acc_ = b_ = psw_ = 0;
+        dptr_ = 0;
+        in_service_ = 0;
+        hold_ = false;
+        stop_ = 0;
+    }
+    uint64_t now_frac() const override {  // only while the peripherals are synced to the current cycle
+        return (now() == time_of(cycles_)) ? (cycles_ % FOSC) * 12 * SEC % FOSC : 0;
+    }
+
+private:
+    struct Pause {};
+    struct Insn {
+        u8 op, a, b, cycles;  // a, b: operand bytes
+        u16 next;             // address of the following instruction
+    };
+    struct Val {  // value of a location after one loop round, in terms of the values it started with
+        bool konst;
+        u16 loc;  // IRAM address, LOC_A for the accumulator, LOC_UNKNOWN if there is no such form
+        u8 off;   // added to it, or the constant
+    };
+    struct Spin {
+        uint32_t cycles;  // one round, jump back included
+        u16 counter;
+        u8 step;          // 1 or 0xFF
+        u8 test;          // the loop ends once counter + test is 0 at the end of a round
+        std::vector<std::pair<u16, Val>> writes;  // everything else the round leaves behind
+    };
+    struct Block {
+        u16 start;
+        uint32_t first, count, cycles;
+        bool io;  // touches the peripherals or the interrupt system, stop_ is checked after every instruction
+        std::array<int32_t, 4> spin = {-2, -2, -2, -2};  // per register bank: index into dec_->spins, -1 none, -2 not looked at
+        bool head = false;  // a backward branch goes here
+        std::array<int32_t, 4> loop = {-1, -1, -1, -1};  // per register bank: index into dec_->loops
+    };
+    // a loop of several blocks is traced instead: the path one round takes is recorded with what it leaves behind and
+    // the branch conditions that kept it on that path. Following rounds are applied from the trace for as long as the
+    // conditions come out the same, however long the path is (the delay() loop around `while(wait--)` is ~370
+    // instructions a round).
+    struct Flag {  // CY as an addition or a compare leaves it
+        u8 op;       // FLAG_* below
+        Val a, b;
+        int8_t cin;  // index of the flag that went in, or CY_CLEAR / CY_SET
+    };
+    struct Guard {
+        int8_t flag;  // a branch on that flag, or -1 for a == b
+        Val a, b;
+        bool outcome;
+    };
+    struct Trace {
+        uint32_t cycles = 0;
+        std::vector<std::pair<u16, Val>> writes;
+        std::vector<Flag> flags;  // flags[0] is CY at the start of the round
+        std::vector<Guard> guards;
+        int8_t cy = 0;      // flag CY is left as, CY_UNKNOWN if it has no closed form
+        bool rest = false;  // leaves more without a closed form (AC, OV...), so the round after one applied runs for real
+    };
+    struct Loop {
+        std::vector<Trace> traces;  // one per path seen
+        unsigned failures = 0;      // rounds that could not be traced
+    };
+    struct Decoded {  // everything learned about the code, only depends on the image
+        std::vector<int32_t> index = std::vector<int32_t>(0x10000, -1);  // block starting at each code address
+        std::vector<Block> blocks;
+        std::vector<Insn> insns;
+        std::vector<Spin> spins;
+        std::vector<bool> heads = std::vector<bool>(0x10000, false);  // loop heads, also the ones not decoded yet
+        std::vector<Loop> loops;
+    };
+    enum : u8 { FLAG_START, FLAG_CARRY, FLAG_BORROW };  // CY at round start, a + b + cin > 0xFF, a < b + cin
+    static constexpr int8_t CY_CLEAR = -1, CY_SET = -2, CY_UNKNOWN = -3;
+    static constexpr size_t TRACE_MAX = 32;  // writes and flags
+    static constexpr u16 LOC_A = 0x100, LOC_UNKNOWN = 0xFFFF;
+
+    // cycle k starts at k * 12 / FOSC s, now() is that rounded down to the ns (now_frac() has the rest)
+    static Time time_of(uint64_t k) { return k / FOSC * 12 * SEC + k % FOSC * 12 * SEC / FOSC; }
+    static uint64_t cycle_at(Time t) {  // first cycle starting at or after t
+        const uint64_t d = 12 * SEC;
+        return t / d * FOSC + (t % d * FOSC + d - 1) / d;
+    }
+
+    void sync() { run_until(time_of(cycles_)); }  // peripherals catch up with the core
+    void boundary() {  // between instructions: interrupts, and how far the core may run unchecked
+        sync();
+        if(cycles_ >= pause_) throw Pause{};  // peripherals are in step with the core here, run_to() can resume
+        if(hold_) {  // RETI or an IE/IP write, one more instruction goes first
+            hold_ = false;
+            stop_ = cycles_ + 1;
+            return;
+        }
+        if(int n = irq()) vector(n - 1);
+        stop_ = std::min(cycle_at(next_activity()), pause_);
+    }
+    void resume() {  // after an SFR write: idle mode ends somewhere ahead, and the next boundary checks interrupts
+        if(now() > time_of(cycles_)) cycles_ = cycle_at(now());
+        stop_ = 0;
+    }
+
+    int irq() const {  // interrupt source + 1 that would be vectored now, 0 if none
+        u8 ie = sfr_latch(0xA8);
+        if(!(ie & 0x80)) return 0;
+        u8 tcon = sfr_latch(0x88);
+        u8 req = ie & ((tcon >> 1 & 0x01) | (tcon >> 4 & 0x02) | (tcon >> 1 & 0x04) | (tcon >> 4 & 0x08) |
+                       ((sfr_latch(0x98) & 0x03) ? 0x10 : 0));
+        if(!req) return 0;
+        u8 high = req & sfr_latch(0xB8);
+        if(high) return (in_service_ & 2) ? 0 : 1 + __builtin_ctz(high);
+        return in_service_ ? 0 : 1 + __builtin_ctz(req);
+    }
+    void vector(int src) {  // hardware LCALL, edge flags and timer flags are cleared on the way
+        u8 tcon = sfr_latch(0x88);
+        if(src == 0 && (tcon & 0x01)) write_bit(0x89, false);
+        if(src == 1) write_bit(0x8D, false);
+        if(src == 2 && (tcon & 0x04)) write_bit(0x8B, false);
+        if(src == 3) write_bit(0x8F, false);
+        in_service_ |= ((sfr_latch(0xB8) >> src) & 1) ? 2 : 1;
+        push(u8(pc_));
+        push(u8(pc_ >> 8));
+        pc_ = u16(3 + 8 * src);
+        cycles_ += 2;
+        stats_.interrupts++;
+    }
+
+    // decoding
+    void own() {  // copy on write before decoding more, forks share the rest and may run on other threads
+        if(dec_.use_count() > 1) dec_ = std::make_shared<Decoded>(*dec_);
+    }
+    static u8 length(u8 op) {
+        if((op & 0x1F) == 0x01) return 2;  // AJMP, ACALL
+        switch(op) {
+            case 0x02: case 0x12: case 0x10: case 0x20: case 0x30: case 0x43: case 0x53: case 0x63: case 0x75:
+            case 0x85: case 0x90: case 0xB4: case 0xB5: case 0xB6: case 0xB7: case 0xD5:
+                return 3;
+            case 0x05: case 0x15: case 0x24: case 0x25: case 0x34: case 0x35: case 0x40: case 0x42: case 0x44:
+            case 0x45: case 0x50: case 0x52: case 0x54: case 0x55: case 0x60: case 0x62: case 0x64: case 0x65:
+            case 0x70: case 0x72: case 0x74: case 0x76: case 0x77: case 0x80: case 0x82: case 0x86: case 0x87:
+            case 0x92: case 0x94: case 0x95: case 0xA0: case 0xA2: case 0xA6: case 0xA7: case 0xB0: case 0xB2:
+            case 0xC0: case 0xC2: case 0xC5: case 0xD0: case 0xD2: case 0xE5: case 0xF5:
+                return 2;
+        }
+        if(op >= 0xB8 && op <= 0xBF) return 3;  // CJNE Rn
+        if((op & 0xF8) == 0x78 || (op & 0xF8) == 0x88 || (op & 0xF8) == 0xA8 || (op & 0xF8) == 0xD8) return 2;
+        return 1;
+    }
+    static u8 machine_cycles(u8 op) {
+        if(op == 0x84 || op == 0xA4) return 4;  // DIV, MUL
+        if((op & 0x1F) == 0x01) return 2;
+        switch(op) {
+            case 0x02: case 0x10: case 0x12: case 0x20: case 0x22: case 0x30: case 0x32: case 0x40: case 0x43:
+            case 0x50: case 0x53: case 0x60: case 0x63: case 0x70: case 0x72: case 0x73: case 0x75: case 0x80:
+            case 0x82: case 0x83: case 0x85: case 0x86: case 0x87: case 0x90: case 0x92: case 0x93: case 0xA0:
+            case 0xA3: case 0xA6: case 0xA7: case 0xB0: case 0xC0: case 0xD0: case 0xD5: case 0xE0: case 0xE2:
+            case 0xE3: case 0xF0: case 0xF2: case 0xF3:
+                return 2;
+        }
+        u8 row = op & 0xF8;
+        if(row == 0x88 || row == 0xA8 || row == 0xD8 || (op >= 0xB4 && op <= 0xBF)) return 2;
+        return 1;
+    }
+    static bool ends_block(u8 op) {
+        if((op & 0x1F) == 0x01 || (op & 0xF8) == 0xD8 || (op >= 0xB4 && op <= 0xBF)) return true;
+        switch(op) {
+            case 0x02: case 0x10: case 0x12: case 0x20: case 0x22: case 0x30: case 0x32: case 0x40: case 0x50:
+            case 0x60: case 0x70: case 0x73: case 0x80: case 0xD5:
+                return true;
+        }
+        return false;
+    }
+    static int32_t branch_target(const Insn& in) {  // jumps and branches, -1 for anything else
+        u8 op = in.op;
+        if(op == 0x02) return in.a << 8 | in.b;
+        if((op & 0x1F) == 0x01 && !(op & 0x10)) return (in.next & 0xF800) | (op >> 5) << 8 | in.a;  // AJMP
+        if(op == 0x40 || op == 0x50 || op == 0x60 || op == 0x70 || op == 0x80 || (op & 0xF8) == 0xD8)
+            return u16(in.next + int8_t(in.a));
+        if(op == 0x10 || op == 0x20 || op == 0x30 || op == 0xD5 || (op >= 0xB4 && op <= 0xBF))
+            return u16(in.next + int8_t(in.b));
+        return -1;
+    }
+    static u16 sym_loc(u8 addr) { return (addr < 0x80) ? addr : (addr == 0xE0) ? LOC_A : LOC_UNKNOWN; }
+    static bool core_reg(u8 addr) {  // SFRs the core keeps itself
+        return addr == 0xE0 || addr == 0xF0 || addr == 0xD0 || addr == 0x81 || addr == 0x82 || addr == 0x83;
+    }
+    static bool io(const Insn& in) {  // may reach the peripherals or change what interrupts can be taken
+        u8 op = in.op;
+        if(op == 0x32) return true;  // RETI
+        if(op == 0x85) return (in.a >= 0x80 && !core_reg(in.a)) || (in.b >= 0x80 && !core_reg(in.b));
+        switch(op) {
+            case 0x10: case 0x20: case 0x30: case 0x72: case 0x82: case 0x92: case 0xA0: case 0xA2: case 0xB0:
+            case 0xB2: case 0xC2: case 0xD2:  // bit operand
+                return in.a >= 0x80 && !core_reg(in.a & 0xF8);
+        }
+        bool direct = op == 0x05 || op == 0x15 || op == 0x42 || op == 0x43 || op == 0x52 || op == 0x53 ||
+                      op == 0x62 || op == 0x63 || op == 0x75 || op == 0xB5 || op == 0xC0 || op == 0xC5 ||
+                      op == 0xD0 || op == 0xD5 || op == 0xE5 || op == 0xF5 || (op & 0x0F) == 0x05 ||
+                      (op & 0xFE) == 0x86 || (op & 0xF8) == 0x88 || (op & 0xFE) == 0xA6 || (op & 0xF8) == 0xA8;
+        return direct && in.a >= 0x80 && !core_reg(in.a);
+    }
+
+    uint32_t block(u16 pc) {
+        if(dec_->index[pc] >= 0) return uint32_t(dec_->index[pc]);
+        own();
+        Block b{pc, uint32_t(dec_->insns.size()), 0, 0, false};
+        b.head = dec_->heads[pc];
+        const std::vector<u8>& code = img_->code;
+        for(u16 p = pc;;) {
+            Insn in{code[p], code[u16(p + 1)], code[u16(p + 2)], machine_cycles(code[p]), u16(p + length(code[p]))};
+            if(in.op == 0xA5) throw std::runtime_error("undefined opcode 0xA5 at " + std::to_string(p));
+            dec_->insns.push_back(in);
+            b.count++;
+            b.cycles += in.cycles;
+            b.io |= io(in);
+            int32_t t = branch_target(in);
+            if(t >= 0 && t <= p) {  // backward, a loop head
+                dec_->heads[t] = true;
+                if(t == pc) b.head = true;
+                else if(dec_->index[t] >= 0) dec_->blocks[dec_->index[t]].head = true;
+            }
+            p = in.next;
+            if(ends_block(in.op) || b.count == 64) break;
+        }
+        dec_->index[pc] = int32_t(dec_->blocks.size());
+        dec_->blocks.push_back(b);
+        return uint32_t(dec_->index[pc]);
+    }
+
+    // spin loops
+    int32_t analyze(uint32_t bi, u8 bank) {  // index into dec_->spins if the block is a loop we can fast-forward
+        Block b = dec_->blocks[bi];
+        if(b.io) return -1;
+        std::vector<std::pair<u16, Val>> cur;
+        auto get = [&](u16 loc) {
+            for(auto& w : cur) {
+                if(w.first == loc) return w.second;
+            }
+            return Val{false, loc, 0};
+        };
+        auto set = [&](u16 loc, Val v) {
+            for(auto& w : cur) {
+                if(w.first == loc) {
+                    w.second = v;
+                    return;
+                }
+            }
+            cur.push_back({loc, v});
+        };
+        for(uint32_t i = b.first; i + 1 < b.first + b.count; i++) {
+            const Insn& in = dec_->insns[i];
+            u8 op = in.op;
+            u16 rn = u16(bank * 8 + (op & 7));
+            u16 da = sym_loc(in.a), db = sym_loc(in.b);
+            if(op == 0x00) continue;
+            else if(op == 0x04 || op == 0x14 || op == 0x05 || op == 0x15 || (op & 0xE8) == 0x08) {  // INC, DEC
+                u16 loc = (op & 0x0F) == 0x04 ? LOC_A : (op & 0x0F) == 0x05 ? da : rn;
+                if(loc == LOC_UNKNOWN) return -1;
+                Val v = get(loc);
+                v.off += (op & 0x10) ? 0xFF : 1;
+                set(loc, v);
+            }
+            else if(op == 0xE4) set(LOC_A, {true, 0, 0});
+            else if(op == 0x74) set(LOC_A, {true, 0, in.a});
+            else if((op & 0xF8) == 0x78) set(rn, {true, 0, in.a});
+            else if(op == 0x75 && da != LOC_UNKNOWN) set(da, {true, 0, in.b});
+            else if(op == 0xE5 && da != LOC_UNKNOWN) set(LOC_A, get(da));
+            else if((op & 0xF8) == 0xE8) set(LOC_A, get(rn));
+            else if(op == 0xF5 && da != LOC_UNKNOWN) set(da, get(LOC_A));
+            else if((op & 0xF8) == 0xF8) set(rn, get(LOC_A));
+            else if(op == 0x85 && da != LOC_UNKNOWN && db != LOC_UNKNOWN) set(db, get(da));
+            else if((op & 0xF8) == 0x88 && da != LOC_UNKNOWN) set(da, get(rn));
+            else if((op & 0xF8) == 0xA8 && da != LOC_UNKNOWN) set(rn, get(da));
+            else return -1;
+        }
+        const Insn& last = dec_->insns[b.first + b.count - 1];
+        u8 op = last.op;
+        int32_t taken = branch_target(last);
+        Val test;
+        if(op == 0x60) {  // JZ out, then a jump back
+            const Block& f = dec_->blocks[block(last.next)];
+            const Insn& j = dec_->insns[f.first];
+            if(f.count != 1 || (j.op != 0x80 && j.op != 0x02 && (j.op & 0x1F) != 0x01) || branch_target(j) != b.start)
+                return -1;
+            b.cycles += j.cycles;
+            test = get(LOC_A);
+        }
+        else if(taken != b.start) return -1;
+        else if(op == 0x70) test = get(LOC_A);  // JNZ
+        else if((op & 0xF8) == 0xD8 || op == 0xD5) {  // DJNZ
+            u16 loc = (op == 0xD5) ? sym_loc(last.a) : u16(bank * 8 + (op & 7));
+            if(loc == LOC_UNKNOWN) return -1;
+            test = get(loc);
+            test.off--;
+            set(loc, test);
+        }
+        else if(op == 0xB4 || (op & 0xF8) == 0xB8) {  // CJNE with an immediate, CY is redone by the last round
+            test = get(op == 0xB4 ? LOC_A : u16(bank * 8 + (op & 7)));
+            test.off -= last.a;
+        }
+        else return -1;
+        if(test.konst) return -1;
+        Spin s{b.cycles, test.loc, 0, test.off, {}};
+        Val c = get(s.counter);
+        if(c.konst || c.loc != s.counter || (c.off != 1 && c.off != 0xFF)) return -1;
+        s.step = c.off;
+        for(auto& w : cur) {
+            if(w.first == s.counter) continue;
+            bool reread = false;  // depends on something a round rewrites, no closed form
+            for(auto& x : cur) reread |= !w.second.konst && w.second.loc != s.counter && w.second.loc == x.first;
+            if(reread) return -1;
+            s.writes.push_back(w);
+        }
+        dec_->spins.push_back(std::move(s));
+        return int32_t(dec_->spins.size() - 1);
+    }
+
+    bool spin(uint32_t bi) {  // fast-forward the spin loop starting here, if this is one
+        int32_t si = dec_->blocks[bi].spin[psw_ >> 3 & 3];
+        if(si == -2) {
+            own();
+            int32_t r = analyze(bi, psw_ >> 3 & 3);
+            dec_->blocks[bi].spin[psw_ >> 3 & 3] = r;  // analyze() may have added blocks
+            return r >= 0 && spin(bi);
+        }
+        if(si < 0) return false;
+        const Spin& s = dec_->spins[uint32_t(si)];
+        u8& counter = loc(s.counter);
+        u8 rounds = (s.step == 1) ? u8(-(counter + s.test)) : u8(counter + s.test);  // before the one that ends it
+        uint64_t m = std::min<uint64_t>(rounds, (stop_ - cycles_) / s.cycles);
+        if(!m) return false;
+        u8 last = u8(counter + (m - 1) * s.step);  // counter at the start of the last round skipped
+        for(auto& w : s.writes) {
+            const Val& v = w.second;
+            loc(w.first) = v.konst ? v.off : u8(((v.loc == s.counter) ? last : loc(v.loc)) + v.off);
+        }
+        counter = u8(counter + m * s.step);
+        cycles_ += m * s.cycles;
+        stats_.spin_rounds += m;
+        stats_.spin_cycles += m * s.cycles;
+        return true;
+    }
+    // traced loops
+    bool loop(uint32_t bi) {  // apply rounds of the loop starting here from its traces
+        u8 bank = psw_ >> 3 & 3;
+        int32_t li = dec_->blocks[bi].loop[bank];
+        if(li >= 0) {
+            const Loop& l = dec_->loops[uint32_t(li)];
+            for(const Trace& t : l.traces) {
+                int64_t n = rounds(t);
+                if(n >= 0) return n > 0;
+            }
+            if(l.failures >= 32 || l.traces.size() >= 8) return false;  // gave up on new paths
+        }
+        own();
+        if(li < 0) {
+            li = int32_t(dec_->loops.size());
+            dec_->loops.emplace_back();
+            dec_->blocks[bi].loop[bank] = li;
+        }
+        Loop& l = dec_->loops[uint32_t(li)];
+        Trace t;
+        if(!trace(dec_->blocks[bi].start, bank, t)) {
+            l.failures++;
+            return false;
+        }
+        l.traces.push_back(std::move(t));
+        return rounds(l.traces.back()) > 0;
+    }
+
+    bool trace(u16 head, u8 bank, Trace& t) {  // follow one round from the current state, false if it has no trace
+        struct Sym {
+            Val v;
+            u8 c;  // value right now
+        };
+        std::vector<std::pair<u16, Sym>> cur;
+        auto get = [&](u16 l) {
+            for(auto& w : cur) {
+                if(w.first == l) return w.second;
+            }
+            return Sym{{false, l, 0}, loc(l)};
+        };
+        auto set = [&](u16 l, Sym v) {
+            for(auto& w : cur) {
+                if(w.first == l) {
+                    w.second = v;
+                    return;
+                }
+            }
+            cur.push_back({l, v});
+        };
+        auto known = [](const Val& v) { return v.konst || v.loc != LOC_UNKNOWN; };
+        auto konst = [](u8 c) { return Sym{{true, 0, c}, c}; };
+        auto unknown = [](u8 c) { return Sym{{false, LOC_UNKNOWN, 0}, c}; };
+        auto guard = [&](int8_t flag, Val a, Val b, bool outcome) {
+            if(flag < 0 && a.konst && b.konst) return true;  // same every round
+            if(flag == CY_UNKNOWN || !known(a) || !known(b)) return false;
+            t.guards.push_back({flag, a, b, outcome});
+            return true;
+        };
+        t.flags.push_back({FLAG_START, {}, {}, 0});
+        int8_t cy_sym = 0;
+        bool cy_now = cy();
+        auto flag = [&](u8 op, const Sym& a, const Sym& b, int8_t cin) {
+            bool c = (cin == CY_CLEAR) ? false : (cin == CY_SET) ? true : cy_now;
+            cy_now = (op == FLAG_CARRY) ? a.c + b.c + c > 0xFF : a.c < b.c + c;
+            if(cin == CY_UNKNOWN || !known(a.v) || !known(b.v) || t.flags.size() >= TRACE_MAX) cy_sym = CY_UNKNOWN;
+            else {
+                t.flags.push_back({op, a.v, b.v, cin});
+                cy_sym = int8_t(t.flags.size() - 1);
+            }
+        };
+        for(u16 pc = head, n = 0; n < 4096;) {
+            uint32_t bi = block(pc);
+            uint32_t first = dec_->blocks[bi].first, count = dec_->blocks[bi].count;
+            pc = dec_->insns[first + count - 1].next;
+            for(uint32_t k = 0; k < count; k++, n++) {
+                const Insn in = dec_->insns[first + k];
+                u8 op = in.op, lo = op & 0x0F;
+                if(io(in)) return false;
+                t.cycles += in.cycles;
+                u16 rn = u16(bank * 8 + (op & 7));
+                u16 da = sym_loc(in.a), db = sym_loc(in.b);
+                // operand of the arithmetic columns: #data, direct or Rn (@Ri has no fixed location)
+                u16 src = (lo >= 8) ? rn : (lo == 5) ? da : LOC_UNKNOWN;
+                Sym s = (lo == 4) ? konst(in.a) : (src != LOC_UNKNOWN) ? get(src) : unknown(0);
+                bool arith = lo == 4 || src != LOC_UNKNOWN;
+                bool jump = false;
+                if(op == 0x00) continue;
+                else if(op == 0x02 || op == 0x80 || ((op & 0x1F) == 0x01 && !(op & 0x10))) jump = true;
+                else if(op == 0x04 || op == 0x14 || op == 0x05 || op == 0x15 || (op & 0xE8) == 0x08) {  // INC, DEC
+                    u16 l = (lo == 0x04) ? LOC_A : (lo == 0x05) ? da : rn;
+                    if(l == LOC_UNKNOWN) return false;
+                    Sym v = get(l);
+                    u8 d = (op & 0x10) ? 0xFF : 1;
+                    if(known(v.v)) v.v.off += d;
+                    v.c += d;
+                    set(l, v);
+                }
+                else if(op == 0xE4) set(LOC_A, konst(0));
+                else if(op == 0x74) set(LOC_A, konst(in.a));
+                else if((op & 0xF8) == 0x78) set(rn, konst(in.a));
+                else if(op == 0x75 && da != LOC_UNKNOWN) set(da, konst(in.b));
+                else if((op == 0xE5 || (op & 0xF8) == 0xE8) && arith) set(LOC_A, s);
+                else if(op == 0xF5 && da != LOC_UNKNOWN) set(da, get(LOC_A));
+                else if((op & 0xF8) == 0xF8) set(rn, get(LOC_A));
+                else if(op == 0x85 && da != LOC_UNKNOWN && db != LOC_UNKNOWN) set(db, get(da));
+                else if((op & 0xF8) == 0x88 && da != LOC_UNKNOWN) set(da, get(rn));
+                else if((op & 0xF8) == 0xA8 && da != LOC_UNKNOWN) set(rn, get(da));
+                else if((op >> 4 == 0x2 || op >> 4 == 0x3 || op >> 4 == 0x9) && lo >= 4 && arith) {  // ADD, ADDC, SUBB
+                    Sym a = get(LOC_A);
+                    bool sub = op >> 4 == 0x9;
+                    int8_t cin = (op >> 4 == 0x2) ? CY_CLEAR : cy_sym;
+                    bool c = (op >> 4 == 0x2) ? false : cy_now;
+                    Sym r = unknown(u8(sub ? a.c - s.c - c : a.c + s.c + c));
+                    if(cin == CY_CLEAR || cin == CY_SET) {  // stays affine with a constant on one side
+                        u8 k = u8(cin == CY_SET);
+                        if(s.v.konst && known(a.v)) r.v = {a.v.konst, a.v.loc, u8(sub ? a.v.off - s.v.off - k : a.v.off + s.v.off + k)};
+                        else if(!sub && a.v.konst && known(s.v)) r.v = {s.v.konst, s.v.loc, u8(s.v.off + a.v.off + k)};
+                    }
+                    flag(sub ? FLAG_BORROW : FLAG_CARRY, a, s, cin);
+                    t.rest = true;  // AC and OV
+                    set(LOC_A, r);
+                }
+                else if((op >> 4 == 0x4 || op >> 4 == 0x5 || op >> 4 == 0x6) && lo >= 4 && arith) {  // ORL, ANL, XRL
+                    Sym a = get(LOC_A);
+                    u8 c = (op >> 4 == 0x4) ? a.c | s.c : (op >> 4 == 0x5) ? a.c & s.c : a.c ^ s.c;
+                    set(LOC_A, (a.v.konst && s.v.konst) ? konst(c) : unknown(c));
+                }
+                else if(op == 0xC3) {
+                    cy_sym = CY_CLEAR;
+                    cy_now = false;
+                }
+                else if(op == 0xD3) {
+                    cy_sym = CY_SET;
+                    cy_now = true;
+                }
+                else if(op == 0x60 || op == 0x70) {  // JZ, JNZ
+                    Sym a = get(LOC_A);
+                    if(!guard(-1, a.v, {true, 0, 0}, a.c == 0)) return false;
+                    jump = (a.c == 0) == (op == 0x60);
+                }
+                else if(op == 0x40 || op == 0x50) {  // JC, JNC
+                    if(cy_sym >= 0 && !guard(cy_sym, {true, 0, 0}, {true, 0, 0}, cy_now)) return false;
+                    if(cy_sym == CY_UNKNOWN) return false;
+                    jump = cy_now == (op == 0x40);
+                }
+                else if((op & 0xF8) == 0xD8 || op == 0xD5) {  // DJNZ
+                    u16 l = (op == 0xD5) ? da : rn;
+                    if(l == LOC_UNKNOWN) return false;
+                    Sym v = get(l);
+                    if(known(v.v)) v.v.off--;
+                    v.c--;
+                    set(l, v);
+                    if(!guard(-1, v.v, {true, 0, 0}, v.c == 0)) return false;
+                    jump = v.c != 0;
+                }
+                else if(op == 0xB4 || op == 0xB5 || (op & 0xF8) == 0xB8) {  // CJNE
+                    Sym a = get((op & 0xF8) == 0xB8 ? rn : LOC_A);
+                    Sym b = (op == 0xB5) ? (da != LOC_UNKNOWN ? get(da) : unknown(0)) : konst(in.a);
+                    if(op == 0xB5 && da == LOC_UNKNOWN) return false;
+                    if(!guard(-1, a.v, b.v, a.c == b.c)) return false;
+                    flag(FLAG_BORROW, a, b, CY_CLEAR);
+                    jump = a.c != b.c;
+                }
+                else return false;  // calls, returns, anything with a side we cannot follow
+                if(jump || k + 1 == count) {
+                    if(jump) pc = u16(branch_target(in));
+                    break;
+                }
+            }
+            if(pc != head) continue;
+            // round complete: what depends on the start values must not read what has no closed form
+            std::vector<u16> lost;
+            for(auto& w : cur) {
+                if(!known(w.second.v)) lost.push_back(w.first);
+                else if(w.second.v.konst || w.second.v.loc != w.first || w.second.v.off) t.writes.push_back({w.first, w.second.v});
+            }
+            t.cy = cy_sym;
+            if(!lost.empty() || cy_sym == CY_UNKNOWN) t.rest = true;
+            auto reads_lost = [&](const Val& v) {
+                return !v.konst && std::find(lost.begin(), lost.end(), v.loc) != lost.end();
+            };
+            bool start_cy = cy_sym == 0;  // used by the next round
+            for(auto& w : t.writes) {
+                if(reads_lost(w.second)) return false;
+            }
+            for(auto& g : t.guards) {
+                if(reads_lost(g.a) || reads_lost(g.b)) return false;
+                start_cy |= g.flag == 0;
+            }
+            for(size_t i = 1; i < t.flags.size(); i++) {
+                if(reads_lost(t.flags[i].a) || reads_lost(t.flags[i].b)) return false;
+                start_cy |= t.flags[i].cin == 0;
+            }
+            if(cy_sym == CY_UNKNOWN && start_cy) return false;
+            return t.writes.size() <= TRACE_MAX;
+        }
+        return false;  // too long a round
+    }
+
+    void eval_flags(const Trace& t, bool* f) {
+        for(size_t i = 0; i < t.flags.size(); i++) {
+            const Flag& x = t.flags[i];
+            if(x.op == FLAG_START) {
+                f[i] = cy();
+                continue;
+            }
+            bool c = (x.cin == CY_SET) || (x.cin >= 0 && f[x.cin]);
+            unsigned a = eval(x.a), b = eval(x.b);
+            f[i] = (x.op == FLAG_CARRY) ? a + b + c > 0xFF : a < b + c;
+        }
+    }
+    bool holds(const Trace& t, const bool* f) {
+        for(auto& g : t.guards) {
+            if(((g.flag >= 0) ? f[g.flag] : eval(g.a) == eval(g.b)) != g.outcome) return false;
+        }
+        return true;
+    }
+    int64_t rounds(const Trace& t) {  // -1 if the state is not on the path of the trace, else rounds applied
+        bool f[TRACE_MAX];
+        eval_flags(t, f);
+        if(!holds(t, f)) return -1;
+        uint64_t need = t.rest ? 2 * uint64_t(t.cycles) : t.cycles;
+        uint64_t n = 0;
+        u8 before[TRACE_MAX], after[TRACE_MAX];
+        while(cycles_ + need <= stop_) {
+            bool cy_before = cy();
+            for(size_t i = 0; i < t.writes.size(); i++) {
+                before[i] = loc(t.writes[i].first);
+                after[i] = eval(t.writes[i].second);
+            }
+            bool same = cy_before == (t.cy == CY_UNKNOWN ? cy_before : t.cy == CY_SET || (t.cy >= 0 && f[t.cy]));
+            if(t.cy != CY_UNKNOWN) set_cy(t.cy == CY_SET || (t.cy >= 0 && f[t.cy]));
+            for(size_t i = 0; i < t.writes.size(); i++) {
+                loc(t.writes[i].first) = after[i];
+                same &= after[i] == before[i];
+            }
+            if(same) {  // nothing moves any more, every round that fits is the same
+                uint64_t m = (stop_ - cycles_ - need) / t.cycles + 1;
+                cycles_ += m * t.cycles;
+                n += m;
+                break;
+            }
+            eval_flags(t, f);
+            bool next = holds(t, f);
+            if(!next && t.rest) {  // the real round after would leave the path, let it be the last one instead
+                for(size_t i = 0; i < t.writes.size(); i++) loc(t.writes[i].first) = before[i];
+                set_cy(cy_before);
+                break;
+            }
+            cycles_ += t.cycles;
+            n++;
+            if(!next) break;
+        }
+        stats_.loop_rounds += n;
+        stats_.loop_cycles += n * t.cycles;
+        return int64_t(n);
+    }
+    u8 eval(const Val& v) { return v.konst ? v.off : u8(loc(v.loc) + v.off); }
+    u8& loc(u16 l) { return (l == LOC_A) ? acc_ : iram_[l]; }
+
+    // data access
+    u8 psw() const { return u8((psw_ & 0xFE) | __builtin_parity(acc_)); }
+    bool cy() const { return psw_ >> 7; }
+    void set_cy(bool c) { psw_ = c ? (psw_ | 0x80) : (psw_ & 0x7F); }
+    u8& reg(u8 n) { return iram_[(psw_ & 0x18) + n]; }
+    void push(u8 v) {
+        iram_[++sp_] = v;
+        if(sp_ > stats_.sp_peak) stats_.sp_peak = sp_;
+    }
+    u8 pop() { return iram_[sp_--]; }
+
+    u8 rd(u8 addr) {
+        if(addr < 0x80) return iram_[addr];
+        switch(addr) {
+            case 0xE0: return acc_;
+            case 0xF0: return b_;
+            case 0xD0: return psw();
+            case 0x81: return sp_;
+            case 0x82: return u8(dptr_);
+            case 0x83: return u8(dptr_ >> 8);
+        }
+        sync();
+        stop_ = 0;  // whatever came in meanwhile may want an interrupt
+        return read_sfr(addr);
+    }
+    u8 rd_latch(u8 addr) {  // read-modify-write instructions see the port latch, not the pins
+        if(addr != 0x90 && addr != 0xB0) return rd(addr);
+        sync();
+        return sfr_latch(addr);
+    }
+    void wr(u8 addr, u8 v) {
+        if(addr < 0x80) {
+            iram_[addr] = v;
+            return;
+        }
+        switch(addr) {
+            case 0xE0: acc_ = v; return;
+            case 0xF0: b_ = v; return;
+            case 0xD0: psw_ = v; return;
+            case 0x81: sp_ = v; return;
+            case 0x82: dptr_ = u16((dptr_ & 0xFF00) | v); return;
+            case 0x83: dptr_ = u16((dptr_ & 0x00FF) | v << 8); return;
+        }
+        sync();
+        if(addr == 0xA8 || addr == 0xB8) hold_ = true;
+        write_sfr(addr, v);
+        resume();
+    }
+    bool rd_bit(u8 bit) {
+        if(bit < 0x80) return iram_[0x20 + (bit >> 3)] >> (bit & 7) & 1;
+        if(core_reg(bit & 0xF8)) return rd(bit & 0xF8) >> (bit & 7) & 1;
+        sync();
+        stop_ = 0;
+        return read_bit(bit);
+    }
+    bool rd_bit_latch(u8 bit) {
+        if(bit < 0x80 || core_reg(bit & 0xF8)) return rd_bit(bit);
+        sync();
+        return latch(bit);
+    }
+    void wr_bit(u8 bit, bool v) {
+        u8 mask = u8(1 << (bit & 7));
+        if(bit < 0x80 || core_reg(bit & 0xF8)) {
+            u8 addr = (bit < 0x80) ? u8(0x20 + (bit >> 3)) : u8(bit & 0xF8);
+            u8 r = rd(addr);
+            wr(addr, v ? (r | mask) : (r & ~mask));
+            return;
+        }
+        sync();
+        if((bit & 0xF8) == 0xA8 || (bit & 0xF8) == 0xB8) hold_ = true;
+        write_bit(bit, v);
+        resume();
+    }
+
+    // arithmetic
+    void add(u8 v, bool c) {
+        unsigned r = acc_ + v + c;
+        bool ac = (acc_ & 0x0F) + (v & 0x0F) + c > 0x0F;
+        bool ov = (~(acc_ ^ v) & (acc_ ^ r) & 0x80) != 0;
+        psw_ = u8((psw_ & 0x3B) | (r > 0xFF) << 7 | ac << 6 | ov << 2);
+        acc_ = u8(r);
+    }
+    void subb(u8 v) {
+        bool c = cy();
+        unsigned r = unsigned(acc_) - v - c;
+        bool ac = (acc_ & 0x0F) < (v & 0x0F) + c;
+        bool ov = ((acc_ ^ v) & (acc_ ^ r) & 0x80) != 0;
+        psw_ = u8((psw_ & 0x3B) | (acc_ < v + c) << 7 | ac << 6 | ov << 2);
+        acc_ = u8(r);
+    }
+    void jump(u8 rel) { pc_ = u16(pc_ + int8_t(rel)); }
+    void cjne(u8 x, u8 y, u8 rel) {
+        set_cy(x < y);
+        if(x != y) jump(rel);
+    }
+
+    __attribute__((always_inline)) void exec(const Insn& in) {
+        u8 op = in.op, a = in.a, b = in.b;
+        pc_ = in.next;
+        switch(op) {
+            case 0x00: break;
+            case 0x02: pc_ = u16(a << 8 | b); break;  // LJMP
+            case 0x03: acc_ = u8(acc_ >> 1 | acc_ << 7); break;  // RR A
+            case 0x04: acc_++; break;
+            case 0x05: wr(a, u8(rd_latch(a) + 1)); break;
+            case 0x10: {  // JBC
+                if(rd_bit_latch(a)) {
+                    wr_bit(a, false);
+                    jump(b);
+                }
+                break;
+            }
+            case 0x12:  // LCALL
+                push(u8(pc_));
+                push(u8(pc_ >> 8));
+                pc_ = u16(a << 8 | b);
+                break;
+            case 0x13: {  // RRC A
+                bool c = acc_ & 1;
+                acc_ = u8(acc_ >> 1 | cy() << 7);
+                set_cy(c);
+                break;
+            }
+            case 0x14: acc_--; break;
+            case 0x15: wr(a, u8(rd_latch(a) - 1)); break;
+            case 0x20: if(rd_bit(a)) jump(b); break;  // JB
+            case 0x22:  // RET
+                pc_ = u16(pop() << 8);
+                pc_ |= pop();
+                break;
+            case 0x23: acc_ = u8(acc_ << 1 | acc_ >> 7); break;  // RL A
+            case 0x24: add(a, false); break;
+            case 0x25: add(rd(a), false); break;
+            case 0x30: if(!rd_bit(a)) jump(b); break;  // JNB
+            case 0x32:  // RETI
+                pc_ = u16(pop() << 8);
+                pc_ |= pop();
+                in_service_ &= (in_service_ & 2) ? 1 : 0;
+                hold_ = true;
+                stop_ = 0;
+                break;
+            case 0x33: {  // RLC A
+                bool c = acc_ >> 7;
+                acc_ = u8(acc_ << 1 | cy());
+                set_cy(c);
+                break;
+            }
+            case 0x34: add(a, cy()); break;
+            case 0x35: add(rd(a), cy()); break;
+            case 0x40: if(cy()) jump(a); break;  // JC
+            case 0x42: wr(a, rd_latch(a) | acc_); break;
+            case 0x43: wr(a, rd_latch(a) | b); break;
+            case 0x44: acc_ |= a; break;
+            case 0x45: acc_ |= rd(a); break;
+            case 0x50: if(!cy()) jump(a); break;  // JNC
+            case 0x52: wr(a, rd_latch(a) & acc_); break;
+            case 0x53: wr(a, rd_latch(a) & b); break;
+            case 0x54: acc_ &= a; break;
+            case 0x55: acc_ &= rd(a); break;
+            case 0x60: if(!acc_) jump(a); break;  // JZ
+            case 0x62: wr(a, rd_latch(a) ^ acc_); break;
+            case 0x63: wr(a, rd_latch(a) ^ b); break;
+            case 0x64: acc_ ^= a; break;
+            case 0x65: acc_ ^= rd(a); break;
+            case 0x70: if(acc_) jump(a); break;  // JNZ
+            case 0x72: set_cy(cy() | rd_bit(a)); break;
+            case 0x73: pc_ = u16(acc_ + dptr_); break;  // JMP @A+DPTR
+            case 0x74: acc_ = a; break;
+            case 0x75: wr(a, b); break;
+            case 0x80: jump(a); break;  // SJMP
+            case 0x82: set_cy(cy() & rd_bit(a)); break;
+            case 0x83: acc_ = img_->code[u16(pc_ + acc_)]; break;  // MOVC A,@A+PC
+            case 0x84: {  // DIV AB
+                u8 x = acc_, y = b_;
+                psw_ &= 0x7B;
+                if(!y) psw_ |= 0x04;
+                else {
+                    acc_ = x / y;
+                    b_ = x % y;
+                }
+                break;
+            }
+            case 0x85: wr(b, rd(a)); break;  // MOV dir,dir: source comes first
+            case 0x90: dptr_ = u16(a << 8 | b); break;
+            case 0x92: wr_bit(a, cy()); break;
+            case 0x93: acc_ = img_->code[u16(acc_ + dptr_)]; break;  // MOVC A,@A+DPTR
+            case 0x94: subb(a); break;
+            case 0x95: subb(rd(a)); break;
+            case 0xA0: set_cy(cy() | !rd_bit(a)); break;
+            case 0xA2: set_cy(rd_bit(a)); break;
+            case 0xA3: dptr_++; break;
+            case 0xA4: {  // MUL AB
+                unsigned r = acc_ * b_;
+                acc_ = u8(r);
+                b_ = u8(r >> 8);
+                psw_ = u8((psw_ & 0x7B) | (r > 0xFF) << 2);
+                break;
+            }
+            case 0xB0: set_cy(cy() & !rd_bit(a)); break;
+            case 0xB2: wr_bit(a, !rd_bit_latch(a)); break;
+            case 0xB3: set_cy(!cy()); break;
+            case 0xB4: cjne(acc_, a, b); break;
+            case 0xB5: cjne(acc_, rd(a), b); break;
+            case 0xC0: push(rd(a)); break;
+            case 0xC2: wr_bit(a, false); break;
+            case 0xC3: set_cy(false); break;
+            case 0xC4: acc_ = u8(acc_ << 4 | acc_ >> 4); break;
+            case 0xC5: {
+                u8 t = rd(a);
+                wr(a, acc_);
+                acc_ = t;
+                break;
+            }
+            case 0xD0: wr(a, pop()); break;
+            case 0xD2: wr_bit(a, true); break;
+            case 0xD3: set_cy(true); break;
+            case 0xD4: {  // DA A
+                unsigned r = acc_;
+                if((r & 0x0F) > 9 || (psw_ & 0x40)) r += 0x06;
+                if(r > 0xFF) set_cy(true);
+                if((r & 0x1F0) > 0x90 || cy()) r += 0x60;
+                if(r > 0xFF) set_cy(true);
+                acc_ = u8(r);
+                break;
+            }
+            case 0xD5: {  // DJNZ dir
+                u8 v = u8(rd_latch(a) - 1);
+                wr(a, v);
+                if(v) jump(b);
+                break;
+            }
+            case 0xE0: case 0xE2: case 0xE3: acc_ = 0xFF; break;  // MOVX, nothing on the external bus
+            case 0xF0: case 0xF2: case 0xF3: break;
+            case 0xE4: acc_ = 0; break;
+            case 0xE5: acc_ = rd(a); break;
+            case 0xF4: acc_ = u8(~acc_); break;
+            case 0xF5: wr(a, acc_); break;
+            default: exec_column(op, a, b); break;
+        }
+        cycles_ += in.cycles;
+    }
+    __attribute__((always_inline)) void exec_column(u8 op, u8 a, u8 b) {  // AJMP/ACALL and the @Ri/Rn columns
+        if((op & 0x1F) == 0x01) {
+            if(op & 0x10) {  // ACALL
+                push(u8(pc_));
+                push(u8(pc_ >> 8));
+            }
+            pc_ = u16((pc_ & 0xF800) | (op >> 5) << 8 | a);
+            return;
+        }
+        u8& r = ((op & 0x0F) >= 8) ? reg(op & 7) : iram_[reg(op & 1)];
+        switch(op >> 4) {
+            case 0x0: r++; break;
+            case 0x1: r--; break;
+            case 0x2: add(r, false); break;
+            case 0x3: add(r, cy()); break;
+            case 0x4: acc_ |= r; break;
+            case 0x5: acc_ &= r; break;
+            case 0x6: acc_ ^= r; break;
+            case 0x7: r = a; break;
+            case 0x8: wr(a, r); break;
+            case 0x9: subb(r); break;
+            case 0xA: r = rd(a); break;
+            case 0xB: cjne(r, a, b); break;
+            case 0xC: std::swap(r, acc_); break;
+            case 0xD:
+                if((op & 0x0F) < 8) {  // XCHD
+                    u8 t = r;
+                    r = u8((r & 0xF0) | (acc_ & 0x0F));
+                    acc_ = u8((acc_ & 0xF0) | (t & 0x0F));
+                }
+                else if(--r) jump(a);  // DJNZ Rn
+                break;
+            case 0xE: acc_ = r; break;
+            case 0xF: r = acc_; break;
+        }
+    }
+
+    std::shared_ptr<const Image> img_;
+    bool ff_;
+    std::shared_ptr<Decoded> dec_;  // shared with forks until one of them decodes something new
+    Stats stats_;
+
+    std::array<u8, 256> iram_{};  // 128 bytes on the chip, the rest only catches a runaway stack
+    u8 acc_ = 0, b_ = 0, psw_ = 0, sp_ = 0x07;
+    u16 dptr_ = 0, pc_ = 0;
+    uint64_t cycles_ = 0;  // machine cycles since reset
+    uint64_t stop_ = 0;    // next cycle something may happen outside the core
+    uint64_t pause_ = ~uint64_t(0);  // run_to() returns there
+    u8 in_service_ = 0;    // interrupt levels running, 1 low 2 high
+    bool hold_ = false;
+};
+
+}  // namespace sim
+
+#endif
@@ -0,0 +1,74 @@
+/*
+    Host build of the firmware. inverter.c is compiled with HOST_BUILD inside the body of sim::Firmware, so
+    its globals become members (every simulated board has its own copy and boards can run on many threads)
+    and its SFR accesses go through the proxies of sim::Mcu. Feature switches are the usual -DUSE_*=1.
+
+    Include this last: inverter.c and 8051.h define short macros (TX, PD, EA...) that would clash with
+    library headers. Compile with -I host_tools/sim so the firmware picks up the host <8051.h>.
+*/
+
+#ifndef SIM_FIRMWARE_HPP
+#define SIM_FIRMWARE_HPP
+
+#include "board.hpp"
+
+#include <stdbool.h>
+
+#define HOST_BUILD 1
+
+namespace sim {
+
+class Firmware : public Board {
+public:
+    static std::unique_ptr<Firmware> create(std::shared_ptr<const Scenario> s) {
+        // value-initialized, so members without an initializer start zeroed like C globals. A memset before
+        // placement new would not do, the compiler may drop stores made before the lifetime starts.
+        std::unique_ptr<Firmware> fw(new Firmware());
+        fw->load(std::move(s));
+        return fw;
+    }
+
+#include "../../software/inverter.c"
+
+#if USE_STAMPS
+    // cycle stamp counters of the sites built in, same values the supervisory link reads from SUP_REG_STAMP
+    const stamp_t& stamp(int slot) const { return stamps[slot]; }
+#endif
+
+protected:
+    void firmware() override { main(); }
+    void warm_reset() override {  // the startup code clears RAM and runs the initializers, only a USE_RESUME block survives
+        Board board = *this;
+        std::unique_ptr<Firmware> fresh(new Firmware());
+#if USE_RESUME
+        fresh->retain = retain;
+#endif
+        *this = *fresh;
+        static_cast<Board&>(*this) = board;
+        reset_cpu();
+    }
+#if USE_SUPERVISOR
+    int control_state() const override { return sup_regs.state; }
+#endif
+    void isr_ie0() override { PLUG_ISR(); }
+    void isr_serial() override { UART_ISR(); }
+#if USE_TICK
+    void isr_tf0() override { T0_ISR(); }
+    unsigned timer0_skip(unsigned max) override {  // overflows that would only count tick_div down
+#if USE_SUPERVISOR
+        if(sup_rx_bit || sup_tx_bit || sup_tx_pos || !SUP_RX) return 0;  // software UART busy, every sample counts
+#endif
+        unsigned n = tick_div - 1;
+        if(n > max) n = max;
+        tick_div -= n;
+#if USE_STAMPS
+        stamp_ovf += n;
+#endif
+        return n;
+    }
+#endif
+};
+
+}  // namespace sim
+
+#endif
@@ -0,0 +1,400 @@
+/*
+    Discrete-event model of the AT89C2051 peripherals the firmware touches: ports, Timer0, the UART and the
+    interrupt system. The firmware itself runs natively (see firmware.hpp), sim::Mcu only decides what its
+    SFR reads return and when interrupts fire. Virtual time only moves inside busy_wait() (the delay() loop)
+    and idle mode, and it jumps straight to the next event instead of spinning through every iteration.
+    An instruction-level core (emulator.hpp) sets core_ instead: interrupts are then left pending for it to
+    vector, and it moves time itself with run_until() as its machine cycles go by.
+
+    Everything is plain data (no pointers into the object), so a whole board can be copied.
+*/
+
+#ifndef SIM_MCU_HPP
+#define SIM_MCU_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace sim {
+
+using u8 = uint8_t;
+using Time = uint64_t;  // ns of virtual time
+constexpr Time US = 1000;
+constexpr Time MS = 1000 * US;
+constexpr Time SEC = 1000 * MS;
+constexpr Time HOUR = 3600 * SEC;
+constexpr Time DAY = 24 * HOUR;
+
+constexpr uint64_t FOSC = 7372800;  // Hz, same crystal as the real board
+
+struct SimEnd {};     // virtual time is up
+struct PowerDown {};  // firmware set PCON.PD, only a reset would wake it up
+struct Reset {};      // warm reset of the uC (brownout, watchdog), the firmware starts over at its reset vector
+
+struct Event {
+    Time t;
+    uint64_t seq;   // keeps events at the same time in scheduling order, runs stay deterministic
+    uint16_t kind;  // EV_* below, or a board-level kind
+    uint32_t arg;
+};
+
+enum : uint16_t {
+    EV_END,      // end of simulated time
+    EV_TX_DONE,  // UART finished shifting out SBUF
+    EV_RX,       // UART received arg
+    EV_BOARD     // first kind free for the board model
+};
+
+class Mcu {
+public:
+    struct BitRef {
+        Mcu* m;
+        u8 addr;
+        operator bool() const { return m->read_bit(addr); }
+        BitRef& operator=(int v) {
+            m->write_bit(addr, v != 0);
+            return *this;
+        }
+        BitRef& operator=(const BitRef& o) { return *this = int(bool(o)); }
+    };
+    struct SfrRef {
+        Mcu* m;
+        u8 addr;
+        operator u8() const { return m->read_sfr(addr); }
+        SfrRef& operator=(int v) {
+            m->write_sfr(addr, u8(v));
+            return *this;
+        }
+        SfrRef& operator|=(int v) { return *this = m->read_sfr(addr) | v; }
+        SfrRef& operator&=(int v) { return *this = m->read_sfr(addr) & v; }
+        SfrRef& operator^=(int v) { return *this = m->read_sfr(addr) ^ v; }
+    };
+
+    Mcu() {
+        sfr_.fill(0);
+        sfr_[0x90 - 0x80] = 0xFF;  // port latches come up high
+        sfr_[0xB0 - 0x80] = 0xFF;
+        schedule(~Time(0) >> 1, EV_END, 0);
+    }
+    virtual ~Mcu() = default;
+    Mcu(const Mcu&) = default;
+
+    Time now() const { return now_; }
+    bool cpu_idle() const { return idle_; }
+    bool tick_on() const { return t0_running() && (sfr_[0xA8 - 0x80] & 0x82) == 0x82; }  // Timer0 interrupts coming
+    bool powered_down() const { return pd_; }
+    uint64_t interrupts() const { return isr_count_; }
+
+    void set_end(Time t) {  // replaces the EV_END scheduled by the constructor
+        for(auto& e : queue_) {
+            if(e.kind == EV_END) e.t = t;
+        }
+        std::make_heap(queue_.begin(), queue_.end(), later);
+    }
+
+    void schedule(Time t, uint16_t kind, uint32_t arg) {
+        queue_.push_back({std::max(t, now_), seq_++, kind, arg});
+        std::push_heap(queue_.begin(), queue_.end(), later);
+    }
+    void unschedule(uint16_t kind) {  // drops whatever of that kind is pending
+        queue_.erase(std::remove_if(queue_.begin(), queue_.end(), [&](const Event& e) { return e.kind == kind; }),
+                     queue_.end());
+        std::make_heap(queue_.begin(), queue_.end(), later);
+    }
+
+    // firmware side, reached through the macros in 8051.h and the HOST_BUILD hooks
+    BitRef bit(u8 addr) { return {this, addr}; }
+    SfrRef sfr(u8 addr) { return {this, addr}; }
+
+    void busy_wait(unsigned time_ms) {
+        observe();
+        run_until(now_ + time_ms * MS);
+    }
+
+    bool ee_read(u8 addr, u8* dest, u8 len) {
+        if(!eeprom_present) return false;
+        for(u8 i = 0; i < len; i++) dest[i] = eeprom[u8(addr + i)];
+        return true;
+    }
+    bool ee_write(u8 addr, u8* src, u8 len) {
+        if(!eeprom_present) return false;
+        for(u8 i = 0; i < len; i++) eeprom[u8(addr + i)] = src[i];
+        busy_wait(5);  // write cycle, firmware polls for the acknowledge
+        return true;
+    }
+
+    std::array<u8, 256> eeprom = filled_eeprom();  // 24C02 contents
+    bool eeprom_present = true;
+
+    // board side
+    void input_changed(u8 addr) {  // an input pin changed its external level
+        if(addr == 0xB2 && !pin_level(addr) && (sfr_[0x88 - 0x80] & 0x01)) {  // falling edge on INT0, edge triggered
+            sfr_[0x88 - 0x80] |= 0x02;  // IE0
+            dispatch();
+        }
+    }
+    bool latch(u8 addr) const { return sfr_[(addr & 0xF8) - 0x80] & (1 << (addr & 7)); }
+
+    void run_until(Time t) {  // process everything up to t, firmware interrupts included
+        while(std::min(next_activity(), t + 1) <= t) step(t + 1);
+        now_ = t;
+    }
+
+    void drain() {  // firmware is gone (power-down), keep the outside world going until the end
+        sfr_[0xA8 - 0x80] = 0;
+        sfr_[0x88 - 0x80] &= ~0x10;
+        try {
+            for(;;) step();
+        }
+        catch(const SimEnd&) {
+        }
+    }
+
+    virtual void firmware() {}  // reset vector, implemented by the firmware wrapper
+
+    void reset_cpu() {  // SFRs as a reset leaves them. RAM is up to the caller, a warm reset keeps it
+        // the port pins float high for the few us the reset lasts, too short for the controller to take EN_OV
+        // as a power cut, so the board is not told. The firmware drives them back right away.
+        sfr_.fill(0);
+        sfr_[0x90 - 0x80] = 0xFF;
+        sfr_[0xB0 - 0x80] = 0xFF;
+        sbuf_rx_ = 0;
+        in_isr_ = false;
+        idle_ = false;
+        pd_ = false;
+        unschedule(EV_TX_DONE);  // the byte being shifted out is cut off
+        observe();
+    }
+
+protected:
+    // implemented by the board model
+    virtual bool pin_input(u8 addr) { (void)addr; return true; }  // external level, pull-ups by default
+    virtual void pin_output(u8 addr, bool level) { (void)addr; (void)level; }  // latch changed
+    virtual void uart_tx(u8 data, Time byte_time) { (void)data; (void)byte_time; }
+    virtual void uart_rx(u8 data) { (void)data; }  // a byte arrived, whether RI was free for it or not
+    virtual void observe() {}  // something the board shows may have changed, for traces
+    virtual void on_event(const Event& e) { (void)e; }
+    virtual void account() {}  // called before anything that may change power draw
+
+    // implemented by the firmware wrapper
+    virtual void isr_ie0() {}
+    virtual void isr_tf0() {}
+    virtual void isr_serial() {}
+    virtual unsigned timer0_skip(unsigned max) { (void)max; return 0; }  // overflows the ISR would ignore
+
+    // implemented by an instruction-level core
+    virtual bool wake_up() { return false; }  // an interrupt is ready to be taken, ends idle mode
+    virtual uint64_t now_frac() const { return 0; }  // now() is short of the exact time by this / FOSC ns
+
+    Time uart_byte_time() const {  // 10 bits, mode 1 clocked by Timer1 in mode 2
+        uint64_t div = 32 * 12 * uint64_t(256 - sfr_[0x8D - 0x80]);
+        if(sfr_[0x87 - 0x80] & 0x80) div /= 2;  // SMOD
+        return 10 * SEC * div / FOSC;
+    }
+
+    bool core_ = false;  // interrupts are taken by an instruction-level core, dispatch() leaves them pending
+
+private:
+    static bool later(const Event& a, const Event& b) { return a.t != b.t ? a.t > b.t : a.seq > b.seq; }
+    static std::array<u8, 256> filled_eeprom() {
+        std::array<u8, 256> e;
+        e.fill(0xFF);
+        return e;
+    }
+
+    bool pin_level(u8 addr) { return latch(addr) && pin_input(addr); }  // quasi-bidirectional port
+
+protected:
+    u8 sfr_latch(u8 addr) const { return sfr_[addr - 0x80]; }  // register itself, no pin or counter behind it
+    bool read_bit(u8 addr) {
+        if((addr & 0xF8) == 0x90 || (addr & 0xF8) == 0xB0) return pin_level(addr);
+        return latch(addr);
+    }
+    void write_bit(u8 addr, bool v) {
+        u8& reg = sfr_[(addr & 0xF8) - 0x80];
+        u8 mask = 1 << (addr & 7);
+        u8 old = reg;
+        reg = v ? (reg | mask) : (reg & ~mask);
+        sfr_written(addr & 0xF8, old);
+    }
+    u8 read_sfr(u8 addr) {
+        if(addr == 0x99) return sbuf_rx_;
+        if(addr == 0x8A && t0_running()) return t0_count();
+        if(addr == 0x90 || addr == 0xB0) {
+            u8 v = 0;
+            for(int i = 0; i < 8; i++) v |= pin_level(addr + i) << i;
+            return v;
+        }
+        return sfr_[addr - 0x80];
+    }
+    void write_sfr(u8 addr, u8 v) {
+        if(addr == 0x99) {  // SBUF, start shifting out
+            sfr_[addr - 0x80] = v;
+            Time bt = uart_byte_time();
+            schedule(now_ + bt, EV_TX_DONE, 0);
+            uart_tx(v, bt);
+            return;
+        }
+        u8 old = sfr_[addr - 0x80];
+        sfr_[addr - 0x80] = v;
+        sfr_written(addr, old);
+    }
+
+    void sfr_written(u8 addr, u8 old) {
+        u8 now_v = sfr_[addr - 0x80];
+        if(addr == 0x90 || addr == 0xB0) {  // port latch
+            for(int i = 0; i < 8; i++) {
+                if(((old ^ now_v) >> i) & 1) {
+                    account();
+                    pin_output(addr + i, (now_v >> i) & 1);
+                }
+            }
+            observe();
+            return;
+        }
+        if(addr == 0x88 && !(old & 0x10) && (now_v & 0x10)) {  // TR0 set, Timer0 starts counting
+            t0_at_ = now_;
+            t0_frac_ = now_frac();
+        }
+        if(addr == 0x87) {
+            if(now_v & 0x02) {
+                account();
+                pd_ = true;
+                throw PowerDown{};
+            }
+            if(now_v & 0x01) {
+                sfr_[addr - 0x80] &= ~0x01;  // IDL clears itself on wake-up
+                idle();
+            }
+            return;
+        }
+        dispatch();  // EA, ES, TI... may have made an interrupt pending
+    }
+
+    Time next_activity() const {
+        Time ev = queue_.front().t;
+        return (t0_running()) ? std::min(ev, t0_next()) : ev;
+    }
+
+private:
+    bool t0_running() const { return (sfr_[0x88 - 0x80] & 0x10) && (sfr_[0x89 - 0x80] & 0x03) == 0x02; }
+    // overflow times are kept exact as t0_at_ + t0_frac_ / FOSC ns, so a week of 2400 Hz ticks does not drift
+    uint64_t t0_period() const { return 12 * uint64_t(256 - sfr_[0x8C - 0x80]) * SEC; }  // ns * FOSC, 8-bit auto-reload
+    Time t0_next() const { return t0_at_ + (t0_frac_ + t0_period()) / FOSC; }
+    void t0_advance(uint64_t n) {  // n <= 0xFFFF keeps the product in 64 bits
+        uint64_t num = t0_frac_ + n * t0_period();
+        t0_at_ += num / FOSC;
+        t0_frac_ = num % FOSC;
+    }
+    u8 t0_count() const {  // TL0, machine cycles counted up from TH0 since the last overflow
+        uint64_t since = (now_ - t0_at_) * FOSC + now_frac();
+        uint64_t cycles = (since > t0_frac_) ? (since - t0_frac_) / (12 * SEC) : 0;
+        return u8(std::min<uint64_t>(0xFF, sfr_[0x8C - 0x80] + cycles));
+    }
+    uint64_t t0_count_before(Time t) const {  // overflows from now on that come strictly before t
+        if(t <= t0_at_) return 0;
+        uint64_t span = std::min<Time>(t - t0_at_, 100 * SEC) * FOSC - t0_frac_;
+        return (span - 1) / t0_period();
+    }
+
+    void step(Time limit = ~Time(0)) {  // handle the next Timer0 overflow or event, whichever comes first
+        Time ev = queue_.front().t;
+        if(t0_running() && t0_next() <= ev) timer0_overflow(std::min(ev, limit));  // skipping never passes limit
+        else next_event();
+    }
+
+    void timer0_overflow(Time limit) {
+        uint64_t before = t0_count_before(limit);  // all but the last of these may be skipped if the ISR ignores them
+        unsigned room = (before > 1) ? unsigned(std::min<uint64_t>(before - 1, 0xFFFF)) : 0;
+        bool enabled = (sfr_[0xA8 - 0x80] & 0x82) == 0x82;
+        if(!enabled || (sfr_[0x88 - 0x80] & 0x20)) t0_advance(room);  // TF0 already pending, nothing to add
+        else t0_advance(timer0_skip(room));
+        t0_advance(1);
+        now_ = t0_at_;
+        sfr_[0x88 - 0x80] |= 0x20;  // TF0
+        dispatch();
+    }
+
+    void next_event() {
+        std::pop_heap(queue_.begin(), queue_.end(), later);
+        Event e = queue_.back();
+        queue_.pop_back();
+        now_ = e.t;
+        account();
+        switch(e.kind) {
+            case EV_END: throw SimEnd{};
+            case EV_TX_DONE: sfr_[0x98 - 0x80] |= 0x02; break;  // TI
+            case EV_RX:
+                uart_rx(u8(e.arg));
+                if(sfr_[0x98 - 0x80] & 0x01) break;  // RI still set, byte lost
+                sbuf_rx_ = u8(e.arg);
+                sfr_[0x98 - 0x80] |= 0x01;
+                break;
+            default: on_event(e);
+        }
+        dispatch();
+        observe();
+    }
+
+    void idle() {
+        account();
+        idle_ = true;
+        observe();
+        uint64_t n = isr_count_;
+        try {
+            while(isr_count_ == n && !wake_up()) step();
+        }
+        catch(...) {
+            idle_ = false;
+            throw;
+        }
+        account();
+        idle_ = false;
+        observe();
+    }
+
+    void dispatch() {  // single priority level, the firmware ISRs never wait for each other
+        if(core_ || in_isr_ || !(sfr_[0xA8 - 0x80] & 0x80)) return;
+        for(;;) {
+            u8 ie = sfr_[0xA8 - 0x80];
+            u8& tcon = sfr_[0x88 - 0x80];
+            u8 scon = sfr_[0x98 - 0x80];
+            bool serial = (ie & 0x10) && (scon & 0x03);
+            in_isr_ = true;
+            if(serial && (sfr_[0xB8 - 0x80] & 0x10)) isr_serial();  // PS
+            else if((ie & 0x01) && (tcon & 0x02)) {
+                tcon &= ~0x02;
+                isr_ie0();
+            }
+            else if((ie & 0x02) && (tcon & 0x20)) {
+                tcon &= ~0x20;
+                isr_tf0();
+            }
+            else if(serial) isr_serial();
+            else {
+                in_isr_ = false;
+                break;
+            }
+            in_isr_ = false;
+            isr_count_++;
+        }
+    }
+
+    std::array<u8, 128> sfr_;  // 0x80-0xFF
+    u8 sbuf_rx_ = 0;
+    Time now_ = 0;
+    std::vector<Event> queue_;
+    uint64_t seq_ = 0;
+    uint64_t isr_count_ = 0;
+    bool in_isr_ = false;
+    bool idle_ = false;
+    bool pd_ = false;
+    Time t0_at_ = 0;         // time of the last Timer0 overflow
+    uint64_t t0_frac_ = 0;
+};
+
+}  // namespace sim
+
+#endif
@@ -0,0 +1,85 @@
+/*
+    Work-stealing thread pool for independent simulation runs. Each worker owns a deque of task indices,
+    takes work from its back and steals from the front of a random victim once its own deque is empty, so
+    long scenarios (flat battery ending early vs. a busy week) balance out without a central queue.
+*/
+
+#ifndef SIM_POOL_HPP
+#define SIM_POOL_HPP
+
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace sim {
+
+class Pool {
+public:
+    explicit Pool(unsigned threads = std::thread::hardware_concurrency()) : threads_(threads ? threads : 1) {}
+
+    unsigned threads() const { return threads_; }
+
+    template <class F>
+    void run(size_t tasks, F&& f) {  // f(task_index) for every index, returns when all are done
+        std::vector<Worker> workers(threads_);
+        for(size_t i = 0; i < tasks; i++) workers[i * threads_ / tasks].tasks.push_back(i);  // contiguous blocks
+        std::exception_ptr error;
+        std::mutex error_lock;
+        std::vector<std::thread> pool;
+        for(unsigned w = 0; w < threads_; w++) {
+            pool.emplace_back([&, w] {
+                std::minstd_rand rng(w + 1);
+                size_t task;
+                while(take(workers, w, rng, task)) {
+                    try {
+                        f(task);
+                    }
+                    catch(...) {
+                        std::lock_guard<std::mutex> g(error_lock);
+                        if(!error) error = std::current_exception();
+                    }
+                }
+            });
+        }
+        for(auto& t : pool) t.join();
+        if(error) std::rethrow_exception(error);
+    }
+
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    bool take(std::vector<Worker>& workers, unsigned self, std::minstd_rand& rng, size_t& task) {
+        {
+            std::lock_guard<std::mutex> g(workers[self].lock);
+            if(!workers[self].tasks.empty()) {
+                task = workers[self].tasks.back();
+                workers[self].tasks.pop_back();
+                return true;
+            }
+        }
+        for(unsigned tries = 0; tries < 2 * threads_; tries++) {  // random victims first, then everyone in turn
+            unsigned v = (tries < threads_) ? rng() % threads_ : tries - threads_;
+            if(v == self) continue;
+            std::lock_guard<std::mutex> g(workers[v].lock);
+            if(!workers[v].tasks.empty()) {
+                task = workers[v].tasks.front();
+                workers[v].tasks.pop_front();
+                return true;
+            }
+        }
+        return false;  // nothing queued anywhere, and nothing ever gets added
+    }
+
+    unsigned threads_;
+};
+
+}  // namespace sim
+
+#endif
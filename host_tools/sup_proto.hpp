@@ -0,0 +1,347 @@
+/*
+    Host side of the supervisory serial protocol, see software/supervisor.h for the frame format and
+    register map. Header-only, shared by all host tools.
+*/
+
+#pragma once
+
+#include "lin.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+extern "C" {
+#include "../software/supervisor.h"
+}
+
+namespace sup {
+
+inline uint8_t checksum(const uint8_t* data, size_t len) {  // LIN style, see lin.hpp
+    return lin::sum(0, data, len);
+}
+
+struct Request {
+    uint8_t addr = SUP_ADDR_DEFAULT;
+    uint8_t cmd = SUP_CMD_READ;
+    uint8_t reg = 0;
+    uint8_t arg = 0;
+
+    std::array<uint8_t, SUP_REQ_LEN> encode() const {
+        std::array<uint8_t, SUP_REQ_LEN> frame{SUP_SYNC, addr, cmd, reg, arg, 0};
+        frame[SUP_REQ_LEN - 1] = checksum(frame.data() + 1, SUP_REQ_LEN - 2);
+        return frame;
+    }
+};
+
+struct Response {
+    uint8_t addr = 0;
+    uint8_t reg = 0;
+    std::vector<uint8_t> data;  // empty when the request was rejected
+
+    std::vector<uint8_t> encode() const {
+        std::vector<uint8_t> frame{SUP_RESP, addr, reg, static_cast<uint8_t>(data.size())};
+        frame.insert(frame.end(), data.begin(), data.end());
+        frame.push_back(checksum(frame.data() + 1, frame.size() - 1));
+        return frame;
+    }
+};
+
+// Byte-at-a-time decoders, resynchronize on the sync byte after garbage or a bad checksum.
+class RequestDecoder {
+public:
+    std::optional<Request> feed(uint8_t b) {
+        if(buf_.empty() && b != SUP_SYNC) return std::nullopt;
+        buf_.push_back(b);
+        if(buf_.size() < SUP_REQ_LEN) return std::nullopt;
+        std::array<uint8_t, SUP_REQ_LEN> frame;
+        std::copy(buf_.begin(), buf_.end(), frame.begin());
+        buf_.clear();
+        if(checksum(frame.data() + 1, SUP_REQ_LEN - 2) != frame[SUP_REQ_LEN - 1]) return std::nullopt;
+        return Request{frame[1], frame[2], frame[3], frame[4]};
+    }
+    void reset() { buf_.clear(); }
+
+private:
+    std::vector<uint8_t> buf_;
+};
+
+class ResponseDecoder {
+public:
+    std::optional<Response> feed(uint8_t b) {
+        if(buf_.empty() && b != SUP_RESP) return std::nullopt;
+        buf_.push_back(b);
+        if(buf_.size() < 4) return std::nullopt;
+        size_t len = buf_[3];
+        if(len > SUP_MAX_READ) {  // can't be a valid header
+            buf_.clear();
+            return std::nullopt;
+        }
+        if(buf_.size() < len + 5) return std::nullopt;
+        std::vector<uint8_t> frame;
+        frame.swap(buf_);
+        if(checksum(frame.data() + 1, frame.size() - 2) != frame.back()) {
+            errors_++;
+            return std::nullopt;
+        }
+        return Response{frame[1], frame[2], std::vector<uint8_t>(frame.begin() + 4, frame.end() - 1)};
+    }
+    void reset() { buf_.clear(); }
+    unsigned checksum_errors() const { return errors_; }
+
+private:
+    std::vector<uint8_t> buf_;
+    unsigned errors_ = 0;
+};
+
+// Decoded status registers (SUP_STATUS_LEN bytes read from register 0).
+struct Snapshot {
+    uint8_t state = SUP_STATE_BOOT;
+    uint8_t flags = 0;
+    unsigned power_w = 0;
+    uint32_t energy_wh = 0;
+    uint8_t err_count = 0;
+    std::array<uint8_t, SUP_ERR_LOG_LEN> err_log{};
+    uint8_t profile = 0;
+    uint8_t clock_hour = 0, clock_min = 0, clock_sec = 0;
+    uint8_t session_min = 0;
+    uint16_t pv_energy_wh = 0;  // wraps around
+    uint8_t pv_hold_min = 0;
+    uint8_t temp_raw = 0;  // degC + 40, 0 = no reading
+    unsigned limit_w = 0;  // 0 = no software limit
+
+    std::optional<int> temp_c() const { return temp_raw ? std::optional<int>(temp_raw - 40) : std::nullopt; }
+
+    static std::optional<Snapshot> decode(const Response& r) {
+        if(r.reg != 0 || r.data.size() < SUP_STATUS_LEN) return std::nullopt;
+        const auto& d = r.data;
+        Snapshot s;
+        s.state = d[SUP_REG_STATE];
+        s.flags = d[SUP_REG_FLAGS];
+        s.power_w = d[SUP_REG_POWER] * 5u;
+        s.energy_wh = d[SUP_REG_ENERGY] | (d[SUP_REG_ENERGY + 1] << 8) | (d[SUP_REG_ENERGY + 2] << 16) |
+                      (uint32_t(d[SUP_REG_ENERGY + 3]) << 24);
+        s.err_count = d[SUP_REG_ERR_COUNT];
+        for(int i = 0; i < SUP_ERR_LOG_LEN; i++) s.err_log[i] = d[SUP_REG_ERR_LOG + i];
+        s.profile = d[SUP_REG_PROFILE];
+        s.clock_hour = d[SUP_REG_CLOCK_HOUR];
+        s.clock_min = d[SUP_REG_CLOCK_MIN];
+        s.clock_sec = d[SUP_REG_CLOCK_SEC];
+        s.session_min = d[SUP_REG_SESSION];
+        s.pv_energy_wh = uint16_t(d[SUP_REG_PV_ENERGY] | (d[SUP_REG_PV_ENERGY + 1] << 8));
+        s.pv_hold_min = d[SUP_REG_PV_HOLD];
+        s.temp_raw = d[SUP_REG_TEMP];
+        s.limit_w = d[SUP_REG_LIMIT] * 5u;
+        return s;
+    }
+};
+
+// Cycle stamp counters of one site (SUP_STAMP_LEN bytes of USE_STAMPS builds, see supervisor.h). The simulator
+// fills the same struct from the firmware variables, so board and simulation print alike.
+struct Stamp {
+    uint8_t site = 0;  // SUP_STAMP_* bit
+    unsigned count = 0, min = 0, max = 0;
+    uint64_t total = 0;  // 4 bytes on the board, more when adding up many simulated boards
+
+    static Stamp decode(uint8_t site, const uint8_t* p) {
+        auto le16 = [&](int i) { return unsigned(p[i] | (p[i + 1] << 8)); };
+        return {site, le16(0), le16(2), le16(4), le16(6) | (uint64_t(le16(8)) << 16)};
+    }
+    void add(const Stamp& o) {
+        if(!o.count) return;
+        min = count ? std::min(min, o.min) : o.min;
+        max = std::max(max, o.max);
+        count += o.count;
+        total += o.total;
+    }
+    double unit_us() const { return ((site & SUP_STAMP_LONG) ? 256 : 1) * 12 / 7.3728; }  // machine cycle at 7.3728 MHz
+
+    static const char* header() { return "site                 calls    min_ms   mean_ms    max_ms   total_s"; }
+    std::string row() const {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "%-18s %7u %9.3f %9.3f %9.3f %9.2f%s", site_name(), count, min * unit_us() / 1000,
+                 count ? total * unit_us() / 1000 / count : 0.0, max * unit_us() / 1000, total * unit_us() / 1e6,
+                 (max == 0xFFFF) ? "  (max saturated)" : "");
+        return buf;
+    }
+    const char* site_name() const {
+        switch(site) {
+            case SUP_STAMP_SEND: return "LIN_send_request";
+            case SUP_STAMP_READ: return "LIN_read_response";
+            case SUP_STAMP_PGOOD: return "is_power_good";
+            case SUP_STAMP_PLUG: return "anything_plugged";
+            case SUP_STAMP_START: return "start_inverter";
+            case SUP_STAMP_STOP: return "stop_inverter";
+            default: return "unknown";
+        }
+    }
+};
+
+// SUP_STAMP_* bits of a USE_STAMPS mask in register order.
+inline std::vector<uint8_t> stamp_sites(uint8_t mask) {
+    std::vector<uint8_t> sites;
+    for(uint8_t bit = 1; bit & SUP_STAMP_ALL; bit <<= 1) {
+        if(mask & bit) sites.push_back(bit);
+    }
+    return sites;
+}
+
+// Configuration block fields by name, in SUP_CFG_* order.
+struct ConfigField {
+    const char* name;
+    uint8_t offset;  // defaults are in SUP_CFG_DEFAULTS
+};
+
+inline const std::array<ConfigField, SUP_CFG_LEN>& config_fields() {
+    static const std::array<ConfigField, SUP_CFG_LEN> fields{{
+        {"version", SUP_CFG_VERSION},
+        {"addr", SUP_CFG_ADDR},
+        {"noload_short", SUP_CFG_NOLOAD_SHORT},
+        {"noload_long", SUP_CFG_NOLOAD_LONG},
+        {"load_votes", SUP_CFG_LOAD_VOTES},
+        {"load_samples", SUP_CFG_LOAD_SAMPLES},
+        {"start_attempts", SUP_CFG_START_ATTEMPTS},
+        {"start_polls", SUP_CFG_START_POLLS},
+        {"stop_attempts", SUP_CFG_STOP_ATTEMPTS},
+        {"wait_short", SUP_CFG_WAIT_SHORT},
+        {"wait_keep", SUP_CFG_WAIT_KEEP},
+        {"wait_long", SUP_CFG_WAIT_LONG},
+        {"wait_err", SUP_CFG_WAIT_ERR},
+        {"wait_pgood", SUP_CFG_WAIT_PGOOD},
+        {"low_batt_limit", SUP_CFG_LOW_BATT_LIMIT},
+        {"profile", SUP_CFG_PROFILE},
+        {"profile_jumper", SUP_CFG_PROFILE_JUMPER},
+        {"session_limit", SUP_CFG_SESSION_LIMIT},
+        {"win1_start", SUP_CFG_WINDOWS},
+        {"win1_end", SUP_CFG_WINDOWS + 1},
+        {"win2_start", SUP_CFG_WINDOWS + 2},
+        {"win2_end", SUP_CFG_WINDOWS + 3},
+        {"pv_on_delay", SUP_CFG_PV_ON_DELAY},
+        {"pv_off_delay", SUP_CFG_PV_OFF_DELAY},
+        {"pv_min_run", SUP_CFG_PV_MIN_RUN},
+        {"temp_byte", SUP_CFG_TEMP_BYTE},
+        {"derate_start", SUP_CFG_DERATE_START},
+        {"derate_end", SUP_CFG_DERATE_END},
+        {"derate_base", SUP_CFG_DERATE_BASE},
+        {"poll_interval", SUP_CFG_POLL_INTERVAL},
+        {"vote_interval", SUP_CFG_VOTE_INTERVAL},
+        {"crc", SUP_CFG_CRC},
+    }};
+    return fields;
+}
+
+inline std::optional<uint8_t> config_offset(const std::string& name) {
+    for(const auto& f : config_fields()) {
+        if(name == f.name) return f.offset;
+    }
+    return std::nullopt;
+}
+
+using ConfigBlock = std::array<uint8_t, SUP_CFG_LEN>;
+
+inline uint8_t config_crc(const ConfigBlock& cfg) {  // same as cfg_crc() in inverter.c
+    uint8_t crc = 0;
+    for(int i = 0; i < SUP_CFG_CRC; i++) {
+        crc ^= cfg[i];
+        for(int j = 0; j < 8; j++) crc = (crc & 0x80) ? uint8_t((crc << 1) ^ 0x07) : uint8_t(crc << 1);
+    }
+    return crc;
+}
+
+// SUP_CFG_DEFAULTS is positional, the firmware's ROM copy of it must line up with the SUP_CFG_* offsets
+constexpr ConfigBlock CFG_DEFAULTS = SUP_CFG_DEFAULTS;
+static_assert(CFG_DEFAULTS[SUP_CFG_VERSION] == SUP_CFG_LAYOUT && CFG_DEFAULTS[SUP_CFG_WAIT_PGOOD] == SUP_DEF_WAIT_PGOOD &&
+                  CFG_DEFAULTS[SUP_CFG_PV_ON_DELAY] == SUP_DEF_PV_ON_DELAY &&
+                  CFG_DEFAULTS[SUP_CFG_VOTE_INTERVAL] == SUP_DEF_VOTE_INTERVAL && CFG_DEFAULTS[SUP_CFG_CRC] == 0,
+              "SUP_CFG_DEFAULTS out of step with the SUP_CFG_* offsets");
+
+inline ConfigBlock default_config() {
+    ConfigBlock cfg = CFG_DEFAULTS;
+    cfg[SUP_CFG_CRC] = config_crc(cfg);
+    return cfg;
+}
+
+inline const char* state_name(uint8_t state) {
+    switch(state) {
+        case SUP_STATE_BOOT: return "boot";
+        case SUP_STATE_SLEEP: return "sleep";
+        case SUP_STATE_RUNNING: return "running";
+        case SUP_STATE_NO_LOAD: return "no-load-3s";
+        case SUP_STATE_NO_LOAD_KEEP: return "no-load-6s";
+        case SUP_STATE_NO_LOAD_LONG: return "no-load-15s";
+        case SUP_STATE_ERROR: return "error";
+        case SUP_STATE_LOW_BATT: return "low-batt";
+        case SUP_STATE_SHUTDOWN: return "shutdown";
+        case SUP_STATE_SCHEDULED_OFF: return "scheduled-off";
+        case SUP_STATE_PV_WAIT: return "pv-wait";
+        default: return "unknown";
+    }
+}
+
+inline const char* profile_name(uint8_t profile) {
+    switch(profile) {
+        case SUP_PROFILE_ECO: return "eco";
+        case SUP_PROFILE_ALWAYS_ON: return "always-on";
+        case SUP_PROFILE_TIMED: return "timed";
+        case SUP_PROFILE_SOLAR: return "solar";
+        case SUP_PROFILE_AUTO: return "auto";
+        default: return "unknown";
+    }
+}
+
+// Opens a serial port (or pty) in raw 8N1 mode at the supervisory baud rate.
+inline int open_port(const std::string& path, bool nonblock = false) {
+    int fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | (nonblock ? O_NONBLOCK : 0));
+    if(fd < 0) throw std::runtime_error("can't open " + path);
+    termios tio{};
+    if(tcgetattr(fd, &tio) == 0) {  // ptys accept this too, their baud rate is just ignored
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, B600);
+        cfsetospeed(&tio, B600);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+// Time a request/response exchange takes on the wire, 10 bits per byte.
+inline unsigned wire_time_ms(size_t bytes) { return static_cast<unsigned>(bytes * 10 * 1000 / SUP_BAUD); }
+
+// Sends one request on a blocking port and waits for the answer of the board it addressed, nullopt on a write
+// error or timeout. Broadcasts are never answered, they return an empty response right away.
+inline std::optional<Response> transact(int fd, const Request& req) {
+    auto frame = req.encode();
+    tcflush(fd, TCIFLUSH);
+    if(write(fd, frame.data(), frame.size()) != static_cast<ssize_t>(frame.size())) return std::nullopt;
+    if(req.addr == SUP_ADDR_BROADCAST) return Response{};
+    ResponseDecoder dec;
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(200 + wire_time_ms(SUP_REQ_LEN + SUP_MAX_READ + 5));
+    for(;;) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if(left.count() <= 0) return std::nullopt;
+        pollfd pfd{fd, POLLIN, 0};
+        if(poll(&pfd, 1, static_cast<int>(left.count())) <= 0) continue;
+        uint8_t buf[64];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        for(ssize_t i = 0; i < n; i++) {
+            auto resp = dec.feed(buf[i]);
+            if(resp && resp->addr == req.addr) return resp;
+        }
+    }
+}
+
+}  // namespace sup
@@ -0,0 +1,177 @@
+/*
+    Command line client for the supervisory serial interface. Works against a real board behind a USB-serial
+    adapter or against board_standin over a pty.
+
+    supctl <port> [-a addr] status
+    supctl <port> [-a addr] config
+    supctl <port> [-a addr] set <name> <value>    (configuration field, see config)
+    supctl <port> [-a addr] save                  (store configuration in EEPROM)
+    supctl <port> [-a addr] clock <hh> <mm>       (set the board clock used by output windows)
+    supctl <port> [-a addr] read <reg> [count]
+    supctl <port> [-a addr] write <reg> <value>
+    supctl <port> [-a addr] stamps [clear]        (cycle stamps of a USE_STAMPS build, clear restarts them)
+
+    stamps are read while the board keeps counting, freeze them first with write 0x60 0 for an exact snapshot.
+*/
+
+#include "sup_proto.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void print_status(const sup::Snapshot& s) {
+    printf("state        %s\n", sup::state_name(s.state));
+    printf("profile      %s\n", sup::profile_name(s.profile));
+    printf("plugged      %d\n", !!(s.flags & SUP_FLAG_PLUGGED));
+    printf("pow_5v       %d\n", !!(s.flags & SUP_FLAG_POW_5V));
+    printf("power_good   %d\n", !!(s.flags & SUP_FLAG_PGOOD));
+    printf("load_detect  %d\n", !!(s.flags & SUP_FLAG_LOAD_DETECT));
+    printf("power        %u W\n", s.power_w);
+    printf("energy       %u Wh\n", s.energy_wh);
+    printf("clock        %02u:%02u:%02u\n", s.clock_hour, s.clock_min, s.clock_sec);
+    printf("session      %u min\n", s.session_min);
+    printf("pv_input     %d\n", !!(s.flags & SUP_FLAG_PV_IN));
+    printf("pv_surplus   %d\n", !!(s.flags & SUP_FLAG_PV_SURPLUS));
+    printf("pv_energy    %u Wh\n", s.pv_energy_wh);
+    printf("pv_hold      %u min\n", s.pv_hold_min);
+    if(auto t = s.temp_c()) printf("temperature  %d C\n", *t);
+    else printf("temperature  -\n");
+    printf("power_limit  %u W\n", s.limit_w);
+    printf("errors       %u [", s.err_count);
+    for(int i = 0; i < SUP_ERR_LOG_LEN; i++) printf("%s%u", i ? " " : "", s.err_log[i]);
+    printf("]\n");
+    printf("cfg_eeprom   %d\n", !!(s.flags & SUP_FLAG_CFG_EEPROM));
+    printf("cfg_saved    %d\n", !!(s.flags & SUP_FLAG_CFG_SAVED));
+}
+
+static void print_config(const sup::Response& r) {
+    for(const auto& f : sup::config_fields()) {
+        if(f.offset < r.data.size()) printf("%-14s %u\n", f.name, r.data[f.offset]);
+    }
+}
+
+static int usage() {
+    fprintf(stderr, "usage: supctl <port> [-a addr] status | config | set <name> <value> | save | clock <hh> <mm> |\n"
+                    "                               read <reg> [count] | write <reg> <value> | stamps [clear]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 3) return usage();
+    std::string port = argv[1];
+    int arg = 2;
+    sup::Request req;
+    if(strcmp(argv[arg], "-a") == 0) {
+        if(argc < 5) return usage();
+        req.addr = static_cast<uint8_t>(strtoul(argv[arg + 1], nullptr, 0));
+        arg += 2;
+    }
+    std::string cmd = argv[arg++];
+    if(cmd == "status") {
+        req.cmd = SUP_CMD_READ;
+        req.reg = 0;
+        req.arg = SUP_STATUS_LEN;
+    }
+    else if(cmd == "config") {
+        req.cmd = SUP_CMD_READ;
+        req.reg = SUP_REG_CFG;
+        req.arg = SUP_CFG_LEN;
+    }
+    else if(cmd == "set" && arg + 1 < argc) {
+        auto offset = sup::config_offset(argv[arg]);
+        if(!offset) {
+            fprintf(stderr, "unknown configuration field %s\n", argv[arg]);
+            return 2;
+        }
+        req.cmd = SUP_CMD_WRITE;
+        req.reg = static_cast<uint8_t>(SUP_REG_CFG + *offset);
+        req.arg = static_cast<uint8_t>(strtoul(argv[arg + 1], nullptr, 0));
+    }
+    else if(cmd == "save") req.cmd = SUP_CMD_SAVE;
+    else if(cmd == "clock" && arg + 1 < argc) {  // hour first, writing minutes restarts the second count
+        req.cmd = SUP_CMD_WRITE;
+        req.reg = SUP_REG_CLOCK_HOUR;
+        req.arg = static_cast<uint8_t>(strtoul(argv[arg], nullptr, 0));
+    }
+    else if(cmd == "read" && arg < argc) {
+        req.cmd = SUP_CMD_READ;
+        req.reg = static_cast<uint8_t>(strtoul(argv[arg], nullptr, 0));
+        req.arg = (arg + 1 < argc) ? static_cast<uint8_t>(strtoul(argv[arg + 1], nullptr, 0)) : 1;
+    }
+    else if(cmd == "write" && arg + 1 < argc) {
+        req.cmd = SUP_CMD_WRITE;
+        req.reg = static_cast<uint8_t>(strtoul(argv[arg], nullptr, 0));
+        req.arg = static_cast<uint8_t>(strtoul(argv[arg + 1], nullptr, 0));
+    }
+    else if(cmd == "stamps") {  // run flag and site mask, the counters follow
+        bool clear = arg < argc && strcmp(argv[arg], "clear") == 0;
+        req.cmd = (clear) ? SUP_CMD_WRITE : SUP_CMD_READ;
+        req.reg = SUP_REG_STAMP_RUN;
+        req.arg = (clear) ? 1 : 2;
+    }
+    else return usage();
+
+    int fd;
+    try {
+        fd = sup::open_port(port);
+    }
+    catch(const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    auto resp = sup::transact(fd, req);
+    if(cmd == "clock" && resp && !resp->data.empty()) {
+        req.reg = SUP_REG_CLOCK_MIN;
+        req.arg = static_cast<uint8_t>(strtoul(argv[arg + 1], nullptr, 0));
+        resp = sup::transact(fd, req);
+    }
+    std::vector<sup::Stamp> stamps;
+    if(cmd == "stamps" && req.cmd == SUP_CMD_READ && resp && resp->data.size() == 2) {
+        auto sites = sup::stamp_sites(resp->data[1]);
+        const size_t per_read = SUP_MAX_READ / SUP_STAMP_LEN;
+        for(size_t i = 0; resp && i < sites.size(); i += per_read) {
+            size_t n = std::min(per_read, sites.size() - i);
+            req.reg = static_cast<uint8_t>(SUP_REG_STAMP + i * SUP_STAMP_LEN);
+            req.arg = static_cast<uint8_t>(n * SUP_STAMP_LEN);
+            auto part = sup::transact(fd, req);
+            if(!part || part->data.size() != req.arg) {
+                resp = std::nullopt;
+                break;
+            }
+            for(size_t j = 0; j < n; j++) stamps.push_back(sup::Stamp::decode(sites[i + j], &part->data[j * SUP_STAMP_LEN]));
+        }
+    }
+    close(fd);
+    if(!resp) {
+        fprintf(stderr, "no response\n");
+        return 1;
+    }
+    if(req.addr == SUP_ADDR_BROADCAST) return 0;
+    if(resp->data.empty()) {
+        fprintf(stderr, "request rejected\n");
+        return 1;
+    }
+    if(cmd == "status") {
+        auto snap = sup::Snapshot::decode(*resp);
+        if(!snap) {
+            fprintf(stderr, "short status response (%zu bytes from 0x%02X)\n", resp->data.size(), resp->reg);
+            return 1;
+        }
+        print_status(*snap);
+    }
+    else if(cmd == "config") print_config(*resp);
+    else if(cmd == "save") printf("save requested\n");
+    else if(cmd == "clock") printf("clock set\n");
+    else if(cmd == "stamps" && req.cmd == SUP_CMD_WRITE) printf("stamps cleared\n");
+    else if(cmd == "stamps") {
+        printf("%s%s\n", sup::Stamp::header(), resp->data[0] ? "" : "  (frozen)");
+        for(const auto& s : stamps) printf("%s\n", s.row().c_str());
+    }
+    else {
+        for(size_t i = 0; i < resp->data.size(); i++) printf("0x%02X: 0x%02X\n", unsigned(resp->reg + i), resp->data[i]);
+    }
+    return 0;
+}
+
+// g++ -std=c++17 -O2 -o supctl supctl.cpp
@@ -0,0 +1,409 @@
+/*
+    Compact binary traces of pins, LIN traffic, states and counters, for multi-day simulations (invsim -T) and
+    bench captures. Header-only, shared by the tools that write traces and invtrace, which reads them.
+
+    A trace has a fixed set of channels, each either a bit, an integer value or a byte string (a LIN frame).
+    Records are (time in ns, channel, value) and are appended in time order into chunks of ~64 KB:
+
+        file    "INVTRACE", u16 version, u16 channels, {u8 kind, u8 name length, name}..., u16 length, info text
+        chunk   u32 CHUNK_MAGIC, u32 payload bytes, u32 records, u32 keys, u64 first time, u64 last time, payload
+        index   u32 INDEX_MAGIC, u32 chunks, {u64 offset, u64 first time, u64 last time}..., u64 index offset,
+                "TRACEEND"
+
+    Everything is little endian. A record is varint(time - previous time), varint(channel << 1 | bit) and then
+    nothing for a bit, a zigzag varint of the change since the last value of that channel in the chunk, or
+    varint(length) and the bytes. Every chunk starts with `keys` records that repeat the last value of each
+    bit and value channel written so far, so a chunk decodes on its own and a reader can start at any of them.
+    The writer only holds one chunk and the index (24 bytes per chunk). Without the index at the end (the
+    writer did not finish) the reader walks the chunk headers instead and stops at the first incomplete one.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace trace {
+
+using Time = uint64_t;  // ns
+
+enum Kind : uint8_t { BIT, VALUE, BYTES };
+
+struct Channel {
+    std::string name;
+    Kind kind;
+};
+
+constexpr char FILE_MAGIC[8] = {'I', 'N', 'V', 'T', 'R', 'A', 'C', 'E'};
+constexpr char END_MAGIC[8] = {'T', 'R', 'A', 'C', 'E', 'E', 'N', 'D'};
+constexpr uint32_t CHUNK_MAGIC = 0x4B4E4843;  // "CHNK"
+constexpr uint32_t INDEX_MAGIC = 0x58444E49;  // "INDX"
+constexpr uint16_t VERSION = 1;
+constexpr size_t CHUNK_HEADER = 32;
+
+struct ChunkInfo {
+    uint64_t offset;  // of the chunk header
+    Time first, last;
+};
+
+class Writer {
+public:
+    Writer(const std::string& path, std::vector<Channel> channels, const std::string& info = "",
+           size_t chunk_bytes = 64 * 1024)
+        : channels_(std::move(channels)), chunk_bytes_(chunk_bytes), last_(channels_.size()), seen_(channels_.size()) {
+        if(channels_.size() > 0x7FFF) throw std::runtime_error("too many trace channels");
+        f_ = fopen(path.c_str(), "wb");
+        if(!f_) throw std::runtime_error("cannot create " + path);
+        std::vector<uint8_t> h(FILE_MAGIC, FILE_MAGIC + 8);
+        put16(h, VERSION);
+        put16(h, uint16_t(channels_.size()));
+        for(const Channel& c : channels_) {
+            h.push_back(c.kind);
+            h.push_back(uint8_t(std::min<size_t>(c.name.size(), 255)));
+            h.insert(h.end(), c.name.begin(), c.name.begin() + h.back());
+        }
+        put16(h, uint16_t(std::min<size_t>(info.size(), 0xFFFF)));
+        h.insert(h.end(), info.begin(), info.begin() + std::min<size_t>(info.size(), 0xFFFF));
+        write(h);
+    }
+    ~Writer() {
+        try {
+            close();
+        }
+        catch(...) {
+        }
+    }
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    const std::vector<Channel>& channels() const { return channels_; }
+    uint64_t records() const { return records_; }
+
+    // times never go backwards, records at the same time keep their order
+    void bit(int ch, Time t, bool v) {
+        record(ch, t, v);
+        last_[ch] = v;
+    }
+    void value(int ch, Time t, int64_t v) {
+        record(ch, t, false);
+        int64_t d = v - base_[ch];
+        varint(uint64_t(d) << 1 ^ uint64_t(d >> 63));  // zigzag
+        base_[ch] = last_[ch] = v;
+    }
+    void bytes(int ch, Time t, const uint8_t* data, size_t len) {
+        record(ch, t, false);
+        varint(len);
+        buf_.insert(buf_.end(), data, data + len);
+    }
+
+    void close() {  // writes the index, the file is complete from here on
+        if(!f_) return;
+        flush();
+        uint64_t at = pos_;
+        std::vector<uint8_t> x;
+        put32(x, INDEX_MAGIC);
+        put32(x, uint32_t(index_.size()));
+        for(const ChunkInfo& c : index_) {
+            put64(x, c.offset);
+            put64(x, c.first);
+            put64(x, c.last);
+        }
+        put64(x, at);
+        x.insert(x.end(), END_MAGIC, END_MAGIC + 8);
+        write(x);
+        int err = fclose(f_);
+        f_ = nullptr;
+        if(err) throw std::runtime_error("cannot write trace");
+    }
+
+private:
+    void record(int ch, Time t, bool bit) {
+        if(ch < 0 || size_t(ch) >= channels_.size()) throw std::runtime_error("no such trace channel");
+        if(t < prev_) throw std::runtime_error("trace time went backwards");
+        if(buf_.size() >= chunk_bytes_) flush();
+        if(buf_.empty()) start(t);
+        varint(t - prev_);
+        varint(uint64_t(ch) << 1 | bit);
+        prev_ = t;
+        last_t_ = t;
+        count_++;
+        records_++;
+        seen_[ch] = true;
+    }
+    void start(Time t) {  // new chunk: the state so far goes first
+        first_ = prev_ = t;
+        count_ = keys_ = 0;
+        base_.assign(channels_.size(), 0);
+        for(size_t c = 0; c < channels_.size(); c++) {
+            if(!seen_[c] || channels_[c].kind == BYTES) continue;
+            varint(0);
+            varint(uint64_t(c) << 1 | (channels_[c].kind == BIT && last_[c]));
+            if(channels_[c].kind == VALUE) {
+                varint(uint64_t(last_[c]) << 1 ^ uint64_t(last_[c] >> 63));
+                base_[c] = last_[c];
+            }
+            keys_++;
+        }
+        count_ = keys_;
+    }
+    void flush() {
+        if(buf_.empty()) return;
+        std::vector<uint8_t> h;
+        put32(h, CHUNK_MAGIC);
+        put32(h, uint32_t(buf_.size()));
+        put32(h, count_);
+        put32(h, keys_);
+        put64(h, first_);
+        put64(h, last_t_);
+        index_.push_back({pos_, first_, last_t_});
+        write(h);
+        write(buf_);
+        buf_.clear();
+    }
+    void write(const std::vector<uint8_t>& b) {
+        if(fwrite(b.data(), 1, b.size(), f_) != b.size()) throw std::runtime_error("cannot write trace");
+        pos_ += b.size();
+    }
+    void varint(uint64_t v) {
+        for(; v >= 0x80; v >>= 7) buf_.push_back(uint8_t(v | 0x80));
+        buf_.push_back(uint8_t(v));
+    }
+    static void put16(std::vector<uint8_t>& b, uint16_t v) {
+        for(int i = 0; i < 2; i++) b.push_back(uint8_t(v >> 8 * i));
+    }
+    static void put32(std::vector<uint8_t>& b, uint32_t v) {
+        for(int i = 0; i < 4; i++) b.push_back(uint8_t(v >> 8 * i));
+    }
+    static void put64(std::vector<uint8_t>& b, uint64_t v) {
+        for(int i = 0; i < 8; i++) b.push_back(uint8_t(v >> 8 * i));
+    }
+
+    std::vector<Channel> channels_;
+    size_t chunk_bytes_;
+    FILE* f_ = nullptr;
+    uint64_t pos_ = 0;
+    std::vector<uint8_t> buf_;  // chunk being filled
+    std::vector<ChunkInfo> index_;
+    std::vector<int64_t> last_;  // value of each channel, repeated at the start of every chunk
+    std::vector<int64_t> base_;  // value the next change of each channel is relative to
+    std::vector<bool> seen_;
+    Time first_ = 0, prev_ = 0, last_t_ = 0;
+    uint32_t count_ = 0, keys_ = 0;
+    uint64_t records_ = 0;
+};
+
+class Mapping {  // a whole file, read-only, read ahead for a front to back pass
+public:
+    explicit Mapping(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0) throw std::runtime_error("cannot open " + path);
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        if(ok && st.st_size > 0) {
+            void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = p != MAP_FAILED;
+            if(ok) {
+                data_ = static_cast<const uint8_t*>(p);
+                size_ = size_t(st.st_size);
+                madvise(p, size_, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        if(!ok) throw std::runtime_error("cannot map " + path);
+    }
+    ~Mapping() {
+        if(data_) munmap(const_cast<uint8_t*>(data_), size_);
+    }
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+struct Record {
+    Time t;
+    uint16_t channel;
+    int64_t value;        // bit or value, length for bytes
+    const uint8_t* data;  // bytes, straight from the mapping
+};
+
+class Reader {
+public:
+    explicit Reader(const std::string& path) : map_(path), base_(map_.data()), size_(map_.size()) {
+        std::runtime_error bad(path + ": not a trace");
+        if(size_ < 14 || memcmp(base_, FILE_MAGIC, 8) != 0 || get16(8) != VERSION) throw bad;
+        size_t p = 12;
+        for(unsigned n = get16(10); n; n--) {
+            if(p + 2 > size_ || base_[p] > BYTES || p + 2 + base_[p + 1] > size_) throw bad;
+            channels_.push_back({std::string(reinterpret_cast<const char*>(base_ + p + 2), base_[p + 1]), Kind(base_[p])});
+            p += 2 + base_[p + 1];
+        }
+        if(p + 2 > size_ || p + 2 + get16(p) > size_) throw bad;
+        info_.assign(reinterpret_cast<const char*>(base_ + p + 2), get16(p));
+        p += 2 + get16(p);
+        if(!read_index()) scan(p);
+    }
+    const std::vector<Channel>& channels() const { return channels_; }
+    const std::string& info() const { return info_; }
+    const std::vector<ChunkInfo>& chunks() const { return chunks_; }
+    bool complete() const { return complete_; }  // has its index, the writer finished
+    size_t bytes() const { return size_; }
+    Time begin() const { return chunks_.empty() ? 0 : chunks_.front().first; }
+    Time end() const { return chunks_.empty() ? 0 : chunks_.back().last; }
+    int find(const std::string& name) const {  // channel number, -1 if there is none
+        for(size_t c = 0; c < channels_.size(); c++) {
+            if(channels_[c].name == name) return int(c);
+        }
+        return -1;
+    }
+
+    class Cursor {  // walks the records in time order
+    public:
+        bool next(Record& r) {
+            while(pos_ == end_) {
+                if(chunk_ + 1 >= rd_->chunks_.size()) return false;
+                enter(chunk_ + 1);
+                skip_keys();
+            }
+            decode(r);
+            return true;
+        }
+        // value of every bit and value channel at the cursor, 0 before its first record
+        const std::vector<int64_t>& state() const { return state_; }
+        const std::vector<bool>& known() const { return known_; }
+
+    private:
+        friend class Reader;
+        explicit Cursor(const Reader* rd) : rd_(rd), state_(rd->channels_.size()), known_(rd->channels_.size()), base_(state_) {}
+
+        void enter(size_t k) {
+            chunk_ = k;
+            const ChunkInfo& c = rd_->chunks_[k];
+            pos_ = rd_->base_ + c.offset + CHUNK_HEADER;
+            end_ = pos_ + rd_->get32(c.offset + 4);
+            keys_ = rd_->get32(c.offset + 12);
+            t_ = c.first;
+            std::fill(base_.begin(), base_.end(), 0);
+        }
+        void skip_keys() {  // repeat what this cursor already knows
+            Record r;
+            for(; keys_; keys_--) decode(r);
+        }
+        void decode(Record& r) {
+            t_ += varint();
+            uint64_t tag = varint();
+            r.t = t_;
+            r.channel = uint16_t(tag >> 1);
+            r.data = nullptr;
+            if(r.channel >= rd_->channels_.size()) throw std::runtime_error("corrupt trace chunk");
+            switch(rd_->channels_[r.channel].kind) {
+                case BIT: r.value = tag & 1; break;
+                case VALUE: {
+                    uint64_t z = varint();
+                    r.value = base_[r.channel] += int64_t(z >> 1 ^ -(z & 1));
+                    break;
+                }
+                case BYTES:
+                    r.value = int64_t(varint());
+                    if(uint64_t(end_ - pos_) < uint64_t(r.value)) throw std::runtime_error("corrupt trace chunk");
+                    r.data = pos_;
+                    pos_ += r.value;
+                    return;
+            }
+            state_[r.channel] = r.value;
+            known_[r.channel] = true;
+        }
+        uint64_t varint() {
+            uint64_t v = 0;
+            for(int s = 0; pos_ < end_ && s < 64; s += 7) {
+                uint8_t b = *pos_++;
+                v |= uint64_t(b & 0x7F) << s;
+                if(!(b & 0x80)) return v;
+            }
+            throw std::runtime_error("corrupt trace chunk");
+        }
+
+        const Reader* rd_;
+        size_t chunk_ = 0;
+        const uint8_t* pos_ = nullptr;
+        const uint8_t* end_ = nullptr;
+        uint32_t keys_ = 0;
+        Time t_ = 0;
+        std::vector<int64_t> state_;
+        std::vector<bool> known_;
+        std::vector<int64_t> base_;
+    };
+
+    Cursor seek(Time t) const {  // first record at or after t, state() is everything before it
+        Cursor c(this);
+        if(chunks_.empty()) return c;
+        // first chunk that may reach t, the one before it holds nothing at or after t
+        size_t k = size_t(std::lower_bound(chunks_.begin(), chunks_.end(), t,
+                                           [](const ChunkInfo& a, Time x) { return a.last < x; }) - chunks_.begin());
+        if(k == chunks_.size()) {  // past the end, the state at the end is what the last chunk leaves
+            k--;
+            t = ~Time(0);
+        }
+        c.enter(k);
+        Record r;
+        for(; c.keys_; c.keys_--) c.decode(r);
+        while(c.pos_ != c.end_) {  // records before t only go into the state
+            const uint8_t* at = c.pos_;
+            Time dt = c.varint();
+            c.pos_ = at;
+            if(c.t_ + dt >= t) break;
+            c.decode(r);
+        }
+        return c;
+    }
+    Cursor all() const { return seek(0); }
+
+private:
+    bool read_index() {
+        if(size_ < 16 || memcmp(base_ + size_ - 8, END_MAGIC, 8) != 0) return false;
+        uint64_t at = get64(size_ - 16);
+        if(at + 8 > size_ - 16 || get32(at) != INDEX_MAGIC) return false;
+        uint64_t n = get32(at + 4);
+        if(at + 8 + n * 24 != size_ - 16) return false;
+        for(uint64_t i = 0; i < n; i++) {
+            size_t e = size_t(at + 8 + i * 24);
+            chunks_.push_back({get64(e), get64(e + 8), get64(e + 16)});
+        }
+        complete_ = true;
+        return true;
+    }
+    void scan(size_t p) {  // no index, walk the chunk headers
+        while(p + CHUNK_HEADER <= size_ && get32(p) == CHUNK_MAGIC && p + CHUNK_HEADER + get32(p + 4) <= size_) {
+            chunks_.push_back({p, get64(p + 16), get64(p + 24)});
+            p += CHUNK_HEADER + get32(p + 4);
+        }
+    }
+    uint16_t get16(size_t p) const { return uint16_t(base_[p] | base_[p + 1] << 8); }
+    uint32_t get32(size_t p) const { return uint32_t(get16(p)) | uint32_t(get16(p + 2)) << 16; }
+    uint64_t get64(size_t p) const { return uint64_t(get32(p)) | uint64_t(get32(p + 4)) << 32; }
+
+    Mapping map_;
+    const uint8_t* base_;
+    size_t size_;
+    std::vector<Channel> channels_;
+    std::string info_;
+    std::vector<ChunkInfo> chunks_;
+    bool complete_ = false;
+};
+
+}  // namespace trace
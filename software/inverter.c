@@ -12,10 +12,85 @@
 
 #include <8051.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+// optional features, enable with -D<name>=1. The original image (soft_compiled.bin) leaves 41 bytes of the 2 KB
+// AT89C2051 free below the SDCC signature, anything more needs AT89C4051 which is pin compatible.
+#ifndef USE_SUPERVISOR
+#define USE_SUPERVISOR 0  // supervisory serial slave on P1.7 / P1.6, see supervisor.h
+#endif
+#ifndef USE_EEPROM
+#define USE_EEPROM 0  // configuration block kept in 24C02 I2C EEPROM on P1.5 (SCL) / P1.4 (SDA)
+#endif
+#ifndef USE_PROFILES
+#define USE_PROFILES 0  // operating profiles switched by plug gesture, P1.3 jumper or supervisory link
+#endif
+#ifndef USE_SCHEDULER
+#define USE_SCHEDULER 0  // output windows and session time limit for the timed profile
+#endif
+#ifndef USE_SOLAR
+#define USE_SOLAR 0  // PV surplus input on P1.2 gating the solar-surplus profile
+#endif
+#ifndef USE_THERMAL
+#define USE_THERMAL 0  // power limit derating from controller temperature
+#endif
+#ifndef USE_STAMPS
+#define USE_STAMPS 0  // debug build, cycle stamps around hot paths, mask of SUP_STAMP_* sites (0x3F for all)
+#endif
+#ifndef USE_PROFILER
+#define USE_PROFILER 0  // debug build, program counter histogram read over the supervisory link (host_tools/invprof)
+#endif
+#ifndef USE_SLEEP
+#define USE_SLEEP 0  // controller put to sleep with the LIN go-to-sleep command, EN_OV force-cut only as fallback
+#endif
+#ifndef USE_FAST_BOOT
+#define USE_FAST_BOOT 0  // boot goes on as soon as the supply looks settled instead of after a fixed 500 ms
+#endif
+#ifndef USE_STATUS_CACHE
+#define USE_STATUS_CACHE 0  // controller status kept with its age, fresh enough answers skip status polls
+#endif
+#ifndef USE_RESUME
+#define USE_RESUME 0  // state kept in RAM over a warm reset, a running inverter is taken over instead of restarted
+#endif
+
+#if USE_SCHEDULER && !USE_PROFILES
+#error "USE_SCHEDULER applies to the timed profile, enable USE_PROFILES too"
+#endif
+#if USE_SOLAR && !USE_PROFILES
+#error "USE_SOLAR applies to the solar-surplus profile, enable USE_PROFILES too"
+#endif
+#if USE_THERMAL && !USE_PROFILES
+#error "USE_THERMAL derates the profile power limit, enable USE_PROFILES too"
+#endif
+#if USE_STAMPS && !USE_SUPERVISOR
+#error "USE_STAMPS are read out over the supervisory link, enable USE_SUPERVISOR too"
+#endif
+#if USE_PROFILER && !USE_SUPERVISOR
+#error "USE_PROFILER is read out over the supervisory link, enable USE_SUPERVISOR too"
+#endif
+#if USE_PROFILER && defined(HOST_BUILD)
+#error "USE_PROFILER samples the real program counter, the simulator has none"
+#endif
+
+#define USE_TICK (USE_SUPERVISOR || USE_PROFILES)  // Timer0 system tick
+#define TICK_IN_IDLE (USE_SUPERVISOR || USE_SCHEDULER || USE_SOLAR)  // link, clock or PV filter keep going while asleep
+#define USE_CONFIG (USE_SUPERVISOR || USE_EEPROM || USE_PROFILES)  // tunable parameters kept in RAM
+
+#include "supervisor.h"  // macros only, the base build takes its compiled-in parameters from there too
+#ifndef LIN_FRAME_CODE
+#define LIN_FRAME_CODE 0  // the macros fold into constants here, the frame helpers are for the host tools
+#endif
+#include "lin.h"
 
 typedef unsigned char byte;
 typedef unsigned int word;
 
+#ifdef HOST_BUILD
+#define ROM static constexpr  // not part of the simulated RAM, which a warm reset assigns anew
+#else
+#define ROM const __code
+#endif
+
 #define RCV_BUFF_SIZE_EXP 3
 #define TR_BUFF_SIZE_EXP 3
 
@@ -40,6 +115,18 @@ typedef unsigned int word;
 #define EN_OV P3_4
 #define LED_OV P3_5
 #define P_GOOD P3_6
+#define PV_IN !(P1_2)  // PV charge controller load output or surplus signal through an optocoupler
+#define PROFILE_JMP P1_3
+#define EE_SDA P1_4
+#define EE_SCL P1_5
+#define SUP_TX P1_6
+#define SUP_RX P1_7
+
+#if USE_TICK
+#define TICKS_PER_10MS 24  // Timer0 overflows every 256 cycles (2400 Hz), delay() counts them too
+#else
+#define DELAY_LOOPS 100  // produces correct delays with 7.37 MHz clock
+#endif
 
 // errors indicated via red LED blinking
 #define WAKEUP_ERROR 1  // short-short-long
@@ -47,8 +134,100 @@ typedef unsigned int word;
 #define STARTUP_ERROR 3 // short-long-long
 #define PGOOD_ERROR 4   // long-short-short or rapid blinking <-- indication from original controller
 #define LOW_BATT_ERR 5  // long-short-long
+#define OVERLOAD_ERR 6  // long-long-short, software power limit exceeded
+#define THERMAL_ERR 7   // long-long-long, derated power limit exceeded or controller too hot
+
+// policy flags, the base firmware picks either POLICY_ECO or nothing at boot
+#define PF_LOAD_DETECT 0x01  // stop output when no load detected
+#define PF_BACKOFF 0x02      // 3s/6s/15s staged no load checks, otherwise straight to 15s with power cut
+#define PF_KEEPALIVE 0x04    // keep controller awake during 6s stage for faster restarts
+#define PF_TIMED 0x08        // output limited by the scheduler
+#define PF_SOLAR 0x10        // output gated by PV surplus input
+#define POLICY_ECO (PF_LOAD_DETECT | PF_BACKOFF | PF_KEEPALIVE)
+#define PF_ALL (PF_LOAD_DETECT | PF_BACKOFF | PF_KEEPALIVE | PF_TIMED | PF_SOLAR)
+
+#define GESTURE_PLUGS 4     // plug-ins in a row that switch to next profile
+#define GESTURE_WINDOW 100  // max 10 ms ticks between gesture plug-ins
+#define OVERLOAD_CHECKS 3   // main loop passes above power limit before shutting down
+#define BOOT_SETTLE_MS 20   // USE_FAST_BOOT: P_GOOD high this long in a row at boot and the supply is taken as up
+#define BOOT_WAIT_MS 500    // at most, then the main loop deals with a low supply like it always did
+#define SLEEP_POLLS 20      // USE_SLEEP: 10 ms POW_5V checks after the go-to-sleep command, then EN_OV cuts the power
+
+#define LS_RUNNING 0x01  // byte 1 of the 0x3B response
+#define LS_PGOOD 0x02
+
+// the 0x3B response last read into resp_buff, every build looks at it through these
+#define STATUS_INTACT(read) ((read) >= 4 && resp_buff[3] == 0xFF)  // byte 3 is always 0xFF, anything else is corrupted
+#define STATUS_POWER() (resp_buff[0])  // drawn power as 5W * x
+#define STATUS_RUNNING() (resp_buff[1] & LS_RUNNING)
+#define STATUS_PGOOD() (resp_buff[1] & LS_PGOOD)
+
+// controller status cache (USE_STATUS_CACHE), ages in ms as delay() runs
+#define STATUS_STALE 0xFF     // age saturates here
+#define STATUS_PASS_AGE 150   // status from the previous main loop pass still tells if the inverter runs
+#define STATUS_VOTE_AGE 10    // a load vote needs a status newer than the vote spacing (12 ms at least)
+
+// tunable parameters, see SUP_CFG_* in supervisor.h for their meaning and SUP_DEF_* for the defaults
+#if USE_CONFIG
+#define NOLOAD_SHORT cfg.noload_short
+#define NOLOAD_LONG cfg.noload_long
+#define LOAD_VOTES cfg.load_votes
+#define LOAD_SAMPLES cfg.load_samples
+#define START_ATTEMPTS cfg.start_attempts
+#define START_POLLS cfg.start_polls
+#define STOP_ATTEMPTS cfg.stop_attempts
+#define WAIT_SHORT cfg.wait_short
+#define WAIT_KEEP cfg.wait_keep
+#define WAIT_LONG cfg.wait_long
+#define WAIT_ERR cfg.wait_err
+#define WAIT_PGOOD cfg.wait_pgood
+#define LOW_BATT_LIMIT cfg.low_batt_limit
+#define POLL_INTERVAL cfg.poll_interval
+#define VOTE_INTERVAL cfg.vote_interval
+#else
+#define NOLOAD_SHORT SUP_DEF_NOLOAD_SHORT
+#define NOLOAD_LONG SUP_DEF_NOLOAD_LONG
+#define LOAD_VOTES SUP_DEF_LOAD_VOTES
+#define LOAD_SAMPLES SUP_DEF_LOAD_SAMPLES
+#define START_ATTEMPTS SUP_DEF_START_ATTEMPTS
+#define START_POLLS SUP_DEF_START_POLLS
+#define STOP_ATTEMPTS SUP_DEF_STOP_ATTEMPTS
+#define WAIT_SHORT SUP_DEF_WAIT_SHORT
+#define WAIT_KEEP SUP_DEF_WAIT_KEEP
+#define WAIT_LONG SUP_DEF_WAIT_LONG
+#define WAIT_ERR SUP_DEF_WAIT_ERR
+#define WAIT_PGOOD SUP_DEF_WAIT_PGOOD
+#define LOW_BATT_LIMIT SUP_DEF_LOW_BATT_LIMIT
+#define POLL_INTERVAL SUP_DEF_POLL_INTERVAL
+#define VOTE_INTERVAL SUP_DEF_VOTE_INTERVAL
+#endif
+
+#if USE_RESUME
+#define SET_STATE(s) retain_save(s)
+#elif USE_CONFIG
+#define SET_STATE(s) (sup_regs.state = (s))
+#else
+#define SET_STATE(s)
+#endif
+#if USE_CONFIG
+#define REPORT_POWER(p) (sup_regs.power = (p))
+#else
+#define REPORT_POWER(p)
+#endif
 
-void show_error(byte);
+#if USE_THERMAL
+#define REPORT_TEMP(read) if((read) > cfg.temp_byte) {sup_regs.temp = resp_buff[cfg.temp_byte];}
+#else
+#define REPORT_TEMP(read)
+#endif
+
+#if USE_STAMPS  // each site is renamed to <name>_body and wrapped by a stamped <name>() right after it
+#define STAMP_BITS(m) (((m) & 1) + (((m) >> 1) & 1) + (((m) >> 2) & 1) + (((m) >> 3) & 1) + (((m) >> 4) & 1) + (((m) >> 5) & 1))
+#define STAMP_SLOTS STAMP_BITS(USE_STAMPS)
+#define STAMP_REG_END (SUP_REG_STAMP + SUP_STAMP_LEN * STAMP_SLOTS)
+#define STAMP_BEGIN() unsigned long stamp_begin = stamp_now()
+#define STAMP_END(site) stamp_add(STAMP_BITS(USE_STAMPS & ((site) - 1)), (site) & SUP_STAMP_LONG, stamp_begin)
+#endif
 
 byte rcv_buff[RCV_BUFF_SIZE];  // UART receive buffer
 byte tr_buff[TR_BUFF_SIZE];    // UART transmit buffer
@@ -62,11 +241,274 @@ volatile bool tr_armed = false; // has transmission started
 byte tr_read_pos = 0;  // pointer to first pending byte
 byte tr_write_pos = 0; // pointer to first free slot for transmission
 
-byte power_on_data[] = {0x02, 0x00, 0x00};  // LIN commands; {0x02, 0x00} for inverter startup, {0x00, 0x00} for stopping 
-byte resp_buff[9];  // LIN response buffer
+byte power_on_data[3] = {0x02, 0x00, 0x00};  // LIN commands; {0x02, 0x00} for inverter startup, {0x00, 0x00} for stopping 
+byte resp_buff[9];  // LIN response buffer, also the EEPROM page buffer of cfg_load() and cfg_save()
+
+#if USE_STATUS_CACHE
+byte status_age = STATUS_STALE;  // ms since resp_buff got the status, saturates at STATUS_STALE
+__bit ls_valid;  // resp_buff holds an intact status response, a single jb/jnb to check
+#endif
+byte policy;  // PF_* flags in use
+
+#if USE_PROFILES
+typedef struct {
+    byte policy;       // PF_* flags
+    byte power_limit;  // 5W * x, 0 = no software limit
+} profile_t;
+
+ROM profile_t profiles[SUP_PROFILE_COUNT] = {
+    {POLICY_ECO, 33},                                // eco, 165W
+    {0, 0},                                          // always-on, leave overload protection to the controller
+    {PF_LOAD_DETECT | PF_BACKOFF | PF_TIMED, 33},    // timed, no keepalive to save battery between sessions
+    {PF_LOAD_DETECT | PF_SOLAR, 33}                  // solar-surplus, cut controller power as soon as load is gone
+};
+
+byte power_limit = 0;    // from active profile
+volatile byte plug_events = 0;    // plug-ins counted by gesture detection
+volatile byte gesture_timer = 0;  // 10 ms ticks left until gesture times out
+#endif
+
+#if USE_TICK
+volatile byte tick_div = TICKS_PER_10MS;  // Timer0 overflows left until next 10 ms tick, delay() waits on it
+byte tick_cs = 0;    // 10 ms ticks within current second
+#endif
+
+#if USE_CONFIG
+// RAM is 128 bytes, so cfg and sup_regs only keep the fields of the features built in. cfg_at[] and sup_reg_at[]
+// map the SUP_CFG_* and SUP_REG_* offsets to them, NOT_IN_RAM fields read as their default (0 for status
+// registers) and cannot be written
+#define NOT_IN_RAM 0xFF
+#if USE_PROFILES
+#define IN_PROFILES(at) (at)
+#else
+#define IN_PROFILES(at) NOT_IN_RAM
+#endif
+#if USE_SCHEDULER
+#define IN_SCHEDULER(at) (at)
+#else
+#define IN_SCHEDULER(at) NOT_IN_RAM
+#endif
+#if USE_SOLAR
+#define IN_SOLAR(at) (at)
+#else
+#define IN_SOLAR(at) NOT_IN_RAM
+#endif
+#if USE_THERMAL
+#define IN_THERMAL(at) (at)
+#else
+#define IN_THERMAL(at) NOT_IN_RAM
+#endif
+#if USE_EEPROM
+#define IN_EEPROM(at) (at)
+#else
+#define IN_EEPROM(at) NOT_IN_RAM
+#endif
+
+typedef struct {  // in SUP_CFG_* order, layout version only in code
+    byte addr;
+    byte noload_short;
+    byte noload_long;
+    byte load_votes;
+    byte load_samples;
+    byte start_attempts;
+    byte start_polls;
+    byte stop_attempts;
+    byte wait_short;
+    byte wait_keep;
+    byte wait_long;
+    byte wait_err;
+    byte wait_pgood;
+    byte low_batt_limit;
+#if USE_PROFILES
+    byte profile;
+    byte profile_jumper;
+#endif
+#if USE_SCHEDULER
+    byte session_limit;
+    byte windows[SUP_WINDOW_COUNT * 2];
+#endif
+#if USE_SOLAR
+    byte pv_on_delay;
+    byte pv_off_delay;
+    byte pv_min_run;
+#endif
+#if USE_THERMAL
+    byte temp_byte;
+    byte derate_start;
+    byte derate_end;
+    byte derate_base;
+#endif
+    byte poll_interval;
+    byte vote_interval;
+#if USE_EEPROM
+    byte crc;  // of the block last loaded from or saved to the EEPROM
+#endif
+} cfg_t;
+
+#define CFG(field) offsetof(cfg_t, field)
+ROM byte cfg_at[SUP_CFG_LEN] = {  // byte of cfg holding each SUP_CFG_* field
+    NOT_IN_RAM, CFG(addr), CFG(noload_short), CFG(noload_long), CFG(load_votes), CFG(load_samples),
+    CFG(start_attempts), CFG(start_polls), CFG(stop_attempts), CFG(wait_short), CFG(wait_keep), CFG(wait_long),
+    CFG(wait_err), CFG(wait_pgood), CFG(low_batt_limit), IN_PROFILES(CFG(profile)), IN_PROFILES(CFG(profile_jumper)),
+    IN_SCHEDULER(CFG(session_limit)), IN_SCHEDULER(CFG(windows[0])), IN_SCHEDULER(CFG(windows[1])),
+    IN_SCHEDULER(CFG(windows[2])), IN_SCHEDULER(CFG(windows[3])), IN_SOLAR(CFG(pv_on_delay)),
+    IN_SOLAR(CFG(pv_off_delay)), IN_SOLAR(CFG(pv_min_run)), IN_THERMAL(CFG(temp_byte)), IN_THERMAL(CFG(derate_start)),
+    IN_THERMAL(CFG(derate_end)), IN_THERMAL(CFG(derate_base)), CFG(poll_interval), CFG(vote_interval), IN_EEPROM(CFG(crc))
+};
+ROM byte cfg_defaults[SUP_CFG_LEN] = SUP_CFG_DEFAULTS;
+cfg_t cfg;  // parameters in use, loaded at boot
+volatile bool cfg_save_req = false;  // SAVE received, write cfg to EEPROM when possible
+#define CFG_BYTE(field) ((cfg_at[field] == NOT_IN_RAM) ? cfg_defaults[field] : ((byte*)&cfg)[cfg_at[field]])
+
+typedef struct {  // status registers, exposed over the supervisory link if enabled, in SUP_REG_* order
+    byte state;
+    byte flags;
+    byte power;
+    byte energy[4];
+    byte err_count;
+    byte err_log[SUP_ERR_LOG_LEN];
+#if USE_PROFILES
+    byte profile;
+#endif
+    byte clock_sec;
+    byte clock_min;
+    byte clock_hour;
+#if USE_SCHEDULER
+    byte session_min;
+#endif
+#if USE_SOLAR
+    byte pv_energy[2];
+    byte pv_hold;
+#endif
+#if USE_THERMAL
+    byte temp;
+#endif
+#if USE_PROFILES
+    byte limit;
+#endif
+} sup_regs_t;
+sup_regs_t sup_regs;  // cleared by the startup code, state is SUP_STATE_BOOT (0) until the first SET_STATE()
+#endif
+
+#if USE_SUPERVISOR
+#define REG(field) offsetof(sup_regs_t, field)
+ROM byte sup_reg_at[SUP_STATUS_LEN] = {  // byte of sup_regs holding each SUP_REG_* register
+    REG(state), REG(flags), REG(power), REG(energy[0]), REG(energy[1]), REG(energy[2]), REG(energy[3]),
+    REG(err_count), REG(err_log[0]), REG(err_log[1]), REG(err_log[2]), REG(err_log[3]), IN_PROFILES(REG(profile)),
+    REG(clock_sec), REG(clock_min), REG(clock_hour), IN_SCHEDULER(REG(session_min)), IN_SOLAR(REG(pv_energy[0])),
+    IN_SOLAR(REG(pv_energy[1])), IN_SOLAR(REG(pv_hold)), IN_THERMAL(REG(temp)), IN_PROFILES(REG(limit))
+};
+#endif
+
+#if USE_TICK
+word energy_ws = 0;  // energy not yet counted in sup_regs.energy, in Ws
+#endif
+
+#if USE_RESUME
+// Kept at the top of RAM over a warm reset (brownout during a motor start, watchdog). Link with
+// --iram-size 0x75 --stack-size <n>: the startup code then clears only what is below the block, and the linker
+// fails when the variables and n bytes of stack do not fit below it. The stack grows up from the variables, so n
+// has to cover its peak (invsim -x prints how high the stack went). Whatever a power-up or a stack overrun leaves
+// there fails the magic, the CRC or the range checks of retain_valid().
+#define RETAIN_ADDR 0x75
+#define RETAIN_MAGIC 0x5EC7
+typedef struct {
+    byte magic[2];   // RETAIN_MAGIC, bytes so the block has no padding on the host either
+    byte state;      // SUP_STATE_* last set
+    byte policy;
+    byte profile;    // cfg.profile, the gesture or the supervisory link may have changed it since boot
+    byte err_count;
+    byte energy[4];  // sup_regs.energy
+    byte crc;        // crc8() of the bytes above
+} retain_t;
+
+__data __at(RETAIN_ADDR) retain_t retain;
+#endif
+
+#if USE_SCHEDULER
+byte session_sec = 0;  // seconds of output not yet counted in sup_regs.session_min
+#endif
+
+#if USE_SOLAR
+volatile bool pv_surplus = false;  // PV input after on/off delays
+byte pv_timer = 0;       // seconds PV input has disagreed with pv_surplus
+byte pv_hold_sec = 0;    // seconds not yet counted off sup_regs.pv_hold
+word pv_energy_ws = 0;   // energy not yet counted in sup_regs.pv_energy, in Ws
+#endif
+
+#if USE_SUPERVISOR
+byte sup_frame[SUP_REQ_LEN];  // request being received
+byte sup_rx_pos = 0;    // bytes of current request received so far
+byte sup_rx_gap = 0;    // 10 ms ticks since last received byte
+byte sup_rx_bit = 0;    // 0 = waiting for start bit, 1 = start bit, 2-9 = data, 10 = stop bit
+byte sup_rx_cnt;        // Timer0 overflows until next sample
+byte sup_rx_shift;      // byte being received
+byte sup_tx_bit = 0;    // same as sup_rx_bit but for transmission
+byte sup_tx_cnt;
+byte sup_tx_shift;
+byte sup_tx_pos = 0;    // bytes of response left to send (header, data and checksum)
+byte sup_tx_reg;        // next register to send
+byte sup_tx_len;        // number of data bytes in response
+byte sup_tx_sum;        // running checksum of response
+
+ROM byte cfg_limits[SUP_CFG_LEN][2] = SUP_CFG_LIMITS;  // WRITE range of each configuration field
+#endif
+
+#if USE_STAMPS  // RAM is short, build in only the sites you need
+typedef struct {  // SUP_STAMP_LEN bytes
+    word count;
+    word min;
+    word max;
+    unsigned long total;
+} stamp_t;
+
+volatile word stamp_ovf = 0;  // Timer0 overflows, upper part of the cycle stamp
+byte stamp_run = 1;
+stamp_t stamps[STAMP_SLOTS];  // sites built in, lowest SUP_STAMP_* bit first
+#endif
+
+#if USE_PROFILER  // RAM is short, keep the other features off in profiling builds
+word prof_pc;  // program counter interrupted by the last Timer0 overflow, stored by T0_PROF_ISR
+struct {
+    byte run;
+    byte base;
+    byte shift;
+    word hist[SUP_PROF_BUCKETS];
+} prof = {1, 0, 9};  // whole 4 KB of AT89C4051 from power-up
+#endif
+
+#if (USE_STAMPS || USE_PROFILER) && !defined(HOST_BUILD)  // the simulator has RAM to spare and wider longs
+#if USE_PROFILES || USE_EEPROM || USE_STATUS_CACHE || USE_RESUME
+#error "no RAM for USE_STAMPS or USE_PROFILER next to features other than USE_SUPERVISOR"
+#endif
+// IRAM of a debug build: the other variables, bit flags and register bank of a USE_SUPERVISOR build take 51 bytes
+// next to cfg and sup_regs, and DEBUG_STACK_RAM is kept for the locals sdcc cannot overlay and the stack (invsim -x
+// prints how high the stack went). Each stamped wrapper keeps its 4 byte start stamp. sdcc has no static_assert,
+// a negative array size stops the build instead.
+#ifndef DEBUG_STACK_RAM
+#define DEBUG_STACK_RAM 24
+#endif
+#if USE_STAMPS
+#define STAMPS_RAM (sizeof(stamp_ovf) + sizeof(stamp_run) + sizeof(stamps) + 4 * STAMP_SLOTS)
+#else
+#define STAMPS_RAM 0
+#endif
+#if USE_PROFILER
+#define PROFILER_RAM (sizeof(prof_pc) + sizeof(prof))
+#else
+#define PROFILER_RAM 0
+#endif
+typedef char debug_ram_check[(51 + sizeof(cfg_t) + sizeof(sup_regs_t) + STAMPS_RAM + PROFILER_RAM <= 128 - DEBUG_STACK_RAM) ? 1 : -1];
+#endif
 
 void PLUG_ISR(void) __interrupt(IE0_VECTOR) {
-    return;  // just a wakeup source
+#if USE_PROFILES
+    if(gesture_timer > GESTURE_WINDOW - 10) return;  // contact bounce
+    if(!gesture_timer) plug_events = 0;  // too slow, start counting over
+    plug_events++;
+    gesture_timer = GESTURE_WINDOW;
+#endif
+    return;  // otherwise just a wakeup source
 }
 
 void UART_ISR(void) __interrupt(SI0_VECTOR) {
@@ -89,13 +531,495 @@ void UART_ISR(void) __interrupt(SI0_VECTOR) {
     }
 }
 
+#if USE_TICK
+#if USE_PROFILER
+void T0_PROF_ISR(void) __interrupt(TF0_VECTOR) __naked {  // grab the return address, then carry on in T0_ISR
+    __asm
+        push psw
+        push acc
+        push 0                  ; r0, everything runs in register bank 0
+        mov  a, sp
+        add  a, #0xFD           ; high byte of the return address, pushed right before psw
+        mov  r0, a
+        mov  (_prof_pc + 1), @r0
+        dec  r0
+        mov  _prof_pc, @r0
+        pop  0
+        pop  acc
+        pop  psw
+        ljmp _T0_ISR            ; its reti goes back to the interrupted code
+    __endasm;
+}
+
+void T0_ISR(void) __interrupt {  // no vector of its own, entered from T0_PROF_ISR
+#else
+void T0_ISR(void) __interrupt(TF0_VECTOR) {  // 2400 Hz, software UART sampling and timekeeping
+#endif
+#if USE_STAMPS
+    stamp_ovf++;
+#endif
+#if USE_SUPERVISOR
+    if(!sup_rx_bit) {
+        if(!SUP_RX) {  // start bit edge, sample it in the middle
+            sup_rx_bit = 1;
+            sup_rx_cnt = 2;
+        }
+    }
+    else if(--sup_rx_cnt == 0) {
+        sup_rx_cnt = 4;  // 4 samples per bit at 600 baud
+        if(sup_rx_bit == 1) {
+            sup_rx_bit = (SUP_RX) ? 0 : 2;  // line went back high, just a glitch
+        }
+        else if(sup_rx_bit < 10) {
+            sup_rx_shift >>= 1;
+            if(SUP_RX) sup_rx_shift |= 0x80;
+            sup_rx_bit++;
+        }
+        else {
+            sup_rx_bit = 0;
+            if(SUP_RX && !sup_tx_pos && (sup_rx_pos || sup_rx_shift == SUP_SYNC)) {  // valid stop bit, not busy answering
+                sup_frame[sup_rx_pos++] = sup_rx_shift;
+                sup_rx_gap = 0;
+            }
+        }
+    }
+    if(sup_rx_pos == SUP_REQ_LEN) {  // whole request received
+        sup_rx_pos = 0;
+        byte sum = 0;
+        for(byte i=1; i<SUP_REQ_LEN-1; i++) {
+            sum += sup_frame[i];
+            if(sum < sup_frame[i]) sum++;  // carry wraps around
+        }
+        byte reg = sup_frame[3];
+        byte arg = sup_frame[4];
+        if((sum ^ 0xFF) == sup_frame[5] && (sup_frame[1] == cfg.addr || sup_frame[1] == SUP_ADDR_BROADCAST)) {
+            sup_tx_len = 0;
+            if(sup_frame[2] == SUP_CMD_READ && arg) {  // an empty answer only ever means rejected
+                if(reg < SUP_REG_COUNT && arg <= SUP_MAX_READ && arg <= SUP_REG_COUNT - reg) sup_tx_len = arg;
+#if USE_STAMPS
+                else if(reg >= SUP_REG_STAMP_RUN && reg < STAMP_REG_END && arg <= SUP_MAX_READ && arg <= STAMP_REG_END - reg) {
+                    sup_tx_len = arg;
+                }
+#endif
+#if USE_PROFILER
+                else if(reg >= SUP_REG_PROF_RUN && reg < SUP_REG_PROF_END && arg <= SUP_REG_PROF_END - reg) sup_tx_len = arg;
+#endif
+            }
+            else if(sup_frame[2] == SUP_CMD_WRITE && reg >= SUP_REG_FIRST_RW && reg < SUP_REG_COUNT && !cfg_save_req) {
+                byte field = reg - SUP_REG_CFG;
+                if(cfg_at[field] != NOT_IN_RAM && ((arg >= cfg_limits[field][0] && arg <= cfg_limits[field][1]) ||
+                   (field == SUP_CFG_PROFILE && arg == SUP_PROFILE_AUTO))) {  // out of range is answered empty
+                    ((byte*)&cfg)[cfg_at[field]] = arg;
+                    sup_tx_len = 1;
+                }
+            }
+#if USE_SCHEDULER
+            else if(sup_frame[2] == SUP_CMD_WRITE && reg == SUP_REG_CLOCK_MIN && arg < 60) {  // set the clock
+                sup_regs.clock_min = arg;
+                sup_regs.clock_sec = 0;
+                tick_cs = 0;
+                sup_tx_len = 1;
+            }
+            else if(sup_frame[2] == SUP_CMD_WRITE && reg == SUP_REG_CLOCK_HOUR && arg < 24) {
+                sup_regs.clock_hour = arg;
+                sup_tx_len = 1;
+            }
+#endif
+#if USE_STAMPS
+            else if(sup_frame[2] == SUP_CMD_WRITE && reg == SUP_REG_STAMP_RUN) {
+                stamp_run = arg;
+                if(arg) {
+                    for(byte i=0; i<sizeof(stamps); i++) ((byte*)stamps)[i] = 0;
+                }
+                sup_tx_len = 1;
+            }
+#endif
+#if USE_PROFILER
+            else if(sup_frame[2] == SUP_CMD_WRITE && reg >= SUP_REG_PROF_RUN && reg < SUP_REG_PROF_HIST &&
+                    (reg != SUP_REG_PROF_SHIFT || arg <= 9)) {
+                ((byte*)&prof)[reg - SUP_REG_PROF_RUN] = arg;
+                if(reg != SUP_REG_PROF_RUN || arg) {  // freezing keeps the counters for reading
+                    for(byte i=0; i<SUP_PROF_BUCKETS; i++) prof.hist[i] = 0;
+                }
+                sup_tx_len = 1;
+            }
+#endif
+#if USE_EEPROM
+            else if(sup_frame[2] == SUP_CMD_SAVE) {
+                cfg_save_req = true;
+                reg = SUP_REG_FLAGS;  // acknowledge with current flags
+                sup_tx_len = 1;
+            }
+#endif
+            sup_tx_reg = reg;
+            if(sup_frame[1] != SUP_ADDR_BROADCAST) sup_tx_pos = sup_tx_len + 5;  // start answering
+        }
+    }
+    if(sup_tx_bit) {
+        if(--sup_tx_cnt == 0) {
+            sup_tx_cnt = 4;
+            if(sup_tx_bit < 10) {
+                SUP_TX = sup_tx_shift & 0x01;
+                sup_tx_shift = (sup_tx_shift >> 1) | 0x80;  // shift in stop bit
+                sup_tx_bit++;
+            }
+            else sup_tx_bit = 0;  // stop bit sent
+        }
+    }
+    else if(sup_tx_pos) {  // fetch next byte of the response
+        byte data;
+        byte left = sup_tx_pos--;
+        if(left == sup_tx_len + 5) {
+            data = SUP_RESP;
+            sup_tx_sum = 0;
+        }
+        else if(left == 1) data = sup_tx_sum ^ 0xFF;
+        else {
+            if(left == sup_tx_len + 4) data = sup_frame[1];
+            else if(left == sup_tx_len + 3) data = sup_tx_reg;
+            else if(left == sup_tx_len + 2) data = sup_tx_len;
+            else {
+                byte reg = sup_tx_reg++;
+                if(reg < SUP_STATUS_LEN) data = (sup_reg_at[reg] == NOT_IN_RAM) ? 0 : ((byte*)&sup_regs)[sup_reg_at[reg]];
+#if USE_STAMPS
+                else if(reg == SUP_REG_STAMP_RUN) data = stamp_run;
+                else if(reg == SUP_REG_STAMP_SITES) data = USE_STAMPS;
+                else if(reg >= SUP_REG_STAMP) data = ((byte*)stamps)[reg - SUP_REG_STAMP];
+#endif
+#if USE_PROFILER
+                else if(reg >= SUP_REG_PROF_RUN) data = ((byte*)&prof)[reg - SUP_REG_PROF_RUN];
+#endif
+                else if(reg >= SUP_REG_CFG) data = CFG_BYTE(reg - SUP_REG_CFG);
+                else data = 0;  // reserved
+            }
+            sup_tx_sum += data;
+            if(sup_tx_sum < data) sup_tx_sum++;  // carry wraps around
+        }
+        SUP_TX = 0;  // start bit
+        sup_tx_shift = data;
+        sup_tx_bit = 2;
+        sup_tx_cnt = 4;
+    }
+#endif
+    if(--tick_div) return;
+    tick_div = TICKS_PER_10MS;  // 10 ms tick
+#if USE_PROFILER
+    if(prof.run) {
+        word start = (word)prof.base << 4;
+        word bucket = (prof_pc - start) >> prof.shift;
+        if(prof_pc >= start && bucket < SUP_PROF_BUCKETS && ++prof.hist[bucket] == 0xFFFF) prof.run = 0;  // full, freeze
+    }
+#endif
+#if USE_PROFILES
+    if(gesture_timer) gesture_timer--;
+#endif
+#if USE_SUPERVISOR
+    if(sup_rx_pos && ++sup_rx_gap > 10) sup_rx_pos = 0;  // drop requests interrupted for more than 100 ms
+#endif
+    sup_regs.flags = (sup_regs.flags & (SUP_FLAG_LOAD_DETECT | SUP_FLAG_CFG_EEPROM | SUP_FLAG_CFG_SAVED)) | ((PLUG) ? SUP_FLAG_PLUGGED : 0) |
+                     ((POW_5V) ? SUP_FLAG_POW_5V : 0) | ((P_GOOD) ? SUP_FLAG_PGOOD : 0);
+#if USE_SOLAR
+    if(PV_IN) sup_regs.flags |= SUP_FLAG_PV_IN;
+    if(pv_surplus) sup_regs.flags |= SUP_FLAG_PV_SURPLUS;
+#endif
+    if(++tick_cs < 100) return;
+    tick_cs = 0;  // 1 s tick
+    energy_ws += (sup_regs.power << 2) + sup_regs.power;  // power is reported in 5W units
+    if(energy_ws >= 3600) {
+        energy_ws -= 3600;
+        for(byte i=0; i<4; i++) {
+            if(++sup_regs.energy[i]) break;
+        }
+    }
+    if(++sup_regs.clock_sec >= 60) {  // software real-time clock, starts at 00:00 on power-up unless set
+        sup_regs.clock_sec = 0;
+        if(++sup_regs.clock_min >= 60) {
+            sup_regs.clock_min = 0;
+            if(++sup_regs.clock_hour >= 24) sup_regs.clock_hour = 0;
+        }
+    }
+#if USE_SCHEDULER
+    if(sup_regs.state == SUP_STATE_RUNNING && ++session_sec >= 60) {  // session time counts only while output is on
+        session_sec = 0;
+        if(sup_regs.session_min < 0xFF) sup_regs.session_min++;
+    }
+#endif
+#if USE_SOLAR
+    if(PV_IN == pv_surplus) pv_timer = 0;  // hysteresis, input has to stay changed for the whole on/off delay
+    else if(++pv_timer >= ((pv_surplus) ? cfg.pv_off_delay : cfg.pv_on_delay)) {
+        pv_surplus = !pv_surplus;
+        pv_timer = 0;
+    }
+    if(sup_regs.pv_hold && ++pv_hold_sec >= 60) {
+        pv_hold_sec = 0;
+        sup_regs.pv_hold--;
+    }
+    if(pv_surplus) {  // energy that came from the panels rather than the battery
+        pv_energy_ws += (sup_regs.power << 2) + sup_regs.power;
+        if(pv_energy_ws >= 3600) {
+            pv_energy_ws -= 3600;
+            if(!++sup_regs.pv_energy[0]) sup_regs.pv_energy[1]++;
+        }
+    }
+#endif
+}
+#endif
+
+#if USE_STAMPS
+unsigned long stamp_now() {  // machine cycles, 24 bits wrapping every 27 s
+    word seen, ovf;
+    byte low;
+    do {
+        seen = stamp_ovf;
+        ovf = seen;
+        low = TL0;  // counts up from TH0 = 0
+        if(TF0) {  // wrapped, but the interrupt has not counted it yet (masked, or called from an interrupt)
+            ovf++;
+            low = TL0;  // the first read may still be from before the wrap
+        }
+    } while(seen != stamp_ovf);  // overflow in between, low may belong to either. bound: 2
+    return (((unsigned long)ovf << 8) | low) & 0xFFFFFF;
+}
+
+void stamp_add(byte slot, bool in_overflows, unsigned long begin) {
+    unsigned long time = (stamp_now() - begin) & 0xFFFFFF;
+    stamp_t* s = &stamps[slot];
+    if(!stamp_run || s->count == 0xFFFF) return;
+    if(in_overflows) time >>= 8;
+    word clipped = (time > 0xFFFF) ? 0xFFFF : time;
+    if(!s->count || clipped < s->min) s->min = clipped;
+    if(clipped > s->max) s->max = clipped;
+    s->total = (s->total > 0xFFFFFFFF - time) ? 0xFFFFFFFF : s->total + time;  // saturate the same way on any host
+    s->count++;
+}
+#endif
+
 void delay(word time_ms) {
+#if USE_STATUS_CACHE
+    if(time_ms >= (byte)(STATUS_STALE - status_age)) status_age = STATUS_STALE;
+    else status_age += time_ms;
+#endif
+#ifdef HOST_BUILD
+    busy_wait(time_ms);  // the simulator (host_tools/sim) runs virtual time instead
+#elif USE_TICK
+    // counts Timer0 overflows, 2.4 per ms, so whatever time the interrupts take counts in. A loop of fixed length
+    // would run long by their unknown share. Every overflow moves tick_div on, ET0 is on whenever delay() runs
+    byte frac = 4;  // rounds up, delay(1) waits 3 overflows
+    for(word i=0; i<time_ms; i++) {
+        for(frac += 12; frac >= 5; frac -= 5) {  // 12/5 overflows per ms
+            byte last = tick_div;
+            while(tick_div == last);  // bound: 64, 256 cycles of at least 4 per pass
+        }
+    }
+#else
     for(word i=0; i<time_ms; i++) {
-        byte wait = 100;  // produces correct delays with 7.37 MHz clock
+        byte wait = DELAY_LOOPS;
         while(wait--);
     }
+#endif
+}
+
+#if USE_EEPROM
+#define EE_ADDR 0xA0  // 24C02 or bigger with A0-A2 grounded
+#define EE_PAGE 8     // smallest page size of the 24Cxx family
+#define EE_CFG 0x00   // configuration block location
+
+#ifndef HOST_BUILD  // the simulator supplies ee_read() and ee_write()
+void i2c_wait() {  // keeps SCL well below 100 kHz
+    byte wait = 2;
+    while(wait--);  // bound: 2
+}
+
+void i2c_start() {  // also works as repeated start
+    EE_SDA = 1;
+    EE_SCL = 1;
+    i2c_wait();
+    EE_SDA = 0;
+    i2c_wait();
+    EE_SCL = 0;
+}
+
+void i2c_stop() {
+    EE_SDA = 0;
+    i2c_wait();
+    EE_SCL = 1;
+    i2c_wait();
+    EE_SDA = 1;
+    i2c_wait();
+}
+
+bool i2c_write(byte data) {  // returns true when acknowledged
+    for(byte i=0; i<8; i++) {
+        EE_SDA = (data & 0x80) ? 1 : 0;
+        data <<= 1;
+        EE_SCL = 1;
+        i2c_wait();
+        EE_SCL = 0;
+    }
+    EE_SDA = 1;  // release the line for ACK, P1 pins are open-drain with pull-up
+    EE_SCL = 1;
+    i2c_wait();
+    bool ack = !EE_SDA;
+    EE_SCL = 0;
+    return ack;
+}
+
+byte i2c_read(bool ack) {
+    byte data = 0;
+    EE_SDA = 1;
+    for(byte i=0; i<8; i++) {
+        EE_SCL = 1;
+        i2c_wait();
+        data = (data << 1) | EE_SDA;
+        EE_SCL = 0;
+        i2c_wait();
+    }
+    EE_SDA = !ack;
+    EE_SCL = 1;
+    i2c_wait();
+    EE_SCL = 0;
+    EE_SDA = 1;
+    return data;
 }
 
+bool ee_read(byte addr, byte* dest, byte len) {
+    i2c_start();
+    bool ok = i2c_write(EE_ADDR) && i2c_write(addr);
+    if(ok) {
+        i2c_start();
+        ok = i2c_write(EE_ADDR | 0x01);
+    }
+    for(byte i=0; ok && i<len; i++) dest[i] = i2c_read(i < len - 1);
+    i2c_stop();
+    return ok;
+}
+
+bool ee_write(byte addr, byte* src, byte len) {  // must not cross a page boundary
+    i2c_start();
+    bool ok = i2c_write(EE_ADDR) && i2c_write(addr);
+    for(byte i=0; ok && i<len; i++) ok = i2c_write(src[i]);  // bound: 8, one EE_PAGE
+    i2c_stop();
+    if(!ok) return false;
+    for(byte i=0; i<10; i++) {  // EEPROM ignores its address until write cycle ends (5 ms max)
+        delay(1);
+        i2c_start();
+        ok = i2c_write(EE_ADDR);
+        i2c_stop();
+        if(ok) return true;
+    }
+    return false;
+}
+#endif
+#endif
+
+#if USE_CONFIG || USE_RESUME
+byte crc8_add(byte crc, byte data) {  // CRC-8, polynomial 0x07
+    crc ^= data;
+    for(byte j=0; j<8; j++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    return crc;
+}
+#endif
+
+#if USE_RESUME
+byte crc8(byte* data, byte len) {
+    byte crc = 0;
+    for(byte i=0; i<len; i++) crc = crc8_add(crc, data[i]);  // bound: 10, the retained block
+    return crc;
+}
+#endif
+
+#if USE_CONFIG
+// The EEPROM block goes through resp_buff a page at a time, cfg only holds part of it. Both run outside of any
+// LIN exchange, at boot and between main loop passes
+#if USE_EEPROM && SUP_CFG_LEN % EE_PAGE
+#error "the configuration block has to be whole EEPROM pages"
+#endif
+void cfg_load() {
+#if USE_EEPROM
+    byte crc = 0;
+    bool ok = true;
+    for(byte i=0; ok && i<SUP_CFG_LEN; i+=EE_PAGE) {
+        ok = ee_read(EE_CFG + i, resp_buff, EE_PAGE);
+        for(byte j=0; ok && j<EE_PAGE; j++) {
+            byte field = i + j;
+            byte value = resp_buff[j];
+            if(field == SUP_CFG_VERSION) ok = (value == SUP_CFG_LAYOUT);
+            else if(field == SUP_CFG_CRC) ok = (value == crc);
+            if(cfg_at[field] != NOT_IN_RAM) ((byte*)&cfg)[cfg_at[field]] = value;
+            crc = crc8_add(crc, value);
+        }
+    }
+    if(ok) {
+        sup_regs.flags |= SUP_FLAG_CFG_EEPROM;
+        return;
+    }
+#endif
+    for(byte i=0; i<SUP_CFG_LEN; i++) {  // EEPROM missing or blank
+        if(cfg_at[i] != NOT_IN_RAM) ((byte*)&cfg)[cfg_at[i]] = cfg_defaults[i];
+    }
+}
+#endif
+
+#if USE_EEPROM
+void cfg_save() {  // fields not in cfg go out as their defaults
+    byte crc = 0;
+    bool ok = true;
+    for(byte i=0; ok && i<SUP_CFG_LEN; i+=EE_PAGE) {
+        for(byte j=0; j<EE_PAGE; j++) {
+            byte field = i + j;
+            if(field == SUP_CFG_CRC) cfg.crc = crc;  // the last byte, all the others are in
+            resp_buff[j] = CFG_BYTE(field);
+            crc = crc8_add(crc, resp_buff[j]);
+        }
+        ok = ee_write(EE_CFG + i, resp_buff, EE_PAGE);
+    }
+    if(ok) sup_regs.flags |= SUP_FLAG_CFG_SAVED;
+    else sup_regs.flags &= ~SUP_FLAG_CFG_SAVED;
+#if USE_STATUS_CACHE
+    ls_valid = 0;  // the pages went through resp_buff
+#endif
+}
+#endif
+
+#if USE_RESUME
+#define retain_crc() crc8((byte*)&retain, sizeof(retain_t) - 1)
+
+bool retain_valid() {  // left by SET_STATE() before a warm reset, not by a power-up or a stack overrun
+    if(retain.magic[0] != (byte)RETAIN_MAGIC || retain.magic[1] != RETAIN_MAGIC >> 8 || retain.crc != retain_crc()) return false;
+#if USE_PROFILES
+    if(retain.profile >= SUP_PROFILE_COUNT) return false;
+#endif
+    return retain.state < SUP_STATE_COUNT && !(retain.policy & ~PF_ALL);
+}
+
+void retain_save(byte state) {  // SET_STATE(), the block is as fresh as the state
+    retain.magic[0] = (byte)RETAIN_MAGIC;
+    retain.magic[1] = RETAIN_MAGIC >> 8;
+    retain.state = state;
+    retain.policy = policy;
+#if USE_CONFIG
+    sup_regs.state = state;
+    retain.profile = cfg.profile;
+    retain.err_count = sup_regs.err_count;
+    cli();  // the tick counts energy up
+    for(byte i=0; i<4; i++) retain.energy[i] = sup_regs.energy[i];
+    sei();
+#endif
+    retain.crc = retain_crc();
+}
+
+void retain_load() {  // warm reset, carry on from the block instead of the power-up defaults
+    policy = retain.policy;
+#if USE_CONFIG
+    cfg.profile = retain.profile;
+    sup_regs.err_count = retain.err_count;
+    cli();
+    for(byte i=0; i<4; i++) sup_regs.energy[i] = retain.energy[i];
+    sei();
+#endif
+}
+#endif
+
 void UART_send(byte data) {
     cli();
     if(buffered_tr < TR_BUFF_SIZE) {
@@ -109,7 +1033,7 @@ void UART_send(byte data) {
     }
     else if(buffered_tr == TR_BUFF_SIZE) {  // buffer full, must wait until at least one slot is empty
         byte iter_limit = 0xFF;  // always a good practice to limit the number of iterations for while loops
-        while(!TI) {
+        while(!TI) {  // bound: 255
             if(--iter_limit == 0) break;
         }
     }
@@ -138,7 +1062,10 @@ void LIN_wakeup() {
     delay(105);  // wait until powered devices wake up
 }
 
-byte LIN_send_request(byte ID) {
+#if USE_STAMPS & SUP_STAMP_SEND
+#define LIN_send_request LIN_send_request_body  // stamped wrapper below
+#endif
+void LIN_send_request(byte pid) {  // header, pid = LIN_PID(id) so the parity bits are worked out at compile time
     for(byte i=0; i<100; i++) {  // wait until all bytes are sent before changing the baud rate
         if(!tr_armed) break;  // no cli() needed, byte read is an atomic operation
         delay(1);
@@ -146,24 +1073,43 @@ byte LIN_send_request(byte ID) {
     PCON &= ~SMOD;    // reset double baud rate bit
     UART_send(0x00);  // insert break
     PCON |= SMOD;     // back to normal baud rate (19200)
-    byte parity_0 = (ID & 0x01) ^ ((ID >> 1) & 0x01) ^ ((ID >> 2) & 0x01) ^ ((ID >> 4) & 0x01);  // just LIN parity stuff
-    byte parity_1 = (!(((ID >> 1) & 0x01) ^ ((ID >> 3) & 0x01) ^ ((ID >> 4) & 0x01) ^ ((ID >> 5) & 0x01))) << 1;
-    byte ID_word = (ID & 0x3F) | ((parity_0 | parity_1) << 6);
-    UART_send(0x55);     // sync word
-    UART_send(ID_word);  // frame ID
-    return ID_word;      // return what was sent, needed for checksum calculation
+    UART_send(LIN_SYNC);
+    UART_send(pid);
 }
+#if USE_STAMPS & SUP_STAMP_SEND
+#undef LIN_send_request
+void LIN_send_request(byte pid) {
+    STAMP_BEGIN();
+    LIN_send_request_body(pid);
+    STAMP_END(SUP_STAMP_SEND);
+}
+#endif
 
-void LIN_send_data(byte* data, byte len, byte ID_word) {  // send data over LIN (master frame)
-    word checksum = ID_word;
+void LIN_send_data(byte* data, byte len, byte pid) {  // send data over LIN (master frame)
+    byte checksum = pid;  // enhanced checksum, wrapped byte by byte
     for(byte i=0; i<len; i++) {
         UART_send(data[i]);
-        checksum += data[i];
+        checksum = LIN_ADD(checksum, data[i]);
+    }
+    UART_send(~checksum);
+}
+
+#if USE_SLEEP
+void LIN_goto_sleep() {  // go-to-sleep command, master request with classic checksum (no PID in it)
+    byte checksum = LIN_GOTO_SLEEP;
+    LIN_send_request(LIN_PID(LIN_ID_MASTER_REQ));
+    UART_send(LIN_GOTO_SLEEP);
+    for(byte i=1; i<LIN_MAX_DATA; i++) {
+        UART_send(0xFF);
+        checksum = LIN_ADD(checksum, 0xFF);
     }
-    checksum = ((checksum & 0xFF) + (checksum >> 8)) ^ 0xFF;  // LIN enhanced checksum
-    UART_send(checksum & 0xFF);
+    UART_send(~checksum);
 }
+#endif
 
+#if USE_STAMPS & SUP_STAMP_READ
+#define LIN_read_response LIN_read_response_body  // stamped wrapper below
+#endif
 byte LIN_read_response(byte* dest) {  // read LIN response (slave frame)
     for(byte i=0; i<5; i++) {
         delay(2);
@@ -171,14 +1117,57 @@ byte LIN_read_response(byte* dest) {  // read LIN response (slave frame)
         if(i == 4) return 0;
     }
     byte read_bytes = 0;
-    while(buffered_rcv) {
+    while(buffered_rcv) {  // bound: 12, echoed header and 9 byte response, only a babbling bus keeps it going
         byte received = UART_read();
         if(read_bytes < 9) dest[read_bytes++] = received;
         delay(1);  // don't read faster than new bytes are coming
     }
     return read_bytes;
 }
+#if USE_STAMPS & SUP_STAMP_READ
+#undef LIN_read_response
+byte LIN_read_response(byte* dest) {
+    STAMP_BEGIN();
+    byte read_bytes = LIN_read_response_body(dest);
+    STAMP_END(SUP_STAMP_READ);
+    return read_bytes;
+}
+#endif
 
+// decoded here rather than in UART_ISR: a 0x3B response has no length byte and short ones are accepted, so only
+// the read loop's gap timeout tells where it ends. The caller waits for that anyway
+byte LIN_read_status() {  // response to a status request already sent, returns number of bytes received
+    byte read = LIN_read_response(resp_buff);
+#if USE_STATUS_CACHE
+    status_age = 0;
+    ls_valid = STATUS_INTACT(read);
+#endif
+    if(STATUS_INTACT(read)) {
+        REPORT_POWER((STATUS_RUNNING()) ? STATUS_POWER() : 0);
+        REPORT_TEMP(read);
+    }
+    return read;
+}
+
+byte LIN_poll_status() {
+    LIN_send_request(LIN_PID(LIN_ID_STATUS));
+    return LIN_read_status();
+}
+
+#if USE_STATUS_CACHE
+bool LIN_cached(byte max_age) {  // valid status no older than max_age ms, never touches the bus
+    return ls_valid && status_age <= max_age;
+}
+
+bool LIN_status(byte max_age) {  // same, but polls the controller when the cached one will not do
+    if(!LIN_cached(max_age)) LIN_poll_status();
+    return ls_valid;
+}
+#endif
+
+#if USE_STAMPS & SUP_STAMP_PGOOD
+#define is_power_good is_power_good_body  // stamped wrapper below
+#endif
 bool is_power_good() {   // check for undervoltage
     byte undervoltages = 0;
     for(byte i=0; i<10; i++) {
@@ -188,39 +1177,74 @@ bool is_power_good() {   // check for undervoltage
     }
     return true;
 }
+#if USE_STAMPS & SUP_STAMP_PGOOD
+#undef is_power_good
+bool is_power_good() {
+    STAMP_BEGIN();
+    bool good = is_power_good_body();
+    STAMP_END(SUP_STAMP_PGOOD);
+    return good;
+}
+#endif
 
+#if USE_STAMPS & SUP_STAMP_PLUG
+#define anything_plugged anything_plugged_body  // stamped wrapper below
+#endif
 bool anything_plugged() {  // check if anything plugged
     if(!PLUG) return false;
     delay(20);
     if(!PLUG) return false;
     return true;
 }
+#if USE_STAMPS & SUP_STAMP_PLUG
+#undef anything_plugged
+bool anything_plugged() {
+    STAMP_BEGIN();
+    bool plugged = anything_plugged_body();
+    STAMP_END(SUP_STAMP_PLUG);
+    return plugged;
+}
+#endif
 
+#if USE_STAMPS & SUP_STAMP_START
+#define start_inverter start_inverter_body  // stamped wrapper below
+#endif
 byte start_inverter() {  // enable 230V output or keep it enabled
     for(byte i=0; i<3; i++) {  // wake up LIN transceiver
-        if(!POW_5V) LIN_wakeup();
+        if(!POW_5V) {
+#if USE_STATUS_CACHE
+            ls_valid = 0;  // controller was off, whatever it said before is gone
+#endif
+            LIN_wakeup();
+        }
         else break;
         if(i == 2) return WAKEUP_ERROR;
     }
-    for(byte i=0; i<10; i++) {  // 3 attempts to get inverter started
-        byte ID_word = LIN_send_request(0x3A);
-        LIN_send_data(power_on_data, 2, ID_word);
+    for(byte i=0; i<START_ATTEMPTS; i++) {  // 3 attempts to get inverter started
+        LIN_send_request(LIN_PID(LIN_ID_COMMAND));
+        LIN_send_data(power_on_data, LIN_LEN_COMMAND, LIN_PID(LIN_ID_COMMAND));
+#if USE_STATUS_CACHE
+        // the command always goes out, nothing says the controller keeps running without it. Only asking whether
+        // it runs is skipped when it has just said so (usually in the previous load check). The wait stays, so
+        // the main loop keeps its pace and does not poll more often than the base build
+        if(!i && LIN_cached(STATUS_PASS_AGE) && STATUS_RUNNING() && STATUS_PGOOD()) {
+            delay(POLL_INTERVAL * 10);
+            return 0;
+        }
+#endif
         bool no_resp = true;
         bool PGOOD_fail = false;
-        for(byte j=0; j<10; j++) {  // 10 attempts to get valid response (starting takes time, read responses frequently)
-            delay(100);
-            LIN_send_request(0x3B);
-            byte read = LIN_read_response(resp_buff);
+        for(byte j=0; j<START_POLLS; j++) {  // 10 attempts to get valid response (starting takes time, read responses frequently)
+            delay(POLL_INTERVAL * 10);
+            byte read = LIN_poll_status();
             if(read > 0) no_resp = false;
-            if(read < 3) continue;
-            byte status = resp_buff[1];
-            if(!(status & 0x01)) continue;
-            if(!(status & 0x02)) {
+            if(!STATUS_INTACT(read) || !STATUS_RUNNING()) continue;
+            if(!STATUS_PGOOD()) {
                 PGOOD_fail = true; continue;
             }
             return 0;
         }
-        if(i == 2) {
+        if(i == START_ATTEMPTS - 1) {
             if(no_resp) return RESP_ERROR;
             return (PGOOD_fail) ? PGOOD_ERROR : STARTUP_ERROR;
         }
@@ -228,46 +1252,97 @@ byte start_inverter() {  // enable 230V output or keep it enabled
     }
     return STARTUP_ERROR;
 }
+#if USE_STAMPS & SUP_STAMP_START
+#undef start_inverter
+byte start_inverter() {
+    STAMP_BEGIN();
+    byte err = start_inverter_body();
+    STAMP_END(SUP_STAMP_START);
+    return err;
+}
+#endif
 
+#if USE_STAMPS & SUP_STAMP_STOP
+#define stop_inverter stop_inverter_body  // stamped wrapper below
+#endif
 void stop_inverter(bool cut_power) {
-    if(!POW_5V) return;  // inverter controller has no power, so it is definitely stopped
-    for(byte i=0; i<3; i++) {  // 3 attempts to turn inverter off
-        byte ID_word = LIN_send_request(0x3A);
-        LIN_send_data(power_on_data + 1, 2, ID_word);
-        for(byte j=0; j<10; j++) {  // 10 attempts to get valid response (turing off might take some time)
+    if(!POW_5V) {  // inverter controller has no power, so it is definitely stopped
+        REPORT_POWER(0);
+        return;
+    }
+    bool stopped = false;
+    for(byte i=0; i<STOP_ATTEMPTS && !stopped; i++) {  // 3 attempts to turn inverter off
+        LIN_send_request(LIN_PID(LIN_ID_COMMAND));
+        LIN_send_data(power_on_data + 1, LIN_LEN_COMMAND, LIN_PID(LIN_ID_COMMAND));
+#if USE_STATUS_CACHE
+        stopped = LIN_cached(STATUS_PASS_AGE) && !STATUS_RUNNING();  // e.g. start just failed, no need to ask again
+#endif
+        for(byte j=0; j<10 && !stopped; j++) {  // 10 attempts to get valid response (turing off might take some time)
+            delay(POLL_INTERVAL * 10);
+            byte read = LIN_poll_status();
+            stopped = STATUS_INTACT(read) && !STATUS_RUNNING();  // not operating anymore
+        }
+        if(!stopped) delay(250);
+    }
+    if(stopped) {
+        REPORT_POWER(0);
+        if(!cut_power) return;
+#if USE_SLEEP
+        LIN_goto_sleep();  // ask first, a controller that listens powers itself down right after the frame
+        for(byte k=0; k<SLEEP_POLLS; k++) {
+            delay(10);
+            if(!POW_5V) {
+#if USE_STATUS_CACHE
+                ls_valid = 0;
+#endif
+                return;
+            }
+        }
+#endif
+        for(byte k=0; k<10; k++) {  // did not listen, or not asked
+            EN_OV = 1;  // force-cut power to the controller
             delay(100);
-            LIN_send_request(0x3B);
-            byte read = LIN_read_response(resp_buff);
-            if(read < 3) continue;
-            if(resp_buff[3] != 0xFF) continue;  // might be a corrupted response
-            if(resp_buff[1] & 0x01) continue;   // still operating
-            if(!cut_power) return;
-            for(byte k=0; k<10; k++) {
-                EN_OV = 1;  // force-cut power to the controller
-                delay(100);
-                EN_OV = 0;
-                if(!POW_5V) return;
+            EN_OV = 0;
+            if(!POW_5V) {
+#if USE_STATUS_CACHE
+                ls_valid = 0;
+#endif
+                return;
             }
-            i = 3; break;
         }
-        delay(250);
     }
     for(byte i=0; i<10; i++) {  // power should be cut automatically after some time, avoid force-cutting when inverter is running
         delay(1000);
-        if(!POW_5V) return;
+        if(!POW_5V) {
+            REPORT_POWER(0);
+            return;
+        }
     }
 }
+#if USE_STAMPS & SUP_STAMP_STOP
+#undef stop_inverter
+void stop_inverter(bool cut_power) {
+    STAMP_BEGIN();
+    stop_inverter_body(cut_power);
+    STAMP_END(SUP_STAMP_STOP);
+}
+#endif
 
 bool enough_power_drawn() {  // check if there is any load
     byte power_sum = 0;
-    for(byte i=0; i<10; i++) {
-        LIN_send_request(0x3B);
-        delay(20);
-        byte read = LIN_read_response(resp_buff);
-        if(read < 3 || !(resp_buff[1] & 0x01) || (resp_buff[3] != 0xFF)) continue;
-        // resp_buff[0] stores drawn power as 5W * x. Count x'es that are not zeros.
-        power_sum += (resp_buff[0] > 0);
-        if(power_sum >= 5) return true;  // at least half of the responses report load greater than 0
+    for(byte i=0; i<LOAD_SAMPLES; i++) {
+#if USE_STATUS_CACHE
+        if(i) delay(VOTE_INTERVAL);  // the first vote may use the status start_inverter() has just read or passed on
+        if(!LIN_status((i) ? STATUS_VOTE_AGE : STATUS_PASS_AGE)) continue;
+#else
+        LIN_send_request(LIN_PID(LIN_ID_STATUS));
+        delay(VOTE_INTERVAL);  // the response comes in meanwhile
+        if(!STATUS_INTACT(LIN_read_status())) continue;
+#endif
+        if(!STATUS_RUNNING()) continue;
+        // power is reported as 5W * x. Count x'es that are not zeros.
+        power_sum += (STATUS_POWER() > 0);
+        if(power_sum >= LOAD_VOTES) return true;  // by default at least half of the responses report load greater than 0
     }
     return false;
 }
@@ -280,6 +1355,13 @@ void wait_if_plugged(byte millis_100) {  // delay that ends upon device unpluggi
 }
 
 void show_error(byte err_code) {  // show error code using red LED
+#if USE_CONFIG
+    cli();
+    for(byte i=SUP_ERR_LOG_LEN-1; i>0; i--) sup_regs.err_log[i] = sup_regs.err_log[i-1];
+    sup_regs.err_log[0] = err_code;
+    if(sup_regs.err_count < 0xFF) sup_regs.err_count++;
+    sei();
+#endif
     if(!POW_5V) LIN_wakeup();  // enables red LED power
     for(byte i=0; i<3; i++) {
         LED_OV = 1;
@@ -290,31 +1372,147 @@ void show_error(byte err_code) {  // show error code using red LED
     }
 }
 
-// replace power-down with long delay, remove buffered UART (to free some flash), add software power limit (shutdown countdown above 165W)
+#if USE_SCHEDULER
+bool output_allowed() {  // timed profile: inside an output window and session time left
+    if(cfg.session_limit && sup_regs.session_min >= cfg.session_limit) return false;
+    byte slot = sup_regs.clock_hour * 6 + sup_regs.clock_min / 10;  // 10 minute slot of the day
+    bool any_window = false;
+    for(byte i=0; i<SUP_WINDOW_COUNT*2; i+=2) {
+        byte start = cfg.windows[i];
+        byte end = cfg.windows[i+1];
+        if(start == end) continue;  // unused
+        any_window = true;
+        if(start < end) {
+            if(slot >= start && slot < end) return true;
+        }
+        else if(slot >= start || slot < end) return true;  // window goes past midnight
+    }
+    return !any_window;
+}
+#endif
+
+#if USE_THERMAL
+byte derated_limit() {  // profile power limit lowered linearly between derate_start and derate_end
+    byte temp = sup_regs.temp;
+    if(temp <= cfg.derate_start || cfg.derate_end <= cfg.derate_start) return power_limit;  // cool, no reading or disabled
+    if(temp >= cfg.derate_end) return 1;
+    byte limit = (power_limit) ? power_limit : cfg.derate_base;
+    limit = (word)limit * (cfg.derate_end - temp) / (cfg.derate_end - cfg.derate_start);
+    return (limit) ? limit : 1;  // 0 would mean no limit
+}
+#endif
+
+#if USE_PROFILES
+void show_profile(byte prof) {  // acknowledge profile change, one short red blink for eco, two for always-on...
+    if(!POW_5V) LIN_wakeup();
+    for(byte i=0; i<=prof; i++) {  // bound: 4, prof < SUP_PROFILE_COUNT
+        LED_OV = 1;
+        delay(150);
+        LED_OV = 0;
+        delay(250);
+    }
+}
+#endif
+
+// replace power-down with long delay, remove buffered UART (to free some flash)
 
 void main(void) {
     LED_OV = 0;
     EN_OV = 0;
+#if USE_CONFIG
+    cfg_load();
+#endif
     SCON = 0x50;  // UART mode 1
     PCON = 0x80; // double baud rate set
+#if USE_TICK
+    TMOD = 0x22;  // Timer 1 and Timer 0 auto-reload
+    TH0 = 0x00;   // Timer 0 overflows every 256 cycles
+    TL0 = 0x00;
+    TCON = 0x51;  // start timers 1 and 0, set INT0 as edge triggered
+    ET0 = 1;
+    sei();
+#else
     TMOD = 0x20;  // Timer 1 auto-reload
+    TCON = 0x41;  // start timer 1, set INT0 as edge triggered
+#endif
     TH1 = 0xFE;   // 9600 baud rate and 19200 after doubling
     TL1 = 0xFE;
-    TCON = 0x41;  // start timer 1, set INT0 as edge triggered
+#if USE_RESUME
+    // a warm reset leaves the block valid, carry on with its policy, profile and counters. If the output was on
+    // and the controller is still powered, only the uC went down and the output is taken over as it is
+    bool warm = retain_valid();
+    bool resume = warm && retain.state == SUP_STATE_RUNNING && POW_5V;
+#endif
+#if USE_FAST_BOOT
+    // no fixed wait for the supply to settle: go on once the comparator has seen it good for a while, or right
+    // away when the controller is powered (only the uC got reset, the supply is obviously there)
+    byte settled = 0;
+    for(byte i=0; i<BOOT_WAIT_MS/2 && settled<BOOT_SETTLE_MS/2 && !POW_5V; i++) {
+        delay(2);
+        settled = (P_GOOD) ? settled + 1 : 0;
+    }
+#else
     delay(500);
+#endif
     byte no_load_counter = 0;    // number of no load indications in a row
     bool prev_was_load = false;  // was there a load during previous check
     byte low_batt_counter = 0;   // number of low battery indications in a row 
-    bool drawn_power_detect = anything_plugged();  // does inverter stop only when load unplugged (false) or also when no load detected (true)
+    // inverter stops only when load unplugged or also when no load detected, depending on what's plugged at power-up
+    policy = (anything_plugged()) ? POLICY_ECO : 0;
+#if USE_RESUME
+    if(warm) retain_load();
+#endif
+#if USE_PROFILES
+    if(cfg.profile == SUP_PROFILE_AUTO) cfg.profile = (policy) ? SUP_PROFILE_ECO : SUP_PROFILE_ALWAYS_ON;
+    byte active_profile = 0xFF;  // forces policy update on first pass
+    byte overload_counter = 0;   // number of main loop passes above power limit in a row
+#elif USE_CONFIG
+    if(policy & PF_LOAD_DETECT) sup_regs.flags |= SUP_FLAG_LOAD_DETECT;
+#endif
     UART_INT_EN();
     PLUG_INT_EN();
     sei();
+#if USE_RESUME
+    // adopt the running output: start_inverter() then only repeats the start command, which leaves a running
+    // output alone (and with a fresh status in the cache does not wait to be told again that it runs)
+    if(resume) {
+        if(STATUS_INTACT(LIN_poll_status()) && STATUS_RUNNING()) SET_STATE(SUP_STATE_RUNNING);
+    }
+#endif
     for(;;) {
+#if USE_EEPROM
+        if(cfg_save_req) {
+            cfg_save();
+            cfg_save_req = false;  // only now, the ISR holds off cfg writes while the pages go out
+        }
+#endif
+#if USE_PROFILES
+        if(plug_events >= GESTURE_PLUGS && !gesture_timer) {  // plug gesture finished, switch to next profile
+            plug_events = 0;
+            if(++cfg.profile >= SUP_PROFILE_COUNT) cfg.profile = 0;
+            if(PROFILE_JMP) show_profile(cfg.profile);  // jumper overrides the selection anyway
+        }
+        byte prof = (PROFILE_JMP) ? cfg.profile : cfg.profile_jumper;  // fitted jumper pulls P1.3 low
+        if(prof >= SUP_PROFILE_COUNT) prof = SUP_PROFILE_ECO;
+        if(prof != active_profile) {  // profile changed, start its policy from scratch
+            active_profile = prof;
+            policy = profiles[prof].policy;
+            power_limit = profiles[prof].power_limit;
+            no_load_counter = 0;
+            prev_was_load = false;
+            overload_counter = 0;
+            sup_regs.profile = prof;
+            if(policy & PF_LOAD_DETECT) sup_regs.flags |= SUP_FLAG_LOAD_DETECT;
+            else sup_regs.flags &= ~SUP_FLAG_LOAD_DETECT;
+        }
+#endif
         if(!is_power_good()) {  // low battery
+            SET_STATE(SUP_STATE_LOW_BATT);
             stop_inverter(true);
             delay(250);
             show_error(LOW_BATT_ERR);
-            if(++low_batt_counter >= 5) {  // battery does not recover, disable inverter permanently
+            if(++low_batt_counter >= LOW_BATT_LIMIT) {  // battery does not recover, disable inverter permanently
+                SET_STATE(SUP_STATE_SHUTDOWN);
                 ENTER_PD();
                 while(1);
             }
@@ -324,44 +1522,103 @@ void main(void) {
         else low_batt_counter = 0;
         
         if(anything_plugged()) {  // something plugged in
+#if USE_SCHEDULER
+            if((policy & PF_TIMED) && !output_allowed()) {  // keep output off until next window or re-plug
+                SET_STATE(SUP_STATE_SCHEDULED_OFF);
+                stop_inverter(true);
+                wait_if_plugged(WAIT_LONG);
+                continue;
+            }
+#endif
+#if USE_SOLAR
+            if((policy & PF_SOLAR) && !pv_surplus && !sup_regs.pv_hold) {  // no PV surplus and minimum run time over
+                SET_STATE(SUP_STATE_PV_WAIT);
+                stop_inverter(true);
+                wait_if_plugged(WAIT_SHORT);  // controller is unpowered, checking often costs nothing
+                continue;
+            }
+#endif
             byte status = start_inverter();  // try to enable 230V output
+#if USE_SOLAR
+            if(status == 0 && (policy & PF_SOLAR) && pv_surplus && sup_regs.state != SUP_STATE_RUNNING) {  // fresh start on PV, avoid short cycling
+                pv_hold_sec = 0;
+                sup_regs.pv_hold = cfg.pv_min_run;
+            }
+#endif
+#if USE_PROFILES
+#if USE_THERMAL
+            byte limit = derated_limit();
+            if(status == 0 && sup_regs.temp >= cfg.derate_end && cfg.derate_end > cfg.derate_start) status = THERMAL_ERR;
+#else
+            byte limit = power_limit;
+#endif
+            sup_regs.limit = limit;
+            if(status == 0 && limit && sup_regs.power > limit) {  // shutdown countdown above power limit
+                if(++overload_counter >= OVERLOAD_CHECKS) status = (limit == power_limit) ? OVERLOAD_ERR : THERMAL_ERR;
+            }
+            else overload_counter = 0;
+#endif
             if(status != 0) {  // something went wrong
+                SET_STATE(SUP_STATE_ERROR);
                 stop_inverter(true);
                 show_error(status);
-                wait_if_plugged((status == PGOOD_ERROR) ? 150 : 15);
+                wait_if_plugged((status == PGOOD_ERROR || status == OVERLOAD_ERR || status == THERMAL_ERR) ? WAIT_PGOOD : WAIT_ERR);
             }
-            else if(drawn_power_detect) {
-                if(!prev_was_load) delay(200);  // filter out startup inrush when measuring power right after startup
-                if(!enough_power_drawn()) {  // no load detected
-                    // when load unplugged, set 3s load check interval for first minute, then 6s interval for 4 minutes, and 15s interval afterwards
-                    if(no_load_counter >= 60) {  // 60
-                        stop_inverter(true);
-                        wait_if_plugged(133);  // ~15s check interval
-                    }
-                    else {
-                        stop_inverter(false);
-                        no_load_counter++;
-                        wait_if_plugged(18);  // ~3s interval
-                        if(no_load_counter >= 20) {  // 20
-                            LIN_wakeup();  // prevent power from getting cut by timeout
-                            wait_if_plugged(30);   // 6s in total
+            else {
+                SET_STATE(SUP_STATE_RUNNING);  // only a confirmed start, a warm reset resumes a RUNNING state
+                if(policy & PF_LOAD_DETECT) {
+                    if(!prev_was_load) delay(200);  // filter out startup inrush when measuring power right after startup
+                    if(!enough_power_drawn()) {  // no load detected
+                        // when load unplugged, set 3s load check interval for first minute, then 6s interval for 4 minutes, and 15s interval afterwards
+                        if(no_load_counter >= NOLOAD_LONG || !(policy & PF_BACKOFF)) {  // 60
+                            SET_STATE(SUP_STATE_NO_LOAD_LONG);
+                            stop_inverter(true);
+                            wait_if_plugged(WAIT_LONG);  // ~15s check interval
+                        }
+                        else {
+                            SET_STATE(SUP_STATE_NO_LOAD);
+                            stop_inverter(false);
+                            no_load_counter++;
+                            wait_if_plugged(WAIT_SHORT);  // ~3s interval
+                            if(no_load_counter >= NOLOAD_SHORT) {  // 20
+                                SET_STATE(SUP_STATE_NO_LOAD_KEEP);
+                                if(policy & PF_KEEPALIVE) LIN_wakeup();  // prevent power from getting cut by timeout
+                                wait_if_plugged(WAIT_KEEP);   // 6s in total
+                            }
                         }
+                        prev_was_load = false;
+                    }
+                    else if(no_load_counter > 0) {
+                        if(prev_was_load) no_load_counter--;  // slowly reset no_load_counter to filter out false positives
+                        else prev_was_load = true;
                     }
-                    prev_was_load = false;
-                }
-                else if(no_load_counter > 0) {
-                    if(prev_was_load) no_load_counter--;  // slowly reset no_load_counter to filter out false positives
-                    else prev_was_load = true;
                 }
             }
         }
         else {  // go to sleep and wake up when something plugged in
+            SET_STATE(SUP_STATE_SLEEP);
+#if USE_SCHEDULER
+            sup_regs.session_min = 0;  // unplugging ends the session
+            session_sec = 0;
+#endif
             stop_inverter(true);
             UART_INT_DIS();
+#if TICK_IN_IDLE
+            while(!PLUG) ENTER_IDLE();  // every tick wakes the uC up, only a plug-in ends the sleep. bound: 1
+#elif USE_TICK
+            while(!PLUG) {  // bound: 1
+                if(!gesture_timer) ET0 = 0;  // nothing left to count, sleep until a plug-in
+                ENTER_IDLE();
+            }
+            ET0 = 1;
+#else
             ENTER_IDLE();  // will be woken up by plugging something in
+#endif
             UART_INT_EN(); 
         }
     }
 }
 
 // sdcc -mmcs51 -o [output file path] [input file path]
+// USE_RESUME builds: sdcc -mmcs51 --iram-size 0x75 --stack-size [n] -DUSE_RESUME=1 -o [output file path] [input file path],
+// then check in the .map file that the stack segment ends below 0x75
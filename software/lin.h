@@ -0,0 +1,83 @@
+/*
+    LIN protocol core of the fancy-inverter auxiliary controller: protected IDs, checksums, frame layout and
+    timing of the bus towards the Audi inverter controller.
+
+    A frame on the wire is a break (dominant for at least LIN_BREAK_MIN bit times), the sync byte 0x55, the
+    protected ID (6 bit ID with two parity bits on top) and then the response, whoever sends it: up to
+    LIN_MAX_DATA data bytes and a checksum. The checksum is the inverted 8-bit sum with carry wrap-around of the
+    data, the protected ID included (enhanced) for everything but the diagnostic frames 0x3C/0x3D (classic).
+    Frames in the helpers below are laid out the same way from the protected ID on: PID, data, checksum.
+
+    The firmware only needs the macros, they fold into constants for the fixed IDs it sends. The frame helpers
+    are for the host tools (through host_tools/lin.hpp, checked by host_tools/lintest) and stay out of the
+    firmware unless LIN_FRAME_CODE is 1: they work on a whole frame in RAM, while the firmware streams the bytes
+    through the UART buffers and sums them on the fly, which 128 bytes of RAM and 2 KB of flash can afford.
+    This header is shared by the firmware and the host tools, so keep it plain C.
+*/
+
+#ifndef LIN_H
+#define LIN_H
+
+#define LIN_BAUD 19200
+#define LIN_SYNC 0x55
+#define LIN_BREAK_MIN 11   // dominant bit times a slave takes for a break
+#define LIN_BREAK_SENT 18  // what the firmware sends, 0x00 at half baud rate
+#define LIN_MAX_DATA 8
+#define LIN_FRAME_MAX (LIN_MAX_DATA + 2)  // PID, data, checksum
+
+// nominal frame length in bit times with n data bytes (13 bit break), a frame may take 40% longer than that
+#define LIN_FRAME_BITS(n) (34 + 10 * ((n) + 1))
+#define LIN_FRAME_MAX_BITS(n) (LIN_FRAME_BITS(n) * 14 / 10)
+
+// frames of the inverter controller
+#define LIN_ID_COMMAND 0x3A     // master frame, LIN_LEN_COMMAND bytes: {0x02, 0x00} starts, {0x00, 0x00} stops
+#define LIN_ID_STATUS 0x3B      // slave frame, LIN_LEN_STATUS bytes: power (5W * x), status bits, temperature, 0xFF
+                                // temperature (degC + 40) is a guess from captures, not yet verified on the bench
+#define LIN_ID_MASTER_REQ 0x3C  // diagnostic master request, classic checksum
+#define LIN_ID_SLAVE_RESP 0x3D  // diagnostic slave response, classic checksum
+#define LIN_LEN_COMMAND 2
+#define LIN_LEN_STATUS 4
+#define LIN_GOTO_SLEEP 0x00  // first byte of the master request that sends every node to sleep, the other 7 are 0xFF
+
+#define LIN_P0(id) (((id) ^ (id) >> 1 ^ (id) >> 2 ^ (id) >> 4) & 1)
+#define LIN_P1(id) (~((id) >> 1 ^ (id) >> 3 ^ (id) >> 4 ^ (id) >> 5) & 1)
+#define LIN_PID(id) (((id) & 0x3F) | LIN_P0(id) << 6 | LIN_P1(id) << 7)  // protected ID
+#define LIN_CLASSIC(id) (((id) & 0x3F) >= LIN_ID_MASTER_REQ)  // diagnostic and reserved IDs, classic checksum
+#define LIN_ADD(sum, b) ((((sum) + (b)) & 0xFF) + (((sum) + (b)) >> 8))  // one checksum step, sum stays <= 0xFF
+
+// decoding results, also the lin_error values of the traces
+#define LIN_OK 0
+#define LIN_ERR_SYNC 1      // no 0x55 after the break
+#define LIN_ERR_PARITY 2    // protected ID with wrong parity bits
+#define LIN_ERR_CHECKSUM 3
+#define LIN_ERR_FRAMING 4   // stop bit missing, or more bytes than a frame can have
+
+#ifndef LIN_FRAME_CODE
+#define LIN_FRAME_CODE 1
+#endif
+
+#if LIN_FRAME_CODE
+static unsigned char lin_checksum(unsigned char pid, const unsigned char* data, unsigned char len) {
+    unsigned char sum = LIN_CLASSIC(pid) ? 0 : pid, i;
+    for(i = 0; i < len; i++) sum = LIN_ADD(sum, data[i]);
+    return ~sum;
+}
+
+static unsigned char lin_encode(unsigned char id, const unsigned char* data, unsigned char len, unsigned char* frame) {
+    unsigned char i;  // frame needs len + 2 bytes, returns that
+    frame[0] = LIN_PID(id);
+    for(i = 0; i < len; i++) frame[i + 1] = data[i];
+    frame[len + 1] = lin_checksum(frame[0], data, len);
+    return len + 2;
+}
+
+static unsigned char lin_decode(const unsigned char* frame, unsigned char len) {  // PID, data, checksum
+    if(len < 1 || len > LIN_FRAME_MAX) return LIN_ERR_FRAMING;
+    if(LIN_PID(frame[0]) != frame[0]) return LIN_ERR_PARITY;
+    if(len == 1) return LIN_OK;  // header alone, nobody answered
+    if(lin_checksum(frame[0], frame + 1, len - 2) != frame[len - 1]) return LIN_ERR_CHECKSUM;
+    return LIN_OK;
+}
+#endif
+
+#endif
@@ -0,0 +1,208 @@
+/*
+    Supervisory serial interface of the fancy-inverter auxiliary controller.
+
+    The hardware UART is busy being a LIN master, so the supervisory link is a software UART on two spare
+    P1 pins (P1.7 RX, P1.6 TX), 600 baud 8N1. P1 pins are quasi-bidirectional, so several boards can share
+    one TX line (wired-AND with a pull-up) and a site controller polls them one by one by address.
+
+    Every request is exactly SUP_REQ_LEN bytes:
+        SUP_SYNC, address, command, register, argument, checksum
+    READ returns <argument> consecutive registers starting at <register>, WRITE stores <argument> into a
+    single writable register and returns its new value, SAVE stores the whole configuration block in the
+    EEPROM (in the background, check SUP_FLAG_CFG_SAVED afterwards; WRITEs to the configuration block are
+    rejected until the save is done, so the stored block always matches its CRC). The answer looks like:
+        SUP_RESP, address, register, length, data[length], checksum
+    Length 0 means the request was rejected (register out of range, read-only, value out of range, a field of a
+    feature not built in or a READ of 0 registers). Checksums are LIN-style:
+    8-bit sum with carry wrap-around of everything between the sync byte and the checksum, inverted.
+
+    This header is shared by the firmware and the host tools, so keep it plain C.
+*/
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#define SUP_BAUD 600
+#define SUP_SYNC 0xA5  // first byte of every request
+#define SUP_RESP 0x5A  // first byte of every response
+#define SUP_REQ_LEN 6
+#define SUP_MAX_READ SUP_REG_COUNT  // longest burst a single READ may ask for, the whole map (1.2 s on the wire)
+
+#define SUP_ADDR_DEFAULT 0x01
+#define SUP_ADDR_BROADCAST 0xFF  // accepted by every board, never answered
+
+#define SUP_CMD_READ 0x01
+#define SUP_CMD_WRITE 0x02
+#define SUP_CMD_SAVE 0x03
+
+// register map, multi-byte values are little endian
+#define SUP_REG_STATE 0x00         // control state, SUP_STATE_*
+#define SUP_REG_FLAGS 0x01         // live inputs, SUP_FLAG_*
+#define SUP_REG_POWER 0x02         // last output power reported by the controller, 5W * x
+#define SUP_REG_ENERGY 0x03        // 4 bytes, output energy since boot in Wh
+#define SUP_REG_ERR_COUNT 0x07     // number of errors since boot (saturates at 255)
+#define SUP_REG_ERR_LOG 0x08       // last SUP_ERR_LOG_LEN error codes, newest first
+#define SUP_REG_PROFILE 0x0C       // operating profile in use, SUP_PROFILE_*
+#define SUP_REG_CLOCK_SEC 0x0D     // software real-time clock, starts at 00:00:00 on power-up
+#define SUP_REG_CLOCK_MIN 0x0E     // writable (0-59) in USE_SCHEDULER builds, also clears seconds
+#define SUP_REG_CLOCK_HOUR 0x0F    // writable (0-23) in USE_SCHEDULER builds
+#define SUP_REG_SESSION 0x10       // minutes of output in current session (since last plug-in)
+#define SUP_REG_PV_ENERGY 0x11     // 2 bytes, output energy delivered during PV surplus since boot in Wh
+#define SUP_REG_PV_HOLD 0x13       // minutes of minimum run time left in solar profile
+#define SUP_REG_TEMP 0x14          // last controller temperature from LIN diagnostics, degC + 40, 0 = no reading
+#define SUP_REG_LIMIT 0x15         // software power limit in use after thermal derating, 5W * x, 0 = none
+#define SUP_STATUS_LEN 0x16        // status registers end here, reserved ones up to SUP_REG_CFG read as 0, so do the
+                                   // ones of features not built in. Their configuration fields read as the defaults
+#define SUP_REG_CFG 0x20           // configuration block, SUP_CFG_* offsets
+#define SUP_REG_COUNT (SUP_REG_CFG + SUP_CFG_LEN)
+
+#define SUP_REG_FIRST_RW (SUP_REG_CFG + SUP_CFG_ADDR)
+#define SUP_ERR_LOG_LEN 4
+
+// sampling profiler, only in USE_PROFILER debug builds. Every 10 ms the Timer0 interrupt bins the program counter it
+// interrupted into SUP_PROF_BUCKETS counters 2^shift bytes wide, starting at base * 16. Samples outside the window
+// are not counted, there are 100 per second in total.
+#define SUP_REG_PROF_RUN 0x40      // 1 = sampling, 0 = frozen (also once a counter saturates), writing 1 clears the counters
+#define SUP_REG_PROF_BASE 0x41     // window start in 16 byte units, writing clears the counters
+#define SUP_REG_PROF_SHIFT 0x42    // bucket width 2^x bytes (0-9), writing clears the counters
+#define SUP_REG_PROF_HIST 0x43     // SUP_PROF_BUCKETS 2 byte counters
+#define SUP_PROF_BUCKETS 8
+#define SUP_REG_PROF_END (SUP_REG_PROF_HIST + 2 * SUP_PROF_BUCKETS)
+
+// cycle stamps, only in USE_STAMPS debug builds, USE_STAMPS being the mask of SUP_STAMP_* sites built in. Each of
+// those has SUP_STAMP_LEN bytes from SUP_REG_STAMP on, lowest bit first: calls, min, max (2 bytes each) and total
+// (4 bytes) time spent inside. Times are machine cycles (12 / 7.3728 MHz = 1.63 us), Timer0 overflows (256 cycles)
+// for the long sites. min and max saturate at 0xFFFF, a site stops counting after 0xFFFF calls.
+#define SUP_REG_STAMP_RUN 0x60     // 1 = counting, 0 = frozen, writing 1 clears the counters
+#define SUP_REG_STAMP_SITES 0x61   // SUP_STAMP_* sites built in, read-only
+#define SUP_REG_STAMP 0x62
+#define SUP_STAMP_LEN 10
+
+#define SUP_STAMP_SEND 0x01   // LIN_send_request()
+#define SUP_STAMP_READ 0x02   // LIN_read_response()
+#define SUP_STAMP_PGOOD 0x04  // is_power_good()
+#define SUP_STAMP_PLUG 0x08   // anything_plugged()
+#define SUP_STAMP_START 0x10  // start_inverter()
+#define SUP_STAMP_STOP 0x20   // stop_inverter()
+#define SUP_STAMP_ALL 0x3F
+#define SUP_STAMP_LONG (SUP_STAMP_START | SUP_STAMP_STOP)  // counted in Timer0 overflows, they take seconds
+
+// configuration block, also the EEPROM image. Times are in wait_if_plugged() units of ~100 ms.
+#define SUP_CFG_VERSION 0         // layout version, read-only
+#define SUP_CFG_ADDR 1            // supervisory address of this board, 1-254 (1)
+#define SUP_CFG_NOLOAD_SHORT 2    // no load checks before switching to 6s interval (20)
+#define SUP_CFG_NOLOAD_LONG 3     // no load checks before cutting controller power (60)
+#define SUP_CFG_LOAD_VOTES 4      // load indications needed to keep running (5)
+#define SUP_CFG_LOAD_SAMPLES 5    // power readings per load check (10)
+#define SUP_CFG_START_ATTEMPTS 6  // start commands before giving up (3)
+#define SUP_CFG_START_POLLS 7     // status reads after each start command (10)
+#define SUP_CFG_STOP_ATTEMPTS 8   // stop commands before waiting for controller timeout (3)
+#define SUP_CFG_WAIT_SHORT 9      // no load check interval during first stage (18)
+#define SUP_CFG_WAIT_KEEP 10      // extra wait during second stage (30)
+#define SUP_CFG_WAIT_LONG 11      // no load check interval once controller power is cut (133)
+#define SUP_CFG_WAIT_ERR 12       // pause after start failure (15)
+#define SUP_CFG_WAIT_PGOOD 13     // pause after controller reported power failure (150)
+#define SUP_CFG_LOW_BATT_LIMIT 14 // low battery indications in a row before shutting down for good (5)
+#define SUP_CFG_PROFILE 15        // selected profile, SUP_PROFILE_AUTO picks it at boot like the base firmware (auto)
+#define SUP_CFG_PROFILE_JUMPER 16 // profile forced while the P1.3 jumper is fitted (always-on)
+#define SUP_CFG_SESSION_LIMIT 17  // max minutes of output per session in timed profile, 0 = unlimited (0)
+#define SUP_CFG_WINDOWS 18        // 2 output windows for timed profile, start and end in 10 minute slots
+                                  // (0-144) each, window unused when start == end (all unused)
+#define SUP_CFG_PV_ON_DELAY 22    // seconds of PV surplus signal before output may start (30)
+#define SUP_CFG_PV_OFF_DELAY 23   // seconds without PV surplus signal before output is stopped (120)
+#define SUP_CFG_PV_MIN_RUN 24     // minutes output is kept on after a solar start regardless of PV (5)
+#define SUP_CFG_TEMP_BYTE 25      // byte of the 0x3B status response carrying temperature (2)
+#define SUP_CFG_DERATE_START 26   // temperature where power limit starts going down, degC + 40 (110 = 70degC)
+#define SUP_CFG_DERATE_END 27     // temperature where output is stopped, degC + 40 (130 = 90degC), 0 = derating off (default)
+#define SUP_CFG_DERATE_BASE 28    // limit derated from when the profile has none, 5W * x (40 = 200W)
+#define SUP_CFG_POLL_INTERVAL 29  // time between status reads after a start or stop command, 10 ms units (10)
+#define SUP_CFG_VOTE_INTERVAL 30  // ms between the power readings of a load check (20)
+#define SUP_CFG_CRC 31            // CRC-8 (poly 0x07) of all previous bytes, updated on SAVE
+#define SUP_CFG_LEN 32
+
+// lowest and highest value a WRITE may store in each SUP_CFG_* field, anything else is rejected. min > max marks
+// the read-only ones: version, and the CRC that only SAVE updates. SUP_PROFILE_AUTO is accepted for the profile too.
+#define SUP_CFG_LIMITS { \
+    {1, 0},   {1, 0xFE}, {1, 0xFF}, {1, 0xFF}, {1, 40},    {1, 40},   {1, 10},   {1, 50},   /* version..start_polls */ \
+    {1, 10},  {1, 0xFF}, {0, 0xFF}, {1, 0xFF}, {0, 0xFF},  {0, 0xFF}, {1, 0xFF},            /* ..low_batt_limit */ \
+    {0, SUP_PROFILE_COUNT - 1}, {0, SUP_PROFILE_COUNT - 1}, {0, 0xFF},                     /* ..session_limit */ \
+    {0, 144}, {0, 144}, {0, 144}, {0, 144},                                                 /* windows */ \
+    {0, 0xFF}, {0, 0xFF}, {0, 0xFF}, {0, 8},   {0, 0xFF}, {0, 0xFF}, {1, 0xFF},              /* ..derate_base */ \
+    {3, 30},  {12, 100}, {1, 0}                                                             /* poll_interval..crc */ \
+}
+
+// compiled-in values of the SUP_CFG_* fields, used when the EEPROM is blank or missing and by the base build
+#define SUP_DEF_NOLOAD_SHORT 20
+#define SUP_DEF_NOLOAD_LONG 60
+#define SUP_DEF_LOAD_VOTES 5
+#define SUP_DEF_LOAD_SAMPLES 10
+#define SUP_DEF_START_ATTEMPTS 3
+#define SUP_DEF_START_POLLS 10
+#define SUP_DEF_STOP_ATTEMPTS 3
+#define SUP_DEF_WAIT_SHORT 18
+#define SUP_DEF_WAIT_KEEP 30
+#define SUP_DEF_WAIT_LONG 133
+#define SUP_DEF_WAIT_ERR 15
+#define SUP_DEF_WAIT_PGOOD 150
+#define SUP_DEF_LOW_BATT_LIMIT 5
+#define SUP_DEF_PROFILE SUP_PROFILE_AUTO
+#define SUP_DEF_PROFILE_JUMPER SUP_PROFILE_ALWAYS_ON
+#define SUP_DEF_SESSION_LIMIT 0
+#define SUP_DEF_WINDOW 0  // all windows empty
+#define SUP_DEF_PV_ON_DELAY 30
+#define SUP_DEF_PV_OFF_DELAY 120
+#define SUP_DEF_PV_MIN_RUN 5
+#define SUP_DEF_TEMP_BYTE 2
+#define SUP_DEF_DERATE_START 110
+#define SUP_DEF_DERATE_END 0  // derating off until the temperature byte is confirmed on the bench, then 130
+#define SUP_DEF_DERATE_BASE 40
+#define SUP_DEF_POLL_INTERVAL 10
+#define SUP_DEF_VOTE_INTERVAL 20
+
+// the whole block with its defaults, CRC left 0
+#define SUP_CFG_DEFAULTS { \
+    SUP_CFG_LAYOUT, SUP_ADDR_DEFAULT, SUP_DEF_NOLOAD_SHORT, SUP_DEF_NOLOAD_LONG, SUP_DEF_LOAD_VOTES, \
+    SUP_DEF_LOAD_SAMPLES, SUP_DEF_START_ATTEMPTS, SUP_DEF_START_POLLS, SUP_DEF_STOP_ATTEMPTS, SUP_DEF_WAIT_SHORT, \
+    SUP_DEF_WAIT_KEEP, SUP_DEF_WAIT_LONG, SUP_DEF_WAIT_ERR, SUP_DEF_WAIT_PGOOD, SUP_DEF_LOW_BATT_LIMIT, \
+    SUP_DEF_PROFILE, SUP_DEF_PROFILE_JUMPER, SUP_DEF_SESSION_LIMIT, \
+    SUP_DEF_WINDOW, SUP_DEF_WINDOW, SUP_DEF_WINDOW, SUP_DEF_WINDOW, \
+    SUP_DEF_PV_ON_DELAY, SUP_DEF_PV_OFF_DELAY, SUP_DEF_PV_MIN_RUN, SUP_DEF_TEMP_BYTE, \
+    SUP_DEF_DERATE_START, SUP_DEF_DERATE_END, SUP_DEF_DERATE_BASE, SUP_DEF_POLL_INTERVAL, SUP_DEF_VOTE_INTERVAL, 0 \
+}
+
+#define SUP_WINDOW_COUNT 2
+#define SUP_CFG_LAYOUT 6  // bump whenever SUP_CFG_* change, older EEPROM images are then ignored
+
+// SUP_REG_STATE values
+#define SUP_STATE_BOOT 0
+#define SUP_STATE_SLEEP 1          // nothing plugged, uC idle
+#define SUP_STATE_RUNNING 2        // 230V output enabled
+#define SUP_STATE_NO_LOAD 3        // no load, output stopped, 3s check interval
+#define SUP_STATE_NO_LOAD_KEEP 4   // no load, 6s check interval with controller kept awake
+#define SUP_STATE_NO_LOAD_LONG 5   // no load, controller power cut, 15s check interval
+#define SUP_STATE_ERROR 6          // start failed, error being shown
+#define SUP_STATE_LOW_BATT 7       // battery undervoltage
+#define SUP_STATE_SHUTDOWN 8       // battery did not recover, uC powered down for good
+#define SUP_STATE_SCHEDULED_OFF 9  // plugged, but outside output windows or session time used up
+#define SUP_STATE_PV_WAIT 10       // plugged, waiting for PV surplus
+#define SUP_STATE_COUNT 11
+
+// operating profiles
+#define SUP_PROFILE_ECO 0        // stop when no load detected, staged back-off
+#define SUP_PROFILE_ALWAYS_ON 1  // keep 230V while plugged, no load detection
+#define SUP_PROFILE_TIMED 2      // eco limited by the output scheduler
+#define SUP_PROFILE_SOLAR 3      // eco gated by PV surplus input
+#define SUP_PROFILE_COUNT 4
+#define SUP_PROFILE_AUTO 0xFF    // eco when something is plugged at power-up, always-on otherwise
+
+// SUP_REG_FLAGS bits
+#define SUP_FLAG_PLUGGED 0x01
+#define SUP_FLAG_POW_5V 0x02
+#define SUP_FLAG_PGOOD 0x04
+#define SUP_FLAG_LOAD_DETECT 0x08  // output is stopped when no load detected
+#define SUP_FLAG_CFG_EEPROM 0x10   // configuration was loaded from EEPROM (defaults otherwise)
+#define SUP_FLAG_CFG_SAVED 0x20    // last SAVE succeeded
+#define SUP_FLAG_PV_IN 0x40        // raw PV surplus input
+#define SUP_FLAG_PV_SURPLUS 0x80   // PV surplus input after on/off delays
+
+#endif